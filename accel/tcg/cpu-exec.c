@@ -393,6 +393,31 @@ static inline void tb_add_jump(TranslationBlock *tb, int n,
     return;
 }
 
+/*
+ * Cache @tb_next as the target of the indirect jump that ends @tb,
+ * replacing the target cached so far: a return that just missed is
+ * more likely to go back to the same caller next time than to the one
+ * before it.
+ */
+void tb_link_indirect(TranslationBlock *tb, TranslationBlock *tb_next)
+{
+#ifndef CONFIG_USER_ONLY
+    /* See tb_find() */
+    if (tb_next->page_addr[1] != -1) {
+        return;
+    }
+#endif
+    tb_unlink_jump(tb, 0);
+    /*
+     * @tb is not CF_PARALLEL, so nothing else runs its code while the
+     * key is updated; a stale key only ever leads to the miss path as
+     * the jump is not patched until tb_add_jump() below succeeds.
+     */
+    tb->indirect_pc = tb_next->pc;
+    tb->indirect_flags = tb_next->flags;
+    tb_add_jump(tb, 0, tb_next);
+}
+
 static inline TranslationBlock *tb_find(CPUState *cpu,
                                         TranslationBlock *last_tb,
                                         int tb_exit, uint32_t cf_mask)
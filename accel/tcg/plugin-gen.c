@@ -75,6 +75,7 @@ enum plugin_gen_from {
 enum plugin_gen_cb {
     PLUGIN_GEN_CB_UDATA,
     PLUGIN_GEN_CB_INLINE,
+    PLUGIN_GEN_CB_EDGE,
     PLUGIN_GEN_CB_MEM,
     PLUGIN_GEN_ENABLE_MEM_HELPER,
     PLUGIN_GEN_DISABLE_MEM_HELPER,
@@ -142,6 +143,14 @@ static void gen_empty_inline_cb(void)
     tcg_temp_free_i64(val);
 }
 
+/*
+ * Edge coverage ops are generated directly at injection time (see
+ * inject_edge_cb), so the placeholder is empty.
+ */
+static void gen_empty_edge_cb(void)
+{
+}
+
 static void gen_empty_mem_cb(TCGv addr, uint32_t info)
 {
     do_gen_mem_cb(addr, info);
@@ -198,6 +207,9 @@ static inline void plugin_gen_empty_callback(enum plugin_gen_from from)
     case PLUGIN_GEN_FROM_TB:
         gen_wrapped(from, PLUGIN_GEN_CB_UDATA, gen_empty_udata_cb);
         gen_wrapped(from, PLUGIN_GEN_CB_INLINE, gen_empty_inline_cb);
+        if (from == PLUGIN_GEN_FROM_TB) {
+            gen_wrapped(from, PLUGIN_GEN_CB_EDGE, gen_empty_edge_cb);
+        }
         break;
     default:
         g_assert_not_reached();
@@ -571,6 +583,63 @@ inject_inline_cb(const GArray *cbs, TCGOp *begin_op, op_ok_fn ok)
     inject_cb_type(cbs, begin_op, append_inline_cb, ok);
 }
 
+static void gen_edge_cb(const struct qemu_plugin_dyn_cb *cb)
+{
+    TCGv_ptr prev_ptr = tcg_const_ptr(cb->edge.prev_loc);
+    TCGv_ptr bucket = tcg_temp_new_ptr();
+    TCGv_i32 val = tcg_temp_new_i32();
+
+    /* map[(*prev_loc ^ cur_loc) & mask]++ */
+    tcg_gen_ld_i32(val, prev_ptr, 0);
+    tcg_gen_xori_i32(val, val, cb->edge.cur_loc);
+    tcg_gen_andi_i32(val, val, cb->edge.mask);
+    tcg_gen_ext_i32_ptr(bucket, val);
+    tcg_gen_addi_ptr(bucket, bucket, (intptr_t)cb->userp);
+    tcg_gen_ld8u_i32(val, bucket, 0);
+    tcg_gen_addi_i32(val, val, 1);
+    tcg_gen_st8_i32(val, bucket, 0);
+
+    /* *prev_loc = cur_loc >> 1 */
+    tcg_gen_movi_i32(val, cb->edge.cur_loc >> 1);
+    tcg_gen_st_i32(val, prev_ptr, 0);
+
+    tcg_temp_free_i32(val);
+    tcg_temp_free_ptr(bucket);
+    tcg_temp_free_ptr(prev_ptr);
+}
+
+/*
+ * Unlike the other callbacks, the edge update is not copied from the
+ * placeholder ops: which ops it needs depends on the host's pointer
+ * size. Generate it at the end of the op list and move it into place.
+ */
+static void inject_edge_cb(const GArray *cbs, TCGOp *begin_op)
+{
+    TCGOp *end_op, *last_op, *op, *next;
+    int i;
+
+    if (!cbs || cbs->len == 0) {
+        rm_ops(begin_op);
+        return;
+    }
+
+    end_op = find_op(begin_op, INDEX_op_plugin_cb_end);
+    tcg_debug_assert(end_op);
+
+    last_op = tcg_last_op();
+    for (i = 0; i < cbs->len; i++) {
+        gen_edge_cb(&g_array_index(cbs, struct qemu_plugin_dyn_cb, i));
+    }
+
+    for (op = QTAILQ_NEXT(last_op, link); op; op = next) {
+        next = QTAILQ_NEXT(op, link);
+        QTAILQ_REMOVE(&tcg_ctx->ops, op, link);
+        QTAILQ_INSERT_AFTER(&tcg_ctx->ops, end_op, op, link);
+        end_op = op;
+    }
+    rm_ops(begin_op);
+}
+
 static void
 inject_mem_cb(const GArray *cbs, TCGOp *begin_op)
 {
@@ -678,6 +747,12 @@ static void plugin_gen_tb_inline(const struct qemu_plugin_tb *ptb,
     inject_inline_cb(ptb->cbs[PLUGIN_CB_INLINE], begin_op, op_ok);
 }
 
+static void plugin_gen_tb_edge(const struct qemu_plugin_tb *ptb,
+                               TCGOp *begin_op)
+{
+    inject_edge_cb(ptb->cbs[PLUGIN_CB_EDGE], begin_op);
+}
+
 static void plugin_gen_insn_udata(const struct qemu_plugin_tb *ptb,
                                   TCGOp *begin_op, int insn_idx)
 {
@@ -740,6 +815,9 @@ static void plugin_inject_cb(const struct qemu_plugin_tb *ptb, TCGOp *begin_op,
         case PLUGIN_GEN_CB_INLINE:
             plugin_gen_tb_inline(ptb, begin_op);
             return;
+        case PLUGIN_GEN_CB_EDGE:
+            plugin_gen_tb_edge(ptb, begin_op);
+            return;
         default:
             g_assert_not_reached();
         }
@@ -816,6 +894,9 @@ static void pr_ops(void)
             case PLUGIN_GEN_CB_INLINE:
                 type = "inline";
                 break;
+            case PLUGIN_GEN_CB_EDGE:
+                type = "edge";
+                break;
             case PLUGIN_GEN_CB_MEM:
                 type = "mem";
                 break;
@@ -0,0 +1,166 @@
+/*
+ * Translation block execution profile
+ *
+ * With -accel tcg,tb-profile=on every TB counts its executions in the
+ * TBProfile of its guest pc, and tb_gen_code and TB invalidation count
+ * translations and invalidations there.  query-tb-hot and "info tb-hot"
+ * list the most executed pcs.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "cpu.h"
+#include "disas/disas.h"
+#include "exec/exec-all.h"
+#include "exec/tb-context.h"
+#include "qapi/error.h"
+#include "qapi/qapi-commands-misc-target.h"
+#include "qemu/thread.h"
+#include "tcg/tcg.h"
+#include "tb-profile.h"
+
+bool tb_profile_enabled;
+
+/* TBProfile by pc.  Entries are never freed, as TBs point to them. */
+static GHashTable *tb_profiles;
+static QemuMutex tb_profile_lock;
+
+static guint tb_profile_hash(gconstpointer key)
+{
+    uint64_t pc = *(const target_ulong *)key;
+
+    return pc ^ (pc >> 32);
+}
+
+static gboolean tb_profile_equal(gconstpointer a, gconstpointer b)
+{
+    return *(const target_ulong *)a == *(const target_ulong *)b;
+}
+
+TBProfile *tb_profile_get(target_ulong pc)
+{
+    TBProfile *p;
+
+    qemu_mutex_lock(&tb_profile_lock);
+    p = g_hash_table_lookup(tb_profiles, &pc);
+    if (!p) {
+        p = g_new0(TBProfile, 1);
+        p->pc = pc;
+        g_hash_table_add(tb_profiles, p);
+    }
+    qemu_mutex_unlock(&tb_profile_lock);
+    return p;
+}
+
+void tb_profile_translated(TranslationBlock *tb)
+{
+    TBProfile *p = tb->prof;
+
+    atomic_inc(&p->translations);
+    atomic_set(&p->guest_insns, tb->icount);
+    atomic_set(&p->host_bytes, tb->tc.size);
+}
+
+static gint tb_profile_cmp(gconstpointer a, gconstpointer b)
+{
+    const TBProfile *pa = *(TBProfile **)a;
+    const TBProfile *pb = *(TBProfile **)b;
+    uint64_t ea = atomic_read_u64(&pa->executions);
+    uint64_t eb = atomic_read_u64(&pb->executions);
+
+    if (ea != eb) {
+        return ea > eb ? -1 : 1;
+    }
+    return pa->pc < pb->pc ? -1 : pa->pc > pb->pc;
+}
+
+TbProfile *qmp_query_tb_hot(bool has_count, int64_t count,
+                            bool has_reset, bool reset, Error **errp)
+{
+    TbProfileEntryList **tail;
+    TbProfile *info;
+    GPtrArray *all;
+    GHashTableIter iter;
+    gpointer value;
+    int i;
+
+    if (!tb_profile_enabled) {
+        error_setg(errp, "TB profiling is not enabled, "
+                   "use -accel tcg,tb-profile=on");
+        return NULL;
+    }
+    if (!has_count) {
+        count = 10;
+    } else if (count < 0) {
+        error_setg(errp, "Parameter 'count' must not be negative");
+        return NULL;
+    }
+
+    info = g_new0(TbProfile, 1);
+    info->flushes = atomic_read(&tb_ctx.tb_flush_count);
+    info->evictions = atomic_read(&tb_ctx.tb_evict_count);
+
+    qemu_mutex_lock(&tb_profile_lock);
+    all = g_ptr_array_sized_new(g_hash_table_size(tb_profiles));
+    g_hash_table_iter_init(&iter, tb_profiles);
+    while (g_hash_table_iter_next(&iter, &value, NULL)) {
+        TBProfile *p = value;
+
+        info->executions += atomic_read_u64(&p->executions);
+        info->translations += atomic_read(&p->translations);
+        info->invalidations += atomic_read(&p->invalidations);
+        if (atomic_read_u64(&p->executions)) {
+            g_ptr_array_add(all, p);
+        }
+    }
+    g_ptr_array_sort(all, tb_profile_cmp);
+
+    tail = &info->hot;
+    for (i = 0; i < all->len && i < count; i++) {
+        TBProfile *p = g_ptr_array_index(all, i);
+        TbProfileEntry *e = g_new0(TbProfileEntry, 1);
+        const char *sym = lookup_symbol(p->pc);
+
+        e->pc = p->pc;
+        if (*sym) {
+            e->has_symbol = true;
+            e->symbol = g_strdup(sym);
+        }
+        e->executions = atomic_read_u64(&p->executions);
+        e->guest_insns = atomic_read(&p->guest_insns);
+        e->host_bytes = atomic_read(&p->host_bytes);
+        e->translations = atomic_read(&p->translations);
+        e->invalidations = atomic_read(&p->invalidations);
+
+        *tail = g_new0(TbProfileEntryList, 1);
+        (*tail)->value = e;
+        tail = &(*tail)->next;
+    }
+    g_ptr_array_free(all, true);
+
+    if (has_reset && reset) {
+        g_hash_table_iter_init(&iter, tb_profiles);
+        while (g_hash_table_iter_next(&iter, &value, NULL)) {
+            TBProfile *p = value;
+
+            /* Racy against running TBs; a few executions may survive */
+            atomic_set_u64(&p->executions, 0);
+            atomic_set(&p->translations, 0);
+            atomic_set(&p->invalidations, 0);
+        }
+    }
+    qemu_mutex_unlock(&tb_profile_lock);
+
+    return info;
+}
+
+void tb_profile_init(void)
+{
+    qemu_mutex_init(&tb_profile_lock);
+    tb_profiles = g_hash_table_new(tb_profile_hash, tb_profile_equal);
+    tb_profile_enabled = true;
+}
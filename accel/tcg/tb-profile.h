@@ -0,0 +1,53 @@
+/*
+ * Translation block execution profile
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef ACCEL_TCG_TB_PROFILE_H
+#define ACCEL_TCG_TB_PROFILE_H
+
+/*
+ * Counters for the code at one guest pc.  Shared by all of its TBs and
+ * kept across retranslations, invalidations and tb_flush.
+ */
+typedef struct TBProfile {
+    target_ulong pc;
+    /* Incremented inline by the TB prologue, see translator_loop() */
+    uint64_t executions;
+    uint32_t translations;
+    uint32_t invalidations;
+    /* Sizes of the latest translation */
+    uint32_t guest_insns;
+    uint32_t host_bytes;
+} TBProfile;
+
+extern bool tb_profile_enabled;
+
+/*
+ * tb_profile_init:
+ *
+ * Start counting executions in the TBs generated from now on.
+ */
+void tb_profile_init(void);
+
+/*
+ * tb_profile_get:
+ * @pc: guest pc of the TB being translated
+ *
+ * Return the counters for @pc, creating them on first use.
+ */
+TBProfile *tb_profile_get(target_ulong pc);
+
+/*
+ * tb_profile_translated:
+ * @tb: TB that was just generated
+ *
+ * Account for a new translation of @tb->pc.
+ */
+void tb_profile_translated(TranslationBlock *tb);
+
+#endif /* ACCEL_TCG_TB_PROFILE_H */
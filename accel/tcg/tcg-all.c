@@ -31,16 +31,20 @@
 #include "sysemu/cpus.h"
 #include "qemu/main-loop.h"
 #include "tcg/tcg.h"
+#include "exec/exec-all.h"
 #include "qapi/error.h"
 #include "qemu/error-report.h"
 #include "hw/boards.h"
 #include "qapi/qapi-builtin-visit.h"
+#include "tb-profile.h"
 
 typedef struct TCGState {
     AccelState parent_obj;
 
     bool mttcg_enabled;
     unsigned long tb_size;
+    bool tb_profile;
+    uint32_t trace_threshold;
 } TCGState;
 
 #define TYPE_TCG_ACCEL ACCEL_CLASS_NAME("tcg")
@@ -129,6 +133,10 @@ static int tcg_init(MachineState *ms)
     tcg_exec_init(s->tb_size * 1024 * 1024);
     cpu_interrupt_handler = tcg_handle_interrupt;
     mttcg_enabled = s->mttcg_enabled;
+    tb_trace_threshold = s->trace_threshold;
+    if (s->tb_profile) {
+        tb_profile_init();
+    }
     return 0;
 }
 
@@ -194,6 +202,46 @@ static void tcg_set_tb_size(Object *obj, Visitor *v,
     s->tb_size = value;
 }
 
+static bool tcg_get_tb_profile(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    return s->tb_profile;
+}
+
+static void tcg_set_tb_profile(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    s->tb_profile = value;
+}
+
+static void tcg_get_trace_threshold(Object *obj, Visitor *v,
+                                    const char *name, void *opaque,
+                                    Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    visit_type_uint32(v, name, &s->trace_threshold, errp);
+}
+
+static void tcg_set_trace_threshold(Object *obj, Visitor *v,
+                                    const char *name, void *opaque,
+                                    Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    Error *error = NULL;
+    uint32_t value;
+
+    visit_type_uint32(v, name, &value, &error);
+    if (error) {
+        error_propagate(errp, error);
+        return;
+    }
+
+    s->trace_threshold = value;
+}
+
 static void tcg_accel_class_init(ObjectClass *oc, void *data)
 {
     AccelClass *ac = ACCEL_CLASS(oc);
@@ -212,6 +260,20 @@ static void tcg_accel_class_init(ObjectClass *oc, void *data)
     object_class_property_set_description(oc, "tb-size",
         "TCG translation block cache size", &error_abort);
 
+    object_class_property_add_bool(oc, "tb-profile",
+                                   tcg_get_tb_profile,
+                                   tcg_set_tb_profile,
+                                   NULL);
+    object_class_property_set_description(oc, "tb-profile",
+        "Count the executions of each TB for query-tb-hot", &error_abort);
+
+    object_class_property_add(oc, "trace-threshold", "uint32",
+        tcg_get_trace_threshold, tcg_set_trace_threshold,
+        NULL, NULL, &error_abort);
+    object_class_property_set_description(oc, "trace-threshold",
+        "Executions after which a TB is retranslated as a hot trace "
+        "(0 to disable)", &error_abort);
+
 }
 
 static const TypeInfo tcg_accel_type = {
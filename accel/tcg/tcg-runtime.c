@@ -145,7 +145,7 @@ uint64_t HELPER(ctpop_i64)(uint64_t arg)
     return ctpop64(arg);
 }
 
-void *HELPER(lookup_tb_ptr)(CPUArchState *env)
+static TranslationBlock *lookup_tb(CPUArchState *env)
 {
     CPUState *cpu = env_cpu(env);
     TranslationBlock *tb;
@@ -153,17 +153,40 @@ void *HELPER(lookup_tb_ptr)(CPUArchState *env)
     uint32_t flags;
 
     tb = tb_lookup__cpu_state(cpu, &pc, &cs_base, &flags, curr_cflags());
+    if (tb) {
+        qemu_log_mask_and_addr(CPU_LOG_EXEC, pc,
+                               "Chain %d: %p ["
+                               TARGET_FMT_lx "/" TARGET_FMT_lx "/%#x] %s\n",
+                               cpu->cpu_index, tb->tc.ptr, cs_base, pc, flags,
+                               lookup_symbol(pc));
+    }
+    return tb;
+}
+
+void *HELPER(lookup_tb_ptr)(CPUArchState *env)
+{
+    TranslationBlock *tb = lookup_tb(env);
+
+    return tb ? tb->tc.ptr : tcg_ctx->code_gen_epilogue;
+}
+
+/* As lookup_tb_ptr, but also fill the inline cache of @src */
+void *HELPER(lookup_tb_ptr_link)(CPUArchState *env, void *src)
+{
+    TranslationBlock *tb = lookup_tb(env);
+
     if (tb == NULL) {
         return tcg_ctx->code_gen_epilogue;
     }
-    qemu_log_mask_and_addr(CPU_LOG_EXEC, pc,
-                           "Chain %d: %p ["
-                           TARGET_FMT_lx "/" TARGET_FMT_lx "/%#x] %s\n",
-                           cpu->cpu_index, tb->tc.ptr, cs_base, pc, flags,
-                           lookup_symbol(pc));
+    tb_link_indirect(src, tb);
     return tb->tc.ptr;
 }
 
+void HELPER(tb_hot)(void *tb)
+{
+    tb_trace_hot(tb);
+}
+
 void HELPER(exit_atomic)(CPUArchState *env)
 {
     cpu_loop_exit_atomic(env_cpu(env), GETPC());
@@ -25,6 +25,9 @@ DEF_HELPER_FLAGS_1(ctpop_i32, TCG_CALL_NO_RWG_SE, i32, i32)
 DEF_HELPER_FLAGS_1(ctpop_i64, TCG_CALL_NO_RWG_SE, i64, i64)
 
 DEF_HELPER_FLAGS_1(lookup_tb_ptr, TCG_CALL_NO_WG_SE, ptr, env)
+DEF_HELPER_FLAGS_2(lookup_tb_ptr_link, TCG_CALL_NO_WG, ptr, env, ptr)
+
+DEF_HELPER_FLAGS_1(tb_hot, TCG_CALL_NO_RWG, void, ptr)
 
 DEF_HELPER_FLAGS_1(exit_atomic, TCG_CALL_NO_WG, noreturn, env)
 
@@ -26,6 +26,7 @@
 #include "trace.h"
 #include "disas/disas.h"
 #include "exec/exec-all.h"
+#include "exec/cpu_ldst.h"
 #include "tcg/tcg.h"
 #if defined(CONFIG_USER_ONLY)
 #include "qemu.h"
@@ -50,6 +51,7 @@
 #include "exec/cputlb.h"
 #include "exec/tb-hash.h"
 #include "translate-all.h"
+#include "tb-profile.h"
 #include "qemu/bitmap.h"
 #include "qemu/error-report.h"
 #include "qemu/qemu-print.h"
@@ -216,6 +218,11 @@ __thread TCGContext *tcg_ctx;
 TBContext tb_ctx;
 bool parallel_cpus;
 
+#ifdef CONFIG_SOFTMMU
+/* Set once a CF_ROM TB has been linked, cleared by tb_flush */
+static bool tb_rom_present;
+#endif
+
 static void page_table_config_init(void)
 {
     uint32_t v_l1_bits;
@@ -288,12 +295,20 @@ static target_long decode_sleb128(uint8_t **pp)
    The logical table consists of TARGET_INSN_START_WORDS target_ulong's,
    which come from the target's insn_start data, followed by a uintptr_t
    which comes from the host pc of the end of the code implementing the insn.
+   For icount TBs with an insn whose cost is not 1 (CF_INSN_COST), a last
+   column holds the icount units charged before the insn.
 
    Each line of the table is encoded as sleb128 deltas from the previous
    line.  The seed for the first line is { tb->pc, 0..., tb->tc.ptr }.
    That is, the first column is seeded with the guest pc, the last column
    with the host pc, and the middle columns with zeros.  */
 
+/* Set by translator_loop for targets that model instruction timing */
+static bool tb_has_cost_column(TranslationBlock *tb)
+{
+    return tb_cflags(tb) & CF_INSN_COST;
+}
+
 static int encode_search(TranslationBlock *tb, uint8_t *block)
 {
     uint8_t *highwater = tcg_ctx->code_gen_highwater;
@@ -314,6 +329,11 @@ static int encode_search(TranslationBlock *tb, uint8_t *block)
         prev = (i == 0 ? 0 : tcg_ctx->gen_insn_end_off[i - 1]);
         p = encode_sleb128(p, tcg_ctx->gen_insn_end_off[i] - prev);
 
+        if (tb_has_cost_column(tb)) {
+            prev = (i == 0 ? 0 : tcg_ctx->gen_insn_cost[i - 1]);
+            p = encode_sleb128(p, tcg_ctx->gen_insn_cost[i] - prev);
+        }
+
         /* Test for (pending) buffer overflow.  The assumption is that any
            one row beginning below the high water mark cannot overrun
            the buffer completely.  Thus we can test for overflow after
@@ -338,6 +358,8 @@ static int cpu_restore_state_from_tb(CPUState *cpu, TranslationBlock *tb,
     CPUArchState *env = cpu->env_ptr;
     uint8_t *p = tb->tc.ptr + tb->tc.size;
     int i, j, num_insns = tb->icount;
+    bool has_cost = tb_has_cost_column(tb);
+    int cost = 0;
 #ifdef CONFIG_PROFILER
     TCGProfile *prof = &tcg_ctx->prof;
     int64_t ti = profile_getclock();
@@ -356,6 +378,9 @@ static int cpu_restore_state_from_tb(CPUState *cpu, TranslationBlock *tb,
             data[j] += decode_sleb128(&p);
         }
         host_pc += decode_sleb128(&p);
+        if (has_cost) {
+            cost += decode_sleb128(&p);
+        }
         if (host_pc > searched_pc) {
             goto found;
         }
@@ -363,11 +388,14 @@ static int cpu_restore_state_from_tb(CPUState *cpu, TranslationBlock *tb,
     return -1;
 
  found:
+    if (!has_cost) {
+        cost = i;
+    }
     if (reset_icount && (tb_cflags(tb) & CF_USE_ICOUNT)) {
         assert(use_icount);
         /* Reset the cycle counter to the start of the block
-           and shift if to the number of actually executed instructions */
-        cpu_neg(cpu)->icount_decr.u16.low += num_insns - i;
+           and shift it to the cost of the actually executed instructions */
+        cpu_neg(cpu)->icount_decr.u16.low += MAX(tb->icount_cost - cost, 0);
     }
     restore_state_to_opc(env, tb, data);
 
@@ -1224,6 +1252,9 @@ static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
 
     qht_reset_size(&tb_ctx.htable, CODE_GEN_HTABLE_SIZE);
     page_flush_tb();
+#ifdef CONFIG_SOFTMMU
+    atomic_set(&tb_rom_present, false);
+#endif
 
     tcg_region_reset_all();
     /* XXX: flush processor icache at this point if cache flush is
@@ -1251,6 +1282,48 @@ void tb_flush(CPUState *cpu)
     }
 }
 
+static void tb_evict_one(TranslationBlock *tb)
+{
+    tb_phys_invalidate(tb, -1);
+}
+
+/*
+ * Make room in the code buffer by evicting the oldest region of code,
+ * keeping the rest, or by flushing everything if there is no region
+ * to evict.
+ */
+static void do_tb_evict(CPUState *cpu, run_on_cpu_data tb_flush_count)
+{
+    bool evicted = true;
+
+    mmap_lock();
+    /* Another CPU may have made room already */
+    if (tb_ctx.tb_flush_count == tb_flush_count.host_int &&
+        !tcg_region_available()) {
+        evicted = tcg_region_evict(tb_evict_one);
+        if (evicted) {
+            atomic_set(&tb_ctx.tb_evict_count, tb_ctx.tb_evict_count + 1);
+        }
+    }
+    mmap_unlock();
+
+    if (!evicted) {
+        do_tb_flush(cpu, tb_flush_count);
+    }
+}
+
+static void tb_evict(CPUState *cpu)
+{
+    unsigned tb_flush_count = atomic_mb_read(&tb_ctx.tb_flush_count);
+
+    if (cpu_in_exclusive_context(cpu)) {
+        do_tb_evict(cpu, RUN_ON_CPU_HOST_INT(tb_flush_count));
+    } else {
+        async_safe_run_on_cpu(cpu, do_tb_evict,
+                              RUN_ON_CPU_HOST_INT(tb_flush_count));
+    }
+}
+
 /*
  * Formerly ifdef DEBUG_TB_CHECK. These debug functions are user-mode-only,
  * so in order to prevent bit rot we compile them unconditionally in user-mode,
@@ -1380,6 +1453,47 @@ static inline void tb_reset_jump(TranslationBlock *tb, int n)
     tb_set_jmp_target(tb, n, addr);
 }
 
+/*
+ * Unchain jump @n of @tb so that it can be linked to another TB.  Unlike
+ * tb_remove_from_jmp_list(), this leaves the slot open for tb_add_jump().
+ */
+void tb_unlink_jump(TranslationBlock *tb, int n)
+{
+    uintptr_t ptr = atomic_read(&tb->jmp_dest[n]);
+    TranslationBlock *dest = (TranslationBlock *)(ptr & ~1);
+    TranslationBlock *t;
+    uintptr_t *pprev;
+    int m;
+
+    /* Nothing linked, or @tb is being invalidated */
+    if (dest == NULL || (ptr & 1)) {
+        return;
+    }
+
+    qemu_spin_lock(&dest->jmp_lock);
+    /*
+     * If @dest was invalidated meanwhile, the jump is already gone; if
+     * @tb is being invalidated, tb_remove_from_jmp_list() will take it
+     * off the list once we drop the lock.
+     */
+    if (atomic_cmpxchg(&tb->jmp_dest[n], ptr, (uintptr_t)NULL) != ptr) {
+        qemu_spin_unlock(&dest->jmp_lock);
+        return;
+    }
+    tb_reset_jump(tb, n);
+
+    pprev = &dest->jmp_list_head;
+    TB_FOR_EACH_JMP(dest, t, m) {
+        if (t == tb && m == n) {
+            *pprev = t->jmp_list_next[m];
+            qemu_spin_unlock(&dest->jmp_lock);
+            return;
+        }
+        pprev = &t->jmp_list_next[m];
+    }
+    g_assert_not_reached();
+}
+
 /* remove any jumps to the TB */
 static inline void tb_jmp_unlink(TranslationBlock *dest)
 {
@@ -1425,6 +1539,9 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
         !qht_remove(&tb_ctx.htable, tb, h)) {
         return;
     }
+    if (tb->prof && !(tb->cflags & CF_NOCACHE)) {
+        atomic_inc(&tb->prof->invalidations);
+    }
 
     /* remove the TB from the page list */
     if (rm_from_page_list) {
@@ -1468,7 +1585,8 @@ static void tb_phys_invalidate__locked(TranslationBlock *tb)
  */
 void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr)
 {
-    if (page_addr == -1 && tb->page_addr[0] != -1) {
+    if (page_addr == -1 && tb->page_addr[0] != -1 &&
+        !(tb->cflags & CF_ROM)) {
         page_lock_tb(tb);
         do_tb_phys_invalidate(tb, true);
         page_unlock_tb(tb);
@@ -1506,6 +1624,95 @@ static void build_page_bitmap(PageDesc *p)
 }
 #endif
 
+#ifdef CONFIG_SOFTMMU
+/*
+ * Is the guest code at @host in memory that the guest cannot write?
+ * Such TBs can only be invalidated by the board rewriting the ROM,
+ * so there is no point in tracking writes to their pages.
+ */
+static bool tb_code_is_rom(void *host)
+{
+    MemoryRegion *mr;
+    ram_addr_t offset;
+
+    if (!host) {
+        return false;
+    }
+    mr = memory_region_from_host(host, &offset);
+    return mr && (memory_region_is_rom(mr) || memory_region_is_romd(mr));
+}
+
+/*
+ * Like tb_link_page, but for CF_ROM TBs: they only go into the hash
+ * table, and the pages keep no TB list, code bitmap or write protection.
+ */
+static TranslationBlock *tb_link_rom(TranslationBlock *tb,
+                                     tb_page_addr_t phys_pc,
+                                     tb_page_addr_t phys_page2)
+{
+    void *existing_tb = NULL;
+    uint32_t h;
+
+    tb->page_addr[0] = phys_pc & TARGET_PAGE_MASK;
+    tb->page_addr[1] = phys_page2;
+
+    h = tb_hash_func(phys_pc, tb->pc, tb->flags, tb->cflags & CF_HASH_MASK,
+                     tb->trace_vcpu_dstate);
+    qht_insert(&tb_ctx.htable, tb, h, &existing_tb);
+    if (unlikely(existing_tb)) {
+        return existing_tb;
+    }
+    atomic_set(&tb_rom_present, true);
+    return tb;
+}
+
+typedef struct TBRomRange {
+    ram_addr_t start;
+    ram_addr_t end;
+    GPtrArray *tbs;
+} TBRomRange;
+
+static void tb_rom_range_collect(void *p, uint32_t hash, void *userp)
+{
+    TranslationBlock *tb = p;
+    TBRomRange *r = userp;
+    int n;
+
+    if (!(tb->cflags & CF_ROM) || (tb->cflags & CF_INVALID)) {
+        return;
+    }
+    for (n = 0; n < 2; n++) {
+        if (tb->page_addr[n] != -1 && tb->page_addr[n] < r->end &&
+            tb->page_addr[n] + TARGET_PAGE_SIZE > r->start) {
+            g_ptr_array_add(r->tbs, tb);
+            return;
+        }
+    }
+}
+
+/*
+ * Invalidate the CF_ROM TBs on pages in [start;end[. Called when the
+ * ROM contents change behind the guest's back, i.e. when a loader,
+ * debugger or flash controller model writes to it.
+ */
+void tb_invalidate_rom_range(ram_addr_t start, ram_addr_t end)
+{
+    TBRomRange r = { .start = start, .end = end };
+    int i;
+
+    if (!atomic_read(&tb_rom_present)) {
+        return;
+    }
+
+    r.tbs = g_ptr_array_new();
+    qht_iter(&tb_ctx.htable, tb_rom_range_collect, &r);
+    for (i = 0; i < r.tbs->len; i++) {
+        tb_phys_invalidate(g_ptr_array_index(r.tbs, i), -1);
+    }
+    g_ptr_array_free(r.tbs, true);
+}
+#endif
+
 /* add the tb in the target page and protect it if necessary
  *
  * Called with mmap_lock held for user-mode emulation.
@@ -1594,6 +1801,12 @@ tb_link_page(TranslationBlock *tb, tb_page_addr_t phys_pc,
         return tb;
     }
 
+#ifdef CONFIG_SOFTMMU
+    if (tb->cflags & CF_ROM) {
+        return tb_link_rom(tb, phys_pc, phys_page2);
+    }
+#endif
+
     /*
      * Add the TB to the page list, acquiring first the pages's locks.
      * We keep the locks held until after inserting the TB in the hash table,
@@ -1652,6 +1865,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     CPUArchState *env = cpu->env_ptr;
     TranslationBlock *tb, *existing_tb;
     tb_page_addr_t phys_pc, phys_page2;
+    void *host_pc = NULL, *host_page2 = NULL;
     target_ulong virt_page2;
     tcg_insn_unit *gen_code_buf;
     int gen_code_size, search_size, max_insns;
@@ -1662,7 +1876,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
 
     assert_memory_lock();
 
-    phys_pc = get_page_addr_code(env, pc);
+    phys_pc = get_page_addr_code_hostp(env, pc, &host_pc);
 
     if (phys_pc == -1) {
         /* Generate a temporary TB with 1 insn in it */
@@ -1687,8 +1901,8 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
  buffer_overflow:
     tb = tcg_tb_alloc(tcg_ctx);
     if (unlikely(!tb)) {
-        /* flush must be done */
-        tb_flush(cpu);
+        /* eviction or flush must be done */
+        tb_evict(cpu);
         mmap_unlock();
         /* Make the execution loop process the flush as soon as possible.  */
         cpu->exception_index = EXCP_INTERRUPT;
@@ -1703,6 +1917,11 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tb->cflags = cflags;
     tb->orig_tb = NULL;
     tb->trace_vcpu_dstate = *cpu->trace_dstate;
+#ifdef CONFIG_SOFTMMU
+    tb->prof = tb_profile_enabled ? tb_profile_get(pc) : NULL;
+#else
+    tb->prof = NULL;
+#endif
     tcg_ctx->tb_cflags = cflags;
  tb_overflow:
 
@@ -1777,6 +1996,11 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
         goto buffer_overflow;
     }
     tb->tc.size = gen_code_size;
+#ifdef CONFIG_SOFTMMU
+    if (tb->prof) {
+        tb_profile_translated(tb);
+    }
+#endif
 
 #ifdef CONFIG_PROFILER
     atomic_set(&prof->code_time, prof->code_time + profile_getclock() - ti);
@@ -1841,8 +2065,14 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     virt_page2 = (pc + tb->size - 1) & TARGET_PAGE_MASK;
     phys_page2 = -1;
     if ((pc & TARGET_PAGE_MASK) != virt_page2) {
-        phys_page2 = get_page_addr_code(env, virt_page2);
+        phys_page2 = get_page_addr_code_hostp(env, virt_page2, &host_page2);
     }
+#ifdef CONFIG_SOFTMMU
+    if (!(cflags & CF_NOCACHE) && tb_code_is_rom(host_pc) &&
+        (phys_page2 == -1 || tb_code_is_rom(host_page2))) {
+        tb->cflags |= CF_ROM;
+    }
+#endif
     /*
      * No explicit memory barrier is required -- tb_link_page() makes the
      * TB visible in a consistent state.
@@ -1860,6 +2090,23 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     return tb;
 }
 
+/* Leave at least this fraction of the code buffer for lazy translation */
+#define TB_PRETRANSLATE_FILL_DIV  2
+
+bool tb_pretranslate_room(void)
+{
+    return tcg_code_size() <= tcg_code_capacity() / TB_PRETRANSLATE_FILL_DIV;
+}
+
+bool tb_pretranslate_mapped(CPUArchState *env, target_ulong pc,
+                            target_ulong len)
+{
+    int mmu_idx = cpu_mmu_index(env, true);
+
+    return tlb_vaddr_to_host(env, pc, MMU_INST_FETCH, mmu_idx) &&
+        tlb_vaddr_to_host(env, pc + len - 1, MMU_INST_FETCH, mmu_idx);
+}
+
 /*
  * @p must be non-NULL.
  * user-mode: call with mmap_lock held.
@@ -2149,7 +2396,69 @@ void tb_check_watchpoint(CPUState *cpu, uintptr_t retaddr)
     }
 }
 
+/*
+ * Hot trace formation.  With a non-zero threshold, TBs count down their
+ * executions and, when they reach zero, their pc is added to tb_trace_pcs
+ * and they are invalidated.  translator_loop then retranslates the code
+ * at that pc as a trace that runs on across direct branches.
+ */
+uint32_t tb_trace_threshold;
+static GHashTable *tb_trace_pcs;
+static QemuSpin tb_trace_lock;
+
+bool tb_trace_head(target_ulong pc)
+{
+    bool ret;
+
+    qemu_spin_lock(&tb_trace_lock);
+    ret = tb_trace_pcs &&
+        g_hash_table_contains(tb_trace_pcs, (gpointer)(uintptr_t)pc);
+    qemu_spin_unlock(&tb_trace_lock);
+    return ret;
+}
+
+/* Called from the TB itself, through helper_tb_hot */
+void tb_trace_hot(TranslationBlock *tb)
+{
+    qemu_spin_lock(&tb_trace_lock);
+    if (!tb_trace_pcs) {
+        tb_trace_pcs = g_hash_table_new(NULL, NULL);
+    }
+    g_hash_table_add(tb_trace_pcs, (gpointer)(uintptr_t)tb->pc);
+    qemu_spin_unlock(&tb_trace_lock);
+
+    mmap_lock();
+    tb_phys_invalidate(tb, -1);
+    mmap_unlock();
+}
+
 #ifndef CONFIG_USER_ONLY
+/*
+ * Guest PCs of instructions caught doing I/O in the middle of a TB.
+ * Every catch costs a longjmp, a state restore and a one insn TB, so
+ * later translations end their TB on these instructions instead; see
+ * translator_loop().  The set survives tb_flush.
+ *
+ * Only used with icount, and so only by the single round-robin vCPU
+ * thread.  Keys may collide on 32-bit hosts, which merely ends a TB
+ * early.
+ */
+static GHashTable *tb_io_pcs;
+
+bool tb_io_insn(target_ulong pc)
+{
+    return tb_io_pcs &&
+        g_hash_table_contains(tb_io_pcs, (gpointer)(uintptr_t)pc);
+}
+
+static void tb_io_insn_add(target_ulong pc)
+{
+    if (!tb_io_pcs) {
+        tb_io_pcs = g_hash_table_new(NULL, NULL);
+    }
+    g_hash_table_add(tb_io_pcs, (gpointer)(uintptr_t)pc);
+}
+
 /* in deterministic execution mode, instructions doing device I/Os
  * must be at the end of the TB.
  *
@@ -2157,10 +2466,10 @@ void tb_check_watchpoint(CPUState *cpu, uintptr_t retaddr)
  */
 void cpu_io_recompile(CPUState *cpu, uintptr_t retaddr)
 {
-#if defined(TARGET_MIPS) || defined(TARGET_SH4)
     CPUArchState *env = cpu->env_ptr;
-#endif
     TranslationBlock *tb;
+    target_ulong pc, cs_base;
+    uint32_t flags;
     uint32_t n;
 
     tb = tcg_tb_lookup(retaddr);
@@ -2203,14 +2512,16 @@ void cpu_io_recompile(CPUState *cpu, uintptr_t retaddr)
             tb_phys_invalidate(tb->orig_tb, -1);
         }
         tcg_tb_remove(tb);
+    } else if (n == 1) {
+        /*
+         * Remember the insn and drop the TB, so that it is retranslated
+         * to end on the insn rather than caught here on every execution.
+         */
+        cpu_get_tb_cpu_state(env, &pc, &cs_base, &flags);
+        tb_io_insn_add(pc);
+        tb_phys_invalidate(tb, -1);
     }
 
-    /* TODO: If env->pc != tb->pc (i.e. the faulting instruction was not
-     * the first in the TB) then we end up generating a whole new TB and
-     *  repeating the fault, which is horribly inefficient.
-     *  Better would be to execute just this insn uncached, or generate a
-     *  second new TB.
-     */
     cpu_loop_exit_noexc(cpu);
 }
 
@@ -2340,6 +2651,8 @@ void dump_exec_info(void)
     qemu_printf("\nStatistics:\n");
     qemu_printf("TB flush count      %u\n",
                 atomic_read(&tb_ctx.tb_flush_count));
+    qemu_printf("TB evict count      %u\n",
+                atomic_read(&tb_ctx.tb_evict_count));
     qemu_printf("TB invalidate count %zu\n",
                 tcg_tb_phys_invalidate_count());
 
@@ -17,6 +17,7 @@
 #include "exec/log.h"
 #include "exec/translator.h"
 #include "exec/plugin-gen.h"
+#include "tb-profile.h"
 
 /* Pairs with tcg_clear_temp_count.
    To be called by #TranslatorOps.{translate_insn,tb_stop} if
@@ -31,11 +32,112 @@ void translator_loop_temp_check(DisasContextBase *db)
     }
 }
 
+/*
+ * The icount decrementer is 16 bits wide, and a TB that runs out the end
+ * of the icount budget (CF_NOCACHE) must fit in what is left of it.
+ */
+static int translator_max_cost(DisasContextBase *db)
+{
+    if (tb_cflags(db->tb) & CF_NOCACHE) {
+        return db->max_insns;
+    }
+    return 0x8000;
+}
+
+/* Can the code at db->pc_first be translated as a hot trace? */
+static bool translator_trace_ok(DisasContextBase *db)
+{
+    return tb_trace_threshold && !db->singlestep_enabled && !singlestep &&
+        !(tb_cflags(db->tb) & (CF_COUNT_MASK | CF_LAST_IO | CF_NOCACHE));
+}
+
+/* Count down executions of @tb, and have it made a trace at zero */
+static void gen_tb_count(TranslationBlock *tb)
+{
+    TCGv_ptr ptr = tcg_const_ptr(tb);
+    TCGv_i32 count = tcg_temp_new_i32();
+    TCGLabel *cold = gen_new_label();
+
+    tb->exec_count = tb_trace_threshold;
+    tcg_gen_ld_i32(count, ptr, offsetof(TranslationBlock, exec_count));
+    tcg_gen_subi_i32(count, count, 1);
+    tcg_gen_st_i32(count, ptr, offsetof(TranslationBlock, exec_count));
+    tcg_gen_brcondi_i32(TCG_COND_NE, count, 0, cold);
+    gen_helper_tb_hot(ptr);
+    gen_set_label(cold);
+
+    tcg_temp_free_i32(count);
+    tcg_temp_free_ptr(ptr);
+}
+
+/* Count executions of @tb in its profile, see tb-profile.c */
+static void gen_tb_profile(TBProfile *prof)
+{
+    TCGv_ptr ptr = tcg_const_ptr(prof);
+    TCGv_i64 count = tcg_temp_new_i64();
+
+    tcg_gen_ld_i64(count, ptr, offsetof(TBProfile, executions));
+    tcg_gen_addi_i64(count, count, 1);
+    tcg_gen_st_i64(count, ptr, offsetof(TBProfile, executions));
+
+    tcg_temp_free_i64(count);
+    tcg_temp_free_ptr(ptr);
+}
+
+bool translator_trace_follow(DisasContextBase *db, target_ulong dest)
+{
+    int i;
+
+    if (!db->trace || db->num_trace_blocks == TRANSLATOR_TRACE_MAX_BLOCKS ||
+        dest < db->pc_first ||
+        (dest & TARGET_PAGE_MASK) != (db->pc_first & TARGET_PAGE_MASK)) {
+        return false;
+    }
+    for (i = 0; i < db->num_trace_blocks; i++) {
+        if (db->trace_blocks[i] == dest) {
+            return false;
+        }
+    }
+    db->trace_blocks[db->num_trace_blocks++] = dest;
+    db->trace_end = MAX(db->trace_end, db->pc_next);
+    return true;
+}
+
+void translator_side_exit(DisasContextBase *db)
+{
+    TCGv_i32 count, imm;
+
+    if (!(tb_cflags(db->tb) & CF_USE_ICOUNT)) {
+        return;
+    }
+    g_assert(db->num_side_exits < TRANSLATOR_TRACE_MAX_BLOCKS);
+
+    count = tcg_temp_new_i32();
+    imm = tcg_temp_new_i32();
+    tcg_gen_ld16u_i32(count, cpu_env,
+                      offsetof(ArchCPU, neg.icount_decr.u16.low) -
+                      offsetof(ArchCPU, env));
+    /* Patched by translator_loop once the cost of the trace is known */
+    tcg_gen_movi_i32(imm, 0xdeadbeef);
+    db->side_exits[db->num_side_exits].icount_op = tcg_last_op();
+    db->side_exits[db->num_side_exits].icount_cost =
+        db->icount_cost + db->insn_cost;
+    db->num_side_exits++;
+    tcg_gen_add_i32(count, count, imm);
+    tcg_gen_st16_i32(count, cpu_env,
+                     offsetof(ArchCPU, neg.icount_decr.u16.low) -
+                     offsetof(ArchCPU, env));
+    tcg_temp_free_i32(imm);
+    tcg_temp_free_i32(count);
+}
+
 void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
                      CPUState *cpu, TranslationBlock *tb, int max_insns)
 {
-    int bp_insn = 0;
     bool plugin_enabled;
+    bool io_insn;
+    bool insn_cost = false;
+    int i;
 
     /* Initialize DisasContext */
     db->tb = tb;
@@ -44,7 +146,11 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
     db->is_jmp = DISAS_NEXT;
     db->num_insns = 0;
     db->max_insns = max_insns;
+    db->icount_cost = 0;
     db->singlestep_enabled = cpu->singlestep_enabled;
+    db->trace = false;
+    db->num_trace_blocks = 0;
+    db->num_side_exits = 0;
 
     ops->init_disas_context(db, cpu);
     tcg_debug_assert(db->is_jmp == DISAS_NEXT);  /* no early exit */
@@ -59,8 +165,25 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
 
     plugin_enabled = plugin_gen_tb_start(cpu, tb);
 
+    if (tb->prof) {
+        gen_tb_profile(tb->prof);
+    }
+
+    /* Plugins see the code one block at a time, so no traces for them */
+    if (!plugin_enabled && translator_trace_ok(db)) {
+        if (tb_trace_head(db->pc_first)) {
+            db->trace = true;
+            db->trace_end = db->pc_first;
+            db->trace_blocks[db->num_trace_blocks++] = db->pc_first;
+        } else {
+            gen_tb_count(db->tb);
+        }
+    }
+
     while (true) {
+        tcg_ctx->gen_insn_cost[db->num_insns] = db->icount_cost;
         db->num_insns++;
+        db->insn_cost = 1;
         ops->insn_start(db, cpu);
         tcg_debug_assert(db->is_jmp == DISAS_NEXT);  /* no early exit */
 
@@ -75,7 +198,6 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
             QTAILQ_FOREACH(bp, &cpu->breakpoints, entry) {
                 if (bp->pc == db->pc_next) {
                     if (ops->breakpoint_check(db, cpu, bp)) {
-                        bp_insn = 1;
                         break;
                     }
                 }
@@ -93,14 +215,19 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
            update db->pc_next and db->is_jmp to indicate what should be
            done next -- either exiting this loop or locate the start of
            the next instruction.  */
-        if (db->num_insns == db->max_insns
-            && (tb_cflags(db->tb) & CF_LAST_IO)) {
+        /* Instructions known to do I/O end the TB, as if CF_LAST_IO */
+        io_insn = (tb_cflags(db->tb) & CF_USE_ICOUNT) &&
+            tb_io_insn(db->pc_next);
+        if ((db->num_insns == db->max_insns
+             && (tb_cflags(db->tb) & CF_LAST_IO)) || io_insn) {
             /* Accept I/O on the last instruction.  */
             gen_io_start();
             ops->translate_insn(db, cpu);
         } else {
             ops->translate_insn(db, cpu);
         }
+        db->icount_cost += db->insn_cost;
+        insn_cost |= db->insn_cost != 1;
 
         /* Stop translation if translate_insn so indicated.  */
         if (db->is_jmp != DISAS_NEXT) {
@@ -117,7 +244,8 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
 
         /* Stop translation if the output buffer is full,
            or we have executed all of the allowed instructions.  */
-        if (tcg_op_buf_full() || db->num_insns >= db->max_insns) {
+        if (tcg_op_buf_full() || db->num_insns >= db->max_insns
+            || db->icount_cost >= translator_max_cost(db) || io_insn) {
             db->is_jmp = DISAS_TOO_MANY;
             break;
         }
@@ -125,15 +253,32 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
 
     /* Emit code to exit the TB, as indicated by db->is_jmp.  */
     ops->tb_stop(db, cpu);
-    gen_tb_end(db->tb, db->num_insns - bp_insn);
+    if (tb_cflags(db->tb) & CF_NOCACHE) {
+        /* The last insn may overshoot the budget; the TB must still run */
+        db->icount_cost = MIN(db->icount_cost, db->max_insns);
+    }
+    for (i = 0; i < db->num_side_exits; i++) {
+        /* Nothing to refund for a side exit past a clamped budget */
+        tcg_set_insn_param(db->side_exits[i].icount_op, 1,
+                           MAX(db->icount_cost -
+                               db->side_exits[i].icount_cost, 0));
+    }
+    gen_tb_end(db->tb, db->icount_cost);
 
     if (plugin_enabled) {
         plugin_gen_tb_end(cpu);
     }
 
     /* The disas_log hook may use these values rather than recompute.  */
-    db->tb->size = db->pc_next - db->pc_first;
+    /* A trace covers everything from its start to its furthest block */
+    db->tb->size = (db->trace ? MAX(db->pc_next, db->trace_end)
+                    : db->pc_next) - db->pc_first;
     db->tb->icount = db->num_insns;
+    db->tb->icount_cost = db->icount_cost;
+    if ((tb_cflags(db->tb) & CF_USE_ICOUNT) && insn_cost) {
+        /* Tells encode_search and cpu_restore_state to use the cost column */
+        db->tb->cflags |= CF_INSN_COST;
+    }
 
 #ifdef DEBUG_DISAS
     if (qemu_loglevel_mask(CPU_LOG_TB_IN_ASM)
@@ -205,6 +205,34 @@ void cpu_update_icount(CPUState *cpu)
                          &timers_state.vm_clock_lock);
 }
 
+/*
+ * Account for @units of icount spent outside translated code, e.g. by
+ * exception entry. They are taken from the vCPU's remaining budget so
+ * that timer deadlines are still met; anything the budget cannot cover
+ * goes straight to the global count.
+ */
+void cpu_icount_charge(CPUState *cpu, int64_t units)
+{
+    int64_t n;
+
+    n = MIN(units, cpu_neg(cpu)->icount_decr.u16.low);
+    cpu_neg(cpu)->icount_decr.u16.low -= n;
+    units -= n;
+
+    n = MIN(units, cpu->icount_extra);
+    cpu->icount_extra -= n;
+    units -= n;
+
+    if (units > 0) {
+        seqlock_write_lock(&timers_state.vm_clock_seqlock,
+                           &timers_state.vm_clock_lock);
+        atomic_set_i64(&timers_state.qemu_icount,
+                       timers_state.qemu_icount + units);
+        seqlock_write_unlock(&timers_state.vm_clock_seqlock,
+                             &timers_state.vm_clock_lock);
+    }
+}
+
 static int64_t cpu_get_icount_raw_locked(void)
 {
     CPUState *cpu = current_cpu;
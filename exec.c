@@ -1016,6 +1016,7 @@ void tb_invalidate_phys_addr(AddressSpace *as, hwaddr addr, MemTxAttrs attrs)
     }
     ram_addr = memory_region_get_ram_addr(mr) + addr;
     tb_invalidate_phys_page_range(ram_addr, ram_addr + 1);
+    tb_invalidate_rom_range(ram_addr, ram_addr + 1);
 }
 
 static void breakpoint_invalidate(CPUState *cpu, target_ulong pc)
@@ -2458,6 +2459,10 @@ void qemu_ram_free(RAMBlock *block)
     if (block->host) {
         ram_block_notify_remove(block->host, block->max_length);
     }
+    if (tcg_enabled()) {
+        tb_invalidate_rom_range(block->offset,
+                                block->offset + block->max_length);
+    }
 
     qemu_mutex_lock_ramlist();
     QLIST_REMOVE_RCU(block, next);
@@ -3048,6 +3053,10 @@ static void invalidate_and_set_dirty(MemoryRegion *mr, hwaddr addr,
         tb_invalidate_phys_range(addr, addr + length);
         dirty_log_mask &= ~(1 << DIRTY_MEMORY_CODE);
     }
+    /* TBs translated from ROM are not tracked by the code dirty bits */
+    if (tcg_enabled() && (memory_region_is_rom(mr) || mr->rom_device)) {
+        tb_invalidate_rom_range(addr, addr + length);
+    }
     cpu_physical_memory_set_dirty_range(addr, length, dirty_log_mask);
 }
 
@@ -127,6 +127,26 @@ SRST
     Show local APIC state
 ERST
 
+#if defined(TARGET_ARM)
+    {
+        .name       = "irq-latency",
+        .args_type  = "reset:-r,nvic:s?",
+        .params     = "[-r] [nvic]",
+        .help       = "show M-profile interrupt latency statistics "
+                      "(-r: reset them after printing; nvic: QOM path "
+                      "of the NVIC when there is more than one)",
+        .cmd        = hmp_info_irq_latency,
+    },
+#endif
+
+SRST
+  ``info irq-latency [-r] [``\ *nvic*\ ``]``
+    Show pending-to-active latency and handler duration histograms for
+    each exception taken by the M-profile NVIC. With ``-r``, clear the
+    statistics afterwards. On machines with more than one NVIC, *nvic*
+    is the QOM path of the one to show.
+ERST
+
 #if defined(TARGET_I386)
     {
         .name       = "ioapic",
@@ -297,6 +317,25 @@ SRST
     Show dynamic compiler opcode counters
 ERST
 
+#if defined(CONFIG_TCG)
+    {
+        .name       = "tb-hot",
+        .args_type  = "reset:-r,count:i?",
+        .params     = "[-r] [count]",
+        .help       = "show the most executed translated code "
+                      "(-r: reset the counters after printing)",
+        .cmd        = hmp_info_tb_hot,
+    },
+#endif
+
+SRST
+  ``info tb-hot [-r] [count]``
+    Show the ``count`` (default 10) guest addresses whose translated code
+    ran most often, with their execution, translation and invalidation
+    counts. Requires ``-accel tcg,tb-profile=on``. With ``-r``, clear the
+    counters afterwards.
+ERST
+
     {
         .name       = "sync-profile",
         .args_type  = "mean:-m,no_coalesce:-n,max:i?",
@@ -67,12 +67,37 @@ static void stm32f2xx_adc_reset(DeviceState *dev)
     s->adc_jdr[2] = 0x00000000;
     s->adc_jdr[3] = 0x00000000;
     s->adc_dr = 0x00000000;
+    s->seq_idx = 0;
+}
+
+/* Channel of the current conversion in the regular sequence */
+static int stm32f2xx_adc_channel(STM32F2XXADCState *s)
+{
+    uint32_t sqr;
+
+    if (s->seq_idx < ADC_SQ_PER_REG) {
+        sqr = s->adc_sqr3;
+    } else if (s->seq_idx < 2 * ADC_SQ_PER_REG) {
+        sqr = s->adc_sqr2;
+    } else {
+        sqr = s->adc_sqr1;
+    }
+
+    return (sqr >> (ADC_SQ_BITS * (s->seq_idx % ADC_SQ_PER_REG))) & 0x1F;
 }
 
 static uint32_t stm32f2xx_adc_generate_value(STM32F2XXADCState *s)
 {
-    /* Attempts to fake some ADC values */
-    s->adc_dr = s->adc_dr + 7;
+    if (s->sample) {
+        s->adc_dr = s->sample(s->sample_opaque, stm32f2xx_adc_channel(s));
+    } else {
+        /* Attempts to fake some ADC values */
+        s->adc_dr = s->adc_dr + 7;
+    }
+
+    if (s->adc_cr1 & ADC_CR1_SCAN) {
+        s->seq_idx = (s->seq_idx + 1) % (ADC_SQR1_L(s->adc_sqr1) + 1);
+    }
 
     switch ((s->adc_cr1 & ADC_CR1_RES) >> 24) {
     case 0:
@@ -196,6 +221,7 @@ static void stm32f2xx_adc_write(void *opaque, hwaddr addr,
         s->adc_cr2 &= (~ADC_CR2_CAL);
         if((s->adc_cr2 & ADC_CR2_ADON) && (s->adc_cr2 & ADC_CR2_SWSTART))
         {
+            s->seq_idx = 0;
             qemu_irq_raise(s->dma_req);
         }
         break;
@@ -258,7 +284,7 @@ static const MemoryRegionOps stm32f2xx_adc_ops = {
 
 static const VMStateDescription vmstate_stm32f2xx_adc = {
     .name = TYPE_STM32F2XX_ADC,
-    .version_id = 1,
+    .version_id = 2,
     .minimum_version_id = 1,
     .fields = (VMStateField[]) {
         VMSTATE_UINT32(adc_sr, STM32F2XXADCState),
@@ -276,6 +302,7 @@ static const VMStateDescription vmstate_stm32f2xx_adc = {
         VMSTATE_UINT32_ARRAY(adc_jdr, STM32F2XXADCState, 4),
         VMSTATE_UINT32(adc_dr, STM32F2XXADCState),
         VMSTATE_BOOL(stm32f1xx, STM32F2XXADCState),
+        VMSTATE_UINT8_V(seq_idx, STM32F2XXADCState, 2),
         VMSTATE_END_OF_LIST()
     }
 };
@@ -285,6 +312,13 @@ static Property stm32f2xx_adc_properties[] = {
     DEFINE_PROP_END_OF_LIST(),
 };
 
+void stm32f2xx_adc_set_sampler(STM32F2XXADCState *s, STM32F2XXADCSample fn,
+                               void *opaque)
+{
+    s->sample = fn;
+    s->sample_opaque = opaque;
+}
+
 static void stm32f2xx_adc_init(Object *obj)
 {
     STM32F2XXADCState *s = STM32F2XX_ADC(obj);
@@ -17,10 +17,13 @@
 #include "hw/qdev-properties.h"
 #include "elf.h"
 #include "sysemu/qtest.h"
+#include "sysemu/tcg.h"
 #include "sysemu/reset.h"
 #include "qemu/error-report.h"
 #include "qemu/module.h"
 #include "exec/address-spaces.h"
+#include "exec/ram_addr.h"
+#include "qemu/atomic.h"
 #include "target/arm/idau.h"
 
 /* Bitbanded IO.  Each word corresponds to a single bit.  */
@@ -31,25 +34,127 @@ static inline hwaddr bitband_addr(BitBandState *s, hwaddr offset)
     return s->base | (offset & 0x1ffffff) >> 5;
 }
 
+/*
+ * Find the part of the source window holding [addr, addr + size), or
+ * NULL if the access is not contained in a single section.
+ */
+static BitBandSection *bitband_find_section(BitBandState *s, hwaddr addr,
+                                            unsigned size)
+{
+    BitBandSection *bs;
+    unsigned lo = 0, hi = s->sections->len, mid;
+
+    if (s->last_section < hi) {
+        bs = &g_array_index(s->sections, BitBandSection, s->last_section);
+        if (addr >= bs->start && addr - bs->start < bs->size) {
+            goto found;
+        }
+    }
+
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        bs = &g_array_index(s->sections, BitBandSection, mid);
+        if (addr < bs->start) {
+            hi = mid;
+        } else if (addr - bs->start >= bs->size) {
+            lo = mid + 1;
+        } else {
+            s->last_section = mid;
+            goto found;
+        }
+    }
+    return NULL;
+
+found:
+    return addr - bs->start + size <= bs->size ? bs : NULL;
+}
+
+/* RAM which can be accessed through its host pointer */
+static bool bitband_section_is_ram(BitBandSection *bs)
+{
+    return memory_region_is_ram(bs->mr) &&
+        !memory_region_is_ram_device(bs->mr);
+}
+
+/* Device registers, which can be accessed by calling the region's ops */
+static bool bitband_section_is_mmio(BitBandSection *bs)
+{
+    return !memory_region_is_ram(bs->mr) && !memory_region_is_romd(bs->mr) &&
+        !memory_region_is_iommu(bs->mr);
+}
+
+static void bitband_listener_begin(MemoryListener *listener)
+{
+    BitBandState *s = container_of(listener, BitBandState, listener);
+
+    g_array_set_size(s->sections, 0);
+    s->last_section = 0;
+}
+
+static void bitband_listener_region_add(MemoryListener *listener,
+                                        MemoryRegionSection *section)
+{
+    BitBandState *s = container_of(listener, BitBandState, listener);
+    hwaddr start = MAX(section->offset_within_address_space, s->base);
+    Int128 end;
+    BitBandSection bs;
+
+    end = int128_add(int128_make64(section->offset_within_address_space),
+                     section->size);
+    end = int128_min(end, int128_make64(s->base + BITBAND_SOURCE_SIZE));
+    if (int128_le(end, int128_make64(start))) {
+        return;
+    }
+
+    /* Sections are reported in ascending address order */
+    bs.mr = section->mr;
+    bs.start = start;
+    bs.size = int128_get64(int128_sub(end, int128_make64(start)));
+    bs.offset_within_region = section->offset_within_region +
+        (start - section->offset_within_address_space);
+    g_array_append_val(s->sections, bs);
+}
+
 static MemTxResult bitband_read(void *opaque, hwaddr offset,
                                 uint64_t *data, unsigned size, MemTxAttrs attrs)
 {
     BitBandState *s = opaque;
+    BitBandSection *bs;
     uint8_t buf[4];
     MemTxResult res;
+    uint64_t val;
     int bitpos, bit;
-    hwaddr addr;
+    hwaddr addr, xlat;
 
     assert(size <= 4);
 
     /* Find address in underlying memory and round down to multiple of size */
     addr = bitband_addr(s, offset) & (-size);
+    /* Bit position in the N bytes read... */
+    bitpos = (offset >> 2) & ((size * 8) - 1);
+
+    bs = bitband_find_section(s, addr, size);
+    if (bs) {
+        xlat = bs->offset_within_region + (addr - bs->start);
+        if (bitband_section_is_ram(bs)) {
+            uint8_t *p = memory_region_get_ram_ptr(bs->mr) + xlat;
+
+            *data = (atomic_read(p + (bitpos >> 3)) >> (bitpos & 7)) & 1;
+            return MEMTX_OK;
+        }
+        if (bitband_section_is_mmio(bs)) {
+            res = memory_region_dispatch_read(bs->mr, xlat, &val,
+                                              size_memop(size), attrs);
+            stn_he_p(buf, size, val);
+            goto extract;
+        }
+    }
+
     res = address_space_read(&s->source_as, addr, attrs, buf, size);
+extract:
     if (res) {
         return res;
     }
-    /* Bit position in the N bytes read... */
-    bitpos = (offset >> 2) & ((size * 8) - 1);
     /* ...converted to byte in buffer and bit in byte */
     bit = (buf[bitpos >> 3] >> (bitpos & 7)) & 1;
     *data = bit;
@@ -60,23 +165,65 @@ static MemTxResult bitband_write(void *opaque, hwaddr offset, uint64_t value,
                                  unsigned size, MemTxAttrs attrs)
 {
     BitBandState *s = opaque;
+    BitBandSection *bs;
     uint8_t buf[4];
     MemTxResult res;
+    uint64_t val;
     int bitpos, bit;
-    hwaddr addr;
+    hwaddr addr, xlat;
 
     assert(size <= 4);
 
     /* Find address in underlying memory and round down to multiple of size */
     addr = bitband_addr(s, offset) & (-size);
-    res = address_space_read(&s->source_as, addr, attrs, buf, size);
-    if (res) {
-        return res;
-    }
     /* Bit position in the N bytes read... */
     bitpos = (offset >> 2) & ((size * 8) - 1);
     /* ...converted to byte in buffer and bit in byte */
     bit = 1 << (bitpos & 7);
+
+    bs = bitband_find_section(s, addr, size);
+    if (bs) {
+        xlat = bs->offset_within_region + (addr - bs->start) + (bitpos >> 3);
+        /*
+         * Writable RAM can be updated in place, unless the page still
+         * needs to be marked dirty or has translated code on it.
+         */
+        if (bitband_section_is_ram(bs) && !memory_region_is_rom(bs->mr) &&
+            !cpu_physical_memory_range_includes_clean(
+                memory_region_get_ram_addr(bs->mr) + xlat, 1,
+                memory_region_get_dirty_log_mask(bs->mr))) {
+            uint8_t *p = memory_region_get_ram_ptr(bs->mr) + xlat;
+
+            if (value & 1) {
+                atomic_or(p, bit);
+            } else {
+                atomic_and(p, ~bit);
+            }
+            return MEMTX_OK;
+        }
+        if (bitband_section_is_mmio(bs)) {
+            xlat -= bitpos >> 3;
+            res = memory_region_dispatch_read(bs->mr, xlat, &val,
+                                              size_memop(size), attrs);
+            if (res) {
+                return res;
+            }
+            stn_he_p(buf, size, val);
+            if (value & 1) {
+                buf[bitpos >> 3] |= bit;
+            } else {
+                buf[bitpos >> 3] &= ~bit;
+            }
+            return memory_region_dispatch_write(bs->mr, xlat,
+                                                ldn_he_p(buf, size),
+                                                size_memop(size), attrs);
+        }
+    }
+
+    res = address_space_read(&s->source_as, addr, attrs, buf, size);
+    if (res) {
+        return res;
+    }
     if (value & 1) {
         buf[bitpos >> 3] |= bit;
     } else {
@@ -115,6 +262,14 @@ static void bitband_realize(DeviceState *dev, Error **errp)
     }
 
     address_space_init(&s->source_as, s->source_memory, "bitband-source");
+
+    s->sections = g_array_new(false, false, sizeof(BitBandSection));
+    s->listener = (MemoryListener) {
+        .begin = bitband_listener_begin,
+        .region_add = bitband_listener_region_add,
+        .region_nop = bitband_listener_region_add,
+    };
+    memory_listener_register(&s->listener, &s->source_as);
 }
 
 /* Board init.  */
@@ -237,6 +392,10 @@ static void armv7m_realize(DeviceState *dev, Error **errp)
     qdev_pass_gpios(DEVICE(&s->nvic), dev, "SYSRESETREQ");
     qdev_pass_gpios(DEVICE(&s->nvic), dev, "NMI");
 
+    if (s->pretranslate && tcg_enabled()) {
+        arm_v7m_pretranslate_init(s->cpu, s->nvic.num_irq);
+    }
+
     /* Wire the NVIC up to the CPU */
     sbd = SYS_BUS_DEVICE(&s->nvic);
     sysbus_connect_irq(sbd, 0,
@@ -280,6 +439,7 @@ static Property armv7m_properties[] = {
                      false),
     DEFINE_PROP_BOOL("vfp", ARMv7MState, vfp, true),
     DEFINE_PROP_BOOL("dsp", ARMv7MState, dsp, true),
+    DEFINE_PROP_BOOL("pretranslate", ARMv7MState, pretranslate, false),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -24,20 +24,237 @@
 
 #include "qemu/osdep.h"
 #include "qapi/error.h"
+#include "qapi/visitor.h"
 #include "hw/boards.h"
 #include "hw/qdev-properties.h"
 #include "qemu/error-report.h"
+#include "qemu/timer.h"
 #include "hw/arm/stm32f103_soc.h"
 #include "hw/arm/boot.h"
+#include "hw/misc/bed_probe.h"
+#include "hw/misc/printer_plant.h"
+#include "hw/misc/tmc22xx.h"
+#include "hw/or-irq.h"
+#include "sysemu/sysemu.h"
+
+#define GPIO_PORT(c) ((c) - 'A')
+
+/* TMC2209 drivers share UART4 (single wire, addressed by MS1/MS2) */
+#define TMC_USART       3
+#define TMC_BAUD_RATE   115200
+
+typedef struct MarlinStepperPins {
+    uint8_t slave_addr;
+    char step_port;
+    uint8_t step_pin;
+    char dir_port;
+    uint8_t dir_pin;
+    char en_port;
+    uint8_t en_pin;
+    char diag_port;
+    uint8_t diag_pin;
+} MarlinStepperPins;
+
+enum {
+    STEPPER_X,
+    STEPPER_Y,
+    STEPPER_Z,
+    STEPPER_E,
+};
+
+/* Stepper wiring follows the BTT SKR Mini E3 V2 layout */
+static const MarlinStepperPins stepper_pins[] = {
+    /* X */ { 0, 'B', 13, 'B', 12, 'B', 14, 'C', 0 },
+    /* Y */ { 2, 'B', 10, 'B', 2,  'B', 11, 'C', 1 },
+    /* Z */ { 1, 'B', 0,  'C', 5,  'B', 1,  'C', 2 },
+    /* E */ { 3, 'B', 3,  'B', 4,  'D', 2,  'C', 15 },
+};
+
+/* BLTouch: servo on PA1 (TIM2 CH2), signal on PC14 */
+#define PROBE_SERVO_PORT    'A'
+#define PROBE_SERVO_PIN     1
+#define PROBE_SERVO_TIMER   0
+#define PROBE_SERVO_CHANNEL 1
+#define PROBE_OUT_PORT      'C'
+#define PROBE_OUT_PIN       14
+
+/* Probe position relative to the nozzle, stock Ender-3 BLTouch mount */
+#define PROBE_X_OFFSET_UM   -44000
+#define PROBE_Y_OFFSET_UM   -6000
+#define PROBE_Z_OFFSET_UM   2000
+
+/* Heaters and part fan on MOSFET outputs, thermistors on PA0 and PC3 */
+#define HOTEND_HEATER_PORT  'C'
+#define HOTEND_HEATER_PIN   8
+#define BED_HEATER_PORT     'C'
+#define BED_HEATER_PIN      9
+#define FAN_PORT            'C'
+#define FAN_PIN             6
+#define HOTEND_ADC_CHANNEL  0
+#define BED_ADC_CHANNEL     13
+
+/*
+ * Sensorless homing: the endstop inputs double as DIAG inputs, so the
+ * physical switch and the driver DIAG output are OR'ed together.
+ */
+static void marlinboard_init_endstops(STM32F103State *soc, DeviceState **stop)
+{
+    const MarlinStepperPins *p;
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(stepper_pins); i++) {
+        p = &stepper_pins[i];
+
+        stop[i] = DEVICE(object_new(TYPE_OR_IRQ));
+        object_property_set_int(OBJECT(stop[i]), 2, "num-lines",
+                                &error_fatal);
+        qdev_init_nofail(stop[i]);
+        qdev_connect_gpio_out(stop[i], 0,
+            qdev_get_gpio_in(DEVICE(&soc->gpio[GPIO_PORT(p->diag_port)]),
+                             p->diag_pin));
+    }
+}
+
+static void marlinboard_init_steppers(STM32F103State *soc, Chardev *uart,
+                                      DeviceState **stop, DeviceState **tmc)
+{
+    const MarlinStepperPins *p;
+    char *name;
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(stepper_pins); i++) {
+        p = &stepper_pins[i];
+
+        tmc[i] = qdev_create(NULL, TYPE_TMC2209);
+        name = g_strdup_printf("stepper-%c", "xyze"[i]);
+        object_property_add_child(qdev_get_machine(), name, OBJECT(tmc[i]),
+                                  &error_abort);
+        g_free(name);
+        qdev_prop_set_uint8(tmc[i], "slave-addr", p->slave_addr);
+        if (uart) {
+            object_property_set_link(OBJECT(tmc[i]), OBJECT(uart), "uart",
+                                     &error_fatal);
+        }
+        qdev_init_nofail(tmc[i]);
+
+        qdev_connect_gpio_out(DEVICE(&soc->gpio[GPIO_PORT(p->step_port)]),
+                              p->step_pin,
+                              qdev_get_gpio_in_named(tmc[i], TMC22XX_STEP, 0));
+        qdev_connect_gpio_out(DEVICE(&soc->gpio[GPIO_PORT(p->dir_port)]),
+                              p->dir_pin,
+                              qdev_get_gpio_in_named(tmc[i], TMC22XX_DIR, 0));
+        qdev_connect_gpio_out(DEVICE(&soc->gpio[GPIO_PORT(p->en_port)]),
+                              p->en_pin,
+                              qdev_get_gpio_in_named(tmc[i], TMC22XX_ENN, 0));
+        qdev_connect_gpio_out_named(tmc[i], TMC22XX_DIAG, 0,
+                                    qdev_get_gpio_in(stop[i], 0));
+    }
+}
+
+static void marlinboard_init_probe(STM32F103State *soc, DeviceState **tmc)
+{
+    DeviceState *probe;
+
+    probe = qdev_create(NULL, TYPE_BLTOUCH);
+    object_property_set_link(OBJECT(probe), OBJECT(tmc[STEPPER_X]),
+                             "x-stepper", &error_fatal);
+    object_property_set_link(OBJECT(probe), OBJECT(tmc[STEPPER_Y]),
+                             "y-stepper", &error_fatal);
+    object_property_set_link(OBJECT(probe), OBJECT(tmc[STEPPER_Z]),
+                             "z-stepper", &error_fatal);
+    qdev_prop_set_int32(probe, "x-offset-um", PROBE_X_OFFSET_UM);
+    qdev_prop_set_int32(probe, "y-offset-um", PROBE_Y_OFFSET_UM);
+    qdev_prop_set_int32(probe, "z-offset-um", PROBE_Z_OFFSET_UM);
+    qdev_init_nofail(probe);
+
+    /* The servo pin is driven either by TIM2 CH2 or by a software servo */
+    qdev_connect_gpio_out_named(DEVICE(&soc->timer[PROBE_SERVO_TIMER]),
+                                STM32F2XX_TIMER_PWM, PROBE_SERVO_CHANNEL,
+                                qdev_get_gpio_in_named(probe,
+                                    BED_PROBE_SERVO_PULSE, 0));
+    qdev_connect_gpio_out(DEVICE(&soc->gpio[GPIO_PORT(PROBE_SERVO_PORT)]),
+                          PROBE_SERVO_PIN,
+                          qdev_get_gpio_in_named(probe, BED_PROBE_SERVO, 0));
+    qdev_connect_gpio_out_named(probe, BED_PROBE_OUT, 0,
+        qdev_get_gpio_in(DEVICE(&soc->gpio[GPIO_PORT(PROBE_OUT_PORT)]),
+                         PROBE_OUT_PIN));
+}
+
+static void marlinboard_init_plant(STM32F103State *soc, DeviceState **stop,
+                                  DeviceState **tmc)
+{
+    DeviceState *plant;
+    int i;
+
+    plant = qdev_create(NULL, TYPE_PRINTER_PLANT);
+    object_property_add_child(qdev_get_machine(), "plant", OBJECT(plant),
+                              &error_abort);
+    object_property_set_link(OBJECT(plant), OBJECT(tmc[STEPPER_X]),
+                             "x-stepper", &error_fatal);
+    object_property_set_link(OBJECT(plant), OBJECT(tmc[STEPPER_Y]),
+                             "y-stepper", &error_fatal);
+    object_property_set_link(OBJECT(plant), OBJECT(tmc[STEPPER_Z]),
+                             "z-stepper", &error_fatal);
+    qdev_prop_set_int32(plant, "hotend-adc-channel", HOTEND_ADC_CHANNEL);
+    qdev_prop_set_int32(plant, "bed-adc-channel", BED_ADC_CHANNEL);
+    qdev_init_nofail(plant);
+
+    qdev_connect_gpio_out(DEVICE(&soc->gpio[GPIO_PORT(HOTEND_HEATER_PORT)]),
+                          HOTEND_HEATER_PIN,
+                          qdev_get_gpio_in_named(plant, PRINTER_PLANT_HEATER,
+                                                 PRINTER_PLANT_HOTEND));
+    qdev_connect_gpio_out(DEVICE(&soc->gpio[GPIO_PORT(BED_HEATER_PORT)]),
+                          BED_HEATER_PIN,
+                          qdev_get_gpio_in_named(plant, PRINTER_PLANT_HEATER,
+                                                 PRINTER_PLANT_BED));
+    qdev_connect_gpio_out(DEVICE(&soc->gpio[GPIO_PORT(FAN_PORT)]), FAN_PIN,
+                          qdev_get_gpio_in_named(plant, PRINTER_PLANT_FAN, 0));
+
+    for (i = 0; i < PRINTER_PLANT_NUM_AXES; i++) {
+        qdev_connect_gpio_out_named(plant, PRINTER_PLANT_ENDSTOP, i,
+                                    qdev_get_gpio_in(stop[i], 1));
+    }
+
+    for (i = 0; i < STM_NUM_ADCS; i++) {
+        stm32f2xx_adc_set_sampler(&soc->adc[i], printer_plant_sample_adc,
+                                  plant);
+    }
+}
 
 static void marlinboard_init(MachineState *machine)
 {
     DeviceState *dev;
+    DeviceState *tmc[ARRAY_SIZE(stepper_pins)];
+    DeviceState *stop[ARRAY_SIZE(stepper_pins)];
+    STM32F103State *soc;
+    Chardev *tmc_uart = NULL;
 
     dev = qdev_create(NULL, TYPE_STM32F103_SOC);
+    soc = STM32F103_SOC(dev);
     qdev_prop_set_string(dev, "cpu-type", ARM_CPU_TYPE_NAME("cortex-m3"));
     object_property_set_str(OBJECT(dev), machine->kernel_filename, "firmware", &error_fatal);
+
+    /* Unless the user redirects UART4, it talks to the stepper drivers */
+    if (!serial_hd(TMC_USART)) {
+        tmc_uart = tmc22xx_uart_new("tmc-uart", TMC_BAUD_RATE, &error_fatal);
+        soc->usart_chr[TMC_USART] = tmc_uart;
+    }
+
     object_property_set_bool(OBJECT(dev), true, "realized", &error_fatal);
+
+    marlinboard_init_endstops(soc, stop);
+    marlinboard_init_steppers(soc, tmc_uart, stop, tmc);
+    marlinboard_init_probe(soc, tmc);
+    marlinboard_init_plant(soc, stop, tmc);
+}
+
+/* Simulated time, so that benchmarks can relate host time to it */
+static void marlinboard_get_vm_clock(Object *obj, Visitor *v, const char *name,
+                                     void *opaque, Error **errp)
+{
+    int64_t value = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+
+    visit_type_int64(v, name, &value, errp);
 }
 
 static void marlinboard_machine_init(MachineClass *mc)
@@ -45,6 +262,10 @@ static void marlinboard_machine_init(MachineClass *mc)
     mc->desc = "Marlin Firmware Board";
     mc->init = marlinboard_init;
     mc->ignore_memory_transaction_failures = true;
+
+    object_class_property_add(OBJECT_CLASS(mc), "vm-clock-ns", "int",
+                              marlinboard_get_vm_clock, NULL, NULL, NULL,
+                              &error_abort);
 }
 
 DEFINE_MACHINE("marlinboard", marlinboard_machine_init)
@@ -29,7 +29,10 @@
 #include "exec/address-spaces.h"
 #include "hw/arm/stm32f103_soc.h"
 #include "hw/qdev-properties.h"
+#include "hw/irq.h"
+#include "cpu.h"
 #include "sysemu/sysemu.h"
+#include "sysemu/runstate.h"
 
 /* At the moment only Timer 2 to 5 are modelled */
 static const uint32_t timer_addr[STM_NUM_TIMERS] = { 0x40000000, 0x40000400, 0x40000800, 0x40000C00 };
@@ -43,6 +46,7 @@ static const uint8_t dma_channel_num[STM_NUM_DMAS] = {7, 5};
 
 /* RCC module */
 static const uint32_t rcc_addr = 0x40021000;
+static const uint32_t flash_addr = 0x40022000;
 
 static const int timer_irq[STM_NUM_TIMERS] = {28, 29, 30, 50};
 static const int usart_irq[STM_NUM_USARTS] = {37, 38, 39, 52, 53};
@@ -54,6 +58,13 @@ static const int spi_irq[STM_NUM_SPIS] = {35, 36, 51};
 int8_t acd_req_map[] = {0, -1, 4};
 int8_t acd_dma_map[] = {0, -1, 1};
 
+static void do_sys_reset(void *opaque, int n, int level)
+{
+    if (level) {
+        qemu_system_reset_request(SHUTDOWN_CAUSE_GUEST_RESET);
+    }
+}
+
 static void stm32f103_soc_initfn(Object *obj)
 {
     STM32F103State *s = STM32F103_SOC(obj);
@@ -100,6 +111,14 @@ static void stm32f103_soc_initfn(Object *obj)
 
     sysbus_init_child_obj(obj, "rcc", &s->rcc, sizeof(s->rcc),
         TYPE_STM32F1XX_RCC);
+
+    sysbus_init_child_obj(obj, "flash", &s->flash, sizeof(s->flash),
+                          TYPE_STM32F1XX_FLASH);
+}
+
+static void stm32f103_soc_set_latency(void *opaque, int n, int level)
+{
+    arm_cpu_set_code_wait_states(opaque, level);
 }
 
 static void stm32f103_soc_realize(DeviceState *dev_soc, Error **errp)
@@ -139,9 +158,19 @@ static void stm32f103_soc_realize(DeviceState *dev_soc, Error **errp)
         error_propagate(errp, err);
         return;
     }
+
+    qdev_connect_gpio_out_named(DEVICE(&s->armv7m.nvic), "SYSRESETREQ", 0,
+                                qemu_allocate_irq(&do_sys_reset, NULL, 0));
+
     //Load firmware
     armv7m_load_kernel(s->armv7m.cpu, s->firmware, FLASH_SIZE);
 
+    if (s->flat_mem) {
+        arm_cpu_add_flat_region(s->armv7m.cpu, FLASH_BASE_ADDRESS, flash);
+        arm_cpu_add_flat_region(s->armv7m.cpu, 0, flash);
+        arm_cpu_add_flat_region(s->armv7m.cpu, SRAM_BASE_ADDRESS, sram);
+    }
+
     /* System configuration controller */
     dev = DEVICE(&s->syscfg);
     object_property_set_bool(OBJECT(&s->syscfg), true, "realized", &err);
@@ -177,7 +206,8 @@ static void stm32f103_soc_realize(DeviceState *dev_soc, Error **errp)
     /* Attach UART (uses USART registers) and USART controllers */
     for (i = 0; i < STM_NUM_USARTS; i++) {
         dev = DEVICE(&(s->usart[i]));
-        qdev_prop_set_chr(dev, "chardev", serial_hd(i));
+        qdev_prop_set_chr(dev, "chardev",
+                          s->usart_chr[i] ? s->usart_chr[i] : serial_hd(i));
         object_property_set_bool(OBJECT(&s->usart[i]), true, "realized", &err);
         if (err != NULL) {
             error_propagate(errp, err);
@@ -191,7 +221,8 @@ static void stm32f103_soc_realize(DeviceState *dev_soc, Error **errp)
     /* Timer 2 to 5 */
     for (i = 0; i < STM_NUM_TIMERS; i++) {
         dev = DEVICE(&(s->timer[i]));
-        qdev_prop_set_uint64(dev, "clock-frequency", 1000000000);
+        qdev_prop_set_uint64(dev, "clock-frequency",
+                             STM32F103_TIMER_CLOCK_HZ);
         object_property_set_bool(OBJECT(&s->timer[i]), true, "realized", &err);
         if (err != NULL) {
             error_propagate(errp, err);
@@ -276,11 +307,25 @@ static void stm32f103_soc_realize(DeviceState *dev_soc, Error **errp)
         busdev = SYS_BUS_DEVICE(dev);
         sysbus_mmio_map(busdev, 0, rcc_addr);
     }
+
+    /* Flash interface, ACR latency feeds the CPU's cycle timing */
+    dev = DEVICE(&s->flash);
+    object_property_set_bool(OBJECT(&s->flash), true, "realized", &err);
+    if (err != NULL) {
+        error_propagate(errp, err);
+        return;
+    }
+    busdev = SYS_BUS_DEVICE(dev);
+    sysbus_mmio_map(busdev, 0, flash_addr);
+    qdev_connect_gpio_out_named(dev, STM32F1XX_FLASH_LATENCY, 0,
+                                qemu_allocate_irq(stm32f103_soc_set_latency,
+                                                  s->armv7m.cpu, 0));
 }
 
 static Property stm32f103_soc_properties[] = {
     DEFINE_PROP_STRING("cpu-type", STM32F103State, cpu_type),
     DEFINE_PROP_STRING("firmware", STM32F103State, firmware),
+    DEFINE_PROP_BOOL("flat-mem", STM32F103State, flat_mem, false),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -152,7 +152,7 @@ static void uart_receive(void *opaque, const uint8_t *buf, int size)
 
 static uint64_t uart_read(void *opaque, hwaddr offset, unsigned size)
 {
-    CMSDKAPBUART *s = CMSDK_APB_UART(opaque);
+    CMSDKAPBUART *s = opaque;
     uint64_t r;
 
     switch (offset) {
@@ -240,7 +240,7 @@ static void uart_cancel_transmit(CMSDKAPBUART *s)
 static void uart_write(void *opaque, hwaddr offset, uint64_t value,
                        unsigned size)
 {
-    CMSDKAPBUART *s = CMSDK_APB_UART(opaque);
+    CMSDKAPBUART *s = opaque;
 
     trace_cmsdk_apb_uart_write(offset, value, size);
 
@@ -322,7 +322,8 @@ static void cmsdk_apb_uart_init(Object *obj)
     SysBusDevice *sbd = SYS_BUS_DEVICE(obj);
     CMSDKAPBUART *s = CMSDK_APB_UART(obj);
 
-    memory_region_init_io(&s->iomem, obj, &uart_ops, s, "uart", 0x1000);
+    memory_region_init_io_typed(&s->iomem, obj, &uart_ops, s,
+                                TYPE_CMSDK_APB_UART, "uart", 0x1000);
     sysbus_init_mmio(sbd, &s->iomem);
     sysbus_init_irq(sbd, &s->txint);
     sysbus_init_irq(sbd, &s->rxint);
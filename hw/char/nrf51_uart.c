@@ -39,7 +39,7 @@ static void nrf51_uart_update_irq(NRF51UARTState *s)
 
 static uint64_t uart_read(void *opaque, hwaddr addr, unsigned int size)
 {
-    NRF51UARTState *s = NRF51_UART(opaque);
+    NRF51UARTState *s = opaque;
     uint64_t r;
 
     if (!s->enabled) {
@@ -112,7 +112,7 @@ static void uart_cancel_transmit(NRF51UARTState *s)
 static void uart_write(void *opaque, hwaddr addr,
                        uint64_t value, unsigned int size)
 {
-    NRF51UARTState *s = NRF51_UART(opaque);
+    NRF51UARTState *s = opaque;
 
     trace_nrf51_uart_write(addr, value, size);
 
@@ -269,8 +269,8 @@ static void nrf51_uart_init(Object *obj)
     NRF51UARTState *s = NRF51_UART(obj);
     SysBusDevice *sbd = SYS_BUS_DEVICE(obj);
 
-    memory_region_init_io(&s->iomem, obj, &uart_ops, s,
-                          "nrf51_soc.uart", UART_SIZE);
+    memory_region_init_io_typed(&s->iomem, obj, &uart_ops, s,
+                                TYPE_NRF51_UART, "nrf51_soc.uart", UART_SIZE);
     sysbus_init_mmio(sbd, &s->iomem);
     sysbus_init_irq(sbd, &s->irq);
 }
@@ -27,6 +27,7 @@
 #include "hw/irq.h"
 #include "hw/qdev-properties.h"
 #include "qemu/log.h"
+#include "qemu/main-loop.h"
 #include "qemu/module.h"
 
 #ifndef STM_USART_ERR_DEBUG
@@ -41,24 +42,76 @@
 
 #define DB_PRINT(fmt, args...) DB_PRINT_L(1, fmt, ## args)
 
+/*
+ * Locking: the registers are protected by s->lock, so that MMIO does not
+ * need the BQL.  The interrupt line and the chardev are only touched with
+ * the BQL held, by stm32f2xx_usart_update() and for transmission.
+ */
+
+/* Bring the interrupt line and the chardev in line with the registers. */
+static void stm32f2xx_usart_update(STM32F2XXUsartState *s)
+{
+    bool release_lock = !qemu_mutex_iothread_locked();
+    bool level, changed, accept;
+
+    if (release_lock) {
+        qemu_mutex_lock_iothread();
+    }
+
+    qemu_mutex_lock(&s->lock);
+    level = s->irq_level;
+    changed = level != s->irq_out;
+    s->irq_out = level;
+    accept = s->rx_throttled && !(s->usart_sr & USART_SR_RXNE);
+    if (accept) {
+        s->rx_throttled = false;
+    }
+    qemu_mutex_unlock(&s->lock);
+
+    if (changed) {
+        qemu_set_irq(s->irq, level);
+    }
+    if (accept) {
+        qemu_chr_fe_accept_input(&s->chr);
+    }
+
+    if (release_lock) {
+        qemu_mutex_unlock_iothread();
+    }
+}
+
+/* Whether stm32f2xx_usart_update() has anything to do, with s->lock held */
+static bool stm32f2xx_usart_needs_update(STM32F2XXUsartState *s)
+{
+    return s->irq_level != s->irq_out ||
+           (s->rx_throttled && !(s->usart_sr & USART_SR_RXNE));
+}
+
 static int stm32f2xx_usart_can_receive(void *opaque)
 {
     STM32F2XXUsartState *s = opaque;
+    int ret = 0;
 
+    qemu_mutex_lock(&s->lock);
     if (!(s->usart_sr & USART_SR_RXNE)) {
-        return 1;
+        ret = 1;
+    } else {
+        s->rx_throttled = true;
     }
+    qemu_mutex_unlock(&s->lock);
 
-    return 0;
+    return ret;
 }
 
 static void stm32f2xx_usart_receive(void *opaque, const uint8_t *buf, int size)
 {
     STM32F2XXUsartState *s = opaque;
 
+    qemu_mutex_lock(&s->lock);
     if (!(s->usart_cr1 & USART_CR1_UE && s->usart_cr1 & USART_CR1_RE)) {
         /* USART not enabled - drop the chars */
         DB_PRINT("Dropping the chars\n");
+        qemu_mutex_unlock(&s->lock);
         return;
     }
 
@@ -66,10 +119,13 @@ static void stm32f2xx_usart_receive(void *opaque, const uint8_t *buf, int size)
     s->usart_sr |= USART_SR_RXNE;
 
     if (s->usart_cr1 & USART_CR1_RXNEIE) {
-        qemu_set_irq(s->irq, 1);
+        s->irq_level = true;
     }
 
     DB_PRINT("Receiving: %c\n", s->usart_dr);
+    qemu_mutex_unlock(&s->lock);
+
+    stm32f2xx_usart_update(s);
 }
 
 static void stm32f2xx_usart_reset(DeviceState *dev)
@@ -83,28 +139,22 @@ static void stm32f2xx_usart_reset(DeviceState *dev)
     s->usart_cr2 = 0x00000000;
     s->usart_cr3 = 0x00000000;
     s->usart_gtpr = 0x00000000;
+    s->irq_level = false;
+    s->irq_out = false;
 
     qemu_set_irq(s->irq, 0);
 }
 
-static uint64_t stm32f2xx_usart_read(void *opaque, hwaddr addr,
-                                       unsigned int size)
+static uint64_t stm32f2xx_usart_read_locked(STM32F2XXUsartState *s,
+                                            hwaddr addr)
 {
-    STM32F2XXUsartState *s = opaque;
-    uint64_t retvalue;
-
-    DB_PRINT("Read 0x%"HWADDR_PRIx"\n", addr);
-
     switch (addr) {
     case USART_SR:
-        retvalue = s->usart_sr;
-        qemu_chr_fe_accept_input(&s->chr);
-        return retvalue;
+        return s->usart_sr;
     case USART_DR:
         DB_PRINT("Value: 0x%" PRIx32 ", %c\n", s->usart_dr, (char) s->usart_dr);
         s->usart_sr &= ~USART_SR_RXNE;
-        qemu_chr_fe_accept_input(&s->chr);
-        qemu_set_irq(s->irq, 0);
+        s->irq_level = false;
         return s->usart_dr & 0x3FF;
     case USART_BRR:
         return s->usart_brr;
@@ -125,15 +175,29 @@ static uint64_t stm32f2xx_usart_read(void *opaque, hwaddr addr,
     return 0;
 }
 
-static void stm32f2xx_usart_write(void *opaque, hwaddr addr,
-                                  uint64_t val64, unsigned int size)
+static uint64_t stm32f2xx_usart_read(void *opaque, hwaddr addr,
+                                       unsigned int size)
 {
     STM32F2XXUsartState *s = opaque;
-    uint32_t value = val64;
-    unsigned char ch;
+    uint64_t retvalue;
+    bool update;
 
-    DB_PRINT("Write 0x%" PRIx32 ", 0x%"HWADDR_PRIx"\n", value, addr);
+    DB_PRINT("Read 0x%"HWADDR_PRIx"\n", addr);
 
+    qemu_mutex_lock(&s->lock);
+    retvalue = stm32f2xx_usart_read_locked(s, addr);
+    update = stm32f2xx_usart_needs_update(s);
+    qemu_mutex_unlock(&s->lock);
+
+    if (update) {
+        stm32f2xx_usart_update(s);
+    }
+    return retvalue;
+}
+
+static void stm32f2xx_usart_write_locked(STM32F2XXUsartState *s, hwaddr addr,
+                                         uint32_t value)
+{
     switch (addr) {
     case USART_SR:
         if (value <= 0x3FF) {
@@ -144,15 +208,11 @@ static void stm32f2xx_usart_write(void *opaque, hwaddr addr,
             s->usart_sr &= value;
         }
         if (!(s->usart_sr & USART_SR_RXNE)) {
-            qemu_set_irq(s->irq, 0);
+            s->irq_level = false;
         }
         return;
     case USART_DR:
         if (value < 0xF000) {
-            ch = value;
-            /* XXX this blocks entire thread. Rewrite to use
-             * qemu_chr_fe_write and background I/O callbacks */
-            qemu_chr_fe_write_all(&s->chr, &ch, 1);
             /* XXX I/O are currently synchronous, making it impossible for
                software to observe transient states where TXE or TC aren't
                set. Unlike TXE however, which is read-only, software may
@@ -168,7 +228,7 @@ static void stm32f2xx_usart_write(void *opaque, hwaddr addr,
         s->usart_cr1 = value;
             if (s->usart_cr1 & USART_CR1_RXNEIE &&
                 s->usart_sr & USART_SR_RXNE) {
-                qemu_set_irq(s->irq, 1);
+                s->irq_level = true;
             }
         return;
     case USART_CR2:
@@ -186,6 +246,41 @@ static void stm32f2xx_usart_write(void *opaque, hwaddr addr,
     }
 }
 
+static void stm32f2xx_usart_write(void *opaque, hwaddr addr,
+                                  uint64_t val64, unsigned int size)
+{
+    STM32F2XXUsartState *s = opaque;
+    uint32_t value = val64;
+    unsigned char ch;
+    bool update;
+
+    DB_PRINT("Write 0x%" PRIx32 ", 0x%"HWADDR_PRIx"\n", value, addr);
+
+    if (addr == USART_DR && value < 0xF000) {
+        bool release_lock = !qemu_mutex_iothread_locked();
+
+        ch = value;
+        if (release_lock) {
+            qemu_mutex_lock_iothread();
+        }
+        /* XXX this blocks entire thread. Rewrite to use
+         * qemu_chr_fe_write and background I/O callbacks */
+        qemu_chr_fe_write_all(&s->chr, &ch, 1);
+        if (release_lock) {
+            qemu_mutex_unlock_iothread();
+        }
+    }
+
+    qemu_mutex_lock(&s->lock);
+    stm32f2xx_usart_write_locked(s, addr, value);
+    update = stm32f2xx_usart_needs_update(s);
+    qemu_mutex_unlock(&s->lock);
+
+    if (update) {
+        stm32f2xx_usart_update(s);
+    }
+}
+
 static const MemoryRegionOps stm32f2xx_usart_ops = {
     .read = stm32f2xx_usart_read,
     .write = stm32f2xx_usart_write,
@@ -205,6 +300,7 @@ static void stm32f2xx_usart_init(Object *obj)
 
     memory_region_init_io(&s->mmio, obj, &stm32f2xx_usart_ops, s,
                           TYPE_STM32F2XX_USART, 0x400);
+    memory_region_clear_global_locking(&s->mmio);
     sysbus_init_mmio(SYS_BUS_DEVICE(obj), &s->mmio);
 }
 
@@ -212,6 +308,7 @@ static void stm32f2xx_usart_realize(DeviceState *dev, Error **errp)
 {
     STM32F2XXUsartState *s = STM32F2XX_USART(dev);
 
+    qemu_mutex_init(&s->lock);
     qemu_chr_fe_set_handlers(&s->chr, stm32f2xx_usart_can_receive,
                              stm32f2xx_usart_receive, NULL, NULL,
                              s, NULL, true);
@@ -35,6 +35,11 @@ static void or_irq_handler(void *opaque, int n, int level)
     int or_level = 0;
     int i;
 
+    /*
+     * Inputs may be driven without the BQL, see stm32f1xx_gpio.c; the
+     * lock also keeps output changes in the order they were computed.
+     */
+    qemu_mutex_lock(&s->lock);
     s->levels[n] = level;
 
     for (i = 0; i < s->num_lines; i++) {
@@ -42,6 +47,7 @@ static void or_irq_handler(void *opaque, int n, int level)
     }
 
     qemu_set_irq(s->out_irq, or_level);
+    qemu_mutex_unlock(&s->lock);
 }
 
 static void or_irq_reset(DeviceState *dev)
@@ -67,6 +73,7 @@ static void or_irq_init(Object *obj)
 {
     qemu_or_irq *s = OR_IRQ(obj);
 
+    qemu_mutex_init(&s->lock);
     qdev_init_gpio_out(DEVICE(obj), &s->out_irq, 1);
 }
 
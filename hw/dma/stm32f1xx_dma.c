@@ -89,9 +89,14 @@
 #define DMA_DATASIZE_16 (0x1)
 #define DMA_DATASIZE_32 (0x2)
 
-static uint64_t stm32f1xx_dma_read(void *opaque, hwaddr addr, unsigned int size)
+/*
+ * Locking: the registers are protected by s->lock, so that MMIO does not
+ * need the BQL.  Requests come from other devices with the BQL held; the
+ * transfer itself is done without s->lock, as it may access the
+ * controller's own registers.
+ */
+static uint64_t stm32f1xx_dma_read_locked(STM32F1XXDMAState *s, hwaddr addr)
 {
-    STM32F1XXDMAState *s = opaque;
     if(DMA_ISR == addr) {
         return s->isr;
     }
@@ -120,12 +125,21 @@ static uint64_t stm32f1xx_dma_read(void *opaque, hwaddr addr, unsigned int size)
     return 0;
 }
 
-
-static void stm32f1xx_dma_write(void *opaque, hwaddr addr, uint64_t val64, unsigned int size)
+static uint64_t stm32f1xx_dma_read(void *opaque, hwaddr addr, unsigned int size)
 {
-    uint32_t val32 = val64 & 0xFFFFFFFF;
     STM32F1XXDMAState *s = opaque;
+    uint64_t val;
+
+    qemu_mutex_lock(&s->lock);
+    val = stm32f1xx_dma_read_locked(s, addr);
+    qemu_mutex_unlock(&s->lock);
+    return val;
+}
 
+
+static void stm32f1xx_dma_write_locked(STM32F1XXDMAState *s, hwaddr addr,
+                                       uint32_t val32)
+{
     if(DMA_ISR == addr) {
         s->isr = val32;
     }
@@ -158,10 +172,20 @@ static void stm32f1xx_dma_write(void *opaque, hwaddr addr, uint64_t val64, unsig
     }
 }
 
+static void stm32f1xx_dma_write(void *opaque, hwaddr addr, uint64_t val64, unsigned int size)
+{
+    STM32F1XXDMAState *s = opaque;
+
+    qemu_mutex_lock(&s->lock);
+    stm32f1xx_dma_write_locked(s, addr, val64 & 0xFFFFFFFF);
+    qemu_mutex_unlock(&s->lock);
+}
+
 static void handle_dma_request(void *opaque, int channel, int level)
 {
     STM32F1XXDMAState *s = opaque;
     STM32F1XXDMAChan *chan;
+    STM32F1XXDMAChan cur;
     uint8_t dir;
     uint8_t msize;
     uint8_t psize;
@@ -175,12 +199,17 @@ static void handle_dma_request(void *opaque, int channel, int level)
 
     //Invalid channel index
     if((channel < 0) || (channel >= s->channel_count)) return;
-    if(0 == (chan->ccr & DMA_CCR_EN)) return;
-    if(0 == chan->cndtr) return;
 
-    dir = (chan->ccr & DMA_CCR_DIR);
-    psize = (chan->ccr & DMA_CCR_PSIZE) >> DMA_CCR_PSIZE_SHIFT;
-    msize = (chan->ccr & DMA_CCR_MSIZE) >> DMA_CCR_MSIZE_SHIFT;
+    qemu_mutex_lock(&s->lock);
+    cur = *chan;
+    qemu_mutex_unlock(&s->lock);
+
+    if(0 == (cur.ccr & DMA_CCR_EN)) return;
+    if(0 == cur.cndtr) return;
+
+    dir = (cur.ccr & DMA_CCR_DIR);
+    psize = (cur.ccr & DMA_CCR_PSIZE) >> DMA_CCR_PSIZE_SHIFT;
+    msize = (cur.ccr & DMA_CCR_MSIZE) >> DMA_CCR_MSIZE_SHIFT;
 
     if (psize == DMA_DATASIZE_8)         pmask = 0xFFFFFFFF;
     else if (psize == DMA_DATASIZE_16)   pmask = 0xFFFFFFFE;
@@ -192,15 +221,15 @@ static void handle_dma_request(void *opaque, int channel, int level)
 
     if(dir)
     {
-        data = ldl_le_phys(&s->dma_as, chan->cmar & mmask);
-        dst_data = ldl_le_phys(&s->dma_as, chan->cpar & pmask);
+        data = ldl_le_phys(&s->dma_as, cur.cmar & mmask);
+        dst_data = ldl_le_phys(&s->dma_as, cur.cpar & pmask);
         src_size = msize; dst_size = psize;
 
     }
     else
     {
-        data = ldl_le_phys(&s->dma_as, chan->cpar & pmask);
-        dst_data = ldl_le_phys(&s->dma_as, chan->cmar & mmask);
+        data = ldl_le_phys(&s->dma_as, cur.cpar & pmask);
+        dst_data = ldl_le_phys(&s->dma_as, cur.cmar & mmask);
         src_size = psize; dst_size = msize;
     }
 
@@ -214,13 +243,20 @@ static void handle_dma_request(void *opaque, int channel, int level)
 
     if(dir)
     {
-        stl_le_phys(&s->dma_as, chan->cpar & pmask, dst_data);
+        stl_le_phys(&s->dma_as, cur.cpar & pmask, dst_data);
     }
     else
     {
-        stl_le_phys(&s->dma_as, chan->cmar & mmask, dst_data);
+        stl_le_phys(&s->dma_as, cur.cmar & mmask, dst_data);
     }
 
+    qemu_mutex_lock(&s->lock);
+    /* Leave the channel alone if the guest reprogrammed it meanwhile */
+    if(chan->ccr != cur.ccr || chan->cndtr != cur.cndtr)
+    {
+        qemu_mutex_unlock(&s->lock);
+        return;
+    }
     if(chan->ccr & DMA_CCR_MINC) chan->cmar++;
     if(chan->ccr & DMA_CCR_PINC) chan->cpar++;
 
@@ -232,6 +268,7 @@ static void handle_dma_request(void *opaque, int channel, int level)
             chan->cndtr = chan->reload_cndtr;
         }
     }
+    qemu_mutex_unlock(&s->lock);
 }
 
 static const MemoryRegionOps stm32f1xx_dma_ops = {
@@ -275,6 +312,7 @@ static void stm32f1xx_dma_init(Object *obj)
 
     memory_region_init_io(&s->mmio_dma, OBJECT(s), &stm32f1xx_dma_ops, s,
                           TYPE_STM32F1XX_DMA, 0x400);
+    memory_region_clear_global_locking(&s->mmio_dma);
     sysbus_init_mmio(SYS_BUS_DEVICE(s), &s->mmio_dma);
 
     qdev_init_gpio_in_named(DEVICE(s), handle_dma_request, STM32F1XX_DMA_REQUEST_SLOTS, STM32F1XX_DMA_MAXCHANS);
@@ -294,6 +332,8 @@ static void stm32f1xx_dma_realize(DeviceState *dev, Error **errp)
     Object *obj;
     Error *err = NULL;
 
+    qemu_mutex_init(&s->lock);
+
     obj = object_property_get_link(OBJECT(dev), "dma-mr", &err);
     if (obj == NULL) return;
     s->dma_mr = MEMORY_REGION(obj);
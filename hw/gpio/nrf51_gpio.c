@@ -136,7 +136,7 @@ static void reflect_dir_bit_in_cnf(NRF51GPIOState *s)
 
 static uint64_t nrf51_gpio_read(void *opaque, hwaddr offset, unsigned int size)
 {
-    NRF51GPIOState *s = NRF51_GPIO(opaque);
+    NRF51GPIOState *s = opaque;
     uint64_t r = 0;
     size_t idx;
 
@@ -172,7 +172,7 @@ static uint64_t nrf51_gpio_read(void *opaque, hwaddr offset, unsigned int size)
 static void nrf51_gpio_write(void *opaque, hwaddr offset,
                        uint64_t value, unsigned int size)
 {
-    NRF51GPIOState *s = NRF51_GPIO(opaque);
+    NRF51GPIOState *s = opaque;
     size_t idx;
 
     trace_nrf51_gpio_write(offset, value);
@@ -285,8 +285,8 @@ static void nrf51_gpio_init(Object *obj)
 {
     NRF51GPIOState *s = NRF51_GPIO(obj);
 
-    memory_region_init_io(&s->mmio, obj, &gpio_ops, s,
-            TYPE_NRF51_GPIO, NRF51_GPIO_SIZE);
+    memory_region_init_io_typed(&s->mmio, obj, &gpio_ops, s,
+            TYPE_NRF51_GPIO, TYPE_NRF51_GPIO, NRF51_GPIO_SIZE);
     sysbus_init_mmio(SYS_BUS_DEVICE(obj), &s->mmio);
 
     qdev_init_gpio_in(DEVICE(s), nrf51_gpio_set, NRF51_GPIO_PINS);
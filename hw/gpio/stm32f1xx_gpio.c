@@ -27,6 +27,19 @@
 #include "qemu/timer.h"
 #include "qapi/qapi-events-misc.h"
 
+/*
+ * Locking: the registers are protected by s->lock, so that MMIO does not
+ * need the BQL.  Output pins are driven by stm32f1xx_gpio_update_outputs(),
+ * which brings them in line with ODR under s->out_lock and without the
+ * BQL: the step, direction, heater and servo pins are toggled far too
+ * often to contend with the main loop.  out_level is updated under both
+ * locks, so whoever changes ODR after that sees the difference and drives
+ * the pins again.
+ *
+ * s->lock is never held while calling out, so devices on out[] may drive
+ * our inputs back.
+ */
+
 static uint32_t controlRegisterRead(STM32F1XXGPIOState *s, uint8_t isLow)
 {
     uint8_t offset = 0;
@@ -56,7 +69,7 @@ static void controlRegisterWrite(STM32F1XXGPIOState *s, uint8_t isLow, uint32_t
 
 static uint32_t readPortOutputData(STM32F1XXGPIOState *s)
 {
-    uint32_t value;
+    uint32_t value = 0;
     uint8_t ii;
     for(ii = 0; ii < GPIO_PIN_COUNT; ii++)
     {
@@ -79,15 +92,13 @@ struct STM32F1XX_GPIO_MESSAGE
 
 static void writePortOutputData(STM32F1XXGPIOState *s, uint32_t val)
 {
-    uint32_t ii = 0;
-    do {
-        uint8_t v = val & 1;
-        if(v != s->port[ii])
-        {
-            qapi_event_send_gpio_pin_change(s->port_id, ii, v);
-        }
-        s->port[ii++] = v;
-    } while (val >>= 1);
+    uint32_t ii;
+
+    /* Only the low 16 bits of ODR are implemented */
+    val &= 0xFFFF;
+    for (ii = 0; ii < GPIO_PIN_COUNT; ii++) {
+        s->port[ii] = (val >> ii) & 1;
+    }
 }
 
 static void writeSetReset(STM32F1XXGPIOState *s, uint16_t reset, uint16_t set)
@@ -100,14 +111,10 @@ static void writeSetReset(STM32F1XXGPIOState *s, uint16_t reset, uint16_t set)
 
         if(isSet)
         {
-            if(0 == s->port[ii])
-                qapi_event_send_gpio_pin_change(s->port_id, ii, s->port[ii]);
             s->port[ii] = 1;
         }
         else if(isReset)
         {
-            if(1 == s->port[ii])
-                qapi_event_send_gpio_pin_change(s->port_id, ii, s->port[ii]);
             s->port[ii] = 0;
         }
 
@@ -116,13 +123,48 @@ static void writeSetReset(STM32F1XXGPIOState *s, uint16_t reset, uint16_t set)
     }
 }
 
+/* Drive the output pins whose level differs from ODR. */
+static void stm32f1xx_gpio_update_outputs(STM32F1XXGPIOState *s)
+{
+    uint16_t level, changed;
+    int pin;
 
+    qemu_mutex_lock(&s->out_lock);
+    qemu_mutex_lock(&s->lock);
+    level = readPortOutputData(s);
+    changed = level ^ s->out_level;
+    s->out_level = level;
+    qemu_mutex_unlock(&s->lock);
 
-static uint64_t stm32f1xx_gpio_read(void *opaque, hwaddr offset, unsigned size)
+    for (pin = 0; changed; pin++, changed >>= 1) {
+        if (changed & 1) {
+            qapi_event_send_gpio_pin_change(s->port_id, pin,
+                                            (level >> pin) & 1);
+            qemu_set_irq(s->out[pin], (level >> pin) & 1);
+        }
+    }
+    qemu_mutex_unlock(&s->out_lock);
+}
+
+static void stm32f1xx_gpio_set_input(void *opaque, int pin, int level)
 {
     STM32F1XXGPIOState *s = STM32F1XX_GPIO(opaque);
+
+    qemu_mutex_lock(&s->lock);
+    if (level) {
+        s->idr |= (1 << pin);
+    } else {
+        s->idr &= ~(1 << pin);
+    }
+    qemu_mutex_unlock(&s->lock);
+}
+
+static uint64_t stm32f1xx_gpio_read(void *opaque, hwaddr offset, unsigned size)
+{
+    STM32F1XXGPIOState *s = opaque;
     uint32_t reg_value = 0;
 
+    qemu_mutex_lock(&s->lock);
     switch (offset) {
     case GPIO_CRL_ADDR:
         reg_value = controlRegisterRead(s, 1);
@@ -148,6 +190,7 @@ static uint64_t stm32f1xx_gpio_read(void *opaque, hwaddr offset, unsigned size)
     default:
         break;
     }
+    qemu_mutex_unlock(&s->lock);
 
     return reg_value;
 }
@@ -155,9 +198,11 @@ static uint64_t stm32f1xx_gpio_read(void *opaque, hwaddr offset, unsigned size)
 static void stm32f1xx_gpio_write(void *opaque, hwaddr offset, uint64_t value,
                            unsigned size)
 {
-    STM32F1XXGPIOState *s = STM32F1XX_GPIO(opaque);
+    STM32F1XXGPIOState *s = opaque;
     uint32_t value32 = value & 0xFFFFFFFF;
- 
+    bool update;
+
+    qemu_mutex_lock(&s->lock);
     switch (offset) {
     case GPIO_CRL_ADDR:
         controlRegisterWrite(s, 1, value32);
@@ -184,8 +229,12 @@ static void stm32f1xx_gpio_write(void *opaque, hwaddr offset, uint64_t value,
     default:
         break;
     }
+    update = readPortOutputData(s) != s->out_level;
+    qemu_mutex_unlock(&s->lock);
 
-    return;
+    if (update) {
+        stm32f1xx_gpio_update_outputs(s);
+    }
 }
 
 static const MemoryRegionOps stm32f1xx_gpio_ops = {
@@ -196,11 +245,21 @@ static const MemoryRegionOps stm32f1xx_gpio_ops = {
     .endianness = DEVICE_NATIVE_ENDIAN,
 };
 
+static int stm32f1xx_gpio_post_load(void *opaque, int version_id)
+{
+    STM32F1XXGPIOState *s = STM32F1XX_GPIO(opaque);
+
+    /* The devices on the other end of the pins restore their own levels */
+    s->out_level = readPortOutputData(s);
+    return 0;
+}
+
 static const VMStateDescription vmstate_stm32f1xx_gpio = {
     .name = TYPE_STM32F1XX_GPIO,
     .version_id = 1,
     .minimum_version_id = 1,
     .minimum_version_id_old = 1,
+    .post_load = stm32f1xx_gpio_post_load,
     .fields = (VMStateField[]) {
         VMSTATE_UINT8_ARRAY(    cnf,        STM32F1XXGPIOState, GPIO_PIN_COUNT),
         VMSTATE_UINT8_ARRAY(    mode,       STM32F1XXGPIOState, GPIO_PIN_COUNT),
@@ -228,16 +287,24 @@ static void stm32f1xx_gpio_reset(DeviceState *dev)
     s->idr          = 0;
     s->lck          = 0;
     s->lckk         = 0;
+    s->out_level    = 0;
 }
 
 static void stm32f1xx_gpio_realize(DeviceState *dev, Error **errp)
 {
     STM32F1XXGPIOState *s = STM32F1XX_GPIO(dev);
 
-    memory_region_init_io(&s->iomem, OBJECT(s), &stm32f1xx_gpio_ops, s,
-                          TYPE_STM32F1XX_GPIO, GPIO_MEM_SIZE);
+    memory_region_init_io_typed(&s->iomem, OBJECT(s), &stm32f1xx_gpio_ops, s,
+                                TYPE_STM32F1XX_GPIO, TYPE_STM32F1XX_GPIO,
+                                GPIO_MEM_SIZE);
+    memory_region_clear_global_locking(&s->iomem);
+    qemu_mutex_init(&s->lock);
+    qemu_mutex_init(&s->out_lock);
 
     sysbus_init_mmio(SYS_BUS_DEVICE(dev), &s->iomem);
+
+    qdev_init_gpio_in(dev, stm32f1xx_gpio_set_input, GPIO_PIN_COUNT);
+    qdev_init_gpio_out(dev, s->out, GPIO_PIN_COUNT);
 }
 
 static void stm32f1xx_gpio_class_init(ObjectClass *klass, void *data)
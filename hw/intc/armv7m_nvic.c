@@ -16,6 +16,7 @@
 #include "hw/sysbus.h"
 #include "migration/vmstate.h"
 #include "qemu/timer.h"
+#include "sysemu/cpus.h"
 #include "hw/intc/armv7m_nvic.h"
 #include "hw/irq.h"
 #include "hw/qdev-properties.h"
@@ -206,11 +207,67 @@ static int exc_group_prio(NVICState *s, int rawprio, bool targets_secure)
     return rawprio;
 }
 
+/* Update the pending and active maps after a change to @vec's
+ * enabled, pending or active fields
+ */
+static void nvic_vec_changed(NVICState *s, VecInfo *vec)
+{
+    long n;
+
+    if (vec >= s->sec_vectors && vec < s->sec_vectors + NVIC_INTERNAL_VECTORS) {
+        n = NVIC_SEC_MAP_BASE + (vec - s->sec_vectors);
+    } else {
+        n = vec - s->vectors;
+    }
+
+    if (vec->enabled && vec->pending) {
+        set_bit(n, s->pending_map);
+    } else {
+        clear_bit(n, s->pending_map);
+    }
+    if (vec->active) {
+        set_bit(n, s->active_map);
+    } else {
+        clear_bit(n, s->active_map);
+    }
+}
+
+/* Rebuild the pending and active maps, after bulk updates of the
+ * vector state (register writes covering several vectors, reset and
+ * migration)
+ */
+static void nvic_rebuild_maps(NVICState *s)
+{
+    int i;
+
+    bitmap_zero(s->pending_map, NVIC_MAP_BITS);
+    bitmap_zero(s->active_map, NVIC_MAP_BITS);
+
+    for (i = 1; i < s->num_irq; i++) {
+        nvic_vec_changed(s, &s->vectors[i]);
+    }
+    for (i = 1; i < NVIC_INTERNAL_VECTORS; i++) {
+        nvic_vec_changed(s, &s->sec_vectors[i]);
+    }
+}
+
+/* Fill @map with the exception numbers which are enabled and pending,
+ * or active, in either security bank.
+ */
+static void nvic_candidate_map(NVICState *s, unsigned long *map)
+{
+    bitmap_or(map, s->pending_map, s->active_map, s->num_irq);
+    map[0] |= (s->pending_map[BIT_WORD(NVIC_SEC_MAP_BASE)] |
+               s->active_map[BIT_WORD(NVIC_SEC_MAP_BASE)]) &
+              MAKE_64BIT_MASK(0, NVIC_INTERNAL_VECTORS);
+}
+
 /* Recompute vectpending and exception_prio for a CPU which implements
  * the Security extension
  */
 static void nvic_recompute_state_secure(NVICState *s)
 {
+    DECLARE_BITMAP(map, NVIC_MAX_VECTORS);
     int i, bank;
     int pend_prio = NVIC_NOEXC_PRIO;
     int active_prio = NVIC_NOEXC_PRIO;
@@ -227,7 +284,9 @@ static void nvic_recompute_state_secure(NVICState *s)
      * Annoyingly, now we have two prigroup values (for S and NS)
      * we can't do the loop comparison on raw priority values.
      */
-    for (i = 1; i < s->num_irq; i++) {
+    nvic_candidate_map(s, map);
+    for (i = find_next_bit(map, s->num_irq, 1); i < s->num_irq;
+         i = find_next_bit(map, s->num_irq, i + 1)) {
         for (bank = M_REG_S; bank >= M_REG_NS; bank--) {
             VecInfo *vec;
             int prio, subprio;
@@ -274,6 +333,7 @@ static void nvic_recompute_state_secure(NVICState *s)
 /* Recompute vectpending and exception_prio */
 static void nvic_recompute_state(NVICState *s)
 {
+    DECLARE_BITMAP(map, NVIC_MAX_VECTORS);
     int i;
     int pend_prio = NVIC_NOEXC_PRIO;
     int active_prio = NVIC_NOEXC_PRIO;
@@ -291,7 +351,9 @@ static void nvic_recompute_state(NVICState *s)
         return;
     }
 
-    for (i = 1; i < s->num_irq; i++) {
+    nvic_candidate_map(s, map);
+    for (i = find_next_bit(map, s->num_irq, 1); i < s->num_irq;
+         i = find_next_bit(map, s->num_irq, i + 1)) {
         VecInfo *vec = &s->vectors[i];
 
         if (vec->enabled && vec->pending && vec->prio < pend_prio) {
@@ -481,6 +543,100 @@ static void nvic_irq_update(NVICState *s)
     qemu_set_irq(s->excpout, lvl);
 }
 
+/*
+ * Interrupt timing statistics. Under icount the virtual clock can only
+ * be read at an I/O point, so samples from inside a TB (lazy FP stacking)
+ * are dropped rather than aborting.
+ */
+static int64_t nvic_stats_clock(NVICState *s)
+{
+    CPUState *cs = &s->cpu->parent_obj;
+
+    if (use_icount && cs->running && !cs->can_do_io) {
+        return -1;
+    }
+    return qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+}
+
+static void nvic_hist_add(NVICHistogram *h, int64_t start, int64_t end)
+{
+    uint64_t ns;
+    int idx;
+
+    if (start < 0 || end < start) {
+        return;
+    }
+    ns = end - start;
+    idx = ns < 128 ? 0 : MIN(63 - clz64(ns) - 6, NVIC_HIST_BUCKETS - 1);
+
+    if (!h->count || ns < h->min_ns) {
+        h->min_ns = ns;
+    }
+    h->max_ns = MAX(h->max_ns, ns);
+    h->total_ns += ns;
+    h->count++;
+    h->bucket[idx]++;
+}
+
+static void nvic_stats_pend(NVICState *s, int irq)
+{
+    s->stats[irq].pending_ns = nvic_stats_clock(s);
+}
+
+/*
+ * Register writes (ISPR/ICPR, SHCSR) set and clear pending bits directly;
+ * start the latency clock on a new pend and drop it when the pend is
+ * withdrawn, so a later activation is not charged with a stale sample.
+ */
+static void nvic_stats_sync_pending(NVICState *s, int start, int end)
+{
+    int irq;
+
+    for (irq = start; irq < end; irq++) {
+        bool pending = s->vectors[irq].pending ||
+            (exc_is_banked(irq) && s->sec_vectors[irq].pending);
+
+        if (!pending) {
+            s->stats[irq].pending_ns = -1;
+        } else if (s->stats[irq].pending_ns < 0) {
+            nvic_stats_pend(s, irq);
+        }
+    }
+}
+
+static void nvic_stats_activate(NVICState *s, int irq)
+{
+    NVICIrqStats *st = &s->stats[irq];
+    int running = s->cpu->env.v7m.exception;
+    int64_t now = nvic_stats_clock(s);
+
+    nvic_hist_add(&st->latency, st->pending_ns, now);
+    st->pending_ns = -1;
+    st->active_ns = now;
+
+    /*
+     * IPSR still holds the exception we are leaving: if it is still active
+     * we are preempting it, otherwise it has just returned and this is a
+     * tail-chain.
+     */
+    if (running > ARMV7M_EXCP_RESET) {
+        if (s->vectors[running].active ||
+            (exc_is_banked(running) && s->sec_vectors[running].active)) {
+            s->stats[running].preempted++;
+        } else {
+            st->tail_chained++;
+        }
+    }
+}
+
+static void nvic_stats_complete(NVICState *s, int irq)
+{
+    NVICIrqStats *st = &s->stats[irq];
+
+    nvic_hist_add(&st->duration, st->active_ns, nvic_stats_clock(s));
+    st->active_ns = -1;
+}
+
 /**
  * armv7m_nvic_clear_pending: mark the specified exception as not pending
  * @opaque: the NVIC
@@ -509,6 +665,8 @@ static void armv7m_nvic_clear_pending(void *opaque, int irq, bool secure)
     trace_nvic_clear_pending(irq, secure, vec->enabled, vec->prio);
     if (vec->pending) {
         vec->pending = 0;
+        nvic_vec_changed(s, vec);
+        s->stats[irq].pending_ns = -1;
         nvic_irq_update(s);
     }
 }
@@ -649,6 +807,8 @@ static void do_armv7m_nvic_set_pending(void *opaque, int irq, bool secure,
 
     if (!vec->pending) {
         vec->pending = 1;
+        nvic_vec_changed(s, vec);
+        nvic_stats_pend(s, irq);
         nvic_irq_update(s);
     }
 }
@@ -747,6 +907,8 @@ void armv7m_nvic_set_pending_lazyfp(void *opaque, int irq, bool secure)
     }
     if (!vec->pending) {
         vec->pending = 1;
+        nvic_vec_changed(s, vec);
+        nvic_stats_pend(s, irq);
         /*
          * We do not call nvic_irq_update(), because we know our caller
          * is going to handle causing us to take the exception by
@@ -783,8 +945,11 @@ void armv7m_nvic_acknowledge_irq(void *opaque)
 
     trace_nvic_acknowledge_irq(pending, s->vectpending_prio);
 
+    nvic_stats_activate(s, pending);
+
     vec->active = 1;
     vec->pending = 0;
+    nvic_vec_changed(s, vec);
 
     write_v7m_exception(env, s->vectpending);
 
@@ -879,13 +1044,16 @@ int armv7m_nvic_complete_irq(void *opaque, int irq, bool secure)
     }
 
     vec->active = 0;
+    nvic_stats_complete(s, irq);
     if (vec->level) {
         /* Re-pend the exception if it's still held high; only
          * happens for extenal IRQs
          */
         assert(irq >= NVIC_FIRST_IRQ);
         vec->pending = 1;
+        nvic_stats_pend(s, irq);
     }
+    nvic_vec_changed(s, vec);
 
     nvic_irq_update(s);
 
@@ -1561,6 +1729,7 @@ static void nvic_writel(NVICState *s, uint32_t offset, uint32_t value,
                     s->sec_vectors[ARMV7M_EXCP_HARD].prio = -1;
                     s->vectors[ARMV7M_EXCP_HARD].enabled = 0;
                 }
+                nvic_vec_changed(s, &s->vectors[ARMV7M_EXCP_HARD]);
             }
             nvic_irq_update(s);
         }
@@ -1674,6 +1843,8 @@ static void nvic_writel(NVICState *s, uint32_t offset, uint32_t value,
 
         /* TODO: this is RAZ/WI from NS if DEMCR.SDME is set */
         s->vectors[ARMV7M_EXCP_DEBUG].active = (value & (1 << 8)) != 0;
+        nvic_stats_sync_pending(s, ARMV7M_EXCP_NMI, NVIC_FIRST_IRQ);
+        nvic_rebuild_maps(s);
         nvic_irq_update(s);
         break;
     case 0xd2c: /* Hard Fault Status.  */
@@ -1731,6 +1902,15 @@ static void nvic_writel(NVICState *s, uint32_t offset, uint32_t value,
             qemu_log_mask(LOG_GUEST_ERROR, "MPU_CTRL: HFNMIENA and !ENABLE is "
                           "UNPREDICTABLE\n");
         }
+        if (cpu->num_flat_regions &&
+            ((cpu->env.v7m.mpu_ctrl[attrs.secure] ^ value) &
+             R_V7M_MPU_CTRL_ENABLE_MASK)) {
+            /*
+             * TBFLAG_M32_FLAT_MEM changes with the rebuilt hflags, but
+             * TBs already chained together would keep loading directly.
+             */
+            tb_flush(CPU(cpu));
+        }
         cpu->env.v7m.mpu_ctrl[attrs.secure]
             = value & (R_V7M_MPU_CTRL_ENABLE_MASK |
                        R_V7M_MPU_CTRL_HFNMIENA_MASK |
@@ -2248,6 +2428,7 @@ static MemTxResult nvic_sysreg_write(void *opaque, hwaddr addr,
             if (value & (1 << i) &&
                 (attrs.secure || s->itns[startvec + i])) {
                 s->vectors[startvec + i].enabled = setval;
+                nvic_vec_changed(s, &s->vectors[startvec + i]);
             }
         }
         nvic_irq_update(s);
@@ -2266,8 +2447,10 @@ static MemTxResult nvic_sysreg_write(void *opaque, hwaddr addr,
             if (value & (1 << i) &&
                 (attrs.secure || s->itns[startvec + i])) {
                 s->vectors[startvec + i].pending = setval;
+                nvic_vec_changed(s, &s->vectors[startvec + i]);
             }
         }
+        nvic_stats_sync_pending(s, startvec, MIN(startvec + end, s->num_irq));
         nvic_irq_update(s);
         goto exit_ok;
     case 0x300 ... 0x33f: /* NVIC Active */
@@ -2443,6 +2626,7 @@ static int nvic_post_load(void *opaque, int version_id)
         }
     }
 
+    nvic_rebuild_maps(s);
     nvic_recompute_state(s);
 
     return 0;
@@ -2532,6 +2716,7 @@ static Property props_nvic[] = {
 static void armv7m_nvic_reset(DeviceState *dev)
 {
     int resetprio;
+    int i;
     NVICState *s = NVIC(dev);
 
     memset(s->vectors, 0, sizeof(s->vectors));
@@ -2575,6 +2760,14 @@ static void armv7m_nvic_reset(DeviceState *dev)
      * So we leave it disabled to catch logic errors.
      */
 
+    memset(s->stats, 0, s->num_irq * sizeof(*s->stats));
+    for (i = 0; i < s->num_irq; i++) {
+        s->stats[i].pending_ns = -1;
+        s->stats[i].active_ns = -1;
+    }
+
+    nvic_rebuild_maps(s);
+
     s->exception_prio = NVIC_NOEXC_PRIO;
     s->vectpending = 0;
     s->vectpending_is_s_banked = false;
@@ -2587,8 +2780,6 @@ static void armv7m_nvic_reset(DeviceState *dev)
          * NVIC; we set the bits to true to avoid having to do a feature
          * bit check in the NVIC enable/pend/etc register accessors.
          */
-        int i;
-
         for (i = NVIC_FIRST_IRQ; i < ARRAY_SIZE(s->itns); i++) {
             s->itns[i] = true;
         }
@@ -2637,6 +2828,7 @@ static void armv7m_nvic_realize(DeviceState *dev, Error **errp)
 
     /* include space for internal exception vectors */
     s->num_irq += NVIC_FIRST_IRQ;
+    s->stats = g_new0(NVICIrqStats, s->num_irq);
 
     s->num_prio_bits = arm_feature(&s->cpu->env, ARM_FEATURE_V7) ? 8 : 2;
 
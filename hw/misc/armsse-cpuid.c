@@ -52,7 +52,7 @@ static const int sysinfo_id[] = {
 static uint64_t armsse_cpuid_read(void *opaque, hwaddr offset,
                                     unsigned size)
 {
-    ARMSSECPUID *s = ARMSSE_CPUID(opaque);
+    ARMSSECPUID *s = opaque;
     uint64_t r;
 
     switch (offset) {
@@ -102,8 +102,8 @@ static void armsse_cpuid_init(Object *obj)
     SysBusDevice *sbd = SYS_BUS_DEVICE(obj);
     ARMSSECPUID *s = ARMSSE_CPUID(obj);
 
-    memory_region_init_io(&s->iomem, obj, &armsse_cpuid_ops,
-                          s, "armsse-cpuid", 0x1000);
+    memory_region_init_io_typed(&s->iomem, obj, &armsse_cpuid_ops,
+                                s, TYPE_ARMSSE_CPUID, "armsse-cpuid", 0x1000);
     sysbus_init_mmio(sbd, &s->iomem);
 }
 
@@ -63,7 +63,7 @@ static void armsse_mhu_update(ARMSSEMHU *s)
 
 static uint64_t armsse_mhu_read(void *opaque, hwaddr offset, unsigned size)
 {
-    ARMSSEMHU *s = ARMSSE_MHU(opaque);
+    ARMSSEMHU *s = opaque;
     uint64_t r;
 
     switch (offset) {
@@ -102,7 +102,7 @@ static uint64_t armsse_mhu_read(void *opaque, hwaddr offset, unsigned size)
 static void armsse_mhu_write(void *opaque, hwaddr offset,
                              uint64_t value, unsigned size)
 {
-    ARMSSEMHU *s = ARMSSE_MHU(opaque);
+    ARMSSEMHU *s = opaque;
 
     trace_armsse_mhu_write(offset, value, size);
 
@@ -169,8 +169,8 @@ static void armsse_mhu_init(Object *obj)
     SysBusDevice *sbd = SYS_BUS_DEVICE(obj);
     ARMSSEMHU *s = ARMSSE_MHU(obj);
 
-    memory_region_init_io(&s->iomem, obj, &armsse_mhu_ops,
-                          s, "armsse-mhu", 0x1000);
+    memory_region_init_io_typed(&s->iomem, obj, &armsse_mhu_ops,
+                                s, TYPE_ARMSSE_MHU, "armsse-mhu", 0x1000);
     sysbus_init_mmio(sbd, &s->iomem);
     sysbus_init_irq(sbd, &s->cpu0irq);
     sysbus_init_irq(sbd, &s->cpu1irq);
@@ -0,0 +1,559 @@
+/*
+ * Bed levelling probes (BLTouch, inductive)
+ *
+ * Copyright (c) 2020 Taras Zakharchenko <taras.zakharchenko@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * The probe tip position is derived from the X/Y/Z stepper drivers'
+ * step integrators. Rather than checking the height on every Z step, the
+ * probe computes when the current Z move will cross the bed surface from
+ * the step rate and arms a single virtual clock deadline. The drivers'
+ * motion notifiers re-arm it when the rate or direction changes. While X
+ * or Y moves, the surface under the tip changes too, so the contact is
+ * also re-checked every BED_PROBE_XY_POLL_NS.
+ *
+ * The bed surface is a bilinearly interpolated heightmap given by the
+ * "mesh" property, rows separated by ';' and values by ',' in mm, which
+ * spans the bed from (0, 0) to (bed-x-um, bed-y-um).
+ */
+
+#include "qemu/osdep.h"
+#include <math.h>
+#include "qapi/error.h"
+#include "hw/irq.h"
+#include "hw/qdev-properties.h"
+#include "hw/misc/bed_probe.h"
+#include "migration/vmstate.h"
+#include "qemu/cutils.h"
+#include "qemu/log.h"
+#include "qemu/module.h"
+#include "trace.h"
+
+enum {
+    AXIS_X = 0,
+    AXIS_Y = 1,
+    AXIS_Z = 2,
+};
+
+/* Servo pulse mapping used by Marlin: 544 us at 0 deg, 2400 us at 180 deg */
+#define SERVO_MIN_US        544
+#define SERVO_MAX_US        2400
+#define SERVO_TOLERANCE     5
+
+enum {
+    BLTOUCH_CMD_NONE = -1,
+    BLTOUCH_CMD_DEPLOY = 10,
+    BLTOUCH_CMD_SW_MODE = 60,
+    BLTOUCH_CMD_STOW = 90,
+    BLTOUCH_CMD_SELFTEST = 120,
+    BLTOUCH_CMD_OD_MODE = 130,
+    BLTOUCH_CMD_5V_MODE = 140,
+    BLTOUCH_CMD_RESET = 160,
+};
+
+static const int bltouch_commands[] = {
+    BLTOUCH_CMD_DEPLOY, BLTOUCH_CMD_SW_MODE, BLTOUCH_CMD_STOW,
+    BLTOUCH_CMD_SELFTEST, BLTOUCH_CMD_OD_MODE, BLTOUCH_CMD_5V_MODE,
+    BLTOUCH_CMD_RESET,
+};
+
+/* Length of the trigger pulse outside of SW mode */
+#define BLTOUCH_PULSE_NS    (5 * SCALE_MS)
+
+/* Contact re-check interval while X or Y moves */
+#define BED_PROBE_XY_POLL_NS    SCALE_MS
+
+static double bed_probe_axis_mm(BedProbeState *s, int axis)
+{
+    double mm = s->start_um[axis] / 1000.0;
+
+    if (s->stepper[axis]) {
+        mm += (double)tmc22xx_get_position(s->stepper[axis]) /
+              s->steps_per_mm[axis];
+    }
+
+    return mm;
+}
+
+static double bed_probe_mesh_at(BedProbeState *s, uint32_t row, uint32_t col)
+{
+    row = MIN(row, s->mesh_rows - 1);
+    col = MIN(col, s->mesh_cols - 1);
+
+    return s->mesh[row * s->mesh_cols + col];
+}
+
+/* Bed surface height at (x, y), in mm */
+static double bed_probe_bed_height(BedProbeState *s, double x, double y)
+{
+    double fx, fy, h0, h1;
+    uint32_t col, row;
+
+    if (!s->mesh) {
+        return 0;
+    }
+
+    fx = s->mesh_cols > 1 ? x * 1000 * (s->mesh_cols - 1) / s->bed_x_um : 0;
+    fy = s->mesh_rows > 1 ? y * 1000 * (s->mesh_rows - 1) / s->bed_y_um : 0;
+    fx = MIN(MAX(fx, 0), s->mesh_cols - 1);
+    fy = MIN(MAX(fy, 0), s->mesh_rows - 1);
+    col = fx;
+    row = fy;
+    fx -= col;
+    fy -= row;
+
+    h0 = bed_probe_mesh_at(s, row, col) * (1 - fx) +
+         bed_probe_mesh_at(s, row, col + 1) * fx;
+    h1 = bed_probe_mesh_at(s, row + 1, col) * (1 - fx) +
+         bed_probe_mesh_at(s, row + 1, col + 1) * fx;
+
+    return h0 * (1 - fy) + h1 * fy;
+}
+
+/* Highest Z stepper position at which the probe tip touches the bed */
+static int32_t bed_probe_trigger_steps(BedProbeState *s)
+{
+    double x = bed_probe_axis_mm(s, AXIS_X) + s->offset_um[AXIS_X] / 1000.0;
+    double y = bed_probe_axis_mm(s, AXIS_Y) + s->offset_um[AXIS_Y] / 1000.0;
+    double z = bed_probe_bed_height(s, x, y) + s->offset_um[AXIS_Z] / 1000.0;
+
+    return floor((z - s->start_um[AXIS_Z] / 1000.0) *
+                 s->steps_per_mm[AXIS_Z]);
+}
+
+static void bed_probe_set_output(BedProbeState *s, bool level)
+{
+    s->triggered = level;
+    qemu_set_irq(s->out, level ^ s->active_low);
+}
+
+static void bed_probe_contact(BedProbeState *s, bool below)
+{
+    BedProbeClass *bc = BED_PROBE_GET_CLASS(s);
+
+    trace_bed_probe_contact(tmc22xx_get_position(s->stepper[AXIS_Z]), below);
+
+    if (!bc->has_servo) {
+        bed_probe_set_output(s, below);
+        return;
+    }
+
+    if (below) {
+        /* The pin is pushed up: signal and stay retracted until commanded */
+        s->deployed = false;
+        bed_probe_set_output(s, true);
+        if (!s->sw_mode) {
+            timer_mod(s->pulse_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+                                      BLTOUCH_PULSE_NS);
+        }
+    }
+}
+
+static bool bed_probe_xy_moving(BedProbeState *s)
+{
+    int64_t last_step_ns, period_ns;
+    int axis;
+
+    for (axis = AXIS_X; axis <= AXIS_Y; axis++) {
+        if (s->stepper[axis] &&
+            tmc22xx_get_motion(s->stepper[axis], &last_step_ns, &period_ns)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void bed_probe_update(BedProbeState *s)
+{
+    TMC22xxState *z = s->stepper[AXIS_Z];
+    int32_t pos, target;
+    int64_t deadline, poll;
+    bool below;
+
+    timer_del(s->timer);
+
+    if (!z || !s->deployed) {
+        return;
+    }
+
+    pos = tmc22xx_get_position(z);
+    target = bed_probe_trigger_steps(s);
+    below = pos <= target;
+    if (below != s->below) {
+        s->below = below;
+        bed_probe_contact(s, below);
+        if (!s->deployed) {
+            return;
+        }
+    }
+
+    /* Only a move towards the other side of the surface changes state */
+    deadline = tmc22xx_predict_crossing(z, below ? target + 1 : target);
+    if (bed_probe_xy_moving(s)) {
+        poll = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + BED_PROBE_XY_POLL_NS;
+        deadline = deadline < 0 ? poll : MIN(deadline, poll);
+    }
+    if (deadline < 0) {
+        return;
+    }
+
+    trace_bed_probe_schedule(pos, target, deadline);
+    timer_mod(s->timer, deadline);
+}
+
+static void bed_probe_timer(void *opaque)
+{
+    BedProbeState *s = opaque;
+
+    qemu_mutex_lock(&s->lock);
+    bed_probe_update(s);
+    qemu_mutex_unlock(&s->lock);
+}
+
+static void bed_probe_motion(BedProbeState *s)
+{
+    qemu_mutex_lock(&s->lock);
+    bed_probe_update(s);
+    qemu_mutex_unlock(&s->lock);
+}
+
+static void bed_probe_x_motion(Notifier *n, void *data)
+{
+    bed_probe_motion(container_of(n, BedProbeState, x_motion));
+}
+
+static void bed_probe_y_motion(Notifier *n, void *data)
+{
+    bed_probe_motion(container_of(n, BedProbeState, y_motion));
+}
+
+static void bed_probe_z_motion(Notifier *n, void *data)
+{
+    bed_probe_motion(container_of(n, BedProbeState, z_motion));
+}
+
+static void bltouch_pulse_end(void *opaque)
+{
+    BedProbeState *s = opaque;
+
+    qemu_mutex_lock(&s->lock);
+    bed_probe_set_output(s, false);
+    qemu_mutex_unlock(&s->lock);
+}
+
+static void bltouch_command(BedProbeState *s, uint64_t pulse_ns)
+{
+    int64_t us = pulse_ns / 1000;
+    int angle, cmd = BLTOUCH_CMD_NONE;
+    int i;
+
+    if (us < SERVO_MIN_US / 2 || us > SERVO_MAX_US + SERVO_MIN_US / 2) {
+        /* Servo output off or out of range */
+        return;
+    }
+
+    angle = (us - SERVO_MIN_US) * 180 / (SERVO_MAX_US - SERVO_MIN_US);
+    for (i = 0; i < ARRAY_SIZE(bltouch_commands); i++) {
+        if (ABS(angle - bltouch_commands[i]) <= SERVO_TOLERANCE) {
+            cmd = bltouch_commands[i];
+            break;
+        }
+    }
+
+    /* Servo outputs repeat the same pulse, only act on a new command */
+    if (cmd == s->last_cmd) {
+        return;
+    }
+    s->last_cmd = cmd;
+    trace_bltouch_command(us, cmd);
+
+    switch (cmd) {
+    case BLTOUCH_CMD_DEPLOY:
+        s->deployed = true;
+        s->below = false;
+        timer_del(s->pulse_timer);
+        bed_probe_set_output(s, false);
+        bed_probe_update(s);
+        break;
+    case BLTOUCH_CMD_STOW:
+        s->deployed = false;
+        timer_del(s->timer);
+        timer_del(s->pulse_timer);
+        bed_probe_set_output(s, false);
+        break;
+    case BLTOUCH_CMD_SW_MODE:
+        s->sw_mode = true;
+        break;
+    case BLTOUCH_CMD_5V_MODE:
+    case BLTOUCH_CMD_OD_MODE:
+        break;
+    case BLTOUCH_CMD_RESET:
+        s->deployed = false;
+        s->sw_mode = false;
+        timer_del(s->timer);
+        timer_del(s->pulse_timer);
+        bed_probe_set_output(s, false);
+        break;
+    case BLTOUCH_CMD_SELFTEST:
+        qemu_log_mask(LOG_UNIMP, "%s: self test not implemented\n", __func__);
+        break;
+    default:
+        break;
+    }
+}
+
+static void bed_probe_servo(void *opaque, int n, int level)
+{
+    BedProbeState *s = opaque;
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+
+    qemu_mutex_lock(&s->lock);
+    if (level != s->servo_level) {
+        s->servo_level = level;
+        if (level) {
+            s->servo_rise_ns = now;
+        } else {
+            bltouch_command(s, now - s->servo_rise_ns);
+        }
+    }
+    qemu_mutex_unlock(&s->lock);
+}
+
+static void bed_probe_servo_pulse(void *opaque, int n, int level)
+{
+    BedProbeState *s = opaque;
+
+    qemu_mutex_lock(&s->lock);
+    bltouch_command(s, level);
+    qemu_mutex_unlock(&s->lock);
+}
+
+static void bed_probe_reset(DeviceState *dev)
+{
+    BedProbeState *s = BED_PROBE(dev);
+    BedProbeClass *bc = BED_PROBE_GET_CLASS(s);
+
+    timer_del(s->timer);
+    timer_del(s->pulse_timer);
+
+    s->deployed = !bc->has_servo;
+    s->below = false;
+    s->sw_mode = false;
+    s->last_cmd = BLTOUCH_CMD_NONE;
+    s->servo_level = false;
+    s->servo_rise_ns = 0;
+
+    bed_probe_set_output(s, false);
+}
+
+static void bed_probe_parse_mesh(BedProbeState *s, Error **errp)
+{
+    g_auto(GStrv) rows = g_strsplit(s->mesh_str, ";", 0);
+    uint32_t r, c, cols;
+    double v;
+
+    s->mesh_rows = g_strv_length(rows);
+    s->mesh_cols = 0;
+
+    for (r = 0; r < s->mesh_rows; r++) {
+        g_auto(GStrv) values = g_strsplit(rows[r], ",", 0);
+
+        cols = g_strv_length(values);
+        if (r == 0) {
+            s->mesh_cols = cols;
+            s->mesh = g_new0(double, s->mesh_rows * cols);
+        } else if (cols != s->mesh_cols) {
+            error_setg(errp, "mesh row %u has %u values, expected %u",
+                       r, cols, s->mesh_cols);
+            return;
+        }
+
+        for (c = 0; c < cols; c++) {
+            if (qemu_strtod_finite(values[c], NULL, &v) < 0) {
+                error_setg(errp, "invalid mesh value '%s'", values[c]);
+                return;
+            }
+            s->mesh[r * cols + c] = v;
+        }
+    }
+
+    if (!s->mesh_cols) {
+        error_setg(errp, "mesh must not be empty");
+    }
+}
+
+static void bed_probe_init(Object *obj)
+{
+    BedProbeState *s = BED_PROBE(obj);
+    DeviceState *dev = DEVICE(obj);
+
+    qemu_mutex_init(&s->lock);
+    qdev_init_gpio_out_named(dev, &s->out, BED_PROBE_OUT, 1);
+    if (BED_PROBE_GET_CLASS(s)->has_servo) {
+        qdev_init_gpio_in_named(dev, bed_probe_servo, BED_PROBE_SERVO, 1);
+        qdev_init_gpio_in_named(dev, bed_probe_servo_pulse,
+                                BED_PROBE_SERVO_PULSE, 1);
+    }
+}
+
+static void bed_probe_realize(DeviceState *dev, Error **errp)
+{
+    BedProbeState *s = BED_PROBE(dev);
+    Error *err = NULL;
+    int i;
+
+    for (i = 0; i < BED_PROBE_NUM_AXES; i++) {
+        if (!s->steps_per_mm[i]) {
+            error_setg(errp, "steps per mm must be non-zero");
+            return;
+        }
+    }
+
+    if (!s->bed_x_um || !s->bed_y_um) {
+        error_setg(errp, "bed size must be non-zero");
+        return;
+    }
+
+    if (s->mesh_str) {
+        bed_probe_parse_mesh(s, &err);
+        if (err) {
+            g_free(s->mesh);
+            s->mesh = NULL;
+            error_propagate(errp, err);
+            return;
+        }
+    }
+
+    s->timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, bed_probe_timer, s);
+    s->pulse_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, bltouch_pulse_end, s);
+
+    /* Without a Z stepper the probe never gets close to the bed */
+    if (s->stepper[AXIS_Z]) {
+        s->z_motion.notify = bed_probe_z_motion;
+        tmc22xx_add_motion_notifier(s->stepper[AXIS_Z], &s->z_motion);
+        if (s->stepper[AXIS_X]) {
+            s->x_motion.notify = bed_probe_x_motion;
+            tmc22xx_add_motion_notifier(s->stepper[AXIS_X], &s->x_motion);
+        }
+        if (s->stepper[AXIS_Y]) {
+            s->y_motion.notify = bed_probe_y_motion;
+            tmc22xx_add_motion_notifier(s->stepper[AXIS_Y], &s->y_motion);
+        }
+    }
+}
+
+static const VMStateDescription vmstate_bed_probe = {
+    .name = TYPE_BED_PROBE,
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_TIMER_PTR(timer, BedProbeState),
+        VMSTATE_TIMER_PTR(pulse_timer, BedProbeState),
+        VMSTATE_BOOL(deployed, BedProbeState),
+        VMSTATE_BOOL(triggered, BedProbeState),
+        VMSTATE_BOOL(below, BedProbeState),
+        VMSTATE_BOOL(sw_mode, BedProbeState),
+        VMSTATE_INT32(last_cmd, BedProbeState),
+        VMSTATE_BOOL(servo_level, BedProbeState),
+        VMSTATE_INT64(servo_rise_ns, BedProbeState),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static Property bed_probe_properties[] = {
+    DEFINE_PROP_LINK("x-stepper", BedProbeState, stepper[AXIS_X],
+                     TYPE_TMC22XX, TMC22xxState *),
+    DEFINE_PROP_LINK("y-stepper", BedProbeState, stepper[AXIS_Y],
+                     TYPE_TMC22XX, TMC22xxState *),
+    DEFINE_PROP_LINK("z-stepper", BedProbeState, stepper[AXIS_Z],
+                     TYPE_TMC22XX, TMC22xxState *),
+    DEFINE_PROP_UINT32("x-steps-per-mm", BedProbeState,
+                       steps_per_mm[AXIS_X], 80),
+    DEFINE_PROP_UINT32("y-steps-per-mm", BedProbeState,
+                       steps_per_mm[AXIS_Y], 80),
+    DEFINE_PROP_UINT32("z-steps-per-mm", BedProbeState,
+                       steps_per_mm[AXIS_Z], 400),
+    DEFINE_PROP_INT32("x-start-um", BedProbeState, start_um[AXIS_X], 0),
+    DEFINE_PROP_INT32("y-start-um", BedProbeState, start_um[AXIS_Y], 0),
+    DEFINE_PROP_INT32("z-start-um", BedProbeState, start_um[AXIS_Z], 10000),
+    DEFINE_PROP_INT32("x-offset-um", BedProbeState, offset_um[AXIS_X], 0),
+    DEFINE_PROP_INT32("y-offset-um", BedProbeState, offset_um[AXIS_Y], 0),
+    DEFINE_PROP_INT32("z-offset-um", BedProbeState, offset_um[AXIS_Z], 0),
+    DEFINE_PROP_UINT32("bed-x-um", BedProbeState, bed_x_um, 235000),
+    DEFINE_PROP_UINT32("bed-y-um", BedProbeState, bed_y_um, 235000),
+    DEFINE_PROP_STRING("mesh", BedProbeState, mesh_str),
+    DEFINE_PROP_BOOL("active-low", BedProbeState, active_low, false),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
+static void bed_probe_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->realize = bed_probe_realize;
+    dc->reset = bed_probe_reset;
+    dc->vmsd = &vmstate_bed_probe;
+    device_class_set_props(dc, bed_probe_properties);
+}
+
+static void bltouch_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+    BedProbeClass *bc = BED_PROBE_CLASS(klass);
+
+    dc->desc = "BLTouch servo deployed bed probe";
+    bc->has_servo = true;
+}
+
+static void inductive_probe_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+    BedProbeClass *bc = BED_PROBE_CLASS(klass);
+
+    dc->desc = "Inductive proximity bed probe";
+    bc->has_servo = false;
+}
+
+static const TypeInfo bed_probe_info = {
+    .name          = TYPE_BED_PROBE,
+    .parent        = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(BedProbeState),
+    .instance_init = bed_probe_init,
+    .class_size    = sizeof(BedProbeClass),
+    .class_init    = bed_probe_class_init,
+    .abstract      = true,
+};
+
+static const TypeInfo bltouch_info = {
+    .name          = TYPE_BLTOUCH,
+    .parent        = TYPE_BED_PROBE,
+    .class_init    = bltouch_class_init,
+};
+
+static const TypeInfo inductive_probe_info = {
+    .name          = TYPE_INDUCTIVE_PROBE,
+    .parent        = TYPE_BED_PROBE,
+    .class_init    = inductive_probe_class_init,
+};
+
+static void bed_probe_register_types(void)
+{
+    type_register_static(&bed_probe_info);
+    type_register_static(&bltouch_info);
+    type_register_static(&inductive_probe_info);
+}
+
+type_init(bed_probe_register_types)
@@ -129,7 +129,7 @@ static MemTxResult iotkit_secctl_s_read(void *opaque, hwaddr addr,
 {
     uint64_t r;
     uint32_t offset = addr & ~0x3;
-    IoTKitSecCtl *s = IOTKIT_SECCTL(opaque);
+    IoTKitSecCtl *s = opaque;
 
     switch (offset) {
     case A_AHBNSPPC0:
@@ -316,7 +316,7 @@ static MemTxResult iotkit_secctl_s_write(void *opaque, hwaddr addr,
                                          uint64_t value,
                                          unsigned size, MemTxAttrs attrs)
 {
-    IoTKitSecCtl *s = IOTKIT_SECCTL(opaque);
+    IoTKitSecCtl *s = opaque;
     uint32_t offset = addr;
     IoTKitSecCtlPPC *ppc;
 
@@ -437,7 +437,7 @@ static MemTxResult iotkit_secctl_ns_read(void *opaque, hwaddr addr,
                                          uint64_t *pdata,
                                          unsigned size, MemTxAttrs attrs)
 {
-    IoTKitSecCtl *s = IOTKIT_SECCTL(opaque);
+    IoTKitSecCtl *s = opaque;
     uint64_t r;
     uint32_t offset = addr & ~0x3;
 
@@ -499,7 +499,7 @@ static MemTxResult iotkit_secctl_ns_write(void *opaque, hwaddr addr,
                                           uint64_t value,
                                           unsigned size, MemTxAttrs attrs)
 {
-    IoTKitSecCtl *s = IOTKIT_SECCTL(opaque);
+    IoTKitSecCtl *s = opaque;
     uint32_t offset = addr;
     IoTKitSecCtlPPC *ppc;
 
@@ -702,10 +702,12 @@ static void iotkit_secctl_init(Object *obj)
                              IOTS_NUM_EXP_MSC);
     qdev_init_gpio_out_named(dev, &s->msc_irq, "msc_irq", 1);
 
-    memory_region_init_io(&s->s_regs, obj, &iotkit_secctl_s_ops,
-                          s, "iotkit-secctl-s-regs", 0x1000);
-    memory_region_init_io(&s->ns_regs, obj, &iotkit_secctl_ns_ops,
-                          s, "iotkit-secctl-ns-regs", 0x1000);
+    memory_region_init_io_typed(&s->s_regs, obj, &iotkit_secctl_s_ops,
+                                s, TYPE_IOTKIT_SECCTL,
+                                "iotkit-secctl-s-regs", 0x1000);
+    memory_region_init_io_typed(&s->ns_regs, obj, &iotkit_secctl_ns_ops,
+                                s, TYPE_IOTKIT_SECCTL,
+                                "iotkit-secctl-ns-regs", 0x1000);
     sysbus_init_mmio(sbd, &s->s_regs);
     sysbus_init_mmio(sbd, &s->ns_regs);
 }
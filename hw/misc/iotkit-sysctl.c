@@ -92,7 +92,7 @@ static void set_init_vtor(uint64_t cpuid, uint32_t vtor)
 static uint64_t iotkit_sysctl_read(void *opaque, hwaddr offset,
                                     unsigned size)
 {
-    IoTKitSysCtl *s = IOTKIT_SYSCTL(opaque);
+    IoTKitSysCtl *s = opaque;
     uint64_t r;
 
     switch (offset) {
@@ -216,7 +216,7 @@ static uint64_t iotkit_sysctl_read(void *opaque, hwaddr offset,
 static void iotkit_sysctl_write(void *opaque, hwaddr offset,
                                  uint64_t value, unsigned size)
 {
-    IoTKitSysCtl *s = IOTKIT_SYSCTL(opaque);
+    IoTKitSysCtl *s = opaque;
 
     trace_iotkit_sysctl_write(offset, value, size);
 
@@ -429,8 +429,8 @@ static void iotkit_sysctl_init(Object *obj)
     SysBusDevice *sbd = SYS_BUS_DEVICE(obj);
     IoTKitSysCtl *s = IOTKIT_SYSCTL(obj);
 
-    memory_region_init_io(&s->iomem, obj, &iotkit_sysctl_ops,
-                          s, "iotkit-sysctl", 0x1000);
+    memory_region_init_io_typed(&s->iomem, obj, &iotkit_sysctl_ops,
+                                s, TYPE_IOTKIT_SYSCTL, "iotkit-sysctl", 0x1000);
     sysbus_init_mmio(sbd, &s->iomem);
 }
 
@@ -52,7 +52,7 @@ static const int sysinfo_id[] = {
 static uint64_t iotkit_sysinfo_read(void *opaque, hwaddr offset,
                                     unsigned size)
 {
-    IoTKitSysInfo *s = IOTKIT_SYSINFO(opaque);
+    IoTKitSysInfo *s = opaque;
     uint64_t r;
 
     switch (offset) {
@@ -107,8 +107,9 @@ static void iotkit_sysinfo_init(Object *obj)
     SysBusDevice *sbd = SYS_BUS_DEVICE(obj);
     IoTKitSysInfo *s = IOTKIT_SYSINFO(obj);
 
-    memory_region_init_io(&s->iomem, obj, &iotkit_sysinfo_ops,
-                          s, "iotkit-sysinfo", 0x1000);
+    memory_region_init_io_typed(&s->iomem, obj, &iotkit_sysinfo_ops,
+                                s, TYPE_IOTKIT_SYSINFO,
+                                "iotkit-sysinfo", 0x1000);
     sysbus_init_mmio(sbd, &s->iomem);
 }
 
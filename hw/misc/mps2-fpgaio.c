@@ -119,7 +119,7 @@ static void resync_counter(MPS2FPGAIO *s)
 
 static uint64_t mps2_fpgaio_read(void *opaque, hwaddr offset, unsigned size)
 {
-    MPS2FPGAIO *s = MPS2_FPGAIO(opaque);
+    MPS2FPGAIO *s = opaque;
     uint64_t r;
     int64_t now;
 
@@ -169,7 +169,7 @@ static uint64_t mps2_fpgaio_read(void *opaque, hwaddr offset, unsigned size)
 static void mps2_fpgaio_write(void *opaque, hwaddr offset, uint64_t value,
                               unsigned size)
 {
-    MPS2FPGAIO *s = MPS2_FPGAIO(opaque);
+    MPS2FPGAIO *s = opaque;
     int64_t now;
 
     trace_mps2_fpgaio_write(offset, value, size);
@@ -246,8 +246,8 @@ static void mps2_fpgaio_init(Object *obj)
     SysBusDevice *sbd = SYS_BUS_DEVICE(obj);
     MPS2FPGAIO *s = MPS2_FPGAIO(obj);
 
-    memory_region_init_io(&s->iomem, obj, &mps2_fpgaio_ops, s,
-                          "mps2-fpgaio", 0x1000);
+    memory_region_init_io_typed(&s->iomem, obj, &mps2_fpgaio_ops, s,
+                                TYPE_MPS2_FPGAIO, "mps2-fpgaio", 0x1000);
     sysbus_init_mmio(sbd, &s->iomem);
 }
 
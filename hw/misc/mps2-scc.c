@@ -88,7 +88,7 @@ static bool scc_cfg_read(MPS2SCC *s, unsigned function,
 
 static uint64_t mps2_scc_read(void *opaque, hwaddr offset, unsigned size)
 {
-    MPS2SCC *s = MPS2_SCC(opaque);
+    MPS2SCC *s = opaque;
     uint64_t r;
 
     switch (offset) {
@@ -142,7 +142,7 @@ static uint64_t mps2_scc_read(void *opaque, hwaddr offset, unsigned size)
 static void mps2_scc_write(void *opaque, hwaddr offset, uint64_t value,
                            unsigned size)
 {
-    MPS2SCC *s = MPS2_SCC(opaque);
+    MPS2SCC *s = opaque;
 
     trace_mps2_scc_write(offset, value, size);
 
@@ -243,7 +243,8 @@ static void mps2_scc_init(Object *obj)
     SysBusDevice *sbd = SYS_BUS_DEVICE(obj);
     MPS2SCC *s = MPS2_SCC(obj);
 
-    memory_region_init_io(&s->iomem, obj, &mps2_scc_ops, s, "mps2-scc", 0x1000);
+    memory_region_init_io_typed(&s->iomem, obj, &mps2_scc_ops, s,
+                                TYPE_MPS2_SCC, "mps2-scc", 0x1000);
     sysbus_init_mmio(sbd, &s->iomem);
 }
 
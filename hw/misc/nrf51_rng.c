@@ -28,7 +28,7 @@ static void update_irq(NRF51RNGState *s)
 
 static uint64_t rng_read(void *opaque, hwaddr offset, unsigned int size)
 {
-    NRF51RNGState *s = NRF51_RNG(opaque);
+    NRF51RNGState *s = opaque;
     uint64_t r = 0;
 
     switch (offset) {
@@ -85,7 +85,7 @@ static void rng_update_timer(NRF51RNGState *s)
 static void rng_write(void *opaque, hwaddr offset,
                        uint64_t value, unsigned int size)
 {
-    NRF51RNGState *s = NRF51_RNG(opaque);
+    NRF51RNGState *s = opaque;
 
     switch (offset) {
     case NRF51_RNG_TASK_START:
@@ -188,8 +188,8 @@ static void nrf51_rng_init(Object *obj)
     NRF51RNGState *s = NRF51_RNG(obj);
     SysBusDevice *sbd = SYS_BUS_DEVICE(obj);
 
-    memory_region_init_io(&s->mmio, obj, &rng_ops, s,
-            TYPE_NRF51_RNG, NRF51_RNG_SIZE);
+    memory_region_init_io_typed(&s->mmio, obj, &rng_ops, s,
+            TYPE_NRF51_RNG, TYPE_NRF51_RNG, NRF51_RNG_SIZE);
     sysbus_init_mmio(sbd, &s->mmio);
 
     timer_init_us(&s->timer, QEMU_CLOCK_VIRTUAL, nrf51_rng_timer_expire, s);
@@ -0,0 +1,464 @@
+/*
+ * 3D printer physics model (heaters, thermistors, axes)
+ *
+ * Copyright (c) 2020 Taras Zakharchenko <taras.zakharchenko@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * The plant closes the loop around the firmware: heater and fan PWM pins
+ * drive first order thermal models whose temperatures are read back
+ * through NTC thermistors on ADC channels, and the X/Y/Z step integrators
+ * of the stepper drivers drive the min endstop switches.
+ *
+ * Nothing runs per instruction or per PWM period. PWM inputs only record
+ * their on-time at edges, and the thermal state is advanced in closed
+ * form when the firmware samples a thermistor, when the temperature is
+ * read over QOM, or, optionally, every "step-ms" of virtual time. Endstops
+ * use a single deadline predicted from the step rate, like the bed probe.
+ */
+
+#include "qemu/osdep.h"
+#include <math.h>
+#include "qapi/error.h"
+#include "qapi/visitor.h"
+#include "hw/irq.h"
+#include "hw/qdev-properties.h"
+#include "hw/misc/printer_plant.h"
+#include "migration/vmstate.h"
+#include "qemu/module.h"
+#include "trace.h"
+
+#define ADC_FULL_SCALE      4095
+#define KELVIN_0C           273.15
+#define KELVIN_25C          298.15
+
+static void printer_plant_pwm_set(PrinterPlantPWM *p, bool level)
+{
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+
+    if (level == p->level) {
+        return;
+    }
+
+    if (level) {
+        p->on_since_ns = now;
+    } else {
+        p->on_ns += now - p->on_since_ns;
+    }
+    p->level = level;
+}
+
+/* Average duty cycle over the @dt_ns since the previous call */
+static double printer_plant_pwm_duty(PrinterPlantPWM *p, int64_t now,
+                                     int64_t dt_ns)
+{
+    int64_t on = p->on_ns;
+
+    if (p->level) {
+        on += now - p->on_since_ns;
+        p->on_since_ns = now;
+    }
+    p->on_ns = 0;
+
+    return (double)on / dt_ns;
+}
+
+static void printer_plant_advance(PrinterPlantState *s)
+{
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    int64_t dt_ns = now - s->last_ns;
+    PrinterPlantHeater *h;
+    double dt, fan, duty, g, c, t, t_ss;
+    int i;
+
+    if (dt_ns <= 0) {
+        return;
+    }
+
+    dt = (double)dt_ns / NANOSECONDS_PER_SECOND;
+    fan = printer_plant_pwm_duty(&s->fan, now, dt_ns);
+
+    for (i = 0; i < PRINTER_PLANT_NUM_HEATERS; i++) {
+        h = &s->heater[i];
+        duty = printer_plant_pwm_duty(&h->pwm, now, dt_ns);
+
+        /*
+         * C dT/dt = P * duty - g * (T - Tamb), solved exactly for inputs
+         * held at their average over the interval, so any interval
+         * length is stable.
+         */
+        g = 1000.0 / h->resistance_mk_per_w + fan * h->fan_mw_per_k / 1000.0;
+        c = h->capacity_mj_per_k / 1000.0;
+        t_ss = s->ambient_mc / 1000.0 + duty * h->power_mw / 1000.0 / g;
+        t = h->temp_uc / 1e6;
+        t = t_ss + (t - t_ss) * exp(-g * dt / c);
+        h->temp_uc = llround(t * 1e6);
+    }
+
+    s->last_ns = now;
+    trace_printer_plant_advance(dt_ns, s->heater[PRINTER_PLANT_HOTEND].temp_uc,
+                                s->heater[PRINTER_PLANT_BED].temp_uc);
+}
+
+/* NTC thermistor (beta model) at the bottom of a pull-up divider */
+static uint32_t printer_plant_thermistor_adc(PrinterPlantState *s,
+                                             int64_t temp_uc)
+{
+    double t = temp_uc / 1e6 + KELVIN_0C;
+    double r = s->th_r25 * exp(s->th_beta * (1 / t - 1 / KELVIN_25C));
+
+    return lround(ADC_FULL_SCALE * r / (r + s->th_pullup));
+}
+
+uint32_t printer_plant_sample_adc(void *opaque, int channel)
+{
+    PrinterPlantState *s = opaque;
+    /* Nothing attached reads like an open thermistor */
+    uint32_t value = ADC_FULL_SCALE;
+    int i;
+
+    qemu_mutex_lock(&s->lock);
+    for (i = 0; i < PRINTER_PLANT_NUM_HEATERS; i++) {
+        if (s->heater[i].adc_channel == channel) {
+            printer_plant_advance(s);
+            value = printer_plant_thermistor_adc(s, s->heater[i].temp_uc);
+            break;
+        }
+    }
+    qemu_mutex_unlock(&s->lock);
+
+    return value;
+}
+
+static void printer_plant_step(void *opaque)
+{
+    PrinterPlantState *s = opaque;
+
+    qemu_mutex_lock(&s->lock);
+    printer_plant_advance(s);
+    qemu_mutex_unlock(&s->lock);
+    timer_mod(s->step_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+                             s->step_ms * SCALE_MS);
+}
+
+/* Highest stepper position at which the min endstop is closed */
+static int32_t printer_plant_endstop_steps(PrinterPlantAxis *a)
+{
+    return floor(-a->start_um / 1000.0 * a->steps_per_mm);
+}
+
+static void printer_plant_axis_update(PrinterPlantAxis *a)
+{
+    int32_t target;
+    int64_t deadline;
+    bool triggered;
+
+    timer_del(a->timer);
+
+    if (!a->stepper) {
+        return;
+    }
+
+    target = printer_plant_endstop_steps(a);
+    triggered = tmc22xx_get_position(a->stepper) <= target;
+    if (triggered != a->triggered) {
+        a->triggered = triggered;
+        trace_printer_plant_endstop(a - a->plant->axis, triggered);
+        qemu_set_irq(a->endstop, triggered);
+    }
+
+    deadline = tmc22xx_predict_crossing(a->stepper,
+                                        triggered ? target + 1 : target);
+    if (deadline >= 0) {
+        timer_mod(a->timer, deadline);
+    }
+}
+
+static void printer_plant_axis_timer(void *opaque)
+{
+    PrinterPlantAxis *a = opaque;
+
+    qemu_mutex_lock(&a->plant->lock);
+    printer_plant_axis_update(a);
+    qemu_mutex_unlock(&a->plant->lock);
+}
+
+static void printer_plant_axis_motion(Notifier *n, void *data)
+{
+    PrinterPlantAxis *a = container_of(n, PrinterPlantAxis, motion);
+
+    qemu_mutex_lock(&a->plant->lock);
+    printer_plant_axis_update(a);
+    qemu_mutex_unlock(&a->plant->lock);
+}
+
+static void printer_plant_heater_in(void *opaque, int n, int level)
+{
+    PrinterPlantState *s = opaque;
+
+    qemu_mutex_lock(&s->lock);
+    printer_plant_pwm_set(&s->heater[n].pwm, level);
+    qemu_mutex_unlock(&s->lock);
+}
+
+static void printer_plant_fan_in(void *opaque, int n, int level)
+{
+    PrinterPlantState *s = opaque;
+
+    qemu_mutex_lock(&s->lock);
+    printer_plant_pwm_set(&s->fan, level);
+    qemu_mutex_unlock(&s->lock);
+}
+
+static void printer_plant_get_temp(Object *obj, Visitor *v, const char *name,
+                                   void *opaque, Error **errp)
+{
+    PrinterPlantState *s = PRINTER_PLANT(obj);
+    PrinterPlantHeater *h = opaque;
+    int64_t value;
+
+    qemu_mutex_lock(&s->lock);
+    printer_plant_advance(s);
+    value = h->temp_uc / 1000;
+    qemu_mutex_unlock(&s->lock);
+    visit_type_int(v, name, &value, errp);
+}
+
+static void printer_plant_set_temp(Object *obj, Visitor *v, const char *name,
+                                   void *opaque, Error **errp)
+{
+    PrinterPlantState *s = PRINTER_PLANT(obj);
+    PrinterPlantHeater *h = opaque;
+    Error *err = NULL;
+    int64_t value;
+
+    visit_type_int(v, name, &value, &err);
+    if (err) {
+        error_propagate(errp, err);
+        return;
+    }
+
+    qemu_mutex_lock(&s->lock);
+    printer_plant_advance(s);
+    h->temp_uc = value * 1000;
+    qemu_mutex_unlock(&s->lock);
+}
+
+static void printer_plant_reset(DeviceState *dev)
+{
+    PrinterPlantState *s = PRINTER_PLANT(dev);
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    PrinterPlantAxis *a;
+    int i;
+
+    for (i = 0; i < PRINTER_PLANT_NUM_HEATERS; i++) {
+        memset(&s->heater[i].pwm, 0, sizeof(s->heater[i].pwm));
+        s->heater[i].temp_uc = (int64_t)s->ambient_mc * 1000;
+    }
+    memset(&s->fan, 0, sizeof(s->fan));
+    s->last_ns = now;
+
+    /* Steppers come out of reset at position 0 */
+    for (i = 0; i < PRINTER_PLANT_NUM_AXES; i++) {
+        a = &s->axis[i];
+        timer_del(a->timer);
+        a->triggered = a->stepper && printer_plant_endstop_steps(a) >= 0;
+        qemu_set_irq(a->endstop, a->triggered);
+    }
+
+    if (s->step_ms) {
+        timer_mod(s->step_timer, now + s->step_ms * SCALE_MS);
+    }
+}
+
+static void printer_plant_init(Object *obj)
+{
+    PrinterPlantState *s = PRINTER_PLANT(obj);
+    DeviceState *dev = DEVICE(obj);
+    int i;
+
+    qemu_mutex_init(&s->lock);
+    qdev_init_gpio_in_named(dev, printer_plant_heater_in, PRINTER_PLANT_HEATER,
+                            PRINTER_PLANT_NUM_HEATERS);
+    qdev_init_gpio_in_named(dev, printer_plant_fan_in, PRINTER_PLANT_FAN, 1);
+
+    for (i = 0; i < PRINTER_PLANT_NUM_AXES; i++) {
+        s->axis[i].plant = s;
+        qdev_init_gpio_out_named(dev, &s->axis[i].endstop,
+                                 PRINTER_PLANT_ENDSTOP, 1);
+    }
+
+    object_property_add(obj, "hotend-temp-mc", "int",
+                        printer_plant_get_temp, printer_plant_set_temp, NULL,
+                        &s->heater[PRINTER_PLANT_HOTEND], &error_abort);
+    object_property_add(obj, "bed-temp-mc", "int",
+                        printer_plant_get_temp, printer_plant_set_temp, NULL,
+                        &s->heater[PRINTER_PLANT_BED], &error_abort);
+}
+
+static void printer_plant_realize(DeviceState *dev, Error **errp)
+{
+    PrinterPlantState *s = PRINTER_PLANT(dev);
+    PrinterPlantAxis *a;
+    int i;
+
+    for (i = 0; i < PRINTER_PLANT_NUM_HEATERS; i++) {
+        if (!s->heater[i].resistance_mk_per_w ||
+            !s->heater[i].capacity_mj_per_k) {
+            error_setg(errp, "heater thermal resistance and capacity "
+                       "must be non-zero");
+            return;
+        }
+    }
+
+    if (!s->th_r25 || !s->th_beta) {
+        error_setg(errp, "thermistor parameters must be non-zero");
+        return;
+    }
+
+    s->step_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, printer_plant_step, s);
+
+    for (i = 0; i < PRINTER_PLANT_NUM_AXES; i++) {
+        a = &s->axis[i];
+        if (!a->steps_per_mm) {
+            error_setg(errp, "steps per mm must be non-zero");
+            return;
+        }
+
+        a->timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
+                                printer_plant_axis_timer, a);
+        if (a->stepper) {
+            a->motion.notify = printer_plant_axis_motion;
+            tmc22xx_add_motion_notifier(a->stepper, &a->motion);
+        }
+    }
+}
+
+static const VMStateDescription vmstate_printer_plant_pwm = {
+    .name = "printer-plant-pwm",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_BOOL(level, PrinterPlantPWM),
+        VMSTATE_INT64(on_since_ns, PrinterPlantPWM),
+        VMSTATE_INT64(on_ns, PrinterPlantPWM),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static const VMStateDescription vmstate_printer_plant_heater = {
+    .name = "printer-plant-heater",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_STRUCT(pwm, PrinterPlantHeater, 1,
+                       vmstate_printer_plant_pwm, PrinterPlantPWM),
+        VMSTATE_INT64(temp_uc, PrinterPlantHeater),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static const VMStateDescription vmstate_printer_plant_axis = {
+    .name = "printer-plant-axis",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_TIMER_PTR(timer, PrinterPlantAxis),
+        VMSTATE_BOOL(triggered, PrinterPlantAxis),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static const VMStateDescription vmstate_printer_plant = {
+    .name = TYPE_PRINTER_PLANT,
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_STRUCT_ARRAY(heater, PrinterPlantState,
+                             PRINTER_PLANT_NUM_HEATERS, 1,
+                             vmstate_printer_plant_heater, PrinterPlantHeater),
+        VMSTATE_STRUCT_ARRAY(axis, PrinterPlantState, PRINTER_PLANT_NUM_AXES,
+                             1, vmstate_printer_plant_axis, PrinterPlantAxis),
+        VMSTATE_STRUCT(fan, PrinterPlantState, 1,
+                       vmstate_printer_plant_pwm, PrinterPlantPWM),
+        VMSTATE_INT64(last_ns, PrinterPlantState),
+        VMSTATE_TIMER_PTR(step_timer, PrinterPlantState),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+#define DEFINE_PROP_HEATER(_name, _i, _power, _cap, _res, _fan, _chan)     \
+    DEFINE_PROP_UINT32(_name "-power-mw", PrinterPlantState,               \
+                       heater[_i].power_mw, _power),                       \
+    DEFINE_PROP_UINT32(_name "-capacity-mj-per-k", PrinterPlantState,      \
+                       heater[_i].capacity_mj_per_k, _cap),                \
+    DEFINE_PROP_UINT32(_name "-resistance-mk-per-w", PrinterPlantState,    \
+                       heater[_i].resistance_mk_per_w, _res),              \
+    DEFINE_PROP_UINT32(_name "-fan-mw-per-k", PrinterPlantState,           \
+                       heater[_i].fan_mw_per_k, _fan),                     \
+    DEFINE_PROP_INT32(_name "-adc-channel", PrinterPlantState,             \
+                      heater[_i].adc_channel, _chan)
+
+#define DEFINE_PROP_AXIS(_name, _i, _steps, _start)                        \
+    DEFINE_PROP_LINK(_name "-stepper", PrinterPlantState,                  \
+                     axis[_i].stepper, TYPE_TMC22XX, TMC22xxState *),      \
+    DEFINE_PROP_UINT32(_name "-steps-per-mm", PrinterPlantState,           \
+                       axis[_i].steps_per_mm, _steps),                     \
+    DEFINE_PROP_INT32(_name "-start-um", PrinterPlantState,                \
+                      axis[_i].start_um, _start)
+
+static Property printer_plant_properties[] = {
+    /* 40 W cartridge in an aluminium block, 220 W bed */
+    DEFINE_PROP_HEATER("hotend", PRINTER_PLANT_HOTEND,
+                       40000, 10000, 7000, 30, 0),
+    DEFINE_PROP_HEATER("bed", PRINTER_PLANT_BED,
+                       220000, 400000, 1200, 0, 13),
+    DEFINE_PROP_AXIS("x", 0, 80, 100000),
+    DEFINE_PROP_AXIS("y", 1, 80, 100000),
+    DEFINE_PROP_AXIS("z", 2, 400, 10000),
+    DEFINE_PROP_UINT32("step-ms", PrinterPlantState, step_ms, 0),
+    DEFINE_PROP_INT32("ambient-mc", PrinterPlantState, ambient_mc, 25000),
+    /* EPCOS 100k, Marlin thermistor table 1, 4.7k pull-up */
+    DEFINE_PROP_UINT32("thermistor-r25", PrinterPlantState, th_r25, 100000),
+    DEFINE_PROP_UINT32("thermistor-beta", PrinterPlantState, th_beta, 4092),
+    DEFINE_PROP_UINT32("thermistor-pullup", PrinterPlantState, th_pullup,
+                       4700),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
+static void printer_plant_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->realize = printer_plant_realize;
+    dc->reset = printer_plant_reset;
+    dc->vmsd = &vmstate_printer_plant;
+    dc->desc = "3D printer heater, thermistor and axis model";
+    device_class_set_props(dc, printer_plant_properties);
+}
+
+static const TypeInfo printer_plant_info = {
+    .name          = TYPE_PRINTER_PLANT,
+    .parent        = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(PrinterPlantState),
+    .instance_init = printer_plant_init,
+    .class_init    = printer_plant_class_init,
+};
+
+static void printer_plant_register_types(void)
+{
+    type_register_static(&printer_plant_info);
+}
+
+type_init(printer_plant_register_types)
@@ -0,0 +1,194 @@
+/*
+ * STM32F1XX flash interface
+ *
+ * Copyright (c) 2020 Taras Zakharchenko <taras.zakharchenko@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * Only the access control register has an effect: its LATENCY field is
+ * forwarded to the CPU, where cycle-approximate icount charges the wait
+ * states. The lock sequence is modelled so firmware sees the expected
+ * state, but programming and erasing the array are not implemented.
+ */
+
+#include "qemu/osdep.h"
+#include "hw/irq.h"
+#include "hw/misc/stm32f1xx_flash.h"
+#include "migration/vmstate.h"
+#include "qemu/log.h"
+#include "qemu/module.h"
+
+static void stm32f1xx_flash_reset(DeviceState *dev)
+{
+    STM32F1XXFlashState *s = STM32F1XXFLASH(dev);
+
+    s->flash_acr = FLASH_ACR_PRFTBE | FLASH_ACR_PRFTBS;
+    s->flash_sr = 0;
+    s->flash_cr = FLASH_CR_LOCK;
+    s->flash_ar = 0;
+    s->key_seq = 0;
+
+    qemu_set_irq(s->latency, 0);
+}
+
+static uint64_t stm32f1xx_flash_read(void *opaque, hwaddr offset,
+                                     unsigned size)
+{
+    STM32F1XXFlashState *s = opaque;
+
+    switch (offset) {
+    case FLASH_ACR:
+        return s->flash_acr;
+    case FLASH_KEYR:
+    case FLASH_OPTKEYR:
+        return 0;
+    case FLASH_SR:
+        return s->flash_sr;
+    case FLASH_CR:
+        return s->flash_cr;
+    case FLASH_AR:
+        return s->flash_ar;
+    case FLASH_OBR:
+        /* No read protection, option bytes erased */
+        return 0x03FFFFFC;
+    case FLASH_WRPR:
+        return 0xFFFFFFFF;
+    default:
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "%s: Bad offset 0x%"HWADDR_PRIx"\n", __func__, offset);
+    }
+
+    return 0;
+}
+
+static void stm32f1xx_flash_write(void *opaque, hwaddr offset,
+                                  uint64_t val64, unsigned size)
+{
+    STM32F1XXFlashState *s = opaque;
+    uint32_t value = val64 & 0xFFFFFFFF;
+
+    switch (offset) {
+    case FLASH_ACR:
+        /* The prefetch buffer status follows its enable */
+        s->flash_acr = value & (FLASH_ACR_LATENCY | FLASH_ACR_HLFCYA |
+                                FLASH_ACR_PRFTBE);
+        if (s->flash_acr & FLASH_ACR_PRFTBE) {
+            s->flash_acr |= FLASH_ACR_PRFTBS;
+        }
+        qemu_set_irq(s->latency, s->flash_acr & FLASH_ACR_LATENCY);
+        return;
+    case FLASH_KEYR:
+        if (s->key_seq == 0 && value == FLASH_KEY1) {
+            s->key_seq = 1;
+        } else if (s->key_seq == 1 && value == FLASH_KEY2) {
+            s->key_seq = 0;
+            s->flash_cr &= ~FLASH_CR_LOCK;
+        } else {
+            /* A wrong key locks the interface until reset */
+            s->key_seq = 2;
+        }
+        return;
+    case FLASH_OPTKEYR:
+        return;
+    case FLASH_SR:
+        /* Status flags are write 1 to clear */
+        s->flash_sr &= ~value;
+        return;
+    case FLASH_CR:
+        if (s->flash_cr & FLASH_CR_LOCK) {
+            return;
+        }
+        s->flash_cr = value;
+        if (value & ~FLASH_CR_LOCK) {
+            qemu_log_mask(LOG_UNIMP, "%s: flash programming is not "
+                          "supported\n", __func__);
+        }
+        return;
+    case FLASH_AR:
+        s->flash_ar = value;
+        return;
+    default:
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "%s: Bad offset 0x%"HWADDR_PRIx"\n", __func__, offset);
+        return;
+    }
+}
+
+static const MemoryRegionOps stm32f1xx_flash_ops = {
+    .read = stm32f1xx_flash_read,
+    .write = stm32f1xx_flash_write,
+    .endianness = DEVICE_NATIVE_ENDIAN,
+};
+
+static int stm32f1xx_flash_post_load(void *opaque, int version_id)
+{
+    STM32F1XXFlashState *s = opaque;
+
+    qemu_set_irq(s->latency, s->flash_acr & FLASH_ACR_LATENCY);
+    return 0;
+}
+
+static const VMStateDescription vmstate_stm32f1xx_flash = {
+    .name = TYPE_STM32F1XX_FLASH,
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .post_load = stm32f1xx_flash_post_load,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32(flash_acr, STM32F1XXFlashState),
+        VMSTATE_UINT32(flash_sr, STM32F1XXFlashState),
+        VMSTATE_UINT32(flash_cr, STM32F1XXFlashState),
+        VMSTATE_UINT32(flash_ar, STM32F1XXFlashState),
+        VMSTATE_UINT8(key_seq, STM32F1XXFlashState),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static void stm32f1xx_flash_init(Object *obj)
+{
+    STM32F1XXFlashState *s = STM32F1XXFLASH(obj);
+
+    memory_region_init_io(&s->iomem, obj, &stm32f1xx_flash_ops, s,
+                          "stm32f1xx_flash", 0x24);
+    sysbus_init_mmio(SYS_BUS_DEVICE(obj), &s->iomem);
+    qdev_init_gpio_out_named(DEVICE(obj), &s->latency,
+                             STM32F1XX_FLASH_LATENCY, 1);
+}
+
+static void stm32f1xx_flash_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->reset = stm32f1xx_flash_reset;
+    dc->vmsd = &vmstate_stm32f1xx_flash;
+}
+
+static const TypeInfo stm32f1xx_flash_info = {
+    .name          = TYPE_STM32F1XX_FLASH,
+    .parent        = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(STM32F1XXFlashState),
+    .instance_init = stm32f1xx_flash_init,
+    .class_init    = stm32f1xx_flash_class_init,
+};
+
+static void stm32f1xx_flash_register_types(void)
+{
+    type_register_static(&stm32f1xx_flash_info);
+}
+
+type_init(stm32f1xx_flash_register_types)
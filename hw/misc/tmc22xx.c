@@ -0,0 +1,821 @@
+/*
+ * Trinamic TMC2208/TMC2209 stepper motor driver
+ *
+ * Copyright (c) 2020 Taras Zakharchenko <taras.zakharchenko@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * The driver is configured over a single wire UART, either through an
+ * MCU USART (TYPE_CHARDEV_TMC22XX backend, up to four addressed drivers
+ * per wire) or through the PDN_UART GPIO lines when the firmware bit-bangs
+ * the protocol (TMC22XX_PDN_UART in, TMC22XX_PDN_UART_OUT for replies).
+ * STEP/DIR pulses are integrated into a position counter, and StallGuard
+ * is modelled as a load drop outside a configurable position window,
+ * which drives the DIAG output.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "hw/irq.h"
+#include "hw/qdev-properties.h"
+#include "hw/misc/tmc22xx.h"
+#include "migration/vmstate.h"
+#include "qemu/bswap.h"
+#include "qemu/log.h"
+#include "qemu/module.h"
+#include "trace.h"
+
+#define TMC_CHOPCONF_DEDGE      (1 << 29)
+
+/* Idle time after which a partially received datagram is dropped */
+#define TMC_RESYNC_BITS         63
+
+static uint8_t tmc22xx_crc(const uint8_t *buf, int len)
+{
+    uint8_t crc = 0;
+    uint8_t byte;
+    int i, j;
+
+    for (i = 0; i < len; i++) {
+        byte = buf[i];
+        for (j = 0; j < 8; j++) {
+            if ((crc >> 7) ^ (byte & 1)) {
+                crc = (crc << 1) ^ 0x07;
+            } else {
+                crc <<= 1;
+            }
+            byte >>= 1;
+        }
+    }
+
+    return crc;
+}
+
+static bool tmc22xx_standstill(TMC22xxState *s, int64_t now)
+{
+    return muldiv64(now - s->last_step_ns, TMC_FCLK_HZ,
+                    NANOSECONDS_PER_SECOND) >= (1 << 20);
+}
+
+static bool tmc22xx_stalled(TMC22xxState *s)
+{
+    return s->position < s->stall_min || s->position > s->stall_max;
+}
+
+static uint32_t tmc22xx_sg_result(TMC22xxState *s)
+{
+    return tmc22xx_stalled(s) ? 0 : s->sg_free;
+}
+
+static void tmc22xx_update_diag(TMC22xxState *s)
+{
+    TMC22xxClass *tc = TMC22XX_GET_CLASS(s);
+    bool diag = false;
+
+    /*
+     * StallGuard4 is active while TCOOLTHRS >= TSTEP and signals a stall
+     * once SG_RESULT falls to or below twice SGTHRS.
+     */
+    if (tc->has_stallguard && s->regs[TMC_SGTHRS] &&
+        s->tstep <= s->regs[TMC_TCOOLTHRS]) {
+        diag = tmc22xx_sg_result(s) <= 2 * s->regs[TMC_SGTHRS];
+    }
+
+    if (diag != s->diag) {
+        s->diag = diag;
+        trace_tmc22xx_diag(s->slave_addr, s->position, diag);
+        qemu_set_irq(s->diag_irq, diag);
+    }
+}
+
+static uint32_t tmc22xx_reg_read(TMC22xxState *s, uint8_t reg)
+{
+    TMC22xxClass *tc = TMC22XX_GET_CLASS(s);
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    bool stst = tmc22xx_standstill(s, now);
+    uint32_t mres = (s->regs[TMC_CHOPCONF] >> TMC_CHOPCONF_MRES_SHIFT) & 0xF;
+    uint32_t cs;
+
+    switch (reg) {
+    case TMC_IOIN:
+        return (tc->version << 24) | (s->dir << 9) | (s->step << 7) |
+               (s->diag << 4) | s->enn;
+    case TMC_TSTEP:
+        return stst ? TMC_TSTEP_MAX : s->tstep;
+    case TMC_SGTHRS:
+    case TMC_TCOOLTHRS:
+    case TMC_COOLCONF:
+        /* Write only */
+        return 0;
+    case TMC_SG_RESULT:
+        return tc->has_stallguard ? tmc22xx_sg_result(s) : 0;
+    case TMC_MSCNT:
+        return ((uint32_t)s->position << MIN(mres, 8)) & 0x3FF;
+    case TMC_DRV_STATUS:
+        cs = s->regs[TMC_IHOLD_IRUN] >> (stst ? 0 : 8);
+        return (stst ? TMC_DRV_STATUS_STST : 0) |
+               ((cs & 0x1F) << TMC_DRV_STATUS_CS_SHIFT);
+    default:
+        return s->regs[reg];
+    }
+}
+
+static void tmc22xx_reg_write(TMC22xxState *s, uint8_t reg, uint32_t value)
+{
+    TMC22xxClass *tc = TMC22XX_GET_CLASS(s);
+
+    switch (reg) {
+    case TMC_GSTAT:
+        s->regs[reg] &= ~(value & 0x7);
+        break;
+    case TMC_IFCNT:
+    case TMC_OTP_READ:
+    case TMC_IOIN:
+    case TMC_TSTEP:
+    case TMC_SG_RESULT:
+    case TMC_MSCNT:
+    case TMC_MSCURACT:
+    case TMC_DRV_STATUS:
+    case TMC_PWM_SCALE:
+    case TMC_PWM_AUTO:
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "%s: write to read-only register 0x%02x\n",
+                      __func__, reg);
+        break;
+    case TMC_SGTHRS:
+    case TMC_TCOOLTHRS:
+    case TMC_COOLCONF:
+        if (!tc->has_stallguard) {
+            qemu_log_mask(LOG_GUEST_ERROR,
+                          "%s: StallGuard register 0x%02x not present\n",
+                          __func__, reg);
+            break;
+        }
+        s->regs[reg] = value;
+        break;
+    default:
+        s->regs[reg] = value;
+        break;
+    }
+
+    tmc22xx_update_diag(s);
+}
+
+/*
+ * Accumulate a byte of an incoming datagram. Returns the datagram length
+ * once a complete read request or write access has been received.
+ */
+static int tmc22xx_datagram_push(uint8_t *buf, uint8_t *len, uint8_t byte)
+{
+    int complete;
+
+    if (*len == 0 && (byte & TMC_SYNC_MASK) != TMC_SYNC) {
+        return 0;
+    }
+
+    buf[(*len)++] = byte;
+
+    if ((*len == TMC_READ_DATAGRAM_LEN && !(buf[2] & TMC_WRITE_FLAG)) ||
+        *len == TMC_WRITE_DATAGRAM_LEN) {
+        complete = *len;
+        *len = 0;
+        return complete;
+    }
+
+    return 0;
+}
+
+/*
+ * Handle a complete datagram, returns the length of the reply in @reply.
+ * Called with s->lock held.
+ */
+static int tmc22xx_datagram(TMC22xxState *s, const uint8_t *buf, int len,
+                            uint8_t *reply)
+{
+    uint8_t reg = buf[2] & ~TMC_WRITE_FLAG;
+    uint32_t value;
+
+    if (buf[1] != s->slave_addr) {
+        return 0;
+    }
+
+    if (buf[len - 1] != tmc22xx_crc(buf, len - 1)) {
+        trace_tmc22xx_crc_error(s->slave_addr, reg);
+        return 0;
+    }
+
+    if (len == TMC_WRITE_DATAGRAM_LEN) {
+        value = ldl_be_p(buf + 3);
+        trace_tmc22xx_write(s->slave_addr, reg, value);
+        tmc22xx_reg_write(s, reg, value);
+        s->regs[TMC_IFCNT] = (s->regs[TMC_IFCNT] + 1) & 0xFF;
+        return 0;
+    }
+
+    value = tmc22xx_reg_read(s, reg);
+    trace_tmc22xx_read(s->slave_addr, reg, value);
+
+    reply[0] = TMC_SYNC;
+    reply[1] = TMC_MASTER_ADDR;
+    reply[2] = reg;
+    stl_be_p(reply + 3, value);
+    reply[7] = tmc22xx_crc(reply, 7);
+
+    return TMC_WRITE_DATAGRAM_LEN;
+}
+
+/* Bit times between the end of a read request and the reply */
+static int tmc22xx_send_delay_bits(TMC22xxState *s)
+{
+    return (TMC_SLAVECONF_SENDDELAY(s->regs[TMC_SLAVECONF]) | 1) * 8;
+}
+
+/* Returns whether the motion notifiers have to be called */
+static bool tmc22xx_step_locked(TMC22xxState *s, int level)
+{
+    int64_t now;
+    int8_t motion_dir;
+    bool started;
+
+    if (level == s->step) {
+        return false;
+    }
+    s->step = level;
+
+    if (!level && !(s->regs[TMC_CHOPCONF] & TMC_CHOPCONF_DEDGE)) {
+        return false;
+    }
+    if (s->enn || !(s->regs[TMC_CHOPCONF] & TMC_CHOPCONF_TOFF)) {
+        return false;
+    }
+
+    now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    started = tmc22xx_standstill(s, now);
+    s->step_period_ns = now - s->last_step_ns;
+    s->tstep = MIN(muldiv64(s->step_period_ns, TMC_FCLK_HZ,
+                            NANOSECONDS_PER_SECOND), TMC_TSTEP_MAX);
+    s->last_step_ns = now;
+
+    motion_dir = (s->dir ^ !!(s->regs[TMC_GCONF] & TMC_GCONF_SHAFT)) ? 1 : -1;
+    s->position += motion_dir;
+    s->step_count++;
+
+    tmc22xx_update_diag(s);
+
+    if (started || motion_dir != s->motion_dir ||
+        ABS(s->step_period_ns - s->notified_period_ns) >
+        s->notified_period_ns / 8) {
+        s->motion_dir = motion_dir;
+        s->notified_period_ns = s->step_period_ns;
+        return true;
+    }
+    return false;
+}
+
+static void tmc22xx_step(void *opaque, int n, int level)
+{
+    TMC22xxState *s = opaque;
+    bool notify;
+
+    qemu_mutex_lock(&s->lock);
+    notify = tmc22xx_step_locked(s, level);
+    qemu_mutex_unlock(&s->lock);
+
+    /* Listeners query the driver back, so call them without the lock */
+    if (notify) {
+        notifier_list_notify(&s->motion_notifiers, s);
+    }
+}
+
+int32_t tmc22xx_get_position(TMC22xxState *s)
+{
+    int32_t position;
+
+    qemu_mutex_lock(&s->lock);
+    position = s->position;
+    qemu_mutex_unlock(&s->lock);
+
+    return position;
+}
+
+static int tmc22xx_get_motion_locked(TMC22xxState *s, int64_t *last_step_ns,
+                                     int64_t *period_ns)
+{
+    *last_step_ns = s->last_step_ns;
+    *period_ns = s->step_period_ns;
+
+    if (tmc22xx_standstill(s, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL))) {
+        return 0;
+    }
+    return s->motion_dir;
+}
+
+int tmc22xx_get_motion(TMC22xxState *s, int64_t *last_step_ns,
+                       int64_t *period_ns)
+{
+    int dir;
+
+    qemu_mutex_lock(&s->lock);
+    dir = tmc22xx_get_motion_locked(s, last_step_ns, period_ns);
+    qemu_mutex_unlock(&s->lock);
+
+    return dir;
+}
+
+void tmc22xx_add_motion_notifier(TMC22xxState *s, Notifier *n)
+{
+    notifier_list_add(&s->motion_notifiers, n);
+}
+
+int64_t tmc22xx_predict_crossing(TMC22xxState *s, int32_t target)
+{
+    int64_t last_step_ns, period_ns, distance, deadline;
+    int dir;
+
+    qemu_mutex_lock(&s->lock);
+    dir = tmc22xx_get_motion_locked(s, &last_step_ns, &period_ns);
+    distance = ((int64_t)target - s->position) * dir;
+    qemu_mutex_unlock(&s->lock);
+    if (!dir || distance <= 0 || period_ns <= 0) {
+        return -1;
+    }
+
+    deadline = last_step_ns + distance * period_ns;
+    /*
+     * A decelerating move falls behind the estimate; never predict the
+     * past, the next step cannot arrive earlier than one period from now.
+     */
+    return MAX(deadline, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + period_ns);
+}
+
+static void tmc22xx_dir(void *opaque, int n, int level)
+{
+    TMC22xxState *s = opaque;
+
+    qemu_mutex_lock(&s->lock);
+    s->dir = level;
+    qemu_mutex_unlock(&s->lock);
+}
+
+static void tmc22xx_enn(void *opaque, int n, int level)
+{
+    TMC22xxState *s = opaque;
+
+    qemu_mutex_lock(&s->lock);
+    s->enn = level;
+    qemu_mutex_unlock(&s->lock);
+}
+
+static int64_t tmc22xx_pdn_bit_ns(TMC22xxState *s)
+{
+    return NANOSECONDS_PER_SECOND / s->pdn_baud;
+}
+
+static void tmc22xx_pdn_tx_bit_locked(TMC22xxState *s)
+{
+    int byte = s->pdn_tx_bit / 10;
+    int bit = s->pdn_tx_bit % 10;
+    int level;
+
+    if (byte >= s->pdn_tx_len) {
+        s->pdn_tx_len = 0;
+        qemu_set_irq(s->pdn_out, 1);
+        return;
+    }
+
+    if (bit == 0) {
+        level = 0;
+    } else if (bit == 9) {
+        level = 1;
+    } else {
+        level = (s->pdn_tx[byte] >> (bit - 1)) & 1;
+    }
+
+    qemu_set_irq(s->pdn_out, level);
+    s->pdn_tx_bit++;
+    timer_mod(s->pdn_tx_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+                               tmc22xx_pdn_bit_ns(s));
+}
+
+static void tmc22xx_pdn_tx_bit(void *opaque)
+{
+    TMC22xxState *s = opaque;
+
+    qemu_mutex_lock(&s->lock);
+    tmc22xx_pdn_tx_bit_locked(s);
+    qemu_mutex_unlock(&s->lock);
+}
+
+/* Sample data bits whose sampling point lies before @until */
+static void tmc22xx_pdn_sample(TMC22xxState *s, int64_t until)
+{
+    while (s->pdn_in_frame && s->pdn_sample_idx < 8 &&
+           s->pdn_next_sample_ns <= until) {
+        if (s->pdn_level) {
+            s->pdn_byte |= 1 << s->pdn_sample_idx;
+        }
+        s->pdn_sample_idx++;
+        s->pdn_next_sample_ns += tmc22xx_pdn_bit_ns(s);
+    }
+}
+
+static void tmc22xx_pdn_rx_frame_locked(TMC22xxState *s)
+{
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    int len;
+
+    tmc22xx_pdn_sample(s, now);
+    s->pdn_in_frame = false;
+
+    if (!s->pdn_level) {
+        /* Framing error, stop bit is low */
+        s->pdn_rx_len = 0;
+        return;
+    }
+
+    if (s->pdn_rx_len &&
+        now - s->pdn_last_byte_ns > TMC_RESYNC_BITS * tmc22xx_pdn_bit_ns(s)) {
+        s->pdn_rx_len = 0;
+    }
+    s->pdn_last_byte_ns = now;
+
+    len = tmc22xx_datagram_push(s->pdn_rx, &s->pdn_rx_len, s->pdn_byte);
+    if (!len) {
+        return;
+    }
+
+    s->pdn_tx_len = tmc22xx_datagram(s, s->pdn_rx, len, s->pdn_tx);
+    if (s->pdn_tx_len) {
+        s->pdn_tx_bit = 0;
+        timer_mod(s->pdn_tx_timer, now + tmc22xx_send_delay_bits(s) *
+                                         tmc22xx_pdn_bit_ns(s));
+    }
+}
+
+static void tmc22xx_pdn_rx_frame(void *opaque)
+{
+    TMC22xxState *s = opaque;
+
+    qemu_mutex_lock(&s->lock);
+    tmc22xx_pdn_rx_frame_locked(s);
+    qemu_mutex_unlock(&s->lock);
+}
+
+static void tmc22xx_pdn_uart_locked(TMC22xxState *s, int level)
+{
+    int64_t now;
+    int64_t bit_ns;
+
+    if (level == s->pdn_level) {
+        return;
+    }
+
+    now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    tmc22xx_pdn_sample(s, now);
+    s->pdn_level = level;
+
+    if (!s->pdn_in_frame && !level) {
+        /* Start bit: sample mid-bit, finish the frame in the stop bit */
+        bit_ns = tmc22xx_pdn_bit_ns(s);
+        s->pdn_in_frame = true;
+        s->pdn_byte = 0;
+        s->pdn_sample_idx = 0;
+        s->pdn_next_sample_ns = now + bit_ns * 3 / 2;
+        timer_mod(s->pdn_rx_timer, now + bit_ns * 19 / 2);
+    }
+}
+
+static void tmc22xx_pdn_uart(void *opaque, int n, int level)
+{
+    TMC22xxState *s = opaque;
+
+    qemu_mutex_lock(&s->lock);
+    tmc22xx_pdn_uart_locked(s, level);
+    qemu_mutex_unlock(&s->lock);
+}
+
+static void tmc22xx_reset(DeviceState *dev)
+{
+    TMC22xxState *s = TMC22XX(dev);
+
+    memset(s->regs, 0, sizeof(s->regs));
+    s->regs[TMC_GCONF] = 0x00000001;
+    s->regs[TMC_GSTAT] = TMC_GSTAT_RESET;
+    s->regs[TMC_IHOLD_IRUN] = 0x00011F10;
+    s->regs[TMC_TPOWERDOWN] = 0x00000014;
+    s->regs[TMC_CHOPCONF] = 0x10000053;
+    s->regs[TMC_PWMCONF] = 0xC10D0024;
+
+    s->position = 0;
+    s->step = false;
+    s->dir = false;
+    s->last_step_ns = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    s->step_period_ns = 0;
+    s->notified_period_ns = 0;
+    s->motion_dir = 0;
+    s->tstep = TMC_TSTEP_MAX;
+    s->diag = false;
+
+    timer_del(s->pdn_rx_timer);
+    timer_del(s->pdn_tx_timer);
+    s->pdn_level = true;
+    s->pdn_in_frame = false;
+    s->pdn_rx_len = 0;
+    s->pdn_tx_len = 0;
+
+    qemu_set_irq(s->diag_irq, 0);
+    qemu_set_irq(s->pdn_out, 1);
+}
+
+static void tmc22xx_init(Object *obj)
+{
+    TMC22xxState *s = TMC22XX(obj);
+    DeviceState *dev = DEVICE(obj);
+
+    qemu_mutex_init(&s->lock);
+    notifier_list_init(&s->motion_notifiers);
+    object_property_add_uint64_ptr(obj, "step-count", &s->step_count,
+                                   OBJ_PROP_FLAG_READ, &error_abort);
+
+    qdev_init_gpio_in_named(dev, tmc22xx_step, TMC22XX_STEP, 1);
+    qdev_init_gpio_in_named(dev, tmc22xx_dir, TMC22XX_DIR, 1);
+    qdev_init_gpio_in_named(dev, tmc22xx_enn, TMC22XX_ENN, 1);
+    qdev_init_gpio_in_named(dev, tmc22xx_pdn_uart, TMC22XX_PDN_UART, 1);
+    qdev_init_gpio_out_named(dev, &s->pdn_out, TMC22XX_PDN_UART_OUT, 1);
+    qdev_init_gpio_out_named(dev, &s->diag_irq, TMC22XX_DIAG, 1);
+}
+
+static void tmc22xx_realize(DeviceState *dev, Error **errp)
+{
+    TMC22xxState *s = TMC22XX(dev);
+
+    if (s->slave_addr >= TMC22XX_MAX_SLAVES) {
+        error_setg(errp, "slave-addr must be in range 0 to %d",
+                   TMC22XX_MAX_SLAVES - 1);
+        return;
+    }
+
+    if (!s->pdn_baud) {
+        error_setg(errp, "pdn-baud must be non-zero");
+        return;
+    }
+
+    if (s->uart) {
+        if (s->uart->num_slaves >= TMC22XX_MAX_SLAVES) {
+            error_setg(errp, "too many drivers on UART '%s'",
+                       CHARDEV(s->uart)->label);
+            return;
+        }
+        s->uart->slaves[s->uart->num_slaves++] = s;
+    }
+
+    s->pdn_rx_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
+                                   tmc22xx_pdn_rx_frame, s);
+    s->pdn_tx_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
+                                   tmc22xx_pdn_tx_bit, s);
+}
+
+static int tmc22xx_post_load(void *opaque, int version_id)
+{
+    TMC22xxState *s = opaque;
+
+    if (s->pdn_rx_len >= TMC_WRITE_DATAGRAM_LEN ||
+        s->pdn_tx_len > TMC_WRITE_DATAGRAM_LEN || s->pdn_sample_idx > 8) {
+        return -EINVAL;
+    }
+    return 0;
+}
+
+static const VMStateDescription vmstate_tmc22xx = {
+    .name = TYPE_TMC22XX,
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .post_load = tmc22xx_post_load,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32_ARRAY(regs, TMC22xxState, TMC_NUM_REGS),
+        VMSTATE_INT32(position, TMC22xxState),
+        VMSTATE_BOOL(step, TMC22xxState),
+        VMSTATE_BOOL(dir, TMC22xxState),
+        VMSTATE_BOOL(enn, TMC22xxState),
+        VMSTATE_INT64(last_step_ns, TMC22xxState),
+        VMSTATE_INT64(step_period_ns, TMC22xxState),
+        VMSTATE_INT8(motion_dir, TMC22xxState),
+        VMSTATE_UINT32(tstep, TMC22xxState),
+        VMSTATE_BOOL(diag, TMC22xxState),
+        VMSTATE_UINT64(step_count, TMC22xxState),
+        VMSTATE_INT64(notified_period_ns, TMC22xxState),
+        VMSTATE_TIMER_PTR(pdn_rx_timer, TMC22xxState),
+        VMSTATE_TIMER_PTR(pdn_tx_timer, TMC22xxState),
+        VMSTATE_BOOL(pdn_level, TMC22xxState),
+        VMSTATE_BOOL(pdn_in_frame, TMC22xxState),
+        VMSTATE_INT64(pdn_next_sample_ns, TMC22xxState),
+        VMSTATE_INT64(pdn_last_byte_ns, TMC22xxState),
+        VMSTATE_UINT8(pdn_sample_idx, TMC22xxState),
+        VMSTATE_UINT8(pdn_byte, TMC22xxState),
+        VMSTATE_UINT8_ARRAY(pdn_rx, TMC22xxState, TMC_WRITE_DATAGRAM_LEN),
+        VMSTATE_UINT8(pdn_rx_len, TMC22xxState),
+        VMSTATE_UINT8_ARRAY(pdn_tx, TMC22xxState, TMC_WRITE_DATAGRAM_LEN),
+        VMSTATE_UINT8(pdn_tx_len, TMC22xxState),
+        VMSTATE_UINT16(pdn_tx_bit, TMC22xxState),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static Property tmc22xx_properties[] = {
+    DEFINE_PROP_UINT8("slave-addr", TMC22xxState, slave_addr, 0),
+    DEFINE_PROP_UINT32("pdn-baud", TMC22xxState, pdn_baud, 19200),
+    DEFINE_PROP_UINT32("sg-free", TMC22xxState, sg_free, 250),
+    DEFINE_PROP_INT32("stall-min", TMC22xxState, stall_min, INT32_MIN),
+    DEFINE_PROP_INT32("stall-max", TMC22xxState, stall_max, INT32_MAX),
+    DEFINE_PROP_LINK("uart", TMC22xxState, uart, TYPE_CHARDEV_TMC22XX,
+                     TMC22xxChardev *),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
+static void tmc22xx_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->realize = tmc22xx_realize;
+    dc->reset = tmc22xx_reset;
+    dc->vmsd = &vmstate_tmc22xx;
+    device_class_set_props(dc, tmc22xx_properties);
+}
+
+static void tmc2208_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+    TMC22xxClass *tc = TMC22XX_CLASS(klass);
+
+    dc->desc = "TMC2208 stepper motor driver";
+    tc->version = 0x20;
+    tc->has_stallguard = false;
+}
+
+static void tmc2209_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+    TMC22xxClass *tc = TMC22XX_CLASS(klass);
+
+    dc->desc = "TMC2209 stepper motor driver";
+    tc->version = 0x21;
+    tc->has_stallguard = true;
+}
+
+static const TypeInfo tmc22xx_info = {
+    .name          = TYPE_TMC22XX,
+    .parent        = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(TMC22xxState),
+    .instance_init = tmc22xx_init,
+    .class_size    = sizeof(TMC22xxClass),
+    .class_init    = tmc22xx_class_init,
+    .abstract      = true,
+};
+
+static const TypeInfo tmc2208_info = {
+    .name          = TYPE_TMC2208,
+    .parent        = TYPE_TMC22XX,
+    .class_init    = tmc2208_class_init,
+};
+
+static const TypeInfo tmc2209_info = {
+    .name          = TYPE_TMC2209,
+    .parent        = TYPE_TMC22XX,
+    .class_init    = tmc2209_class_init,
+};
+
+/* USART attachment, a character backend shared by all drivers on the wire */
+
+static void tmc22xx_uart_tx(void *opaque)
+{
+    TMC22xxChardev *d = opaque;
+    Chardev *chr = CHARDEV(d);
+
+    if (d->tx_pos >= d->tx_len) {
+        return;
+    }
+
+    if (qemu_chr_be_can_write(chr) <= 0) {
+        /* Resumed from chr_accept_input once the USART has room */
+        d->tx_blocked = true;
+        return;
+    }
+
+    qemu_chr_be_write(chr, &d->tx[d->tx_pos++], 1);
+    if (d->tx_pos < d->tx_len) {
+        timer_mod(d->tx_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+                               10 * (NANOSECONDS_PER_SECOND / d->baud));
+    }
+}
+
+static int tmc22xx_uart_write(Chardev *chr, const uint8_t *buf, int len)
+{
+    TMC22xxChardev *d = TMC22XX_CHARDEV(chr);
+    int64_t bit_ns = NANOSECONDS_PER_SECOND / d->baud;
+    TMC22xxState *slave;
+    int i, j, n, delay_bits;
+
+    for (i = 0; i < len; i++) {
+        n = tmc22xx_datagram_push(d->rx, &d->rx_len, buf[i]);
+        if (!n) {
+            continue;
+        }
+
+        for (j = 0; j < d->num_slaves; j++) {
+            slave = d->slaves[j];
+            qemu_mutex_lock(&slave->lock);
+            d->tx_len = tmc22xx_datagram(slave, d->rx, n, d->tx);
+            delay_bits = tmc22xx_send_delay_bits(slave);
+            qemu_mutex_unlock(&slave->lock);
+            if (d->tx_len) {
+                d->tx_pos = 0;
+                d->tx_blocked = false;
+                timer_mod(d->tx_timer,
+                          qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+                          (delay_bits + 10) * bit_ns);
+                break;
+            }
+        }
+    }
+
+    return len;
+}
+
+static void tmc22xx_uart_accept_input(Chardev *chr)
+{
+    TMC22xxChardev *d = TMC22XX_CHARDEV(chr);
+
+    /*
+     * Called from within the frontend's register access, so defer the
+     * next byte rather than feeding the USART re-entrantly.
+     */
+    if (d->tx_blocked) {
+        d->tx_blocked = false;
+        timer_mod(d->tx_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL));
+    }
+}
+
+static void tmc22xx_uart_instance_init(Object *obj)
+{
+    TMC22xxChardev *d = TMC22XX_CHARDEV(obj);
+
+    d->baud = 115200;
+    d->tx_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, tmc22xx_uart_tx, d);
+}
+
+static void tmc22xx_uart_instance_finalize(Object *obj)
+{
+    TMC22xxChardev *d = TMC22XX_CHARDEV(obj);
+
+    timer_free(d->tx_timer);
+}
+
+static void tmc22xx_uart_class_init(ObjectClass *oc, void *data)
+{
+    ChardevClass *cc = CHARDEV_CLASS(oc);
+
+    cc->chr_write = tmc22xx_uart_write;
+    cc->chr_accept_input = tmc22xx_uart_accept_input;
+}
+
+static const TypeInfo tmc22xx_uart_info = {
+    .name = TYPE_CHARDEV_TMC22XX,
+    .parent = TYPE_CHARDEV,
+    .instance_size = sizeof(TMC22xxChardev),
+    .instance_init = tmc22xx_uart_instance_init,
+    .instance_finalize = tmc22xx_uart_instance_finalize,
+    .class_init = tmc22xx_uart_class_init,
+};
+
+Chardev *tmc22xx_uart_new(const char *id, uint32_t baud, Error **errp)
+{
+    Chardev *chr;
+
+    chr = qemu_chardev_new(id, TYPE_CHARDEV_TMC22XX, NULL, NULL, errp);
+    if (chr) {
+        TMC22XX_CHARDEV(chr)->baud = baud;
+    }
+
+    return chr;
+}
+
+static void tmc22xx_register_types(void)
+{
+    type_register_static(&tmc22xx_info);
+    type_register_static(&tmc2208_info);
+    type_register_static(&tmc2209_info);
+    type_register_static(&tmc22xx_uart_info);
+}
+
+type_init(tmc22xx_register_types)
@@ -136,7 +136,7 @@ static MemTxResult tz_mpc_reg_read(void *opaque, hwaddr addr,
                                    uint64_t *pdata,
                                    unsigned size, MemTxAttrs attrs)
 {
-    TZMPC *s = TZ_MPC(opaque);
+    TZMPC *s = opaque;
     uint64_t r;
     uint32_t offset = addr & ~0x3;
 
@@ -228,7 +228,7 @@ static MemTxResult tz_mpc_reg_write(void *opaque, hwaddr addr,
                                     uint64_t value,
                                     unsigned size, MemTxAttrs attrs)
 {
-    TZMPC *s = TZ_MPC(opaque);
+    TZMPC *s = opaque;
     uint32_t offset = addr & ~0x3;
 
     trace_tz_mpc_reg_write(addr, value, size);
@@ -389,7 +389,7 @@ static MemTxResult tz_mpc_mem_blocked_read(void *opaque, hwaddr addr,
                                            uint64_t *pdata,
                                            unsigned size, MemTxAttrs attrs)
 {
-    TZMPC *s = TZ_MPC(opaque);
+    TZMPC *s = opaque;
 
     trace_tz_mpc_mem_blocked_read(addr, size, attrs.secure);
 
@@ -401,7 +401,7 @@ static MemTxResult tz_mpc_mem_blocked_write(void *opaque, hwaddr addr,
                                             uint64_t value,
                                             unsigned size, MemTxAttrs attrs)
 {
-    TZMPC *s = TZ_MPC(opaque);
+    TZMPC *s = opaque;
 
     trace_tz_mpc_mem_blocked_write(addr, value, size, attrs.secure);
 
@@ -422,7 +422,7 @@ static IOMMUTLBEntry tz_mpc_translate(IOMMUMemoryRegion *iommu,
                                       hwaddr addr, IOMMUAccessFlags flags,
                                       int iommu_idx)
 {
-    TZMPC *s = TZ_MPC(container_of(iommu, TZMPC, upstream));
+    TZMPC *s = container_of(iommu, TZMPC, upstream);
     bool ok;
 
     IOMMUTLBEntry ret = {
@@ -533,8 +533,8 @@ static void tz_mpc_realize(DeviceState *dev, Error **errp)
      */
     s->blk_max = DIV_ROUND_UP(size / s->blocksize, 32);
 
-    memory_region_init_io(&s->regmr, obj, &tz_mpc_reg_ops,
-                          s, "tz-mpc-regs", 0x1000);
+    memory_region_init_io_typed(&s->regmr, obj, &tz_mpc_reg_ops,
+                                s, TYPE_TZ_MPC, "tz-mpc-regs", 0x1000);
     sysbus_init_mmio(sbd, &s->regmr);
 
     sysbus_init_mmio(sbd, MEMORY_REGION(&s->upstream));
@@ -543,8 +543,9 @@ static void tz_mpc_realize(DeviceState *dev, Error **errp)
      * sysbus MMIO region, but is instead used internally as something
      * that our IOMMU translate function might direct accesses to.
      */
-    memory_region_init_io(&s->blocked_io, obj, &tz_mpc_mem_blocked_ops,
-                          s, "tz-mpc-blocked-io", size);
+    memory_region_init_io_typed(&s->blocked_io, obj,
+                                &tz_mpc_mem_blocked_ops, s, TYPE_TZ_MPC,
+                                "tz-mpc-blocked-io", size);
 
     address_space_init(&s->downstream_as, s->downstream,
                        "tz-mpc-downstream");
@@ -171,7 +171,7 @@ static const MemoryRegionOps ficr_ops = {
 
 static uint64_t uicr_read(void *opaque, hwaddr offset, unsigned int size)
 {
-    NRF51NVMState *s = NRF51_NVM(opaque);
+    NRF51NVMState *s = opaque;
 
     assert(offset < sizeof(s->uicr_content));
     return s->uicr_content[offset / 4];
@@ -180,7 +180,7 @@ static uint64_t uicr_read(void *opaque, hwaddr offset, unsigned int size)
 static void uicr_write(void *opaque, hwaddr offset, uint64_t value,
         unsigned int size)
 {
-    NRF51NVMState *s = NRF51_NVM(opaque);
+    NRF51NVMState *s = opaque;
 
     assert(offset < sizeof(s->uicr_content));
     s->uicr_content[offset / 4] = value;
@@ -197,7 +197,7 @@ static const MemoryRegionOps uicr_ops = {
 
 static uint64_t io_read(void *opaque, hwaddr offset, unsigned int size)
 {
-    NRF51NVMState *s = NRF51_NVM(opaque);
+    NRF51NVMState *s = opaque;
     uint64_t r = 0;
 
     switch (offset) {
@@ -219,7 +219,7 @@ static uint64_t io_read(void *opaque, hwaddr offset, unsigned int size)
 static void io_write(void *opaque, hwaddr offset, uint64_t value,
         unsigned int size)
 {
-    NRF51NVMState *s = NRF51_NVM(opaque);
+    NRF51NVMState *s = opaque;
 
     switch (offset) {
     case NRF51_NVMC_CONFIG:
@@ -277,7 +277,7 @@ static const MemoryRegionOps io_ops = {
 static void flash_write(void *opaque, hwaddr offset, uint64_t value,
         unsigned int size)
 {
-    NRF51NVMState *s = NRF51_NVM(opaque);
+    NRF51NVMState *s = opaque;
 
     if (s->config & NRF51_NVMC_CONFIG_WEN) {
         uint32_t oldval;
@@ -311,16 +311,16 @@ static void nrf51_nvm_init(Object *obj)
     NRF51NVMState *s = NRF51_NVM(obj);
     SysBusDevice *sbd = SYS_BUS_DEVICE(obj);
 
-    memory_region_init_io(&s->mmio, obj, &io_ops, s, "nrf51_soc.nvmc",
-                          NRF51_NVMC_SIZE);
+    memory_region_init_io_typed(&s->mmio, obj, &io_ops, s, TYPE_NRF51_NVM,
+                                "nrf51_soc.nvmc", NRF51_NVMC_SIZE);
     sysbus_init_mmio(sbd, &s->mmio);
 
     memory_region_init_io(&s->ficr, obj, &ficr_ops, s, "nrf51_soc.ficr",
                           sizeof(ficr_content));
     sysbus_init_mmio(sbd, &s->ficr);
 
-    memory_region_init_io(&s->uicr, obj, &uicr_ops, s, "nrf51_soc.uicr",
-                          sizeof(s->uicr_content));
+    memory_region_init_io_typed(&s->uicr, obj, &uicr_ops, s, TYPE_NRF51_NVM,
+                                "nrf51_soc.uicr", sizeof(s->uicr_content));
     sysbus_init_mmio(sbd, &s->uicr);
 }
 
@@ -329,8 +329,8 @@ static void nrf51_nvm_realize(DeviceState *dev, Error **errp)
     NRF51NVMState *s = NRF51_NVM(dev);
     Error *err = NULL;
 
-    memory_region_init_rom_device(&s->flash, OBJECT(dev), &flash_ops, s,
-        "nrf51_soc.flash", s->flash_size, &err);
+    memory_region_init_rom_device_typed(&s->flash, OBJECT(dev), &flash_ops, s,
+        TYPE_NRF51_NVM, "nrf51_soc.flash", s->flash_size, &err);
     if (err) {
         error_propagate(errp, err);
         return;
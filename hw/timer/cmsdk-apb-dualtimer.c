@@ -221,7 +221,7 @@ static void cmsdk_dualtimermod_write_control(CMSDKAPBDualTimerModule *m,
 static uint64_t cmsdk_apb_dualtimer_read(void *opaque, hwaddr offset,
                                           unsigned size)
 {
-    CMSDKAPBDualTimer *s = CMSDK_APB_DUALTIMER(opaque);
+    CMSDKAPBDualTimer *s = opaque;
     uint64_t r;
 
     if (offset >= A_TIMERITCR) {
@@ -294,7 +294,7 @@ static uint64_t cmsdk_apb_dualtimer_read(void *opaque, hwaddr offset,
 static void cmsdk_apb_dualtimer_write(void *opaque, hwaddr offset,
                                        uint64_t value, unsigned size)
 {
-    CMSDKAPBDualTimer *s = CMSDK_APB_DUALTIMER(opaque);
+    CMSDKAPBDualTimer *s = opaque;
 
     trace_cmsdk_apb_dualtimer_write(offset, value, size);
 
@@ -437,8 +437,9 @@ static void cmsdk_apb_dualtimer_init(Object *obj)
     CMSDKAPBDualTimer *s = CMSDK_APB_DUALTIMER(obj);
     int i;
 
-    memory_region_init_io(&s->iomem, obj, &cmsdk_apb_dualtimer_ops,
-                          s, "cmsdk-apb-dualtimer", 0x1000);
+    memory_region_init_io_typed(&s->iomem, obj, &cmsdk_apb_dualtimer_ops,
+                                s, TYPE_CMSDK_APB_DUALTIMER,
+                                "cmsdk-apb-dualtimer", 0x1000);
     sysbus_init_mmio(sbd, &s->iomem);
     sysbus_init_irq(sbd, &s->timerintc);
 
@@ -74,7 +74,7 @@ static void cmsdk_apb_timer_update(CMSDKAPBTIMER *s)
 
 static uint64_t cmsdk_apb_timer_read(void *opaque, hwaddr offset, unsigned size)
 {
-    CMSDKAPBTIMER *s = CMSDK_APB_TIMER(opaque);
+    CMSDKAPBTIMER *s = opaque;
     uint64_t r;
 
     switch (offset) {
@@ -106,7 +106,7 @@ static uint64_t cmsdk_apb_timer_read(void *opaque, hwaddr offset, unsigned size)
 static void cmsdk_apb_timer_write(void *opaque, hwaddr offset, uint64_t value,
                                   unsigned size)
 {
-    CMSDKAPBTIMER *s = CMSDK_APB_TIMER(opaque);
+    CMSDKAPBTIMER *s = opaque;
 
     trace_cmsdk_apb_timer_write(offset, value, size);
 
@@ -208,8 +208,9 @@ static void cmsdk_apb_timer_init(Object *obj)
     SysBusDevice *sbd = SYS_BUS_DEVICE(obj);
     CMSDKAPBTIMER *s = CMSDK_APB_TIMER(obj);
 
-    memory_region_init_io(&s->iomem, obj, &cmsdk_apb_timer_ops,
-                          s, "cmsdk-apb-timer", 0x1000);
+    memory_region_init_io_typed(&s->iomem, obj, &cmsdk_apb_timer_ops,
+                                s, TYPE_CMSDK_APB_TIMER,
+                                "cmsdk-apb-timer", 0x1000);
     sysbus_init_mmio(sbd, &s->iomem);
     sysbus_init_irq(sbd, &s->timerint);
 }
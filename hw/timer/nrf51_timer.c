@@ -151,7 +151,7 @@ static void counter_compare(NRF51TimerState *s)
 
 static uint64_t nrf51_timer_read(void *opaque, hwaddr offset, unsigned int size)
 {
-    NRF51TimerState *s = NRF51_TIMER(opaque);
+    NRF51TimerState *s = opaque;
     uint64_t r = 0;
 
     switch (offset) {
@@ -193,7 +193,7 @@ static uint64_t nrf51_timer_read(void *opaque, hwaddr offset, unsigned int size)
 static void nrf51_timer_write(void *opaque, hwaddr offset,
                        uint64_t value, unsigned int size)
 {
-    NRF51TimerState *s = NRF51_TIMER(opaque);
+    NRF51TimerState *s = opaque;
     uint64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
     size_t idx;
 
@@ -312,8 +312,8 @@ static void nrf51_timer_init(Object *obj)
     NRF51TimerState *s = NRF51_TIMER(obj);
     SysBusDevice *sbd = SYS_BUS_DEVICE(obj);
 
-    memory_region_init_io(&s->iomem, obj, &rng_ops, s,
-            TYPE_NRF51_TIMER, NRF51_TIMER_SIZE);
+    memory_region_init_io_typed(&s->iomem, obj, &rng_ops, s,
+            TYPE_NRF51_TIMER, TYPE_NRF51_TIMER, NRF51_TIMER_SIZE);
     sysbus_init_mmio(sbd, &s->iomem);
     sysbus_init_irq(sbd, &s->irq);
 
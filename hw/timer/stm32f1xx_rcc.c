@@ -47,6 +47,12 @@ static void stm32f1xx_rcc_reset(DeviceState *dev)
     s->rcc_csr = 0;
 }
 
+/*
+ * The registers are only ever accessed as a whole, and a write never
+ * depends on another register, so MMIO runs without the BQL or a lock
+ * of its own: every register is read and written with a single atomic
+ * access.  Reset and migration run with the vCPUs stopped.
+ */
 static uint64_t stm32f1xx_rcc_read(void *opaque, hwaddr offset,
                            unsigned size)
 {
@@ -54,25 +60,25 @@ static uint64_t stm32f1xx_rcc_read(void *opaque, hwaddr offset,
 
     switch (offset) {
     case RCC_CR:
-        return s->rcc_cr.value;
+        return atomic_read(&s->rcc_cr.value);
     case RCC_CFGR:
-        return s->rcc_cfgr.value;
+        return atomic_read(&s->rcc_cfgr.value);
     case RCC_CIR:
-        return s->rcc_cir;
+        return atomic_read(&s->rcc_cir);
     case RCC_APB2RSTR:
-        return s->rcc_abp2rstr;
+        return atomic_read(&s->rcc_abp2rstr);
     case RCC_APB1RSTR:
-        return s->rcc_abp1rstr;
+        return atomic_read(&s->rcc_abp1rstr);
     case RCC_AHBENR:
-        return s->rcc_ahbenr;
+        return atomic_read(&s->rcc_ahbenr);
     case RCC_APB2ENR:
-        return s->rcc_abp2enr;
+        return atomic_read(&s->rcc_abp2enr);
     case RCC_APB1ENR:
-        return s->rcc_abp1enr;
+        return atomic_read(&s->rcc_abp1enr);
     case RCC_BDCR:
-        return s->rcc_bdcr;
+        return atomic_read(&s->rcc_bdcr);
     case RCC_CSR:
-        return s->rcc_csr;
+        return atomic_read(&s->rcc_csr);
     default:
         qemu_log_mask(LOG_GUEST_ERROR,
                       "%s: Bad offset 0x%"HWADDR_PRIx"\n", __func__, offset);
@@ -86,41 +92,45 @@ static void stm32f1xx_rcc_write(void *opaque, hwaddr offset,
 {
     STM32F1XXRCCState *s = opaque;
     uint32_t value = val64 & 0xFFFFFFFF;
+    typeof(s->rcc_cr) cr;
+    typeof(s->rcc_cfgr) cfgr;
 
     switch (offset) {
     case RCC_CR:
-        s->rcc_cr.value = value;
-        s->rcc_cr.fields.hsi_rdy = s->rcc_cr.fields.hsi_on;
-        s->rcc_cr.fields.hse_rdy = s->rcc_cr.fields.hse_on;
-        s->rcc_cr.fields.pll_rdy = s->rcc_cr.fields.pll_on;
+        cr.value = value;
+        cr.fields.hsi_rdy = cr.fields.hsi_on;
+        cr.fields.hse_rdy = cr.fields.hse_on;
+        cr.fields.pll_rdy = cr.fields.pll_on;
+        atomic_set(&s->rcc_cr.value, cr.value);
         return;
     case RCC_CFGR:
-        s->rcc_cfgr.value = value;
-        s->rcc_cfgr.fields.sws = s->rcc_cfgr.fields.sw;
+        cfgr.value = value;
+        cfgr.fields.sws = cfgr.fields.sw;
+        atomic_set(&s->rcc_cfgr.value, cfgr.value);
         return;
     case RCC_CIR:
-        s->rcc_cir = value;
+        atomic_set(&s->rcc_cir, value);
         return;
     case RCC_APB2RSTR:
-        s->rcc_abp2rstr = value;
+        atomic_set(&s->rcc_abp2rstr, value);
         return;
     case RCC_APB1RSTR:
-        s->rcc_abp1rstr = value;
+        atomic_set(&s->rcc_abp1rstr, value);
         return;
     case RCC_AHBENR:
-        s->rcc_ahbenr = value;
+        atomic_set(&s->rcc_ahbenr, value);
         return;
     case RCC_APB2ENR:
-        s->rcc_abp2enr = value;
+        atomic_set(&s->rcc_abp2enr, value);
         return;
     case RCC_APB1ENR:
-        s->rcc_abp1enr = value;
+        atomic_set(&s->rcc_abp1enr, value);
         return;
     case RCC_BDCR:
-        s->rcc_bdcr = value;
+        atomic_set(&s->rcc_bdcr, value);
         return;
     case RCC_CSR:
-        s->rcc_csr = value;
+        atomic_set(&s->rcc_csr, value);
         break;
     default:
         qemu_log_mask(LOG_GUEST_ERROR,
@@ -163,6 +173,7 @@ static void stm32f1xx_rcc_init(Object *obj)
     STM32F1XXRCCState *s = STM32F1XXRCC(obj);
     memory_region_init_io(&s->iomem, obj, &stm32f1xx_rcc_ops, s,
                           "stm32f1xx_rcc", 0x28);
+    memory_region_clear_global_locking(&s->iomem);
     sysbus_init_mmio(SYS_BUS_DEVICE(obj), &s->iomem);
 }
 
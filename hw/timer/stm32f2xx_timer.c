@@ -42,17 +42,28 @@
 
 #define DB_PRINT(fmt, args...) DB_PRINT_L(1, fmt, ## args)
 
+/*
+ * Locking: the registers are protected by s->lock, so that MMIO does not
+ * need the BQL.  The interrupt is only raised from the timer callback,
+ * with the BQL held.  The PWM outputs are driven under s->out_lock and
+ * without the BQL; pwm_out_ns is updated under both locks, so whoever
+ * changes pwm_pulse_ns after that sees the difference and drives the
+ * outputs again.
+ */
+
 static void stm32f2xx_timer_set_alarm(STM32F2XXTimerState *s, int64_t now);
 
 static void stm32f2xx_timer_interrupt(void *opaque)
 {
     STM32F2XXTimerState *s = opaque;
+    bool pulse = false;
 
     DB_PRINT("Interrupt\n");
 
+    qemu_mutex_lock(&s->lock);
     if (s->tim_dier & TIM_DIER_UIE && s->tim_cr1 & TIM_CR1_CEN) {
         s->tim_sr |= 1;
-        qemu_irq_pulse(s->irq);
+        pulse = true;
         stm32f2xx_timer_set_alarm(s, s->hit_time);
     }
 
@@ -64,6 +75,11 @@ static void stm32f2xx_timer_interrupt(void *opaque)
         DB_PRINT("PWM2 Duty Cycle: %d%%\n",
                 s->tim_ccr2 / (100 * (s->tim_psc + 1)));
     }
+    qemu_mutex_unlock(&s->lock);
+
+    if (pulse) {
+        qemu_irq_pulse(s->irq);
+    }
 }
 
 static inline int64_t stm32f2xx_ns_to_ticks(STM32F2XXTimerState *s, int64_t t)
@@ -94,6 +110,89 @@ static void stm32f2xx_timer_set_alarm(STM32F2XXTimerState *s, int64_t now)
     DB_PRINT("Wait Time: %" PRId64 " ticks\n", s->hit_time);
 }
 
+static uint32_t stm32f2xx_timer_ccr(STM32F2XXTimerState *s, int ch)
+{
+    switch (ch) {
+    case 0:
+        return s->tim_ccr1;
+    case 1:
+        return s->tim_ccr2;
+    case 2:
+        return s->tim_ccr3;
+    default:
+        return s->tim_ccr4;
+    }
+}
+
+static void stm32f2xx_timer_update_pwm(STM32F2XXTimerState *s)
+{
+    uint64_t period = (uint64_t)s->tim_arr + 1;
+    uint64_t pulse, pulse_ns;
+    uint32_t ccmr;
+    int ch;
+
+    for (ch = 0; ch < TIM_NUM_CHANNELS; ch++) {
+        ccmr = ch < 2 ? s->tim_ccmr1 : s->tim_ccmr2;
+        pulse = 0;
+
+        if (s->tim_cr1 & TIM_CR1_CEN && s->tim_ccer & TIM_CCER_CCE(ch) &&
+            s->tim_arr) {
+            switch (TIM_CCMR_OCM(ccmr, ch)) {
+            case TIM_OCM_FORCE_HIGH:
+                pulse = period;
+                break;
+            case TIM_OCM_PWM1:
+                pulse = MIN(stm32f2xx_timer_ccr(s, ch), period);
+                break;
+            case TIM_OCM_PWM2:
+                pulse = period - MIN(stm32f2xx_timer_ccr(s, ch), period);
+                break;
+            default:
+                break;
+            }
+            if (s->tim_ccer & TIM_CCER_CCP(ch)) {
+                pulse = period - pulse;
+            }
+        }
+
+        pulse_ns = muldiv64(pulse * (s->tim_psc + 1), 1000000000ULL,
+                            s->freq_hz);
+        if (pulse_ns != s->pwm_pulse_ns[ch]) {
+            s->pwm_pulse_ns[ch] = pulse_ns;
+            DB_PRINT("PWM channel %d high time: %" PRIu64 " ns\n", ch + 1,
+                     pulse_ns);
+        }
+    }
+}
+
+/* Whether stm32f2xx_timer_update_outputs() has anything to do */
+static bool stm32f2xx_timer_pwm_pending(STM32F2XXTimerState *s)
+{
+    return memcmp(s->pwm_pulse_ns, s->pwm_out_ns, sizeof(s->pwm_out_ns)) != 0;
+}
+
+/* Drive the PWM outputs whose level differs from pwm_pulse_ns. */
+static void stm32f2xx_timer_update_outputs(STM32F2XXTimerState *s)
+{
+    uint64_t old_ns[TIM_NUM_CHANNELS];
+    uint64_t new_ns[TIM_NUM_CHANNELS];
+    int ch;
+
+    qemu_mutex_lock(&s->out_lock);
+    qemu_mutex_lock(&s->lock);
+    memcpy(old_ns, s->pwm_out_ns, sizeof(old_ns));
+    memcpy(new_ns, s->pwm_pulse_ns, sizeof(new_ns));
+    memcpy(s->pwm_out_ns, new_ns, sizeof(new_ns));
+    qemu_mutex_unlock(&s->lock);
+
+    for (ch = 0; ch < TIM_NUM_CHANNELS; ch++) {
+        if (new_ns[ch] != old_ns[ch]) {
+            qemu_set_irq(s->pwm[ch], MIN(new_ns[ch], INT_MAX));
+        }
+    }
+    qemu_mutex_unlock(&s->out_lock);
+}
+
 static void stm32f2xx_timer_reset(DeviceState *dev)
 {
     STM32F2XXTimerState *s = STM32F2XXTIMER(dev);
@@ -119,15 +218,13 @@ static void stm32f2xx_timer_reset(DeviceState *dev)
     s->tim_or = 0;
 
     s->tick_offset = stm32f2xx_ns_to_ticks(s, now);
+    stm32f2xx_timer_update_pwm(s);
+    stm32f2xx_timer_update_outputs(s);
 }
 
-static uint64_t stm32f2xx_timer_read(void *opaque, hwaddr offset,
-                           unsigned size)
+static uint64_t stm32f2xx_timer_read_locked(STM32F2XXTimerState *s,
+                                            hwaddr offset)
 {
-    STM32F2XXTimerState *s = opaque;
-
-    DB_PRINT("Read 0x%"HWADDR_PRIx"\n", offset);
-
     switch (offset) {
     case TIM_CR1:
         return s->tim_cr1;
@@ -176,19 +273,30 @@ static uint64_t stm32f2xx_timer_read(void *opaque, hwaddr offset,
     return 0;
 }
 
-static void stm32f2xx_timer_write(void *opaque, hwaddr offset,
-                        uint64_t val64, unsigned size)
+static uint64_t stm32f2xx_timer_read(void *opaque, hwaddr offset,
+                           unsigned size)
 {
     STM32F2XXTimerState *s = opaque;
-    uint32_t value = val64;
+    uint64_t value;
+
+    DB_PRINT("Read 0x%"HWADDR_PRIx"\n", offset);
+
+    qemu_mutex_lock(&s->lock);
+    value = stm32f2xx_timer_read_locked(s, offset);
+    qemu_mutex_unlock(&s->lock);
+    return value;
+}
+
+static void stm32f2xx_timer_write_locked(STM32F2XXTimerState *s,
+                                         hwaddr offset, uint32_t value)
+{
     int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
     uint32_t timer_val = 0;
 
-    DB_PRINT("Write 0x%x, 0x%"HWADDR_PRIx"\n", value, offset);
-
     switch (offset) {
     case TIM_CR1:
         s->tim_cr1 = value;
+        stm32f2xx_timer_update_pwm(s);
         return;
     case TIM_CR2:
         s->tim_cr2 = value;
@@ -212,12 +320,15 @@ static void stm32f2xx_timer_write(void *opaque, hwaddr offset,
         return;
     case TIM_CCMR1:
         s->tim_ccmr1 = value;
+        stm32f2xx_timer_update_pwm(s);
         return;
     case TIM_CCMR2:
         s->tim_ccmr2 = value;
+        stm32f2xx_timer_update_pwm(s);
         return;
     case TIM_CCER:
         s->tim_ccer = value;
+        stm32f2xx_timer_update_pwm(s);
         return;
     case TIM_PSC:
         timer_val = stm32f2xx_ns_to_ticks(s, now) - s->tick_offset;
@@ -230,18 +341,23 @@ static void stm32f2xx_timer_write(void *opaque, hwaddr offset,
     case TIM_ARR:
         s->tim_arr = value;
         stm32f2xx_timer_set_alarm(s, now);
+        stm32f2xx_timer_update_pwm(s);
         return;
     case TIM_CCR1:
         s->tim_ccr1 = value;
+        stm32f2xx_timer_update_pwm(s);
         return;
     case TIM_CCR2:
         s->tim_ccr2 = value;
+        stm32f2xx_timer_update_pwm(s);
         return;
     case TIM_CCR3:
         s->tim_ccr3 = value;
+        stm32f2xx_timer_update_pwm(s);
         return;
     case TIM_CCR4:
         s->tim_ccr4 = value;
+        stm32f2xx_timer_update_pwm(s);
         return;
     case TIM_DCR:
         s->tim_dcr = value;
@@ -263,6 +379,28 @@ static void stm32f2xx_timer_write(void *opaque, hwaddr offset,
      */
     s->tick_offset = stm32f2xx_ns_to_ticks(s, now) - timer_val;
     stm32f2xx_timer_set_alarm(s, now);
+    if (offset == TIM_PSC) {
+        stm32f2xx_timer_update_pwm(s);
+    }
+}
+
+static void stm32f2xx_timer_write(void *opaque, hwaddr offset,
+                        uint64_t val64, unsigned size)
+{
+    STM32F2XXTimerState *s = opaque;
+    uint32_t value = val64;
+    bool update;
+
+    DB_PRINT("Write 0x%x, 0x%"HWADDR_PRIx"\n", value, offset);
+
+    qemu_mutex_lock(&s->lock);
+    stm32f2xx_timer_write_locked(s, offset, value);
+    update = stm32f2xx_timer_pwm_pending(s);
+    qemu_mutex_unlock(&s->lock);
+
+    if (update) {
+        stm32f2xx_timer_update_outputs(s);
+    }
 }
 
 static const MemoryRegionOps stm32f2xx_timer_ops = {
@@ -271,10 +409,23 @@ static const MemoryRegionOps stm32f2xx_timer_ops = {
     .endianness = DEVICE_NATIVE_ENDIAN,
 };
 
+static int stm32f2xx_timer_post_load(void *opaque, int version_id)
+{
+    STM32F2XXTimerState *s = opaque;
+
+    if (version_id < 2) {
+        stm32f2xx_timer_update_pwm(s);
+    }
+    /* The devices on the other end of the outputs restore their own state */
+    memcpy(s->pwm_out_ns, s->pwm_pulse_ns, sizeof(s->pwm_out_ns));
+    return 0;
+}
+
 static const VMStateDescription vmstate_stm32f2xx_timer = {
     .name = TYPE_STM32F2XX_TIMER,
-    .version_id = 1,
+    .version_id = 2,
     .minimum_version_id = 1,
+    .post_load = stm32f2xx_timer_post_load,
     .fields = (VMStateField[]) {
         VMSTATE_INT64(tick_offset, STM32F2XXTimerState),
         VMSTATE_UINT32(tim_cr1, STM32F2XXTimerState),
@@ -295,6 +446,8 @@ static const VMStateDescription vmstate_stm32f2xx_timer = {
         VMSTATE_UINT32(tim_dcr, STM32F2XXTimerState),
         VMSTATE_UINT32(tim_dmar, STM32F2XXTimerState),
         VMSTATE_UINT32(tim_or, STM32F2XXTimerState),
+        VMSTATE_UINT64_ARRAY_V(pwm_pulse_ns, STM32F2XXTimerState,
+                               TIM_NUM_CHANNELS, 2),
         VMSTATE_END_OF_LIST()
     }
 };
@@ -310,15 +463,20 @@ static void stm32f2xx_timer_init(Object *obj)
     STM32F2XXTimerState *s = STM32F2XXTIMER(obj);
 
     sysbus_init_irq(SYS_BUS_DEVICE(obj), &s->irq);
+    qdev_init_gpio_out_named(DEVICE(obj), s->pwm, STM32F2XX_TIMER_PWM,
+                             TIM_NUM_CHANNELS);
 
     memory_region_init_io(&s->iomem, obj, &stm32f2xx_timer_ops, s,
                           "stm32f2xx_timer", 0x400);
+    memory_region_clear_global_locking(&s->iomem);
     sysbus_init_mmio(SYS_BUS_DEVICE(obj), &s->iomem);
 }
 
 static void stm32f2xx_timer_realize(DeviceState *dev, Error **errp)
 {
     STM32F2XXTimerState *s = STM32F2XXTIMER(dev);
+    qemu_mutex_init(&s->lock);
+    qemu_mutex_init(&s->out_lock);
     s->timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, stm32f2xx_timer_interrupt, s);
 }
 
@@ -119,7 +119,7 @@ static void cmsdk_apb_watchdog_update(CMSDKAPBWatchdog *s)
 static uint64_t cmsdk_apb_watchdog_read(void *opaque, hwaddr offset,
                                         unsigned size)
 {
-    CMSDKAPBWatchdog *s = CMSDK_APB_WATCHDOG(opaque);
+    CMSDKAPBWatchdog *s = opaque;
     uint64_t r;
 
     switch (offset) {
@@ -182,7 +182,7 @@ bad_offset:
 static void cmsdk_apb_watchdog_write(void *opaque, hwaddr offset,
                                      uint64_t value, unsigned size)
 {
-    CMSDKAPBWatchdog *s = CMSDK_APB_WATCHDOG(opaque);
+    CMSDKAPBWatchdog *s = opaque;
 
     trace_cmsdk_apb_watchdog_write(offset, value, size);
 
@@ -313,8 +313,9 @@ static void cmsdk_apb_watchdog_init(Object *obj)
     SysBusDevice *sbd = SYS_BUS_DEVICE(obj);
     CMSDKAPBWatchdog *s = CMSDK_APB_WATCHDOG(obj);
 
-    memory_region_init_io(&s->iomem, obj, &cmsdk_apb_watchdog_ops,
-                          s, "cmsdk-apb-watchdog", 0x1000);
+    memory_region_init_io_typed(&s->iomem, obj, &cmsdk_apb_watchdog_ops,
+                                s, TYPE_CMSDK_APB_WATCHDOG,
+                                "cmsdk-apb-watchdog", 0x1000);
     sysbus_init_mmio(sbd, &s->iomem);
     sysbus_init_irq(sbd, &s->wdogint);
 
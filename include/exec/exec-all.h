@@ -66,11 +66,36 @@ bool cpu_restore_state(CPUState *cpu, uintptr_t searched_pc, bool will_exit);
 
 void QEMU_NORETURN cpu_loop_exit_noexc(CPUState *cpu);
 void QEMU_NORETURN cpu_io_recompile(CPUState *cpu, uintptr_t retaddr);
+extern uint32_t tb_trace_threshold;
+bool tb_trace_head(target_ulong pc);
+void tb_trace_hot(TranslationBlock *tb);
+#ifdef CONFIG_USER_ONLY
+static inline bool tb_io_insn(target_ulong pc)
+{
+    return false;
+}
+#else
+bool tb_io_insn(target_ulong pc);
+#endif
 TranslationBlock *tb_gen_code(CPUState *cpu,
                               target_ulong pc, target_ulong cs_base,
                               uint32_t flags,
                               int cflags);
 
+/*
+ * Helpers for translating guest code before it first runs.
+ *
+ * tb_pretranslate_room: returns false once the code buffer is too full
+ * for more translation ahead of the guest, keeping the rest of it for
+ * lazy translation.
+ *
+ * tb_pretranslate_mapped: returns true if [@pc, @pc + @len) can be fetched
+ * with the current MMU index without raising a guest fault.
+ */
+bool tb_pretranslate_room(void);
+bool tb_pretranslate_mapped(CPUArchState *env, target_ulong pc,
+                            target_ulong len);
+
 void QEMU_NORETURN cpu_loop_exit(CPUState *cpu);
 void QEMU_NORETURN cpu_loop_exit_restore(CPUState *cpu, uintptr_t pc);
 void QEMU_NORETURN cpu_loop_exit_atomic(CPUState *cpu, uintptr_t pc);
@@ -376,6 +401,8 @@ struct TranslationBlock {
     uint16_t size;      /* size of target code for this block (1 <=
                            size <= TARGET_PAGE_SIZE) */
     uint16_t icount;
+    uint16_t icount_cost; /* icount units charged, equal to icount unless
+                             the target models instruction timing */
     uint32_t cflags;    /* compile flags */
 #define CF_COUNT_MASK  0x00007fff
 #define CF_LAST_IO     0x00008000 /* Last insn may be an IO access.  */
@@ -383,6 +410,8 @@ struct TranslationBlock {
 #define CF_USE_ICOUNT  0x00020000
 #define CF_INVALID     0x00040000 /* TB is stale. Set with @jmp_lock held */
 #define CF_PARALLEL    0x00080000 /* Generate code for a parallel context */
+#define CF_INSN_COST   0x00100000 /* Search data has an icount cost column */
+#define CF_ROM         0x00200000 /* Code is in ROM, not on the page lists */
 #define CF_CLUSTER_MASK 0xff000000 /* Top 8 bits are cluster ID */
 #define CF_CLUSTER_SHIFT 24
 /* cflags' mask for hashing/comparison */
@@ -392,6 +421,20 @@ struct TranslationBlock {
     /* Per-vCPU dynamic tracing state used to generate this TB */
     uint32_t trace_vcpu_dstate;
 
+    /* Executions left before a hot trace is formed at pc */
+    uint32_t exec_count;
+
+    /* Execution profile for pc, or NULL; see accel/tcg/tb-profile.c */
+    struct TBProfile *prof;
+
+    /*
+     * Target of the indirect jump cached in direct jump slot 0, see
+     * tcg_gen_lookup_and_goto_tb().  Only meaningful while jmp_dest[0]
+     * is set.
+     */
+    target_ulong indirect_pc;
+    uint32_t indirect_flags;
+
     struct tb_tc tc;
 
     /* original tb when cflags has CF_NOCACHE */
@@ -466,6 +509,8 @@ TranslationBlock *tb_htable_lookup(CPUState *cpu, target_ulong pc,
                                    target_ulong cs_base, uint32_t flags,
                                    uint32_t cf_mask);
 void tb_set_jmp_target(TranslationBlock *tb, int n, uintptr_t addr);
+void tb_unlink_jump(TranslationBlock *tb, int n);
+void tb_link_indirect(TranslationBlock *tb, TranslationBlock *tb_next);
 
 /* GETPC is the true target of the return instruction that we'll execute.  */
 #if defined(CONFIG_TCG_INTERPRETER)
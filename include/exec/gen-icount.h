@@ -71,12 +71,12 @@ static inline void gen_tb_start(TranslationBlock *tb)
     tcg_temp_free_i32(count);
 }
 
-static inline void gen_tb_end(TranslationBlock *tb, int num_insns)
+static inline void gen_tb_end(TranslationBlock *tb, int icount_cost)
 {
     if (tb_cflags(tb) & CF_USE_ICOUNT) {
-        /* Update the num_insn immediate parameter now that we know
-         * the actual insn count.  */
-        tcg_set_insn_param(icount_start_insn, 1, num_insns);
+        /* Update the icount immediate parameter now that we know
+         * the actual cost of the TB.  */
+        tcg_set_insn_param(icount_start_insn, 1, icount_cost);
     }
 
     gen_set_label(tcg_ctx->exitreq_label);
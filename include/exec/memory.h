@@ -794,6 +794,32 @@ void memory_region_init_io(MemoryRegion *mr,
                            const char *name,
                            uint64_t size);
 
+/**
+ * memory_region_init_io_typed: Initialize an I/O memory region whose
+ *                              opaque is a QOM object of a known type.
+ *
+ * Like memory_region_init_io(), but checks once that @opaque is an instance
+ * of @typename.  The callbacks in @ops can then assign @opaque straight to
+ * a pointer to that type, instead of going through a checked QOM cast on
+ * every access.
+ *
+ * @mr: the #MemoryRegion to be initialized.
+ * @owner: the object that tracks the region's reference count
+ * @ops: a structure containing read and write callbacks to be used when
+ *       I/O is performed on the region.
+ * @opaque: QOM object passed to the read and write callbacks of @ops.
+ * @typename: QOM type that @opaque must be an instance of.
+ * @name: used for debugging; not visible to the user or ABI
+ * @size: size of the region.
+ */
+void memory_region_init_io_typed(MemoryRegion *mr,
+                                 struct Object *owner,
+                                 const MemoryRegionOps *ops,
+                                 void *opaque,
+                                 const char *typename,
+                                 const char *name,
+                                 uint64_t size);
+
 /**
  * memory_region_init_ram_nomigrate:  Initialize RAM memory region.  Accesses
  *                                    into the region will modify memory
@@ -1156,6 +1182,33 @@ void memory_region_init_rom_device(MemoryRegion *mr,
                                    uint64_t size,
                                    Error **errp);
 
+/**
+ * memory_region_init_rom_device_typed: Initialize a ROM memory region
+ *                                      whose opaque is a QOM object of a
+ *                                      known type.
+ *
+ * Like memory_region_init_rom_device(), but checks once that @opaque is an
+ * instance of @typename; see memory_region_init_io_typed().
+ *
+ * @mr: the #MemoryRegion to be initialized.
+ * @owner: the object that tracks the region's reference count
+ * @ops: callbacks for write access handling (must not be NULL).
+ * @opaque: QOM object passed to the read and write callbacks of @ops.
+ * @typename: QOM type that @opaque must be an instance of.
+ * @name: Region name, becomes part of RAMBlock name used in migration stream
+ *        must be unique within any device
+ * @size: size of the region.
+ * @errp: pointer to Error*, to store an error if it happens.
+ */
+void memory_region_init_rom_device_typed(MemoryRegion *mr,
+                                         struct Object *owner,
+                                         const MemoryRegionOps *ops,
+                                         void *opaque,
+                                         const char *typename,
+                                         const char *name,
+                                         uint64_t size,
+                                         Error **errp);
+
 
 /**
  * memory_region_owner: get a memory region's owner.
@@ -53,6 +53,9 @@ typedef enum DisasJumpType {
     DISAS_TARGET_11,
 } DisasJumpType;
 
+/* Maximum number of blocks of guest code joined into a hot trace */
+#define TRANSLATOR_TRACE_MAX_BLOCKS 8
+
 /**
  * DisasContextBase:
  * @tb: Translation block for this disassembly.
@@ -63,6 +66,16 @@ typedef enum DisasJumpType {
  * @num_insns: Number of translated instructions (including current).
  * @max_insns: Maximum number of instructions to be translated in this TB.
  * @singlestep_enabled: "Hardware" single stepping enabled.
+ * @insn_cost: icount units charged for the current instruction. Reset to 1
+ *             before each instruction; targets that model instruction timing
+ *             may change it from @translate_insn.
+ * @icount_cost: icount units charged for the instructions translated so far.
+ * @trace: This TB is a hot trace, see translator_trace_follow().
+ * @trace_end: End of the furthest guest code included in the trace so far.
+ * @trace_blocks: Start of each block of guest code included in the trace.
+ * @num_trace_blocks: Number of entries in @trace_blocks.
+ * @side_exits: Side exits emitted by translator_side_exit().
+ * @num_side_exits: Number of entries in @side_exits.
  *
  * Architecture-agnostic disassembly context.
  */
@@ -74,6 +87,17 @@ typedef struct DisasContextBase {
     int num_insns;
     int max_insns;
     bool singlestep_enabled;
+    int insn_cost;
+    int icount_cost;
+    bool trace;
+    target_ulong trace_end;
+    target_ulong trace_blocks[TRANSLATOR_TRACE_MAX_BLOCKS];
+    int num_trace_blocks;
+    struct {
+        TCGOp *icount_op;
+        int icount_cost;
+    } side_exits[TRANSLATOR_TRACE_MAX_BLOCKS];
+    int num_side_exits;
 } DisasContextBase;
 
 /**
@@ -145,6 +169,30 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
 
 void translator_loop_temp_check(DisasContextBase *db);
 
+/**
+ * translator_trace_follow:
+ * @db: Disassembly context.
+ * @dest: Guest address translation would continue at.
+ *
+ * Called by targets for a direct branch when @db->trace is set.  Returns
+ * true if the trace goes on at @dest; the target then sets @db->pc_next
+ * to @dest instead of ending the TB with the branch.  Traces only follow
+ * branches forward of their start within its page, never return to code
+ * they already include, and join at most TRANSLATOR_TRACE_MAX_BLOCKS
+ * blocks.
+ */
+bool translator_trace_follow(DisasContextBase *db, target_ulong dest);
+
+/**
+ * translator_side_exit:
+ * @db: Disassembly context.
+ *
+ * Called by targets on the path that leaves a trace in the middle, after
+ * the current instruction, before they emit the exit itself.  Gives back
+ * the icount budget of the rest of the trace, which was charged up front.
+ */
+void translator_side_exit(DisasContextBase *db);
+
 /*
  * Translator Load Functions
  *
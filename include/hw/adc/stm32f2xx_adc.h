@@ -57,6 +57,11 @@
 
 
 #define ADC_CR1_RES ((s->stm32f1xx)?0x0:0x3000000)
+#define ADC_CR1_SCAN    0x100
+
+#define ADC_SQ_BITS     5
+#define ADC_SQ_PER_REG  6
+#define ADC_SQR1_L(v)   (((v) >> 20) & 0xF)
 
 #define ADC_COMMON_ADDRESS 0x100
 
@@ -65,6 +70,12 @@
     OBJECT_CHECK(STM32F2XXADCState, (obj), TYPE_STM32F2XX_ADC)
 #define STM32F2XX_ADC_DMA_REQUEST "stm32f2xx-adc-dma-req"
 
+/*
+ * Returns the raw 12-bit conversion result for @channel. Called when the
+ * conversion is read, so the source can compute the value lazily.
+ */
+typedef uint32_t (*STM32F2XXADCSample)(void *opaque, int channel);
+
 typedef struct {
     /* <private> */
     SysBusDevice parent_obj;
@@ -87,10 +98,19 @@ typedef struct {
     uint32_t adc_jdr[4];
     uint32_t adc_dr;
 
+    /* Position in the regular sequence */
+    uint8_t seq_idx;
+
+    STM32F2XXADCSample sample;
+    void *sample_opaque;
+
     bool stm32f1xx;
 
     qemu_irq irq;
     qemu_irq dma_req;
 } STM32F2XXADCState;
 
+void stm32f2xx_adc_set_sampler(STM32F2XXADCState *s, STM32F2XXADCSample fn,
+                               void *opaque);
+
 #endif /* HW_STM32F2XX_ADC_H */
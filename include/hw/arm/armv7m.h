@@ -17,6 +17,17 @@
 #define TYPE_BITBAND "ARM,bitband-memory"
 #define BITBAND(obj) OBJECT_CHECK(BitBandState, (obj), TYPE_BITBAND)
 
+/* Size of the memory window aliased by a bitband region */
+#define BITBAND_SOURCE_SIZE 0x100000
+
+/* Part of the flat view of the bitband source window */
+typedef struct BitBandSection {
+    MemoryRegion *mr;
+    hwaddr start;
+    hwaddr size;
+    hwaddr offset_within_region;
+} BitBandSection;
+
 typedef struct {
     /*< private >*/
     SysBusDevice parent_obj;
@@ -26,6 +37,11 @@ typedef struct {
     MemoryRegion iomem;
     uint32_t base;
     MemoryRegion *source_memory;
+
+    /* Flat view of the source window, rebuilt on every topology change */
+    MemoryListener listener;
+    GArray *sections;
+    unsigned last_section;
 } BitBandState;
 
 #define TYPE_ARMV7M "armv7m"
@@ -70,6 +86,7 @@ typedef struct ARMv7MState {
     bool start_powered_off;
     bool vfp;
     bool dsp;
+    bool pretranslate;
 } ARMv7MState;
 
 #endif
@@ -28,6 +28,7 @@
 #include "hw/misc/stm32f2xx_syscfg.h"
 #include "hw/timer/stm32f2xx_timer.h"
 #include "hw/timer/stm32f1xx_rcc.h"
+#include "hw/misc/stm32f1xx_flash.h"
 #include "hw/char/stm32f2xx_usart.h"
 #include "hw/adc/stm32f2xx_adc.h"
 #include "hw/gpio/stm32f1xx_gpio.h"
@@ -52,6 +53,9 @@
 #define SRAM_BASE_ADDRESS 0x20000000
 #define SRAM_SIZE (128 * 1024)
 
+/* TIMxCLK with the usual 72 MHz SYSCLK and APB1 prescaler of 2 */
+#define STM32F103_TIMER_CLOCK_HZ 72000000
+
 typedef struct STM32F103State {
     /*< private >*/
     SysBusDevice parent_obj;
@@ -59,7 +63,15 @@ typedef struct STM32F103State {
 
     char *cpu_type;
     char *firmware;
+    /* Let translated code read flash and SRAM without the softmmu TLB */
+    bool flat_mem;
 
+    /*
+     * Optional per-USART character backends. A board may set these before
+     * realize to attach on-board peripherals (e.g. stepper drivers) to a
+     * USART; unset entries fall back to serial_hd().
+     */
+    Chardev *usart_chr[STM_NUM_USARTS];
 
     ARMv7MState armv7m;
 
@@ -69,6 +81,7 @@ typedef struct STM32F103State {
     STM32F2XXADCState adc[STM_NUM_ADCS];
     STM32F2XXSPIState spi[STM_NUM_SPIS];
     STM32F1XXRCCState rcc;
+    STM32F1XXFlashState flash;
     STM32F1XXGPIOState gpio[STM_NUM_GPIOS];
     STM32F1XXDMAState dma[STM_NUM_DMAS];
 
@@ -27,6 +27,7 @@
 
 #include "hw/sysbus.h"
 #include "chardev/char-fe.h"
+#include "qemu/thread.h"
 
 #define USART_SR   0x00
 #define USART_DR   0x04
@@ -62,6 +63,7 @@ typedef struct {
 
     /* <public> */
     MemoryRegion mmio;
+    QemuMutex lock;
 
     uint32_t usart_sr;
     uint32_t usart_dr;
@@ -73,5 +75,10 @@ typedef struct {
 
     CharBackend chr;
     qemu_irq irq;
+    /* Level the registers ask for, and the one being driven under the BQL */
+    bool irq_level;
+    bool irq_out;
+    /* can_receive refused input that accept_input must now ask for again */
+    bool rx_throttled;
 } STM32F2XXUsartState;
 #endif /* HW_STM32F2XX_USART_H */
@@ -24,6 +24,7 @@
 #define STM32F1XX_DMA_H
 
 #include "hw/sysbus.h"
+#include "qemu/thread.h"
 
 #define TYPE_STM32F1XX_DMA "stm32f1xx-dma"
 #define STM32F1XX_DMA(obj) \
@@ -46,6 +47,7 @@ typedef struct {
     MemoryRegion *dma_mr;
     AddressSpace dma_as;
     MemoryRegion mmio_dma;
+    QemuMutex lock;
     uint8_t channel_count;
 
     STM32F1XXDMAChan chan_dma[STM32F1XX_DMA_MAXCHANS];
@@ -21,6 +21,7 @@
 #define STM32F1XX_GPIO_H
 
 #include "hw/sysbus.h"
+#include "qemu/thread.h"
 #include <mqueue.h>
 
 #define TYPE_STM32F1XX_GPIO "stm32f1xx.gpio"
@@ -68,6 +69,9 @@ typedef struct STM32F1XXGPIOState {
 
     /*< public >*/
     MemoryRegion iomem;
+    QemuMutex lock;
+    /* Serializes driving out[], taken before lock */
+    QemuMutex out_lock;
 
     uint8_t  cnf[GPIO_PIN_COUNT];
     uint8_t  mode[GPIO_PIN_COUNT];
@@ -75,6 +79,15 @@ typedef struct STM32F1XXGPIOState {
     uint16_t idr;
     uint16_t lck;
     uint8_t  lckk;
+
+    /*
+     * Pin level outputs (ODR) and external input levels (IDR). out[] is
+     * driven without the BQL, so whatever is connected to it must do its
+     * own locking.
+     */
+    qemu_irq out[GPIO_PIN_COUNT];
+    /* Levels being driven on out[], updated under out_lock and lock */
+    uint16_t out_level;
 } STM32F1XXGPIOState;
 
 #endif /* STM32F1XX */
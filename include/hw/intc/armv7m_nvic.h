@@ -11,6 +11,7 @@
 #define HW_ARM_ARMV7M_NVIC_H
 
 #include "target/arm/cpu.h"
+#include "qemu/bitmap.h"
 #include "hw/sysbus.h"
 #include "hw/timer/armv7m_systick.h"
 
@@ -23,6 +24,9 @@
 #define NVIC_MAX_VECTORS 512
 /* Number of internal exceptions */
 #define NVIC_INTERNAL_VECTORS 16
+/* Bit for sec_vectors[0] in the pending and active maps */
+#define NVIC_SEC_MAP_BASE NVIC_MAX_VECTORS
+#define NVIC_MAP_BITS (NVIC_MAX_VECTORS + NVIC_INTERNAL_VECTORS)
 
 typedef struct VecInfo {
     /* Exception priorities can range from -3 to 255; only the unmodifiable
@@ -35,6 +39,32 @@ typedef struct VecInfo {
     uint8_t level; /* exceptions <=15 never set level */
 } VecInfo;
 
+/*
+ * Interrupt timing statistics, in nanoseconds of virtual time.
+ * Bucket 0 counts samples below 128ns, bucket n counts samples in
+ * [64 << n, 128 << n) and the last bucket everything above that.
+ */
+#define NVIC_HIST_BUCKETS 16
+
+typedef struct NVICHistogram {
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t min_ns;
+    uint64_t max_ns;
+    uint64_t bucket[NVIC_HIST_BUCKETS];
+} NVICHistogram;
+
+typedef struct NVICIrqStats {
+    /* Timestamps of the last pend and activation, or -1 */
+    int64_t pending_ns;
+    int64_t active_ns;
+
+    NVICHistogram latency;
+    NVICHistogram duration;
+    uint64_t preempted;
+    uint64_t tail_chained;
+} NVICIrqStats;
+
 typedef struct NVICState {
     /*< private >*/
     SysBusDevice parent_obj;
@@ -76,6 +106,12 @@ typedef struct NVICState {
     bool vectpending_is_s_banked;
     int exception_prio; /* group prio of the highest prio active exception */
     int vectpending_prio; /* group prio of the exeception in vectpending */
+    /* Also cached, so that the recomputation only has to visit the
+     * exceptions which are enabled and pending, or active. Bit n is
+     * vectors[n]; bit NVIC_SEC_MAP_BASE + n is sec_vectors[n].
+     */
+    DECLARE_BITMAP(pending_map, NVIC_MAP_BITS);
+    DECLARE_BITMAP(active_map, NVIC_MAP_BITS);
 
     MemoryRegion sysregmem;
     MemoryRegion sysreg_ns_mem;
@@ -84,6 +120,8 @@ typedef struct NVICState {
     MemoryRegion container;
 
     uint32_t num_irq;
+    /* Per exception timing statistics, num_irq entries */
+    NVICIrqStats *stats;
     qemu_irq excpout;
     qemu_irq sysresetreq;
 
@@ -0,0 +1,97 @@
+/*
+ * Bed levelling probes (BLTouch, inductive)
+ *
+ * Copyright (c) 2020 Taras Zakharchenko <taras.zakharchenko@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HW_MISC_BED_PROBE_H
+#define HW_MISC_BED_PROBE_H
+
+#include "hw/sysbus.h"
+#include "hw/misc/tmc22xx.h"
+#include "qemu/thread.h"
+#include "qemu/timer.h"
+
+#define TYPE_BED_PROBE "bed-probe"
+#define BED_PROBE(obj) OBJECT_CHECK(BedProbeState, (obj), TYPE_BED_PROBE)
+#define BED_PROBE_CLASS(klass) \
+    OBJECT_CLASS_CHECK(BedProbeClass, (klass), TYPE_BED_PROBE)
+#define BED_PROBE_GET_CLASS(obj) \
+    OBJECT_GET_CLASS(BedProbeClass, (obj), TYPE_BED_PROBE)
+
+#define TYPE_BLTOUCH "bltouch"
+#define TYPE_INDUCTIVE_PROBE "inductive-probe"
+
+/* Named GPIO lines */
+#define BED_PROBE_OUT           "bed-probe-out"
+/* Servo signal as a pin level */
+#define BED_PROBE_SERVO         "bed-probe-servo"
+/* Servo signal as a PWM high time in ns, see STM32F2XX_TIMER_PWM */
+#define BED_PROBE_SERVO_PULSE   "bed-probe-servo-pulse"
+
+#define BED_PROBE_NUM_AXES      3
+
+typedef struct BedProbeState {
+    /* <private> */
+    SysBusDevice parent_obj;
+
+    /* <public> */
+    /*
+     * The servo inputs are driven by MCU pins and the motion notifier by
+     * a stepper without the BQL; the state below is protected by lock,
+     * which is held when driving out and taken before a stepper's lock.
+     */
+    QemuMutex lock;
+    QEMUTimer *timer;
+    QEMUTimer *pulse_timer;
+    Notifier x_motion;
+    Notifier y_motion;
+    Notifier z_motion;
+
+    bool deployed;
+    bool triggered;
+    bool below;
+    bool sw_mode;
+    int32_t last_cmd;
+    bool servo_level;
+    int64_t servo_rise_ns;
+
+    double *mesh;
+    uint32_t mesh_rows;
+    uint32_t mesh_cols;
+
+    /* Properties */
+    TMC22xxState *stepper[BED_PROBE_NUM_AXES];
+    uint32_t steps_per_mm[BED_PROBE_NUM_AXES];
+    int32_t start_um[BED_PROBE_NUM_AXES];
+    int32_t offset_um[BED_PROBE_NUM_AXES];
+    uint32_t bed_x_um;
+    uint32_t bed_y_um;
+    char *mesh_str;
+    bool active_low;
+
+    qemu_irq out;
+} BedProbeState;
+
+typedef struct BedProbeClass {
+    /* <private> */
+    SysBusDeviceClass parent_class;
+
+    /* <public> */
+    bool has_servo;
+} BedProbeClass;
+
+#endif /* HW_MISC_BED_PROBE_H */
@@ -0,0 +1,108 @@
+/*
+ * 3D printer physics model (heaters, thermistors, axes)
+ *
+ * Copyright (c) 2020 Taras Zakharchenko <taras.zakharchenko@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HW_MISC_PRINTER_PLANT_H
+#define HW_MISC_PRINTER_PLANT_H
+
+#include "hw/sysbus.h"
+#include "hw/misc/tmc22xx.h"
+#include "qemu/thread.h"
+#include "qemu/timer.h"
+
+#define TYPE_PRINTER_PLANT "printer-plant"
+#define PRINTER_PLANT(obj) \
+    OBJECT_CHECK(PrinterPlantState, (obj), TYPE_PRINTER_PLANT)
+
+/* Named GPIO lines */
+#define PRINTER_PLANT_HEATER    "printer-plant-heater"
+#define PRINTER_PLANT_FAN       "printer-plant-fan"
+#define PRINTER_PLANT_ENDSTOP   "printer-plant-endstop"
+
+#define PRINTER_PLANT_HOTEND        0
+#define PRINTER_PLANT_BED           1
+#define PRINTER_PLANT_NUM_HEATERS   2
+#define PRINTER_PLANT_NUM_AXES      3
+
+typedef struct PrinterPlantState PrinterPlantState;
+
+/* Duty cycle of a PWM input, integrated lazily from its edges */
+typedef struct PrinterPlantPWM {
+    bool level;
+    int64_t on_since_ns;
+    int64_t on_ns;
+} PrinterPlantPWM;
+
+typedef struct PrinterPlantHeater {
+    PrinterPlantPWM pwm;
+    /* Temperature in micro degrees C */
+    int64_t temp_uc;
+
+    /* Properties, in milli-units */
+    uint32_t power_mw;
+    uint32_t capacity_mj_per_k;
+    uint32_t resistance_mk_per_w;
+    uint32_t fan_mw_per_k;
+    int32_t adc_channel;
+} PrinterPlantHeater;
+
+typedef struct PrinterPlantAxis {
+    PrinterPlantState *plant;
+    QEMUTimer *timer;
+    Notifier motion;
+    bool triggered;
+    qemu_irq endstop;
+
+    /* Properties */
+    TMC22xxState *stepper;
+    uint32_t steps_per_mm;
+    int32_t start_um;
+} PrinterPlantAxis;
+
+struct PrinterPlantState {
+    /* <private> */
+    SysBusDevice parent_obj;
+
+    /* <public> */
+    /*
+     * Heater and fan inputs are driven by MCU pins and the motion
+     * notifiers by the steppers without the BQL; the state below is
+     * protected by lock, which is held when driving the endstops and taken
+     * before a stepper's lock.
+     */
+    QemuMutex lock;
+    PrinterPlantHeater heater[PRINTER_PLANT_NUM_HEATERS];
+    PrinterPlantAxis axis[PRINTER_PLANT_NUM_AXES];
+    PrinterPlantPWM fan;
+
+    /* Virtual time the thermal state was last advanced to */
+    int64_t last_ns;
+    QEMUTimer *step_timer;
+
+    /* Properties */
+    uint32_t step_ms;
+    int32_t ambient_mc;
+    uint32_t th_r25;
+    uint32_t th_beta;
+    uint32_t th_pullup;
+};
+
+/* STM32F2XXADCSample callback returning thermistor readings */
+uint32_t printer_plant_sample_adc(void *opaque, int channel);
+
+#endif /* HW_MISC_PRINTER_PLANT_H */
@@ -0,0 +1,76 @@
+/*
+ * STM32F1XX flash interface
+ *
+ * Copyright (c) 2020 Taras Zakharchenko <taras.zakharchenko@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#ifndef HW_STM32F1XX_FLASH_H
+#define HW_STM32F1XX_FLASH_H
+
+#include "hw/sysbus.h"
+
+#define FLASH_ACR       0x00
+#define FLASH_KEYR      0x04
+#define FLASH_OPTKEYR   0x08
+#define FLASH_SR        0x0C
+#define FLASH_CR        0x10
+#define FLASH_AR        0x14
+#define FLASH_OBR       0x1C
+#define FLASH_WRPR      0x20
+
+#define FLASH_ACR_LATENCY   0x7
+#define FLASH_ACR_HLFCYA    (1 << 3)
+#define FLASH_ACR_PRFTBE    (1 << 4)
+#define FLASH_ACR_PRFTBS    (1 << 5)
+
+#define FLASH_CR_LOCK       (1 << 7)
+
+#define FLASH_KEY1          0x45670123
+#define FLASH_KEY2          0xCDEF89AB
+
+/* Output line, level is the number of flash wait states */
+#define STM32F1XX_FLASH_LATENCY "stm32f1xx-flash-latency"
+
+#define TYPE_STM32F1XX_FLASH "stm32f1xx-flash"
+#define STM32F1XXFLASH(obj) OBJECT_CHECK(STM32F1XXFlashState, \
+                            (obj), TYPE_STM32F1XX_FLASH)
+
+typedef struct STM32F1XXFlashState {
+    /* <private> */
+    SysBusDevice parent_obj;
+
+    /* <public> */
+    MemoryRegion iomem;
+
+    /* <registers> */
+    uint32_t flash_acr;
+    uint32_t flash_sr;
+    uint32_t flash_cr;
+    uint32_t flash_ar;
+
+    /* Number of KEYR writes of the unlock sequence seen */
+    uint8_t key_seq;
+
+    qemu_irq latency;
+} STM32F1XXFlashState;
+
+#endif /* HW_STM32F1XX_FLASH_H */
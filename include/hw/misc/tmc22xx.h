@@ -0,0 +1,209 @@
+/*
+ * Trinamic TMC2208/TMC2209 stepper motor driver
+ *
+ * Copyright (c) 2020 Taras Zakharchenko <taras.zakharchenko@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 or
+ * (at your option) version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HW_MISC_TMC22XX_H
+#define HW_MISC_TMC22XX_H
+
+#include "hw/sysbus.h"
+#include "chardev/char.h"
+#include "qemu/notify.h"
+#include "qemu/thread.h"
+#include "qemu/timer.h"
+
+#define TYPE_TMC22XX "tmc22xx"
+#define TMC22XX(obj) OBJECT_CHECK(TMC22xxState, (obj), TYPE_TMC22XX)
+#define TMC22XX_CLASS(klass) \
+    OBJECT_CLASS_CHECK(TMC22xxClass, (klass), TYPE_TMC22XX)
+#define TMC22XX_GET_CLASS(obj) \
+    OBJECT_GET_CLASS(TMC22xxClass, (obj), TYPE_TMC22XX)
+
+#define TYPE_TMC2208 "tmc2208"
+#define TYPE_TMC2209 "tmc2209"
+
+#define TYPE_CHARDEV_TMC22XX "chardev-tmc22xx"
+#define TMC22XX_CHARDEV(obj) \
+    OBJECT_CHECK(TMC22xxChardev, (obj), TYPE_CHARDEV_TMC22XX)
+
+/* Named GPIO lines */
+#define TMC22XX_STEP        "tmc22xx-step"
+#define TMC22XX_DIR         "tmc22xx-dir"
+#define TMC22XX_ENN         "tmc22xx-enn"
+#define TMC22XX_PDN_UART    "tmc22xx-pdn-uart"
+#define TMC22XX_PDN_UART_OUT "tmc22xx-pdn-uart-out"
+#define TMC22XX_DIAG        "tmc22xx-diag"
+
+/* Register map */
+#define TMC_GCONF           0x00
+#define TMC_GSTAT           0x01
+#define TMC_IFCNT           0x02
+#define TMC_SLAVECONF       0x03
+#define TMC_OTP_PROG        0x04
+#define TMC_OTP_READ        0x05
+#define TMC_IOIN            0x06
+#define TMC_FACTORY_CONF    0x07
+#define TMC_IHOLD_IRUN      0x10
+#define TMC_TPOWERDOWN      0x11
+#define TMC_TSTEP           0x12
+#define TMC_TPWMTHRS        0x13
+#define TMC_TCOOLTHRS       0x14
+#define TMC_VACTUAL         0x22
+#define TMC_SGTHRS          0x40
+#define TMC_SG_RESULT       0x41
+#define TMC_COOLCONF        0x42
+#define TMC_MSCNT           0x6A
+#define TMC_MSCURACT        0x6B
+#define TMC_CHOPCONF        0x6C
+#define TMC_DRV_STATUS      0x6F
+#define TMC_PWMCONF         0x70
+#define TMC_PWM_SCALE       0x71
+#define TMC_PWM_AUTO        0x72
+
+#define TMC_NUM_REGS        0x80
+
+#define TMC_GCONF_SHAFT             (1 << 3)
+#define TMC_GSTAT_RESET             (1 << 0)
+#define TMC_CHOPCONF_TOFF           0xF
+#define TMC_CHOPCONF_MRES_SHIFT     24
+#define TMC_DRV_STATUS_STST         (1u << 31)
+#define TMC_DRV_STATUS_CS_SHIFT     16
+#define TMC_SLAVECONF_SENDDELAY(v)  (((v) >> 8) & 0xF)
+
+#define TMC_SYNC                    0x05
+#define TMC_SYNC_MASK               0x0F
+#define TMC_MASTER_ADDR             0xFF
+#define TMC_WRITE_FLAG              0x80
+#define TMC_READ_DATAGRAM_LEN       4
+#define TMC_WRITE_DATAGRAM_LEN      8
+
+/* Internal clock, used for TSTEP and standstill detection */
+#define TMC_FCLK_HZ                 12000000
+#define TMC_TSTEP_MAX               0xFFFFF
+
+#define TMC22XX_MAX_SLAVES          4
+
+typedef struct TMC22xxChardev TMC22xxChardev;
+
+typedef struct TMC22xxState {
+    /* <private> */
+    SysBusDevice parent_obj;
+
+    /* <public> */
+    /*
+     * STEP/DIR/ENN are driven by MCU pins without the BQL; everything
+     * below is protected by lock.  DIAG and PDN_UART_OUT are driven with
+     * it held, motion notifiers are called without it.
+     */
+    QemuMutex lock;
+    uint32_t regs[TMC_NUM_REGS];
+
+    /* STEP/DIR integrator, in step pulses */
+    int32_t position;
+    bool step;
+    bool dir;
+    bool enn;
+    int64_t last_step_ns;
+    int64_t step_period_ns;
+    int8_t motion_dir;
+    uint32_t tstep;
+    bool diag;
+    /* Steps taken since the machine was created, for benchmarks */
+    uint64_t step_count;
+
+    /*
+     * Notified on motion changes that invalidate a prediction of future
+     * positions: direction reversal, start from standstill, or a step rate
+     * change of more than 1/8 since the last notification.
+     */
+    NotifierList motion_notifiers;
+    int64_t notified_period_ns;
+
+    /* Single wire UART on the PDN_UART pin */
+    QEMUTimer *pdn_rx_timer;
+    QEMUTimer *pdn_tx_timer;
+    bool pdn_level;
+    bool pdn_in_frame;
+    int64_t pdn_next_sample_ns;
+    int64_t pdn_last_byte_ns;
+    uint8_t pdn_sample_idx;
+    uint8_t pdn_byte;
+    uint8_t pdn_rx[TMC_WRITE_DATAGRAM_LEN];
+    uint8_t pdn_rx_len;
+    uint8_t pdn_tx[TMC_WRITE_DATAGRAM_LEN];
+    uint8_t pdn_tx_len;
+    uint16_t pdn_tx_bit;
+
+    /* Properties */
+    uint8_t slave_addr;
+    uint32_t pdn_baud;
+    uint32_t sg_free;
+    int32_t stall_min;
+    int32_t stall_max;
+    TMC22xxChardev *uart;
+
+    qemu_irq diag_irq;
+    qemu_irq pdn_out;
+} TMC22xxState;
+
+typedef struct TMC22xxClass {
+    /* <private> */
+    SysBusDeviceClass parent_class;
+
+    /* <public> */
+    uint8_t version;
+    bool has_stallguard;
+} TMC22xxClass;
+
+/*
+ * UART backend shared by up to four drivers on one wire. Plug it into a
+ * USART frontend; drivers attach to it through their "uart" link property.
+ */
+struct TMC22xxChardev {
+    Chardev parent;
+
+    TMC22xxState *slaves[TMC22XX_MAX_SLAVES];
+    int num_slaves;
+    uint32_t baud;
+
+    uint8_t rx[TMC_WRITE_DATAGRAM_LEN];
+    uint8_t rx_len;
+    uint8_t tx[TMC_WRITE_DATAGRAM_LEN];
+    uint8_t tx_len;
+    uint8_t tx_pos;
+    bool tx_blocked;
+    QEMUTimer *tx_timer;
+};
+
+Chardev *tmc22xx_uart_new(const char *id, uint32_t baud, Error **errp);
+
+int32_t tmc22xx_get_position(TMC22xxState *s);
+/*
+ * Returns the direction of the current motion (-1, 0 at standstill, 1)
+ * and the time of the last step and the period between the last two steps.
+ */
+int tmc22xx_get_motion(TMC22xxState *s, int64_t *last_step_ns,
+                       int64_t *period_ns);
+void tmc22xx_add_motion_notifier(TMC22xxState *s, Notifier *n);
+/*
+ * Predict when the current move reaches @target assuming a constant step
+ * rate, for arming a single deadline instead of checking every step.
+ * Returns -1 if the motor is not moving towards @target.
+ */
+int64_t tmc22xx_predict_crossing(TMC22xxState *s, int32_t target);
+
+#endif /* HW_MISC_TMC22XX_H */
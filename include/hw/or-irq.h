@@ -27,6 +27,7 @@
 
 #include "hw/sysbus.h"
 #include "qom/object.h"
+#include "qemu/thread.h"
 
 #define TYPE_OR_IRQ "or-irq"
 
@@ -42,6 +43,7 @@ typedef struct OrIRQState qemu_or_irq;
 struct OrIRQState {
     DeviceState parent_obj;
 
+    QemuMutex lock;
     qemu_irq out_irq;
     bool levels[MAX_OR_LINES];
     uint16_t num_lines;
@@ -26,6 +26,7 @@
 #define HW_STM32F2XX_TIMER_H
 
 #include "hw/sysbus.h"
+#include "qemu/thread.h"
 #include "qemu/timer.h"
 
 #define TIM_CR1      0x00
@@ -60,6 +61,24 @@
 
 #define TIM_DIER_UIE  1
 
+#define TIM_NUM_CHANNELS    4
+#define TIM_CCMR_OCM(ccmr, ch)  (((ccmr) >> (4 + 8 * ((ch) & 1))) & 0x7)
+#define TIM_OCM_FORCE_LOW   4
+#define TIM_OCM_FORCE_HIGH  5
+#define TIM_OCM_PWM1        6
+#define TIM_OCM_PWM2        7
+#define TIM_CCER_CCE(ch)    (1 << (4 * (ch)))
+#define TIM_CCER_CCP(ch)    (2 << (4 * (ch)))
+
+/*
+ * Compare output channels. The line level is the high time of the PWM
+ * waveform in nanoseconds, saturated to INT_MAX, updated whenever the
+ * configuration changes.
+ * The lines are driven without the BQL, so whatever is connected to them
+ * must do its own locking.
+ */
+#define STM32F2XX_TIMER_PWM "stm32f2xx-timer-pwm"
+
 #define TYPE_STM32F2XX_TIMER "stm32f2xx-timer"
 #define STM32F2XXTIMER(obj) OBJECT_CHECK(STM32F2XXTimerState, \
                             (obj), TYPE_STM32F2XX_TIMER)
@@ -70,8 +89,15 @@ typedef struct STM32F2XXTimerState {
 
     /* <public> */
     MemoryRegion iomem;
+    QemuMutex lock;
+    /* Serializes driving pwm[], taken before lock */
+    QemuMutex out_lock;
     QEMUTimer *timer;
     qemu_irq irq;
+    qemu_irq pwm[TIM_NUM_CHANNELS];
+    uint64_t pwm_pulse_ns[TIM_NUM_CHANNELS];
+    /* Levels being driven on pwm[], updated under out_lock and lock */
+    uint64_t pwm_out_ns[TIM_NUM_CHANNELS];
 
     int64_t tick_offset;
     uint64_t hit_time;
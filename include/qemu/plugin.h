@@ -84,6 +84,7 @@ enum plugin_dyn_cb_type {
 enum plugin_dyn_cb_subtype {
     PLUGIN_CB_REGULAR,
     PLUGIN_CB_INLINE,
+    PLUGIN_CB_EDGE, /* TBs only */
     PLUGIN_N_CB_SUBTYPES,
 };
 
@@ -105,6 +106,12 @@ struct qemu_plugin_dyn_cb {
             enum qemu_plugin_op op;
             uint64_t imm;
         } inline_insn;
+        /* @userp points to the map */
+        struct {
+            uint32_t *prev_loc;
+            uint32_t cur_loc;
+            uint32_t mask;
+        } edge;
     };
 };
 
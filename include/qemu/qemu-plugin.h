@@ -249,6 +249,28 @@ void qemu_plugin_register_vcpu_tb_exec_inline(struct qemu_plugin_tb *tb,
                                               enum qemu_plugin_op op,
                                               void *ptr, uint64_t imm);
 
+/**
+ * qemu_plugin_register_vcpu_tb_exec_edge_inline() - inline edge coverage
+ * @tb: the opaque qemu_plugin_tb handle for the translation
+ * @map: the coverage map, one 8-bit hit counter per bucket
+ * @map_size: the number of buckets in @map, a power of 2
+ * @prev_loc: location of the previously executed translated unit
+ * @cur_loc: location of this translated unit, e.g. a hash of its address
+ *
+ * Insert an AFL style edge coverage update to every time a translated
+ * unit executes: increment map[(*prev_loc ^ cur_loc) % map_size] and
+ * set *prev_loc to cur_loc >> 1. The update is generated inline, with
+ * no call out of the translated code.
+ *
+ * @prev_loc is updated without synchronization, so it should not be
+ * shared between vCPUs that run in parallel.
+ */
+void qemu_plugin_register_vcpu_tb_exec_edge_inline(struct qemu_plugin_tb *tb,
+                                                   uint8_t *map,
+                                                   size_t map_size,
+                                                   uint32_t *prev_loc,
+                                                   uint32_t cur_loc);
+
 /**
  * qemu_plugin_register_vcpu_insn_exec_cb() - register insn execution cb
  * @insn: the opaque qemu_plugin_insn handle for an instruction
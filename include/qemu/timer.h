@@ -86,7 +86,8 @@ struct QEMUTimer {
     QEMUTimerList *timer_list;
     QEMUTimerCB *cb;
     void *opaque;
-    QEMUTimer *next;
+    uint64_t seq;               /* orders timers with equal expire_time */
+    int heap_index;             /* position in the timer list's heap */
     int attributes;
     int scale;
 };
@@ -856,6 +857,7 @@ int64_t cpu_get_icount(void);
 int64_t cpu_get_clock(void);
 int64_t cpu_icount_to_ns(int64_t icount);
 void    cpu_update_icount(CPUState *cpu);
+void    cpu_icount_charge(CPUState *cpu, int64_t units);
 
 /*******************************************/
 /* host CPU ticks (if available) */
@@ -833,6 +833,24 @@ void tcg_gen_goto_tb(unsigned idx);
  */
 void tcg_gen_lookup_and_goto_ptr(void);
 
+/**
+ * tcg_gen_lookup_and_goto_tb() - cached variant of lookup_and_goto_ptr
+ * @tb: The TB being translated
+ * @pc: Guest address of the target TB
+ * @flags: TB flags the target TB will be looked up with
+ *
+ * Compare @pc and @flags against the last target cached for @tb and
+ * jump there directly through direct jump slot 0 if they match;
+ * otherwise look the target up as tcg_gen_lookup_and_goto_ptr() does
+ * and cache it.  @tb must not use slot 0 for anything else.
+ *
+ * NOTE: As for tcg_gen_goto_tb(), nothing takes care of the cached jump
+ * when address mapping changes, so this is only suitable for targets
+ * whose code addresses are not remapped at run time and whose cs_base
+ * is constant.
+ */
+void tcg_gen_lookup_and_goto_tb(TranslationBlock *tb, TCGv pc, TCGv_i32 flags);
+
 static inline void tcg_gen_plugin_cb_start(unsigned from, unsigned type,
                                            unsigned wr)
 {
@@ -264,7 +264,7 @@ DEF(cmpsel_vec, 1, 4, 1, IMPLVEC | IMPL(TCG_TARGET_HAS_cmpsel_vec))
 
 DEF(last_generic, 0, 0, 0, TCG_OPF_NOT_PRESENT)
 
-#if TCG_TARGET_MAYBE_vec
+#if TCG_TARGET_MAYBE_vec || defined(CONFIG_TCG_INTERPRETER)
 #include "tcg-target.opc.h"
 #endif
 
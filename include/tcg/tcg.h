@@ -640,6 +640,10 @@ struct TCGContext {
 #ifdef TCG_TARGET_NEED_POOL_LABELS
     struct TCGLabelPoolData *pool_labels;
 #endif
+#ifdef CONFIG_TCG_INTERPRETER
+    /* Last op a following op may be fused into, NULL after a label */
+    uint8_t *tci_fuse_ptr;
+#endif
 
     TCGLabel *exitreq_label;
 
@@ -672,6 +676,8 @@ struct TCGContext {
 
     uint16_t gen_insn_end_off[TCG_MAX_INSNS];
     target_ulong gen_insn_data[TCG_MAX_INSNS][TARGET_INSN_START_WORDS];
+    /* icount units charged before each insn, see TranslationBlock.icount_cost */
+    uint16_t gen_insn_cost[TCG_MAX_INSNS];
 };
 
 extern TCGContext tcg_init_ctx;
@@ -817,6 +823,8 @@ TranslationBlock *tcg_tb_alloc(TCGContext *s);
 
 void tcg_region_init(void);
 void tcg_region_reset_all(void);
+bool tcg_region_available(void);
+bool tcg_region_evict(void (*evict_tb)(TranslationBlock *tb));
 
 size_t tcg_code_size(void);
 size_t tcg_code_capacity(void);
@@ -1501,6 +1501,30 @@ void memory_region_init_io(MemoryRegion *mr,
     mr->terminates = true;
 }
 
+/* Unconditional, unlike the QOM cast checks it replaces */
+static void memory_region_check_opaque_type(void *opaque,
+                                            const char *typename,
+                                            const char *name)
+{
+    if (!object_dynamic_cast(OBJECT(opaque), typename)) {
+        error_report("opaque of memory region '%s' is a %s, not a %s",
+                     name, object_get_typename(OBJECT(opaque)), typename);
+        abort();
+    }
+}
+
+void memory_region_init_io_typed(MemoryRegion *mr,
+                                 Object *owner,
+                                 const MemoryRegionOps *ops,
+                                 void *opaque,
+                                 const char *typename,
+                                 const char *name,
+                                 uint64_t size)
+{
+    memory_region_check_opaque_type(opaque, typename, name);
+    memory_region_init_io(mr, owner, ops, opaque, name, size);
+}
+
 void memory_region_init_ram_nomigrate(MemoryRegion *mr,
                                       Object *owner,
                                       const char *name,
@@ -3221,6 +3245,19 @@ void memory_region_init_rom_device(MemoryRegion *mr,
     vmstate_register_ram(mr, owner_dev);
 }
 
+void memory_region_init_rom_device_typed(MemoryRegion *mr,
+                                         struct Object *owner,
+                                         const MemoryRegionOps *ops,
+                                         void *opaque,
+                                         const char *typename,
+                                         const char *name,
+                                         uint64_t size,
+                                         Error **errp)
+{
+    memory_region_check_opaque_type(opaque, typename, name);
+    memory_region_init_rom_device(mr, owner, ops, opaque, name, size, errp);
+}
+
 static const TypeInfo memory_region_info = {
     .parent             = TYPE_OBJECT,
     .name               = TYPE_MEMORY_REGION,
@@ -71,6 +71,7 @@
 #include "qapi/qapi-commands-control.h"
 #include "qapi/qapi-commands-migration.h"
 #include "qapi/qapi-commands-misc.h"
+#include "qapi/qapi-commands-misc-target.h"
 #include "qapi/qapi-commands-qom.h"
 #include "qapi/qapi-commands-trace.h"
 #include "qapi/qapi-init-commands.h"
@@ -353,6 +354,44 @@ static void hmp_info_opcount(Monitor *mon, const QDict *qdict)
 {
     dump_opcount_info();
 }
+
+static void hmp_info_tb_hot(Monitor *mon, const QDict *qdict)
+{
+    bool reset = qdict_get_try_bool(qdict, "reset", false);
+    int64_t count = qdict_get_try_int(qdict, "count", 10);
+    TbProfileEntryList *l;
+    TbProfile *info;
+    Error *err = NULL;
+
+    info = qmp_query_tb_hot(true, count, true, reset, &err);
+    if (err) {
+        monitor_printf(mon, "%s\n", error_get_pretty(err));
+        error_free(err);
+        return;
+    }
+
+    monitor_printf(mon, "executions %" PRIu64 ", translations %" PRIu64
+                   ", invalidations %" PRIu64 ", flushes %" PRIu64
+                   ", evictions %" PRIu64 "\n", info->executions,
+                   info->translations, info->invalidations, info->flushes,
+                   info->evictions);
+    monitor_printf(mon, "%-18s %12s %6s %6s %6s %6s %6s  %s\n", "pc",
+                   "executions", "%", "insns", "host", "trans", "inval",
+                   "symbol");
+    for (l = info->hot; l; l = l->next) {
+        TbProfileEntry *e = l->value;
+
+        monitor_printf(mon, "0x%016" PRIx64 " %12" PRIu64 " %6.2f %6u %6u"
+                       " %6" PRIu64 " %6" PRIu64 "  %s\n", e->pc,
+                       e->executions,
+                       info->executions ?
+                       100.0 * e->executions / info->executions : 0.0,
+                       e->guest_insns, e->host_bytes, e->translations,
+                       e->invalidations, e->has_symbol ? e->symbol : "");
+    }
+
+    qapi_free_TbProfile(info);
+}
 #endif
 
 static void hmp_info_sync_profile(Monitor *mon, const QDict *qdict)
@@ -95,6 +95,16 @@ void qemu_plugin_register_vcpu_tb_exec_inline(struct qemu_plugin_tb *tb,
     plugin_register_inline_op(&tb->cbs[PLUGIN_CB_INLINE], 0, op, ptr, imm);
 }
 
+void qemu_plugin_register_vcpu_tb_exec_edge_inline(struct qemu_plugin_tb *tb,
+                                                   uint8_t *map,
+                                                   size_t map_size,
+                                                   uint32_t *prev_loc,
+                                                   uint32_t cur_loc)
+{
+    plugin_register_edge_op(&tb->cbs[PLUGIN_CB_EDGE], map, map_size,
+                            prev_loc, cur_loc);
+}
+
 void qemu_plugin_register_vcpu_insn_exec_cb(struct qemu_plugin_insn *insn,
                                             qemu_plugin_vcpu_udata_cb_t cb,
                                             enum qemu_plugin_cb_flags flags,
@@ -19,6 +19,7 @@
 #include "qemu/option.h"
 #include "qemu/rcu_queue.h"
 #include "qemu/xxhash.h"
+#include "qemu/host-utils.h"
 #include "qemu/rcu.h"
 #include "hw/core/cpu.h"
 #include "exec/cpu-common.h"
@@ -278,6 +279,21 @@ void plugin_register_inline_op(GArray **arr,
     dyn_cb->inline_insn.imm = imm;
 }
 
+void plugin_register_edge_op(GArray **arr, uint8_t *map, size_t map_size,
+                             uint32_t *prev_loc, uint32_t cur_loc)
+{
+    struct qemu_plugin_dyn_cb *dyn_cb;
+
+    g_assert(is_power_of_2(map_size) && map_size <= UINT32_MAX);
+
+    dyn_cb = plugin_get_dyn_cb(arr);
+    dyn_cb->userp = map;
+    dyn_cb->type = PLUGIN_CB_EDGE;
+    dyn_cb->edge.prev_loc = prev_loc;
+    dyn_cb->edge.mask = map_size - 1;
+    dyn_cb->edge.cur_loc = cur_loc & dyn_cb->edge.mask;
+}
+
 static inline uint32_t cb_to_tcg_flags(enum qemu_plugin_cb_flags flags)
 {
     uint32_t ret;
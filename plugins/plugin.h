@@ -63,6 +63,9 @@ struct qemu_plugin_ctx {
 
 struct qemu_plugin_ctx *plugin_id_to_ctx_locked(qemu_plugin_id_t id);
 
+void plugin_register_edge_op(GArray **arr, uint8_t *map, size_t map_size,
+                             uint32_t *prev_loc, uint32_t cur_loc);
+
 void plugin_register_inline_op(GArray **arr,
                                enum qemu_plugin_mem_rw rw,
                                enum qemu_plugin_op op, void *ptr,
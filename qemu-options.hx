@@ -123,8 +123,10 @@ DEF("accel", HAS_ARG, QEMU_OPTION_accel,
     "                igd-passthru=on|off (enable Xen integrated Intel graphics passthrough, default=off)\n"
     "                kernel-irqchip=on|off|split controls accelerated irqchip support (default=on)\n"
     "                kvm-shadow-mem=size of KVM shadow MMU in bytes\n"
+    "                tb-profile=on|off (count executions of each TB)\n"
     "                tb-size=n (TCG translation block cache size)\n"
-    "                thread=single|multi (enable multi-threaded TCG)\n", QEMU_ARCH_ALL)
+    "                thread=single|multi (enable multi-threaded TCG)\n"
+    "                trace-threshold=n (form hot traces after n executions)\n", QEMU_ARCH_ALL)
 SRST
 ``-accel name[,prop=value[,...]]``
     This is used to enable an accelerator. Depending on the target
@@ -148,6 +150,12 @@ SRST
     ``kvm-shadow-mem=size``
         Defines the size of the KVM shadow MMU.
 
+    ``tb-profile=on|off``
+        Counts how often the code at each guest address runs, along with
+        its translations and invalidations, for the ``query-tb-hot`` QMP
+        command and ``info tb-hot`` in HMP. Each TB then increments a
+        counter on entry, so this is off by default.
+
     ``tb-size=n``
         Controls the size (in MiB) of the TCG translation block cache.
 
@@ -158,6 +166,14 @@ SRST
         where both the back-end and front-ends support it and no
         incompatible TCG features have been enabled (e.g.
         icount/replay).
+
+    ``trace-threshold=n``
+        Once a TCG translation block has run ``n`` times, it is
+        translated again as a hot trace that carries on across direct
+        branches, leaving through side exits where conditional branches
+        go the unexpected way. Only Thumb code forms traces for now, and
+        none are formed while TCG plugins are loaded. The default, 0,
+        disables traces.
 ERST
 
 DEF("smp", HAS_ARG, QEMU_OPTION_smp,
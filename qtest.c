@@ -34,6 +34,18 @@
 
 #define MAX_IRQ 256
 
+#define QTEST_BATCH_VERSION     1
+#define QTEST_BATCH_OP_SIZE     24
+#define QTEST_BATCH_MAX_OPS     (1 << 16)
+
+enum {
+    QTEST_BATCH_READ = 1,
+    QTEST_BATCH_WRITE,
+    QTEST_BATCH_CLOCK_STEP,
+    QTEST_BATCH_CLOCK_STEP_NEXT,
+    QTEST_BATCH_SET_IRQ_IN,
+};
+
 bool qtest_allowed;
 
 static DeviceState *irq_intercept_dev;
@@ -45,6 +57,10 @@ static qemu_timeval start_time;
 static bool qtest_opened;
 static void (*qtest_server_send)(void*, const char*);
 static void *qtest_server_send_opaque;
+static GArray *irq_handles;
+static size_t batch_pending;
+static uint8_t *batch_shm;
+static size_t batch_shm_size;
 
 #define FMT_timeval "%ld.%06ld"
 
@@ -177,6 +193,67 @@ static void *qtest_server_send_opaque;
  *
  * Forcibly set the given interrupt pin to the given level.
  *
+ *  > irq_handle QOM-PATH NAME NUM
+ *  < OK HANDLE
+ *
+ * Look the interrupt pin up once and return a small integer that batches
+ * can use to refer to it, see below.
+ *
+ * Batches:
+ *
+ * Harnesses that issue many accesses back to back can send them as one
+ * binary batch and get one reply, instead of paying a round trip and the
+ * text formatting for each access.
+ *
+ *  > batch_hello VERSION
+ *  < OK VERSION TRANSPORTS
+ *
+ *     Negotiate the batch format.  The server replies with the highest
+ *     version it supports that is not above VERSION, and with a comma
+ *     separated list of the transports it can use: "stream", "shm".
+ *
+ *  > batch NOPS
+ *  > <NOPS operation records>
+ *  < OK SIZE
+ *  < <SIZE bytes of results>
+ *
+ *     The operation records follow the newline directly.  The results
+ *     follow the newline of the reply directly.
+ *
+ *  > batch_shm_open PATH SIZE
+ *  < OK
+ *
+ *  > batch_shm NOPS
+ *  < OK NOPS
+ *
+ *     Map the first SIZE bytes of the file at PATH, which the client also
+ *     maps, and run the NOPS operation records at its start.  SIZE must
+ *     not be 0 or larger than the file.  Results are
+ *     stored over the VALUE field of each record; only the reply line
+ *     goes through the qtest stream.
+ *
+ * An operation record is 24 bytes, all fields little endian:
+ *
+ *     0  u8   OP
+ *     1  u8   SIZE    access size in bytes for read and write: 1, 2, 4, 8
+ *     2  u16  reserved, 0
+ *     4  u32  HANDLE  interrupt pin for set_irq_in, from irq_handle
+ *     8  u64  ADDR
+ *    16  u64  VALUE
+ *
+ * with OP one of
+ *
+ *     1  read          result: the value read
+ *     2  write         write VALUE
+ *     3  clock_step    advance the clock by VALUE ns; result: the clock
+ *     4  clock_step    advance the clock to the next deadline; result: the
+ *                      clock
+ *     5  set_irq_in    set the pin to the signed level VALUE
+ *
+ * Each operation produces one 8 byte little endian result, 0 for those
+ * without one.  Values have the target's endianness, as with readl and
+ * writel.  Operations run in order; if one is malformed the reply is
+ * "FAIL" and the operations after it are not run.
  */
 
 static int hex2nib(char ch)
@@ -273,6 +350,98 @@ static void qtest_irq_handler(void *opaque, int n, int level)
     }
 }
 
+/* Binary replies need a chardev, in-process clients only take strings */
+static bool qtest_batch_stream_ok(void)
+{
+    return qtest_server_send == qtest_server_char_be_send;
+}
+
+static bool qtest_batch_run_op(const uint8_t *op, uint64_t *result)
+{
+    unsigned size = op[1];
+    uint32_t handle = ldl_le_p(op + 4);
+    uint64_t addr = ldq_le_p(op + 8);
+    uint64_t value = ldq_le_p(op + 16);
+    uint8_t data[8];
+
+    *result = 0;
+
+    switch (op[0]) {
+    case QTEST_BATCH_READ:
+    case QTEST_BATCH_WRITE:
+        if (size != 1 && size != 2 && size != 4 && size != 8) {
+            return false;
+        }
+        if (op[0] == QTEST_BATCH_READ) {
+            address_space_read(first_cpu->as, addr, MEMTXATTRS_UNSPECIFIED,
+                               data, size);
+            *result = ldn_p(data, size);
+        } else {
+            stn_p(data, size, value);
+            address_space_write(first_cpu->as, addr, MEMTXATTRS_UNSPECIFIED,
+                                data, size);
+        }
+        return true;
+    case QTEST_BATCH_CLOCK_STEP:
+    case QTEST_BATCH_CLOCK_STEP_NEXT:
+        if (!qtest_enabled()) {
+            return false;
+        }
+        if (op[0] == QTEST_BATCH_CLOCK_STEP_NEXT) {
+            value = qemu_clock_deadline_ns_all(QEMU_CLOCK_VIRTUAL,
+                                               QEMU_TIMER_ATTR_ALL);
+        }
+        qtest_clock_warp(qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + value);
+        *result = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+        return true;
+    case QTEST_BATCH_SET_IRQ_IN:
+        if (!irq_handles || handle >= irq_handles->len) {
+            return false;
+        }
+        qemu_set_irq(g_array_index(irq_handles, qemu_irq, handle),
+                     (int64_t)value);
+        return true;
+    default:
+        return false;
+    }
+}
+
+/*
+ * Run @nops operation records from @ops, storing their results at @res,
+ * @stride bytes apart.  Returns the number of operations run.
+ */
+static uint32_t qtest_batch_run(const uint8_t *ops, uint32_t nops,
+                                uint8_t *res, size_t stride)
+{
+    uint64_t result;
+    uint32_t i;
+
+    for (i = 0; i < nops; i++) {
+        if (!qtest_batch_run_op(ops, &result)) {
+            break;
+        }
+        stq_le_p(res, result);
+        ops += QTEST_BATCH_OP_SIZE;
+        res += stride;
+    }
+    return i;
+}
+
+static void qtest_batch_stream(CharBackend *chr, const uint8_t *ops,
+                               uint32_t nops)
+{
+    g_autofree uint8_t *res = g_malloc(nops * 8);
+
+    if (qtest_batch_run(ops, nops, res, 8) < nops) {
+        qtest_send_prefix(chr);
+        qtest_send(chr, "FAIL Invalid batch operation\n");
+        return;
+    }
+    qtest_send_prefix(chr);
+    qtest_sendf(chr, "OK %u\n", nops * 8);
+    qemu_chr_fe_write_all(chr, res, nops * 8);
+}
+
 static void qtest_process_command(CharBackend *chr, gchar **words)
 {
     const gchar *command;
@@ -686,6 +855,130 @@ static void qtest_process_command(CharBackend *chr, gchar **words)
         qtest_send_prefix(chr);
         qtest_sendf(chr, "OK %"PRIi64"\n",
                     (int64_t)qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL));
+    } else if (strcmp(words[0], "irq_handle") == 0) {
+        DeviceState *dev;
+        qemu_irq irq;
+        char *name;
+        int ret;
+        int num;
+
+        g_assert(words[1] && words[2] && words[3]);
+
+        dev = DEVICE(object_resolve_path(words[1], NULL));
+        if (!dev) {
+            qtest_send_prefix(chr);
+            qtest_send(chr, "FAIL Unknown device\n");
+            return;
+        }
+
+        if (strcmp(words[2], "unnamed-gpio-in") == 0) {
+            name = NULL;
+        } else {
+            name = words[2];
+        }
+
+        ret = qemu_strtoi(words[3], NULL, 0, &num);
+        g_assert(!ret);
+
+        irq = qdev_get_gpio_in_named(dev, name, num);
+        if (!irq_handles) {
+            irq_handles = g_array_new(false, false, sizeof(qemu_irq));
+        }
+        g_array_append_val(irq_handles, irq);
+        qtest_send_prefix(chr);
+        qtest_sendf(chr, "OK %u\n", irq_handles->len - 1);
+    } else if (strcmp(words[0], "batch_hello") == 0) {
+        const char *transports;
+        unsigned long version;
+        int ret;
+
+        g_assert(words[1]);
+        ret = qemu_strtoul(words[1], NULL, 0, &version);
+        g_assert(ret == 0);
+
+#ifdef CONFIG_POSIX
+        transports = qtest_batch_stream_ok() ? "stream,shm" : "shm";
+#else
+        transports = qtest_batch_stream_ok() ? "stream" : "";
+#endif
+        qtest_send_prefix(chr);
+        qtest_sendf(chr, "OK %lu %s\n", MIN(version, QTEST_BATCH_VERSION),
+                    transports);
+    } else if (strcmp(words[0], "batch") == 0) {
+        unsigned long nops;
+        int ret;
+
+        g_assert(words[1]);
+        ret = qemu_strtoul(words[1], NULL, 0, &nops);
+        g_assert(ret == 0);
+        g_assert(nops <= QTEST_BATCH_MAX_OPS);
+
+        if (!qtest_batch_stream_ok()) {
+            qtest_send_prefix(chr);
+            qtest_send(chr, "FAIL Binary batches need a chardev\n");
+            return;
+        }
+        if (!nops) {
+            qtest_batch_stream(chr, NULL, 0);
+            return;
+        }
+        /* The records are picked up from the input by qtest_process_inbuf */
+        batch_pending = nops * QTEST_BATCH_OP_SIZE;
+#ifdef CONFIG_POSIX
+    } else if (strcmp(words[0], "batch_shm_open") == 0) {
+        uint64_t size;
+        void *p = MAP_FAILED;
+        int ret;
+        int fd;
+
+        g_assert(words[1] && words[2]);
+        ret = qemu_strtou64(words[2], NULL, 0, &size);
+        g_assert(ret == 0);
+
+        fd = qemu_open(words[1], O_RDWR);
+        if (fd >= 0) {
+            struct stat st;
+
+            /* Pages past the end of the file would SIGBUS when touched */
+            if (size && fstat(fd, &st) == 0 && size <= st.st_size) {
+                p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                         fd, 0);
+            }
+            close(fd);
+        }
+        qtest_send_prefix(chr);
+        if (p == MAP_FAILED) {
+            qtest_sendf(chr, "FAIL Cannot map '%s'\n", words[1]);
+            return;
+        }
+
+        if (batch_shm) {
+            munmap(batch_shm, batch_shm_size);
+        }
+        batch_shm = p;
+        batch_shm_size = size;
+        qtest_send(chr, "OK\n");
+    } else if (strcmp(words[0], "batch_shm") == 0) {
+        unsigned long nops;
+        uint32_t done = 0;
+        int ret;
+
+        g_assert(words[1]);
+        ret = qemu_strtoul(words[1], NULL, 0, &nops);
+        g_assert(ret == 0);
+
+        if (batch_shm && nops <= batch_shm_size / QTEST_BATCH_OP_SIZE) {
+            /* Each result goes over the VALUE field of its record */
+            done = qtest_batch_run(batch_shm, nops, batch_shm + 16,
+                                   QTEST_BATCH_OP_SIZE);
+        }
+        qtest_send_prefix(chr);
+        if (done < nops || !batch_shm) {
+            qtest_send(chr, "FAIL Invalid batch operation\n");
+        } else {
+            qtest_sendf(chr, "OK %lu\n", nops);
+        }
+#endif
     } else {
         qtest_send_prefix(chr);
         qtest_sendf(chr, "FAIL Unknown command '%s'\n", words[0]);
@@ -696,11 +989,28 @@ static void qtest_process_inbuf(CharBackend *chr, GString *inbuf)
 {
     char *end;
 
-    while ((end = strchr(inbuf->str, '\n')) != NULL) {
+    for (;;) {
         size_t offset;
         GString *cmd;
         gchar **words;
 
+        if (batch_pending) {
+            if (inbuf->len < batch_pending) {
+                break;
+            }
+            offset = batch_pending;
+            batch_pending = 0;
+            qtest_batch_stream(chr, (uint8_t *)inbuf->str,
+                               offset / QTEST_BATCH_OP_SIZE);
+            g_string_erase(inbuf, 0, offset);
+            continue;
+        }
+
+        /* Batch records may contain NULs, so do not stop at one */
+        end = memchr(inbuf->str, '\n', inbuf->len);
+        if (!end) {
+            break;
+        }
         offset = end - inbuf->str;
 
         cmd = g_string_new_len(inbuf->str, offset);
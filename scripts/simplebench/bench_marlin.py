@@ -0,0 +1,290 @@
+#!/usr/bin/env python3
+#
+# Benchmark the marlinboard machine running a reference Marlin firmware
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+"""Benchmark the marlinboard machine
+
+Boots a Marlin firmware image and measures:
+
+  boot    -- host seconds from VM start to the firmware's "start" line
+  idle    -- host CPU seconds per simulated second with nothing to do
+  motion  -- host CPU seconds per simulated second while moving X and Y,
+             and step pulses per host second
+  gcode   -- host seconds per G-code line accepted over the host USART,
+             and lines per second
+
+Every case boots a fresh VM.  The results, including every run, are
+written as JSON so that they can be compared between releases.  Host CPU
+time is read from /proc, so this only runs on Linux hosts.
+"""
+
+import argparse
+import contextlib
+import json
+import os
+import shutil
+import socket
+import sys
+import tempfile
+import time
+
+sys.path.append(os.path.join(os.path.dirname(__file__), '..', '..', 'python'))
+from qemu.machine import QEMUMachine
+from qemu.qmp import QMPConnectError
+
+import simplebench
+
+
+STEPPERS = ('/machine/stepper-x', '/machine/stepper-y',
+            '/machine/stepper-z', '/machine/stepper-e')
+
+
+class MarlinSerial:
+    """Line oriented access to the firmware's host serial port"""
+
+    def __init__(self, path, timeout):
+        self._sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self._sock.settimeout(timeout)
+        self._sock.connect(path)
+        self._buf = b''
+
+    def close(self):
+        self._sock.close()
+
+    def send(self, line):
+        self._sock.sendall(line.encode() + b'\n')
+
+    def readline(self):
+        while b'\n' not in self._buf:
+            data = self._sock.recv(4096)
+            if not data:
+                raise EOFError('serial port closed')
+            self._buf += data
+        line, self._buf = self._buf.split(b'\n', 1)
+        return line.decode(errors='replace').strip()
+
+    def wait_for(self, prefix):
+        while True:
+            line = self.readline()
+            if line.startswith(prefix):
+                return line
+
+    def command(self, line):
+        self.send(line)
+        self.wait_for('ok')
+
+
+class MarlinVM:
+    """A marlinboard VM, stopped until start() is called"""
+
+    def __init__(self, env):
+        self._dir = tempfile.mkdtemp(prefix='marlin-bench-')
+        self._serial_path = os.path.join(self._dir, 'serial.sock')
+        self.vm = QEMUMachine(env['qemu-binary'], test_dir=self._dir,
+                              args=['-machine', 'marlinboard',
+                                    '-kernel', env['firmware'],
+                                    '-chardev', 'socket,id=host,path={},'
+                                    'server,nowait'.format(self._serial_path),
+                                    '-serial', 'null',
+                                    '-serial', 'chardev:host',
+                                    '-S'] + env['qemu-args'])
+        self.serial = None
+        try:
+            self.vm.launch()
+            self.serial = MarlinSerial(self._serial_path, env['timeout'])
+        except Exception:
+            self.shutdown()
+            raise
+
+    def shutdown(self):
+        if self.serial:
+            self.serial.close()
+        self.vm.shutdown()
+        shutil.rmtree(self._dir, ignore_errors=True)
+
+    def start(self):
+        self.vm.command('cont')
+
+    def boot(self):
+        self.start()
+        self.serial.wait_for('start')
+        # Let setup() finish before measuring anything else
+        self.serial.command('M400')
+
+    def vm_clock_ns(self):
+        return self.vm.command('qom-get', path='/machine',
+                               property='vm-clock-ns')
+
+    def steps(self):
+        return sum(self.vm.command('qom-get', path=p, property='step-count')
+                   for p in STEPPERS)
+
+    def cpu_seconds(self):
+        with open('/proc/{}/stat'.format(self.vm.get_pid())) as f:
+            # The command name may contain spaces, skip past it
+            fields = f.read().rsplit(')', 1)[1].split()
+        return (int(fields[11]) + int(fields[12])) / os.sysconf('SC_CLK_TCK')
+
+    def sample(self):
+        return {'wall': time.monotonic(), 'cpu': self.cpu_seconds(),
+                'vm-clock-ns': self.vm_clock_ns(), 'steps': self.steps()}
+
+
+def delta(start, end):
+    return {k: end[k] - start[k] for k in start}
+
+
+def bench_boot(vm, case):
+    start = time.monotonic()
+    vm.start()
+    vm.serial.wait_for('start')
+    return {'seconds': time.monotonic() - start,
+            'vm-seconds': vm.vm_clock_ns() / 1e9}
+
+
+def bench_idle(vm, case):
+    vm.boot()
+    start = vm.sample()
+    time.sleep(case['duration'])
+    d = delta(start, vm.sample())
+    return {'seconds': d['cpu'] * 1e9 / d['vm-clock-ns'],
+            'vm-seconds': d['vm-clock-ns'] / 1e9}
+
+
+def bench_motion(vm, case):
+    vm.boot()
+    vm.serial.command('G92 X100 Y100 Z10')
+    vm.serial.command('G91')
+    start = vm.sample()
+    for i in range(case['moves']):
+        sign = '-' if i % 2 else ''
+        vm.serial.command('G1 X{0}50 Y{0}50 F{1}'.format(sign, case['feed']))
+    vm.serial.command('M400')
+    d = delta(start, vm.sample())
+    return {'seconds': d['cpu'] * 1e9 / d['vm-clock-ns'],
+            'vm-seconds': d['vm-clock-ns'] / 1e9,
+            'steps': d['steps'],
+            'steps-per-second': d['steps'] / d['wall']}
+
+
+def bench_gcode(vm, case):
+    # Marlin buffers a few commands, keep that many in flight
+    window = case['window']
+    lines = case['lines']
+    vm.boot()
+    start = vm.sample()
+    sent = 0
+    while sent < min(window, lines):
+        vm.serial.send(case['gcode'])
+        sent += 1
+    for _ in range(lines):
+        vm.serial.wait_for('ok')
+        if sent < lines:
+            vm.serial.send(case['gcode'])
+            sent += 1
+    d = delta(start, vm.sample())
+    return {'seconds': d['wall'] / lines,
+            'lines-per-second': lines / d['wall']}
+
+
+def bench_marlin(env, case):
+    """Run one benchmark case in a freshly launched VM
+
+    Returns a dict compatible with simplebench: {'seconds': float, ...}
+    on success and {'error': str} on failure.
+    """
+    try:
+        vm = MarlinVM(env)
+    except OSError as e:
+        return {'error': 'popen failed: ' + str(e)}
+    except (QMPConnectError, socket.timeout):
+        return {'error': 'qemu failed to start'}
+
+    try:
+        return case['func'](vm, case)
+    except (socket.timeout, EOFError) as e:
+        return {'error': 'firmware did not respond: ' + str(e)}
+    finally:
+        vm.shutdown()
+
+
+CASES = [
+    {'id': 'boot', 'func': bench_boot},
+    {'id': 'idle', 'func': bench_idle, 'duration': 5},
+    {'id': 'motion', 'func': bench_motion, 'moves': 20, 'feed': 12000},
+    {'id': 'gcode', 'func': bench_gcode, 'lines': 2000, 'window': 2,
+     'gcode': 'G90'},
+]
+
+
+def average(runs, key):
+    values = [r[key] for r in runs if key in r]
+    return sum(values) / len(values) if values else None
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__,
+                                formatter_class=argparse.RawTextHelpFormatter)
+    p.add_argument('qemu', help='path to qemu-system-arm')
+    p.add_argument('firmware', help='Marlin firmware image')
+    p.add_argument('-c', '--count', type=int, default=3,
+                   help='runs per case (default: %(default)s)')
+    p.add_argument('-o', '--output', help='JSON output file '
+                   '(default: standard output)')
+    p.add_argument('--case', action='append', choices=[c['id'] for c in CASES],
+                   help='only run this case; may be repeated')
+    p.add_argument('--timeout', type=float, default=60,
+                   help='seconds to wait for the firmware (default: '
+                   '%(default)s)')
+    p.add_argument('--icount', default='shift=0,sleep=off',
+                   help='-icount option, or "" for none '
+                   '(default: %(default)s)')
+    args, qemu_args = p.parse_known_args()
+
+    env = {'id': 'qemu', 'qemu-binary': args.qemu, 'firmware': args.firmware,
+           'timeout': args.timeout,
+           'qemu-args': (['-icount', args.icount] if args.icount else []) +
+                        qemu_args}
+    cases = [c for c in CASES if not args.case or c['id'] in args.case]
+
+    results = {}
+    # Progress goes to stderr, so that the JSON can go to stdout
+    with contextlib.redirect_stdout(sys.stderr):
+        for case in cases:
+            print('Testing {}'.format(case['id']))
+            res = simplebench.bench_one(bench_marlin, env, case,
+                                        count=args.count, initial_run=False)
+            for key in ('vm-seconds', 'steps-per-second', 'lines-per-second'):
+                avg = average(res['runs'], key)
+                if avg is not None:
+                    res['average-' + key] = avg
+            results[case['id']] = res
+
+    out = {'qemu': args.qemu,
+           'firmware': os.path.basename(args.firmware),
+           'qemu-args': env['qemu-args'],
+           'results': results}
+    if args.output:
+        with open(args.output, 'w') as f:
+            json.dump(out, f, indent=2)
+    else:
+        json.dump(out, sys.stdout, indent=2)
+        print()
+
+
+if __name__ == '__main__':
+    main()
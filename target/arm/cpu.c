@@ -1121,6 +1121,9 @@ static Property arm_cpu_has_dsp_property =
 static Property arm_cpu_has_mpu_property =
             DEFINE_PROP_BOOL("has-mpu", ARMCPU, has_mpu, true);
 
+static Property arm_cpu_cycle_timing_property =
+            DEFINE_PROP_UINT32("cycle-timing-hz", ARMCPU, cycle_timing_hz, 0);
+
 /* This is like DEFINE_PROP_UINT32 but it doesn't set the default value,
  * because the CPU initfn will have already set cpu->pmsav7_dregion to
  * the right value for that particular CPU type, and we don't want
@@ -1178,6 +1181,35 @@ unsigned int gt_cntfrq_period_ns(ARMCPU *cpu)
       NANOSECONDS_PER_SECOND / cpu->gt_cntfrq_hz : 1;
 }
 
+void arm_cpu_set_code_wait_states(ARMCPU *cpu, unsigned ws)
+{
+    if (cpu->code_wait_states == ws) {
+        return;
+    }
+
+    cpu->code_wait_states = ws;
+    /* The wait states are part of the cost of already translated code */
+    if (cpu->cycle_ns_fp) {
+        tb_flush(CPU(cpu));
+    }
+}
+
+#ifndef CONFIG_USER_ONLY
+void arm_cpu_add_flat_region(ARMCPU *cpu, uint32_t base, MemoryRegion *mr)
+{
+    ARMFlatRegion *r;
+
+    assert(arm_feature(&cpu->env, ARM_FEATURE_M));
+    assert(memory_region_is_ram(mr));
+    assert(cpu->num_flat_regions < ARM_MAX_FLAT_REGIONS);
+
+    r = &cpu->flat_regions[cpu->num_flat_regions++];
+    r->base = base;
+    r->size = memory_region_size(mr);
+    r->host = memory_region_get_ram_ptr(mr);
+}
+#endif
+
 void arm_cpu_post_init(Object *obj)
 {
     ARMCPU *cpu = ARM_CPU(obj);
@@ -1263,6 +1295,10 @@ void arm_cpu_post_init(Object *obj)
         }
     }
 
+    if (arm_feature(&cpu->env, ARM_FEATURE_M)) {
+        qdev_property_add_static(DEVICE(obj), &arm_cpu_cycle_timing_property);
+    }
+
     if (arm_feature(&cpu->env, ARM_FEATURE_M_SECURITY)) {
         object_property_add_link(obj, "idau", TYPE_IDAU_INTERFACE, &cpu->idau,
                                  qdev_prop_allow_set_link_before_realize,
@@ -1355,6 +1391,10 @@ static void arm_cpu_realizefn(DeviceState *dev, Error **errp)
             error_setg(errp, "This board cannot be used with Cortex-M CPUs");
             return;
         }
+        if (cpu->cycle_timing_hz) {
+            cpu->cycle_ns_fp = (NANOSECONDS_PER_SECOND << 16) /
+                               cpu->cycle_timing_hz;
+        }
     } else {
         if (env->nvic) {
             error_setg(errp, "This board can only be used with Cortex-M CPUs");
@@ -1786,6 +1826,11 @@ static void arm_cpu_realizefn(DeviceState *dev, Error **errp)
     }
     cpu_address_space_init(cs, ARMASIdx_NS, "cpu-memory", cs->memory);
 
+    if (arm_feature(env, ARM_FEATURE_M) &&
+        !arm_feature(env, ARM_FEATURE_M_SECURITY)) {
+        arm_v7m_vec_cache_init(cpu);
+    }
+
     /* No core_count specified, default to smp_cpus. */
     if (cpu->core_count == -1) {
         cpu->core_count = smp_cpus;
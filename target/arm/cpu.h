@@ -719,6 +719,15 @@ typedef enum ARMPSCIState {
 
 typedef struct ARMISARegisters ARMISARegisters;
 
+#define ARM_MAX_FLAT_REGIONS 4
+
+/* See arm_cpu_add_flat_region() */
+typedef struct ARMFlatRegion {
+    uint32_t base;
+    uint32_t size;
+    uint8_t *host;
+} ARMFlatRegion;
+
 /**
  * ARMCPU:
  * @env: #CPUARMState
@@ -821,6 +830,24 @@ struct ARMCPU {
     /* For v8M, initial value of the Secure VTOR */
     uint32_t init_svtor;
 
+    /*
+     * M profile cycle-approximate icount: core clock in Hz, or 0 to
+     * charge one icount unit per insn as usual. When enabled, icount
+     * units are nanoseconds (-icount shift=0).
+     */
+    uint32_t cycle_timing_hz;
+    /* Nanoseconds per core cycle, 16.16 fixed point */
+    uint32_t cycle_ns_fp;
+    /* Wait states on instruction fetches from the Code region */
+    uint8_t code_wait_states;
+
+    /* M profile: host mapping of the vector table, owned by m_helper.c */
+    struct ARMV7MVecCache *vec_cache;
+
+    /* M profile: regions translated code may access directly */
+    ARMFlatRegion flat_regions[ARM_MAX_FLAT_REGIONS];
+    int num_flat_regions;
+
     /* [QEMU_]KVM_ARM_TARGET_* constant for this CPU, or
      * QEMU_KVM_ARM_TARGET_NONE if the kernel doesn't support this CPU type.
      */
@@ -960,6 +987,30 @@ struct ARMCPU {
 
 unsigned int gt_cntfrq_period_ns(ARMCPU *cpu);
 
+/**
+ * arm_cpu_set_code_wait_states:
+ * @cpu: ARMCPU
+ * @ws: wait states
+ *
+ * Set the number of wait states for instruction fetches from the Code
+ * region (e.g. flash latency), used by M profile cycle-approximate icount.
+ */
+void arm_cpu_set_code_wait_states(ARMCPU *cpu, unsigned ws);
+
+/**
+ * arm_cpu_add_flat_region:
+ * @cpu: ARMCPU
+ * @base: guest physical address the region is mapped at
+ * @mr: RAM or ROM memory region
+ *
+ * Let M profile translated code load from @mr directly, bypassing the
+ * softmmu TLB, at addresses known at translation time (literal pool
+ * loads) and while the MPU is disabled.  The board must keep @mr mapped
+ * at @base for the lifetime of the machine.  Must be called before the
+ * CPU is reset.
+ */
+void arm_cpu_add_flat_region(ARMCPU *cpu, uint32_t base, MemoryRegion *mr);
+
 void arm_cpu_post_init(Object *obj);
 
 uint64_t arm_cpu_mp_affinity(int idx, uint8_t clustersz);
@@ -2210,6 +2261,18 @@ static inline bool armv7m_nvic_neg_prio_requested(void *opaque, bool secure)
 }
 #endif
 
+/**
+ * arm_v7m_pretranslate_init: translate M profile firmware ahead of time
+ * @cpu: the CPU
+ * @num_vectors: number of entries in the vector table
+ *
+ * When the VM first starts, translate the code reachable through direct
+ * branches from the reset vector and from the exception vectors, before
+ * the CPU runs its first instruction. The NMI and HardFault handlers run
+ * with the NEGPRI MMU index and are left to lazy translation.
+ */
+void arm_v7m_pretranslate_init(ARMCPU *cpu, int num_vectors);
+
 /* Interface for defining coprocessor registers.
  * Registers are defined in tables of arm_cp_reginfo structs
  * which are passed to define_arm_cp_regs().
@@ -3218,6 +3281,8 @@ FIELD(TBFLAG_M32, LSPACT, 11, 1)                 /* Not cached. */
 FIELD(TBFLAG_M32, NEW_FP_CTXT_NEEDED, 12, 1)     /* Not cached. */
 /* Set if FPCCR.S does not match current security state */
 FIELD(TBFLAG_M32, FPCCR_S_WRONG, 13, 1)          /* Not cached. */
+/* Set if the MPU is disabled and flat regions are configured */
+FIELD(TBFLAG_M32, FLAT_MEM, 14, 1)
 
 /*
  * Bit usage when in AArch64 state
@@ -12486,6 +12486,11 @@ static uint32_t rebuild_hflags_m32(CPUARMState *env, int fp_el,
         flags = FIELD_DP32(flags, TBFLAG_M32, STACKCHECK, 1);
     }
 
+    if (env_archcpu(env)->num_flat_regions &&
+        !(env->v7m.mpu_ctrl[env->v7m.secure] & R_V7M_MPU_CTRL_ENABLE_MASK)) {
+        flags = FIELD_DP32(flags, TBFLAG_M32, FLAT_MEM, 1);
+    }
+
     return rebuild_hflags_common_32(env, fp_el, mmu_idx, flags);
 }
 
@@ -808,6 +808,15 @@ ARMMMUIdx arm_v7m_mmu_idx_for_secstate_and_priv(CPUARMState *env,
 /* Return the MMU index for a v7M CPU in the specified security state */
 ARMMMUIdx arm_v7m_mmu_idx_for_secstate(CPUARMState *env, bool secstate);
 
+#ifndef CONFIG_USER_ONLY
+/*
+ * Set up caching of the vector table host mapping for an M profile CPU
+ * without the Security extension. Must be called after the CPU's
+ * address space has been created.
+ */
+void arm_v7m_vec_cache_init(ARMCPU *cpu);
+#endif
+
 /* Return true if the stage 1 translation regime is using LPAE format page
  * tables */
 bool arm_s1_regime_using_lpae_format(CPUARMState *env, ARMMMUIdx mmu_idx);
@@ -1000,6 +1009,42 @@ static inline bool v7m_using_psp(CPUARMState *env)
         env->v7m.control[env->v7m.secure] & R_V7M_CONTROL_SPSEL_MASK;
 }
 
+/*
+ * M profile cycle-approximate icount (see ARMCPU.cycle_timing_hz).
+ * Exception latencies are those of the Cortex-M3, without wait states.
+ */
+#define ARM_M_ENTRY_CYCLES      12
+#define ARM_M_EXIT_CYCLES       10
+#define ARM_M_TAILCHAIN_CYCLES  6
+
+/* Start of the System (SRAM and peripherals) region; below is Code */
+#define ARM_M_CODE_REGION_END   0x20000000
+
+/**
+ * arm_m_cycles_to_icount: Convert core cycles to icount units
+ * @cycle_ns_fp: ARMCPU.cycle_ns_fp
+ * @cycles: number of cycles
+ */
+static inline int64_t arm_m_cycles_to_icount(uint32_t cycle_ns_fp,
+                                             int64_t cycles)
+{
+    return (cycles * cycle_ns_fp) >> 16;
+}
+
+/**
+ * arm_m_insn_cycles: Cortex-M3 cycle cost of a Thumb instruction
+ * @insn: instruction, first halfword in the high half if 32-bit
+ * @is_16bit: true for a 16-bit instruction
+ * @wait_states: wait states for fetches and literal loads
+ * @ldst: in, whether the previous insn was a load or store it can pipeline
+ *        with; out, the same for this insn
+ *
+ * Costs that depend on run time state are charged at their worst case:
+ * conditional branches are assumed taken and divides take 12 cycles.
+ */
+int arm_m_insn_cycles(uint32_t insn, bool is_16bit, int wait_states,
+                      bool *ldst);
+
 /**
  * v7m_sp_limit: Return SP limit for current CPU state
  * Return the SP limit value for the current CPU security state
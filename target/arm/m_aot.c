@@ -0,0 +1,251 @@
+/*
+ * ARM M profile ahead-of-time translation
+ *
+ * Translates the firmware code reachable from the reset vector and the
+ * exception vectors before the first guest instruction runs, so that
+ * early boot and first interrupt latency do not depend on lazy
+ * translation.
+ *
+ * This code is licensed under the GNU GPL v2 or later.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bitops.h"
+#include "cpu.h"
+#include "exec/exec-all.h"
+#include "sysemu/runstate.h"
+#include "tcg/tcg.h"
+
+typedef struct MAOTState {
+    ARMCPU *cpu;
+    int num_vectors;
+    VMChangeStateEntry *vmse;
+} MAOTState;
+
+static bool m_aot_insn_is_32bit(uint16_t hw1)
+{
+    return (hw1 >> 11) >= 0x1d;
+}
+
+/*
+ * Decode the direct branch, if any, of the Thumb instruction at @pc.
+ * Sets *dest to its target and returns true; *fallthrough says whether
+ * execution may also continue after the instruction.
+ */
+static bool m_aot_branch(uint32_t insn, bool is_16bit, bool in_it,
+                         uint32_t pc, uint32_t *dest, bool *fallthrough)
+{
+    uint32_t s, imm;
+
+    *fallthrough = true;
+
+    if (is_16bit) {
+        if ((insn & 0xf000) == 0xd000 && (insn & 0x0e00) != 0x0e00) {
+            /* B<c> */
+            *dest = pc + 4 + sextract32(insn << 1, 0, 9);
+            return true;
+        }
+        if ((insn & 0xf800) == 0xe000) {
+            /* B */
+            *dest = pc + 4 + sextract32(insn << 1, 0, 12);
+            *fallthrough = in_it;
+            return true;
+        }
+        if ((insn & 0xf500) == 0xb100) {
+            /* CB{N}Z */
+            *dest = pc + 4 + (extract32(insn, 9, 1) << 6) +
+                (extract32(insn, 3, 5) << 1);
+            return true;
+        }
+        if ((insn & 0xff87) == 0x4700 || (insn & 0xff00) == 0xbd00) {
+            /* BX, POP {..., pc} */
+            *fallthrough = in_it;
+        }
+        return false;
+    }
+
+    s = extract32(insn, 26, 1);
+    if ((insn & 0xf800d000) == 0xf0008000 &&
+        (insn & 0x03800000) != 0x03800000) {
+        /* B<c>.W */
+        imm = (s << 20) | (extract32(insn, 11, 1) << 19) |
+            (extract32(insn, 13, 1) << 18) | (extract32(insn, 16, 6) << 12) |
+            (extract32(insn, 0, 11) << 1);
+        *dest = pc + 4 + sextract32(imm, 0, 21);
+        return true;
+    }
+    if ((insn & 0xf800d000) == 0xf0009000 ||
+        (insn & 0xf800d000) == 0xf000d000) {
+        /* B.W, BL */
+        imm = (s << 24) | ((!(extract32(insn, 13, 1) ^ s)) << 23) |
+            ((!(extract32(insn, 11, 1) ^ s)) << 22) |
+            (extract32(insn, 16, 10) << 12) | (extract32(insn, 0, 11) << 1);
+        *dest = pc + 4 + sextract32(imm, 0, 25);
+        *fallthrough = in_it || extract32(insn, 14, 1);
+        return true;
+    }
+    if ((insn & 0xffff8000) == 0xe8bd8000 || insn == 0xf85dfb04) {
+        /* POP.W {..., pc}, LDR pc, [sp], #4 */
+        *fallthrough = in_it;
+    }
+    return false;
+}
+
+/* Queue the successors of @tb, found by decoding its last instruction */
+static void m_aot_successors(CPUState *cs, TranslationBlock *tb, GArray *queue)
+{
+    g_autofree uint8_t *buf = g_malloc(tb->size);
+    uint32_t pc, insn = 0, dest, end = tb->pc + tb->size;
+    bool is_16bit = true, in_it = false, fallthrough = true;
+    int it_left = 0;
+
+    if (cpu_memory_rw_debug(cs, tb->pc, buf, tb->size, false)) {
+        return;
+    }
+
+    for (pc = tb->pc; pc < end; pc += is_16bit ? 2 : 4) {
+        insn = lduw_le_p(buf + pc - tb->pc);
+        is_16bit = !m_aot_insn_is_32bit(insn);
+        if (!is_16bit) {
+            if (pc + 4 > end) {
+                return;
+            }
+            insn = (insn << 16) | lduw_le_p(buf + pc - tb->pc + 2);
+        }
+
+        in_it = it_left > 0;
+        if (in_it) {
+            it_left--;
+        }
+        if (is_16bit && (insn & 0xff00) == 0xbf00 && (insn & 0xf)) {
+            /* IT: the mask's trailing one ends the block */
+            it_left = 4 - ctz32(insn & 0xf);
+        }
+        if (pc + (is_16bit ? 2 : 4) >= end) {
+            break;
+        }
+    }
+
+    if (m_aot_branch(insn, is_16bit, in_it, pc, &dest, &fallthrough)) {
+        g_array_append_val(queue, dest);
+    }
+    /* The IT state of the next TB would not match the flags we use */
+    if (fallthrough && !it_left) {
+        g_array_append_val(queue, end);
+    }
+}
+
+/*
+ * Translate everything reachable from @queue through direct branches,
+ * with the TB flags of the CPU's current mode.
+ */
+static void m_aot_walk(CPUState *cs, GArray *queue)
+{
+    CPUARMState *env = cs->env_ptr;
+    g_autoptr(GHashTable) seen = g_hash_table_new(NULL, NULL);
+    uint32_t cflags = curr_cflags();
+    target_ulong pc, cs_base;
+    TranslationBlock *tb;
+    uint32_t flags;
+
+    cpu_get_tb_cpu_state(env, &pc, &cs_base, &flags);
+
+    while (queue->len) {
+        pc = g_array_index(queue, uint32_t, queue->len - 1);
+        g_array_set_size(queue, queue->len - 1);
+
+        if (!g_hash_table_add(seen, GUINT_TO_POINTER(pc))) {
+            continue;
+        }
+        if (!tb_pretranslate_room()) {
+            break;
+        }
+        /* A first insn straddling two pages is fetched from both */
+        if ((pc & 1) || !tb_pretranslate_mapped(env, pc, 4)) {
+            continue;
+        }
+
+        tb = tb_htable_lookup(cs, pc, cs_base, flags, cflags);
+        if (!tb) {
+            mmap_lock();
+            tb = tb_gen_code(cs, pc, cs_base, flags, cflags);
+            mmap_unlock();
+        }
+        if (tb->cflags & CF_NOCACHE) {
+            /* Not backed by RAM or ROM; nothing worth keeping */
+            tb_phys_invalidate(tb, -1);
+            tcg_tb_remove(tb);
+            continue;
+        }
+        m_aot_successors(cs, tb, queue);
+    }
+}
+
+static void m_aot_run(CPUState *cs, run_on_cpu_data data)
+{
+    MAOTState *s = data.host_ptr;
+    CPUARMState *env = &s->cpu->env;
+    uint32_t saved_exception = env->v7m.exception;
+    uint32_t vecbase = env->v7m.vecbase[env->v7m.secure];
+    g_autoptr(GArray) queue = g_array_new(false, false, sizeof(uint32_t));
+    uint32_t pc;
+    uint8_t buf[4];
+    int i;
+
+    /* Thread mode, from the reset vector */
+    pc = env->regs[15];
+    g_array_append_val(queue, pc);
+    m_aot_walk(cs, queue);
+
+    /*
+     * Handler mode, from the exception vectors. NMI and HardFault run at
+     * negative priority and so with the NEGPRI MMU index, which follows
+     * from the NVIC's active state rather than from anything we could set
+     * here; they are left to lazy translation.
+     */
+    g_array_set_size(queue, 0);
+    for (i = ARMV7M_EXCP_MEM; i < s->num_vectors; i++) {
+        if (cpu_memory_rw_debug(cs, vecbase + i * 4, buf, 4, false)) {
+            break;
+        }
+        pc = ldl_le_p(buf);
+        if (pc & 1) {
+            pc &= ~1;
+            g_array_append_val(queue, pc);
+        }
+    }
+    env->v7m.exception = ARMV7M_EXCP_MEM;
+    arm_rebuild_hflags(env);
+    m_aot_walk(cs, queue);
+    env->v7m.exception = saved_exception;
+    arm_rebuild_hflags(env);
+
+    g_free(s);
+}
+
+/*
+ * The vector table is only in place once ROMs have been loaded by the
+ * machine reset, so translate when the VM first starts. The work runs
+ * on the vCPU thread before its first guest instruction.
+ */
+static void m_aot_vm_state_change(void *opaque, int running, RunState state)
+{
+    MAOTState *s = opaque;
+
+    if (!running) {
+        return;
+    }
+    qemu_del_vm_change_state_handler(s->vmse);
+    async_safe_run_on_cpu(CPU(s->cpu), m_aot_run, RUN_ON_CPU_HOST_PTR(s));
+}
+
+void arm_v7m_pretranslate_init(ARMCPU *cpu, int num_vectors)
+{
+    MAOTState *s = g_new0(MAOTState, 1);
+
+    s->cpu = cpu;
+    s->num_vectors = num_vectors;
+    s->vmse = qemu_add_vm_change_state_handler(m_aot_vm_state_change, s);
+}
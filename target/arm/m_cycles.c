@@ -0,0 +1,127 @@
+/*
+ * ARM M profile instruction timing
+ *
+ * This code is licensed under the GNU GPL v2 or later.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bitops.h"
+#include "qemu/host-utils.h"
+#include "cpu.h"
+#include "internals.h"
+
+/*
+ * Cortex-M3 instruction cycle counts, from the Cortex-M3 TRM
+ * "Processor instruction timings". P, the pipeline refill after a
+ * branch, is 1 plus the fetch wait states.
+ */
+
+#define MC_LDST         (1 << 0) /* single load/store, can pipeline */
+#define MC_LIST         (1 << 1) /* +1 per register in @list */
+#define MC_BRANCH       (1 << 2) /* always refills the pipeline */
+#define MC_RD_PC        (1 << 3) /* 16-bit high register op, refill if Rd=PC */
+#define MC_RT_PC        (1 << 4) /* 32-bit load, refill if Rt=PC */
+#define MC_LITERAL      (1 << 5) /* load from the literal pool */
+#define MC_RN_LITERAL   (1 << 6) /* 32-bit load, literal if Rn=PC */
+
+typedef struct MCycleCost {
+    uint32_t mask;
+    uint32_t value;
+    uint8_t cycles;
+    uint8_t flags;
+    uint16_t list;
+    uint16_t list_pc;
+} MCycleCost;
+
+/* First match wins; the last entry matches everything */
+static const MCycleCost m_cycles_t16[] = {
+    { 0xfe00, 0xde00, 1 },                              /* UDF, SVC */
+    { 0xf000, 0xd000, 1, MC_BRANCH },                   /* B<c> */
+    { 0xf800, 0xe000, 1, MC_BRANCH },                   /* B */
+    { 0xf500, 0xb100, 1, MC_BRANCH },                   /* CB{N}Z */
+    { 0xff0f, 0xbf00, 1 },                              /* hints */
+    { 0xff00, 0xbf00, 0 },                              /* IT, folded */
+    { 0xfe00, 0xb400, 1, MC_LIST, 0x01ff },             /* PUSH */
+    { 0xfe00, 0xbc00, 1, MC_LIST, 0x01ff, 0x0100 },     /* POP */
+    { 0xf000, 0xc000, 1, MC_LIST, 0x00ff },             /* LDM, STM */
+    { 0xff00, 0x4700, 1, MC_BRANCH },                   /* BX, BLX */
+    { 0xfd00, 0x4400, 1, MC_RD_PC },                    /* ADD, MOV high */
+    { 0xffc0, 0x4340, 1 },                              /* MUL */
+    { 0xf800, 0x4800, 2, MC_LDST | MC_LITERAL },        /* LDR literal */
+    { 0xf000, 0x5000, 2, MC_LDST },                     /* LDR/STR reg */
+    { 0xe000, 0x6000, 2, MC_LDST },                     /* LDR/STR{B} imm */
+    { 0xf000, 0x8000, 2, MC_LDST },                     /* LDRH/STRH imm */
+    { 0xf000, 0x9000, 2, MC_LDST },                     /* LDR/STR SP */
+    { 0, 0, 1 },
+};
+
+static const MCycleCost m_cycles_t32[] = {
+    { 0xff80d000, 0xf3808000, 2 },                      /* MSR, MRS, hints */
+    { 0xf800d000, 0xf0008000, 1, MC_BRANCH },           /* B<c>.W */
+    { 0xf800d000, 0xf0009000, 1, MC_BRANCH },           /* B.W */
+    { 0xf800d000, 0xf000d000, 1, MC_BRANCH },           /* BL */
+    { 0xfff0ffe0, 0xe8d0f000, 2, MC_BRANCH },           /* TBB, TBH */
+    { 0xffe00000, 0xe8400000, 2, MC_LDST },             /* LDREX, STREX */
+    { 0xfe400000, 0xe8400000, 3, MC_LDST },             /* LDRD, STRD */
+    { 0xfe500000, 0xe8100000, 1, MC_LIST, 0xffff, 0x8000 }, /* LDM */
+    { 0xfe500000, 0xe8000000, 1, MC_LIST, 0xffff },     /* STM */
+    { 0xff700000, 0xf8500000, 2,
+      MC_LDST | MC_RT_PC | MC_RN_LITERAL },             /* LDR */
+    { 0xfe000000, 0xf8000000, 2, MC_LDST | MC_RN_LITERAL }, /* LDR/STR */
+    { 0xfff0f0f0, 0xfb00f000, 1 },                      /* MUL */
+    { 0xff800000, 0xfb000000, 2 },                      /* MLA, MLS */
+    { 0xffd00000, 0xfb900000, 12 },                     /* SDIV, UDIV */
+    { 0xffd00000, 0xfbc00000, 7 },                      /* SMLAL, UMLAL */
+    { 0xff800000, 0xfb800000, 5 },                      /* SMULL, UMULL */
+    { 0, 0, 1 },
+};
+
+int arm_m_insn_cycles(uint32_t insn, bool is_16bit, int wait_states,
+                      bool *ldst)
+{
+    const MCycleCost *e = is_16bit ? m_cycles_t16 : m_cycles_t32;
+    bool branch, literal;
+    uint32_t list;
+    int cycles;
+
+    while ((insn & e->mask) != e->value) {
+        e++;
+    }
+
+    cycles = e->cycles;
+    branch = e->flags & MC_BRANCH;
+    literal = e->flags & MC_LITERAL;
+
+    if (e->flags & MC_LIST) {
+        list = insn & e->list;
+        cycles += ctpop32(list);
+        branch |= list & e->list_pc;
+    }
+    if ((e->flags & MC_RD_PC) && ((insn & 7) | ((insn >> 4) & 8)) == 15) {
+        branch = true;
+    }
+    if ((e->flags & MC_RT_PC) && extract32(insn, 12, 4) == 15) {
+        branch = true;
+    }
+    if ((e->flags & MC_RN_LITERAL) && extract32(insn, 16, 4) == 15) {
+        literal = true;
+    }
+
+    if (literal) {
+        cycles += wait_states;
+    }
+    /* Neighbouring loads and stores overlap address and data phases */
+    if ((e->flags & MC_LDST) && *ldst) {
+        cycles--;
+    }
+    *ldst = e->flags & MC_LDST;
+
+    if (branch) {
+        cycles += 1 + wait_states;
+        *ldst = false;
+    }
+
+    return cycles;
+}
@@ -23,6 +23,7 @@
 #include <zlib.h> /* For crc32 */
 #include "hw/semihosting/semihost.h"
 #include "sysemu/cpus.h"
+#include "qemu/timer.h"
 #include "sysemu/kvm.h"
 #include "qemu/range.h"
 #include "qapi/qapi-commands-machine-target.h"
@@ -268,6 +269,56 @@ pend_fault:
     return false;
 }
 
+/*
+ * Transfer the basic 8 word exception frame with a single memory access.
+ * This only handles the common case of a CPU without the Security
+ * extension and a frame which lies within one MPU region and one page;
+ * it returns false if the caller must fall back to v7m_stack_write() or
+ * v7m_stack_read(), which also take care of reporting faults.
+ */
+static bool v7m_stack_frame_access(ARMCPU *cpu, uint32_t frameptr,
+                                   ARMMMUIdx mmu_idx, uint32_t *frame,
+                                   bool is_write)
+{
+    CPUARMState *env = &cpu->env;
+    MemTxAttrs attrs = {};
+    target_ulong page_size;
+    hwaddr physaddr;
+    int prot;
+    ARMMMUFaultInfo fi = {};
+    uint32_t buf[8];
+    int i;
+
+    if (arm_feature(env, ARM_FEATURE_M_SECURITY) ||
+        (frameptr & ~TARGET_PAGE_MASK) + sizeof(buf) > TARGET_PAGE_SIZE) {
+        return false;
+    }
+    if (get_phys_addr(env, frameptr, is_write ? MMU_DATA_STORE : MMU_DATA_LOAD,
+                      mmu_idx, &physaddr, &attrs, &prot, &page_size, &fi,
+                      NULL) ||
+        page_size < TARGET_PAGE_SIZE) {
+        return false;
+    }
+
+    if (is_write) {
+        for (i = 0; i < ARRAY_SIZE(buf); i++) {
+            buf[i] = cpu_to_le32(frame[i]);
+        }
+        return address_space_write(arm_addressspace(CPU(cpu), attrs),
+                                   physaddr, attrs, buf,
+                                   sizeof(buf)) == MEMTX_OK;
+    }
+
+    if (address_space_read(arm_addressspace(CPU(cpu), attrs), physaddr,
+                           attrs, buf, sizeof(buf)) != MEMTX_OK) {
+        return false;
+    }
+    for (i = 0; i < ARRAY_SIZE(buf); i++) {
+        frame[i] = le32_to_cpu(buf[i]);
+    }
+    return true;
+}
+
 static bool v7m_stack_read(ARMCPU *cpu, uint32_t *dest, uint32_t addr,
                            ARMMMUIdx mmu_idx)
 {
@@ -655,6 +706,70 @@ static uint32_t *get_v7m_sp_ptr(CPUARMState *env, bool secure, bool threadmode,
     }
 }
 
+/*
+ * Host mapping of the vector table for CPUs without the Security
+ * extension. It is looked up again when VTOR changes or the memory map
+ * is reconfigured; loads through it always see the current contents of
+ * the table, so guest writes to a table in RAM need no special handling.
+ */
+typedef struct ARMV7MVecCache {
+    MemoryListener listener;
+    uint32_t vecbase;
+    uint8_t *host;
+    hwaddr len;
+} ARMV7MVecCache;
+
+static void v7m_vec_cache_commit(MemoryListener *listener)
+{
+    ARMV7MVecCache *c = container_of(listener, ARMV7MVecCache, listener);
+
+    c->host = NULL;
+}
+
+void arm_v7m_vec_cache_init(ARMCPU *cpu)
+{
+    ARMV7MVecCache *c = g_new0(ARMV7MVecCache, 1);
+
+    c->listener.commit = v7m_vec_cache_commit;
+    memory_listener_register(&c->listener,
+                             cpu_get_address_space(CPU(cpu), ARMASIdx_NS));
+    cpu->vec_cache = c;
+}
+
+static bool v7m_vec_cache_load(ARMCPU *cpu, int exc, uint32_t *pvec)
+{
+    ARMV7MVecCache *c = cpu->vec_cache;
+    uint32_t vecbase = cpu->env.v7m.vecbase[M_REG_NS];
+    MemoryRegion *mr;
+    hwaddr xlat;
+
+    if (!c) {
+        return false;
+    }
+
+    RCU_READ_LOCK_GUARD();
+
+    if (!c->host || c->vecbase != vecbase) {
+        /* Architectural maximum of 512 vectors */
+        c->len = 512 * 4;
+        mr = address_space_translate(cpu_get_address_space(CPU(cpu),
+                                                           ARMASIdx_NS),
+                                     vecbase, &xlat, &c->len, false,
+                                     MEMTXATTRS_UNSPECIFIED);
+        if (!memory_access_is_direct(mr, false)) {
+            return false;
+        }
+        c->host = memory_region_get_ram_ptr(mr) + xlat;
+        c->vecbase = vecbase;
+    }
+
+    if (exc * 4 + 4 > c->len) {
+        return false;
+    }
+    *pvec = ldl_le_p(c->host + exc * 4);
+    return true;
+}
+
 static bool arm_v7m_load_vector(ARMCPU *cpu, int exc, bool targets_secure,
                                 uint32_t *pvec)
 {
@@ -667,6 +782,10 @@ static bool arm_v7m_load_vector(ARMCPU *cpu, int exc, bool targets_secure,
     ARMMMUIdx mmu_idx;
     bool exc_secure;
 
+    if (v7m_vec_cache_load(cpu, exc, pvec)) {
+        return true;
+    }
+
     mmu_idx = arm_v7m_mmu_idx_for_secstate_and_priv(env, targets_secure, true);
 
     /*
@@ -1145,6 +1264,22 @@ void HELPER(v7m_vlldm)(CPUARMState *env, uint32_t fptr)
     env->v7m.control[M_REG_S] |= R_V7M_CONTROL_FPCA_MASK;
 }
 
+/*
+ * Cycle-approximate icount: charge for work the core does in hardware,
+ * plus wait states for each of @fetches accesses to the Code region
+ * (vector fetch, pipeline refill).
+ */
+static void v7m_charge_cycles(ARMCPU *cpu, int cycles, int fetches)
+{
+    if (!cpu->cycle_ns_fp || !use_icount) {
+        return;
+    }
+
+    cycles += fetches * cpu->code_wait_states;
+    cpu_icount_charge(CPU(cpu),
+                      arm_m_cycles_to_icount(cpu->cycle_ns_fp, cycles));
+}
+
 static bool v7m_push_stack(ARMCPU *cpu)
 {
     /*
@@ -1154,7 +1289,7 @@ static bool v7m_push_stack(ARMCPU *cpu)
      * should ignore further stack faults trying to process
      * that derived exception.)
      */
-    bool stacked_ok = true, limitviol = false;
+    bool stacked_ok = true, limitviol = false, fast = false;
     CPUARMState *env = &cpu->env;
     uint32_t xpsr = xpsr_read(env);
     uint32_t frameptr = env->regs[13];
@@ -1162,6 +1297,8 @@ static bool v7m_push_stack(ARMCPU *cpu)
     uint32_t framesize;
     bool nsacr_cp10 = extract32(env->v7m.nsacr, 10, 1);
 
+    v7m_charge_cycles(cpu, ARM_M_ENTRY_CYCLES, 2);
+
     if ((env->v7m.control[M_REG_S] & R_V7M_CONTROL_FPCA_MASK) &&
         (env->v7m.secure || nsacr_cp10)) {
         if (env->v7m.secure &&
@@ -1216,13 +1353,22 @@ static bool v7m_push_stack(ARMCPU *cpu)
         }
     }
 
+    if (stacked_ok && framesize == 0x20) {
+        uint32_t frame[8] = {
+            env->regs[0], env->regs[1], env->regs[2], env->regs[3],
+            env->regs[12], env->regs[14], env->regs[15], xpsr,
+        };
+
+        fast = v7m_stack_frame_access(cpu, frameptr, mmu_idx, frame, true);
+    }
+
     /*
      * Write as much of the stack frame as we can. If we fail a stack
      * write this will result in a derived exception being pended
      * (which may be taken in preference to the one we started with
      * if it has higher priority).
      */
-    stacked_ok = stacked_ok &&
+    stacked_ok = stacked_ok && (fast ||
         v7m_stack_write(cpu, frameptr, env->regs[0], mmu_idx, STACK_NORMAL) &&
         v7m_stack_write(cpu, frameptr + 4, env->regs[1],
                         mmu_idx, STACK_NORMAL) &&
@@ -1236,7 +1382,7 @@ static bool v7m_push_stack(ARMCPU *cpu)
                         mmu_idx, STACK_NORMAL) &&
         v7m_stack_write(cpu, frameptr + 24, env->regs[15],
                         mmu_idx, STACK_NORMAL) &&
-        v7m_stack_write(cpu, frameptr + 28, xpsr, mmu_idx, STACK_NORMAL);
+        v7m_stack_write(cpu, frameptr + 28, xpsr, mmu_idx, STACK_NORMAL));
 
     if (env->v7m.control[M_REG_S] & R_V7M_CONTROL_FPCA_MASK) {
         /* FPU is active, try to save its registers */
@@ -1545,6 +1691,7 @@ static void do_v7m_exception_exit(ARMCPU *cpu)
      */
     if (armv7m_nvic_can_take_pending_exception(env->nvic)) {
         qemu_log_mask(CPU_LOG_INT, "...tailchaining to pending exception\n");
+        v7m_charge_cycles(cpu, ARM_M_TAILCHAIN_CYCLES, 2);
         v7m_exception_taken(cpu, excret, true, false);
         return;
     }
@@ -1568,6 +1715,7 @@ static void do_v7m_exception_exit(ARMCPU *cpu)
                                               return_to_sp_process);
         uint32_t frameptr = *frame_sp_p;
         bool pop_ok = true;
+        uint32_t frame[8];
         ARMMMUIdx mmu_idx;
         bool return_to_priv = return_to_handler ||
             !(env->v7m.control[return_to_secure] & R_V7M_CONTROL_NPRIV_MASK);
@@ -1615,15 +1763,30 @@ static void do_v7m_exception_exit(ARMCPU *cpu)
         }
 
         /* Pop registers */
-        pop_ok = pop_ok &&
-            v7m_stack_read(cpu, &env->regs[0], frameptr, mmu_idx) &&
-            v7m_stack_read(cpu, &env->regs[1], frameptr + 0x4, mmu_idx) &&
-            v7m_stack_read(cpu, &env->regs[2], frameptr + 0x8, mmu_idx) &&
-            v7m_stack_read(cpu, &env->regs[3], frameptr + 0xc, mmu_idx) &&
-            v7m_stack_read(cpu, &env->regs[12], frameptr + 0x10, mmu_idx) &&
-            v7m_stack_read(cpu, &env->regs[14], frameptr + 0x14, mmu_idx) &&
-            v7m_stack_read(cpu, &env->regs[15], frameptr + 0x18, mmu_idx) &&
-            v7m_stack_read(cpu, &xpsr, frameptr + 0x1c, mmu_idx);
+        if (pop_ok &&
+            v7m_stack_frame_access(cpu, frameptr, mmu_idx, frame, false)) {
+            env->regs[0] = frame[0];
+            env->regs[1] = frame[1];
+            env->regs[2] = frame[2];
+            env->regs[3] = frame[3];
+            env->regs[12] = frame[4];
+            env->regs[14] = frame[5];
+            env->regs[15] = frame[6];
+            xpsr = frame[7];
+        } else {
+            pop_ok = pop_ok &&
+                v7m_stack_read(cpu, &env->regs[0], frameptr, mmu_idx) &&
+                v7m_stack_read(cpu, &env->regs[1], frameptr + 0x4, mmu_idx) &&
+                v7m_stack_read(cpu, &env->regs[2], frameptr + 0x8, mmu_idx) &&
+                v7m_stack_read(cpu, &env->regs[3], frameptr + 0xc, mmu_idx) &&
+                v7m_stack_read(cpu, &env->regs[12], frameptr + 0x10,
+                               mmu_idx) &&
+                v7m_stack_read(cpu, &env->regs[14], frameptr + 0x14,
+                               mmu_idx) &&
+                v7m_stack_read(cpu, &env->regs[15], frameptr + 0x18,
+                               mmu_idx) &&
+                v7m_stack_read(cpu, &xpsr, frameptr + 0x1c, mmu_idx);
+        }
 
         if (!pop_ok) {
             /*
@@ -1828,6 +1991,7 @@ static void do_v7m_exception_exit(ARMCPU *cpu)
     }
 
     /* Otherwise, we have a successful exception exit. */
+    v7m_charge_cycles(cpu, ARM_M_EXIT_CYCLES, 1);
     arm_clear_exclusive(env);
     arm_rebuild_hflags(env);
     qemu_log_mask(CPU_LOG_INT, "...successful exception return\n");
@@ -22,7 +22,10 @@
 
 #include "qemu/osdep.h"
 #include "hw/boards.h"
+#include "hw/intc/armv7m_nvic.h"
 #include "kvm_arm.h"
+#include "monitor/hmp-target.h"
+#include "monitor/monitor.h"
 #include "qapi/error.h"
 #include "qapi/visitor.h"
 #include "qapi/qobject-input-visitor.h"
@@ -239,3 +242,148 @@ CpuModelExpansionInfo *qmp_query_cpu_model_expansion(CpuModelExpansionType type,
 
     return expansion_info;
 }
+
+static IrqLatencyHistogram *irq_latency_histogram(const NVICHistogram *h)
+{
+    IrqLatencyHistogram *info = g_new0(IrqLatencyHistogram, 1);
+    uint64List **tail = &info->buckets;
+    int i;
+
+    info->count = h->count;
+    info->min = h->min_ns;
+    info->max = h->max_ns;
+    info->total = h->total_ns;
+
+    for (i = 0; i < NVIC_HIST_BUCKETS; i++) {
+        *tail = g_new0(uint64List, 1);
+        (*tail)->value = h->bucket[i];
+        tail = &(*tail)->next;
+    }
+    return info;
+}
+
+IrqLatencyInfoList *qmp_query_irq_latency(bool has_nvic, const char *nvic,
+                                          bool has_reset, bool reset,
+                                          Error **errp)
+{
+    IrqLatencyInfoList *head = NULL, **tail = &head;
+    bool ambiguous = false;
+    Object *obj;
+    NVICState *s;
+    int i;
+
+    if (has_nvic) {
+        obj = object_resolve_path_type(nvic, TYPE_NVIC, NULL);
+        if (!obj) {
+            error_setg(errp, "'%s' is not an M-profile NVIC", nvic);
+            return NULL;
+        }
+    } else {
+        obj = object_resolve_path_type("", TYPE_NVIC, &ambiguous);
+        if (ambiguous) {
+            error_setg(errp, "More than one M-profile NVIC, "
+                       "use 'nvic' to select one");
+            return NULL;
+        }
+        if (!obj) {
+            error_setg(errp, "No M-profile NVIC found");
+            return NULL;
+        }
+    }
+    s = NVIC(obj);
+    if (!s->stats) {
+        error_setg(errp, "NVIC is not realized");
+        return NULL;
+    }
+
+    for (i = 0; i < s->num_irq; i++) {
+        NVICIrqStats *st = &s->stats[i];
+        IrqLatencyInfo *info;
+
+        if (!st->latency.count && !st->duration.count) {
+            continue;
+        }
+
+        info = g_new0(IrqLatencyInfo, 1);
+        info->exception = i;
+        info->latency = irq_latency_histogram(&st->latency);
+        info->duration = irq_latency_histogram(&st->duration);
+        info->preempted = st->preempted;
+        info->tail_chained = st->tail_chained;
+
+        *tail = g_new0(IrqLatencyInfoList, 1);
+        (*tail)->value = info;
+        tail = &(*tail)->next;
+
+        if (has_reset && reset) {
+            memset(&st->latency, 0, sizeof(st->latency));
+            memset(&st->duration, 0, sizeof(st->duration));
+            st->preempted = 0;
+            st->tail_chained = 0;
+        }
+    }
+
+    return head;
+}
+
+static void hmp_print_irq_histogram(Monitor *mon, const char *name,
+                                    IrqLatencyHistogram *h)
+{
+    uint64List *b;
+    int i;
+
+    if (!h->count) {
+        return;
+    }
+    monitor_printf(mon, "  %-8s min %" PRIu64 " avg %" PRIu64
+                   " max %" PRIu64 " ns\n", name, h->min,
+                   h->total / h->count, h->max);
+
+    for (b = h->buckets, i = 0; b; b = b->next, i++) {
+        if (!b->value) {
+            continue;
+        }
+        if (i == 0) {
+            monitor_printf(mon, "    %10s < %-10d", "", 128);
+        } else if (!b->next) {
+            monitor_printf(mon, "    %10s >= %-9" PRIu64, "",
+                           (uint64_t)64 << i);
+        } else {
+            monitor_printf(mon, "    %10" PRIu64 " .. %-9" PRIu64,
+                           (uint64_t)64 << i, (uint64_t)128 << i);
+        }
+        monitor_printf(mon, " %" PRIu64 "\n", b->value);
+    }
+}
+
+void hmp_info_irq_latency(Monitor *mon, const QDict *qdict)
+{
+    bool reset = qdict_get_try_bool(qdict, "reset", false);
+    const char *nvic = qdict_get_try_str(qdict, "nvic");
+    IrqLatencyInfoList *list, *l;
+    Error *err = NULL;
+
+    list = qmp_query_irq_latency(!!nvic, nvic, true, reset, &err);
+    if (err) {
+        monitor_printf(mon, "%s\n", error_get_pretty(err));
+        error_free(err);
+        return;
+    }
+    if (!list) {
+        monitor_printf(mon, "No exceptions taken\n");
+        return;
+    }
+
+    for (l = list; l; l = l->next) {
+        IrqLatencyInfo *info = l->value;
+
+        monitor_printf(mon, "exception %" PRId64 ": taken %" PRIu64
+                       ", preempted %" PRIu64 ", tail-chained %" PRIu64 "\n",
+                       info->exception, info->latency->count,
+                       info->preempted, info->tail_chained);
+        hmp_print_irq_histogram(mon, "latency", info->latency);
+        hmp_print_irq_histogram(mon, "duration", info->duration);
+    }
+
+    qapi_free_IrqLatencyInfoList(list);
+}
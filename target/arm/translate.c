@@ -963,7 +963,54 @@ static void gen_aa32_st_i32(DisasContext *s, TCGv_i32 val, TCGv_i32 a32,
     tcg_temp_free(addr);
 }
 
-#define DO_GEN_LD(SUFF, OPC)                                             \
+/*
+ * Load from @addr, known at translation time, straight from the host
+ * memory of a flat region.  Returns false if @addr is not in one and
+ * the load must go through the softmmu.  Unaligned and byte-swapped
+ * loads always do, so that alignment faults are still raised.
+ */
+static bool gen_flat_ld_i32(DisasContext *s, TCGv_i32 val, uint32_t addr,
+                            MemOp opc)
+{
+    uint32_t size = memop_size(opc);
+    int i;
+
+    if ((addr & (size - 1)) || (opc & MO_BSWAP)) {
+        return false;
+    }
+
+    for (i = 0; i < s->num_flat_regions; i++) {
+        const ARMFlatRegion *r = &s->flat_regions[i];
+        TCGv_ptr ptr;
+
+        if (addr < r->base || addr - r->base > r->size - size) {
+            continue;
+        }
+        ptr = tcg_const_ptr(r->host + (addr - r->base));
+        switch (opc & MO_SSIZE) {
+        case MO_UB:
+            tcg_gen_ld8u_i32(val, ptr, 0);
+            break;
+        case MO_SB:
+            tcg_gen_ld8s_i32(val, ptr, 0);
+            break;
+        case MO_UW:
+            tcg_gen_ld16u_i32(val, ptr, 0);
+            break;
+        case MO_SW:
+            tcg_gen_ld16s_i32(val, ptr, 0);
+            break;
+        default:
+            tcg_gen_ld_i32(val, ptr, 0);
+            break;
+        }
+        tcg_temp_free_ptr(ptr);
+        return true;
+    }
+    return false;
+}
+
+#define DO_GEN_LD(SUFF, OPC)                                            \
 static inline void gen_aa32_ld##SUFF(DisasContext *s, TCGv_i32 val,      \
                                      TCGv_i32 a32, int index)            \
 {                                                                        \
@@ -2661,6 +2708,44 @@ static void gen_goto_ptr(void)
     tcg_gen_lookup_and_goto_ptr();
 }
 
+/*
+ * Indirect jump through a per-TB inline cache of the last target.
+ * M profile has no MMU to remap code, and everything but the Thumb bit
+ * of the next TB's flags is known here, so only it is used there.
+ */
+static void gen_goto_ptr_cached(DisasContext *s)
+{
+    uint32_t flags = s->base.tb->flags;
+    uint32_t condexec = 0;
+    TCGv_i32 tmp;
+    TCGv pc;
+
+    if (!arm_dc_feature(s, ARM_FEATURE_M) || s->ss_active) {
+        gen_goto_ptr();
+        return;
+    }
+
+    /* As written back by gen_set_condexec() */
+    if (s->condexec_mask) {
+        condexec = (s->condexec_cond << 4) | (s->condexec_mask >> 1);
+    }
+    flags = FIELD_DP32(flags, TBFLAG_AM32, CONDEXEC, condexec);
+    flags = FIELD_DP32(flags, TBFLAG_AM32, THUMB, 0);
+    flags = FIELD_DP32(flags, TBFLAG_M32, LSPACT, s->v7m_lspact);
+    flags = FIELD_DP32(flags, TBFLAG_M32, NEW_FP_CTXT_NEEDED,
+                       s->v7m_new_fp_ctxt_needed);
+    flags = FIELD_DP32(flags, TBFLAG_M32, FPCCR_S_WRONG, s->v8m_fpccr_s_wrong);
+
+    tmp = load_cpu_field(thumb);
+    tcg_gen_shli_i32(tmp, tmp, R_TBFLAG_AM32_THUMB_SHIFT);
+    tcg_gen_ori_i32(tmp, tmp, flags);
+    pc = tcg_temp_new();
+    tcg_gen_extu_i32_tl(pc, cpu_R[15]);
+    tcg_gen_lookup_and_goto_tb(s->base.tb, pc, tmp);
+    tcg_temp_free(pc);
+    tcg_temp_free_i32(tmp);
+}
+
 /* This will end the TB but doesn't guarantee we'll return to
  * cpu_loop_exec. Any live exit_requests will be processed as we
  * enter the next TB.
@@ -2689,6 +2774,53 @@ static inline void gen_jmp (DisasContext *s, uint32_t dest)
     }
 }
 
+/*
+ * Direct branch that a hot trace may follow instead of ending the TB.
+ * Only Thumb code checks for page crossings insn by insn, as continuing
+ * elsewhere in the page requires.
+ */
+static void gen_jmp_trace(DisasContext *s, uint32_t dest)
+{
+    if (s->thumb && !s->condjmp && !s->condexec_mask &&
+        !is_singlestepping(s) && translator_trace_follow(&s->base, dest)) {
+        s->base.pc_next = dest;
+    } else {
+        gen_jmp(s, dest);
+    }
+}
+
+/*
+ * Conditional direct branch in a hot trace: continue on the predicted
+ * path and leave through a side exit on the other.  Backward branches
+ * are predicted taken, forward ones not taken.  Returns false, emitting
+ * nothing, if the trace cannot go on.
+ */
+static bool gen_jmp_cond_trace(DisasContext *s, DisasCompare *cmp,
+                               uint32_t dest)
+{
+    bool taken = dest < s->pc_curr;
+    uint32_t other = taken ? s->base.pc_next : dest;
+    TCGLabel *stay;
+
+    if (!s->thumb || s->condexec_mask || is_singlestepping(s) ||
+        !translator_trace_follow(&s->base, taken ? dest : s->base.pc_next)) {
+        return false;
+    }
+
+    stay = gen_new_label();
+    tcg_gen_brcondi_i32(taken ? cmp->cond : tcg_invert_cond(cmp->cond),
+                        cmp->value, 0, stay);
+    translator_side_exit(&s->base);
+    gen_set_pc_im(s, other);
+    gen_goto_ptr();
+    gen_set_label(stay);
+
+    if (taken) {
+        s->base.pc_next = dest;
+    }
+    return true;
+}
+
 static inline void gen_mulxy(TCGv_i32 t0, TCGv_i32 t1, int x, int y)
 {
     if (x)
@@ -8952,6 +9084,20 @@ static TCGv_i32 op_addr_ri_pre(DisasContext *s, arg_ldst_ri *a)
     return add_reg_for_lit(s, a->rn, a->p ? ofs : 0);
 }
 
+/*
+ * Literal loads have an address known at translation time: return it
+ * in @addr.
+ */
+static bool op_addr_ri_literal(DisasContext *s, arg_ldst_ri *a,
+                               uint32_t *addr)
+{
+    if (a->rn != 15 || !a->p || a->w) {
+        return false;
+    }
+    *addr = (read_pc(s) & ~3) + (a->u ? a->imm : -a->imm);
+    return true;
+}
+
 static void op_addr_ri_post(DisasContext *s, arg_ldst_ri *a,
                             TCGv_i32 addr, int address_offset)
 {
@@ -8974,11 +9120,15 @@ static bool op_load_ri(DisasContext *s, arg_ldst_ri *a,
 {
     ISSInfo issinfo = make_issinfo(s, a->rt, a->p, a->w);
     TCGv_i32 addr, tmp;
+    uint32_t lit;
 
     addr = op_addr_ri_pre(s, a);
 
     tmp = tcg_temp_new_i32();
-    gen_aa32_ld_i32(s, tmp, addr, mem_idx, mop | s->be_data);
+    if (!op_addr_ri_literal(s, a, &lit) ||
+        !gen_flat_ld_i32(s, tmp, lit, mop | s->be_data)) {
+        gen_aa32_ld_i32(s, tmp, addr, mem_idx, mop | s->be_data);
+    }
     disas_set_da_iss(s, mop, issinfo);
 
     /*
@@ -9011,17 +9161,23 @@ static bool op_ldrd_ri(DisasContext *s, arg_ldst_ri *a, int rt2)
 {
     int mem_idx = get_mem_index(s);
     TCGv_i32 addr, tmp;
+    uint32_t lit;
+    bool literal = op_addr_ri_literal(s, a, &lit);
 
     addr = op_addr_ri_pre(s, a);
 
     tmp = tcg_temp_new_i32();
-    gen_aa32_ld_i32(s, tmp, addr, mem_idx, MO_UL | s->be_data);
+    if (!literal || !gen_flat_ld_i32(s, tmp, lit, MO_UL | s->be_data)) {
+        gen_aa32_ld_i32(s, tmp, addr, mem_idx, MO_UL | s->be_data);
+    }
     store_reg(s, a->rt, tmp);
 
     tcg_gen_addi_i32(addr, addr, 4);
 
     tmp = tcg_temp_new_i32();
-    gen_aa32_ld_i32(s, tmp, addr, mem_idx, MO_UL | s->be_data);
+    if (!literal || !gen_flat_ld_i32(s, tmp, lit + 4, MO_UL | s->be_data)) {
+        gen_aa32_ld_i32(s, tmp, addr, mem_idx, MO_UL | s->be_data);
+    }
     store_reg(s, rt2, tmp);
 
     /* LDRD w/ base writeback is undefined if the registers overlap.  */
@@ -10356,7 +10512,7 @@ static bool trans_LDM_t16(DisasContext *s, arg_ldst_block *a)
 
 static bool trans_B(DisasContext *s, arg_i *a)
 {
-    gen_jmp(s, read_pc(s) + a->imm);
+    gen_jmp_trace(s, read_pc(s) + a->imm);
     return true;
 }
 
@@ -10370,6 +10526,17 @@ static bool trans_B_cond_thumb(DisasContext *s, arg_ci *a)
         unallocated_encoding(s);
         return true;
     }
+    if (s->base.trace) {
+        DisasCompare cmp;
+        bool followed;
+
+        arm_test_cc(&cmp, a->cond);
+        followed = gen_jmp_cond_trace(s, &cmp, read_pc(s) + a->imm);
+        arm_free_cc(&cmp);
+        if (followed) {
+            return true;
+        }
+    }
     arm_skip_unless(s, a->cond);
     gen_jmp(s, read_pc(s) + a->imm);
     return true;
@@ -10378,7 +10545,7 @@ static bool trans_B_cond_thumb(DisasContext *s, arg_ci *a)
 static bool trans_BL(DisasContext *s, arg_i *a)
 {
     tcg_gen_movi_i32(cpu_R[14], s->base.pc_next | s->thumb);
-    gen_jmp(s, read_pc(s) + a->imm);
+    gen_jmp_trace(s, read_pc(s) + a->imm);
     return true;
 }
 
@@ -10466,6 +10633,17 @@ static bool trans_CBZ(DisasContext *s, arg_CBZ *a)
 {
     TCGv_i32 tmp = load_reg(s, a->rn);
 
+    if (s->base.trace) {
+        DisasCompare cmp = {
+            .cond = a->nz ? TCG_COND_NE : TCG_COND_EQ,
+            .value = tmp,
+        };
+
+        if (gen_jmp_cond_trace(s, &cmp, read_pc(s) + a->imm)) {
+            tcg_temp_free_i32(tmp);
+            return true;
+        }
+    }
     arm_gen_condlabel(s);
     tcg_gen_brcondi_i32(a->nz ? TCG_COND_EQ : TCG_COND_NE,
                         tmp, 0, s->condlabel);
@@ -11061,6 +11239,16 @@ static void arm_tr_init_disas_context(DisasContextBase *dcbase, CPUState *cs)
         dc->v7m_new_fp_ctxt_needed =
             FIELD_EX32(tb_flags, TBFLAG_M32, NEW_FP_CTXT_NEEDED);
         dc->v7m_lspact = FIELD_EX32(tb_flags, TBFLAG_M32, LSPACT);
+        if (FIELD_EX32(tb_flags, TBFLAG_M32, FLAT_MEM)) {
+            dc->flat_regions = cpu->flat_regions;
+            dc->num_flat_regions = cpu->num_flat_regions;
+        }
+        if (tb_cflags(dc->base.tb) & CF_USE_ICOUNT) {
+            dc->cycle_ns_fp = cpu->cycle_ns_fp;
+        }
+        if (dc->base.pc_first < ARM_M_CODE_REGION_END) {
+            dc->cycle_wait_states = cpu->code_wait_states;
+        }
     } else {
         dc->be_data =
             FIELD_EX32(tb_flags, TBFLAG_ANY, BE_DATA) ? MO_BE : MO_LE;
@@ -11332,6 +11520,15 @@ static void thumb_tr_translate_insn(DisasContextBase *dcbase, CPUState *cpu)
     }
     dc->insn = insn;
 
+    if (dc->cycle_ns_fp) {
+        int before = arm_m_cycles_to_icount(dc->cycle_ns_fp, dc->cycles);
+
+        dc->cycles += arm_m_insn_cycles(insn, is_16bit, dc->cycle_wait_states,
+                                        &dc->cycle_ldst);
+        dc->base.insn_cost =
+            arm_m_cycles_to_icount(dc->cycle_ns_fp, dc->cycles) - before;
+    }
+
     if (dc->condexec_mask && !thumb_insn_is_unconditional(dc, insn)) {
         uint32_t cond = dc->condexec_cond;
 
@@ -11446,7 +11643,7 @@ static void arm_tr_tb_stop(DisasContextBase *dcbase, CPUState *cpu)
             gen_goto_tb(dc, 1, dc->base.pc_next);
             break;
         case DISAS_JUMP:
-            gen_goto_ptr();
+            gen_goto_ptr_cached(dc);
             break;
         case DISAS_UPDATE:
             gen_set_pc_im(dc, dc->base.pc_next);
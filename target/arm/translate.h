@@ -45,6 +45,14 @@ typedef struct DisasContext {
     bool v8m_fpccr_s_wrong; /* true if v8M FPCCR.S != v8m_secure */
     bool v7m_new_fp_ctxt_needed; /* ASPEN set but no active FP context */
     bool v7m_lspact; /* FPCCR.LSPACT set */
+    /* Regions loads may access directly, see arm_cpu_add_flat_region() */
+    const ARMFlatRegion *flat_regions;
+    int num_flat_regions; /* 0 unless TBFLAG_M32_FLAT_MEM */
+    /* Cycle-approximate icount: ns per cycle (16.16), 0 if disabled */
+    uint32_t cycle_ns_fp;
+    int cycle_wait_states; /* fetch wait states for this TB's region */
+    int cycles;         /* cycles charged so far in this TB */
+    bool cycle_ldst;    /* previous insn was a load or store */
     /* Immediate value in AArch32 SVC insn; must be set if is_jmp == DISAS_SWI
      * so that top level loop can generate correct syndrome information.
      */
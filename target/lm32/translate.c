@@ -1133,6 +1133,7 @@ void gen_intermediate_code(CPUState *cs, TranslationBlock *tb, int max_insns)
 
     tb->size = dc->pc - pc_start;
     tb->icount = num_insns;
+    tb->icount_cost = num_insns;
 
 #ifdef DEBUG_DISAS
     if (qemu_loglevel_mask(CPU_LOG_TB_IN_ASM)
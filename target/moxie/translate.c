@@ -883,6 +883,7 @@ void gen_intermediate_code(CPUState *cs, TranslationBlock *tb, int max_insns)
 
     tb->size = ctx.pc - pc_start;
     tb->icount = num_insns;
+    tb->icount_cost = num_insns;
 }
 
 void restore_state_to_opc(CPUMoxieState *env, TranslationBlock *tb,
@@ -888,6 +888,7 @@ void gen_intermediate_code(CPUState *cs, TranslationBlock *tb, int max_insns)
     /* Mark instruction starts for the final generated instruction */
     tb->size = dc->pc - tb->pc;
     tb->icount = num_insns;
+    tb->icount_cost = num_insns;
 
 #ifdef DEBUG_DISAS
     if (qemu_loglevel_mask(CPU_LOG_TB_IN_ASM)
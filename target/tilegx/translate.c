@@ -2416,6 +2416,7 @@ void gen_intermediate_code(CPUState *cs, TranslationBlock *tb, int max_insns)
     gen_tb_end(tb, num_insns);
     tb->size = dc->pc - pc_start;
     tb->icount = num_insns;
+    tb->icount_cost = num_insns;
 }
 
 void restore_state_to_opc(CPUTLGState *env, TranslationBlock *tb,
@@ -2004,6 +2004,7 @@ done_generating:
 #endif
     tb->size = dc->pc - pc_start;
     tb->icount = num_insns;
+    tb->icount_cost = num_insns;
 }
 
 static const char *cpu_mode_names[16] = {
@@ -2720,6 +2720,52 @@ void tcg_gen_lookup_and_goto_ptr(void)
     }
 }
 
+void tcg_gen_lookup_and_goto_tb(TranslationBlock *tb, TCGv pc, TCGv_i32 flags)
+{
+    TCGLabel *miss;
+    TCGv_ptr ptr;
+    TCGv t0, t1;
+    TCGv_i32 t2;
+
+    /*
+     * Direct jump slot 0 and the cached key are updated non-atomically,
+     * which only the single-threaded round-robin mode can afford.
+     */
+    if (!TCG_TARGET_HAS_goto_ptr || qemu_loglevel_mask(CPU_LOG_TB_NOCHAIN) ||
+        (tb_cflags(tb) & CF_PARALLEL)) {
+        tcg_gen_lookup_and_goto_ptr();
+        return;
+    }
+
+    plugin_gen_disable_mem_helpers();
+    miss = gen_new_label();
+    ptr = tcg_const_ptr(tb);
+    t0 = tcg_temp_new();
+    t1 = tcg_temp_new();
+    t2 = tcg_temp_new_i32();
+
+    tcg_gen_ld_tl(t0, ptr, offsetof(TranslationBlock, indirect_pc));
+    tcg_gen_xor_tl(t0, t0, pc);
+    tcg_gen_ld_i32(t2, ptr, offsetof(TranslationBlock, indirect_flags));
+    tcg_gen_xor_i32(t2, t2, flags);
+    tcg_gen_extu_i32_tl(t1, t2);
+    tcg_gen_or_tl(t0, t0, t1);
+    tcg_gen_brcondi_tl(TCG_COND_NE, t0, 0, miss);
+    tcg_temp_free(t0);
+    tcg_temp_free(t1);
+    tcg_temp_free_i32(t2);
+    tcg_temp_free_ptr(ptr);
+
+    /* Until the slot is linked, goto_tb falls through to the miss path */
+    tcg_gen_goto_tb(0);
+
+    gen_set_label(miss);
+    ptr = tcg_const_ptr(tb);
+    gen_helper_lookup_tb_ptr_link(ptr, cpu_env, ptr);
+    tcg_gen_op1i(INDEX_op_goto_ptr, tcgv_ptr_arg(ptr));
+    tcg_temp_free_ptr(ptr);
+}
+
 static inline MemOp tcg_canonicalize_memop(MemOp op, bool is64, bool st)
 {
     /* Trigger the asserts within as early as possible.  */
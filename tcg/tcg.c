@@ -172,6 +172,9 @@ struct tcg_region_tree {
  * dynamically allocate from as demand dictates. Given appropriate region
  * sizing, this minimizes flushes even when some TCG threads generate a lot
  * more code than others.
+ *
+ * Once every region has been handed out, the oldest one that no thread is
+ * translating into is evicted and handed out again; see tcg_region_evict.
  */
 struct tcg_region_state {
     QemuMutex lock;
@@ -187,6 +190,10 @@ struct tcg_region_state {
     /* fields protected by the lock */
     size_t current; /* current region index */
     size_t agg_size_full; /* aggregate size of full regions */
+    uint64_t generation; /* number of regions handed out */
+    uint64_t *birth; /* generation each region was handed out at, 0 if free */
+    size_t *free; /* evicted regions, ready to be handed out again */
+    size_t n_free;
 };
 
 static struct tcg_region_state region;
@@ -300,6 +307,10 @@ static void tcg_out_label(TCGContext *s, TCGLabel *l, tcg_insn_unit *ptr)
     tcg_debug_assert(!l->has_value);
     l->has_value = 1;
     l->u.value_ptr = ptr;
+#ifdef CONFIG_TCG_INTERPRETER
+    /* Branches to the label must not land inside a superinstruction */
+    s->tci_fuse_ptr = NULL;
+#endif
 }
 
 TCGLabel *gen_new_label(void)
@@ -399,22 +410,23 @@ static void tcg_region_trees_init(void)
     }
 }
 
-static struct tcg_region_tree *tc_ptr_to_region_tree(void *p)
+static size_t tc_ptr_to_region_idx(void *p)
 {
-    size_t region_idx;
-
     if (p < region.start_aligned) {
-        region_idx = 0;
+        return 0;
     } else {
         ptrdiff_t offset = p - region.start_aligned;
 
         if (offset > region.stride * (region.n - 1)) {
-            region_idx = region.n - 1;
-        } else {
-            region_idx = offset / region.stride;
+            return region.n - 1;
         }
+        return offset / region.stride;
     }
-    return region_trees + region_idx * tree_size;
+}
+
+static struct tcg_region_tree *tc_ptr_to_region_tree(void *p)
+{
+    return region_trees + tc_ptr_to_region_idx(p) * tree_size;
 }
 
 void tcg_tb_insert(TranslationBlock *tb)
@@ -549,11 +561,17 @@ static void tcg_region_assign(TCGContext *s, size_t curr_region)
 
 static bool tcg_region_alloc__locked(TCGContext *s)
 {
-    if (region.current == region.n) {
+    size_t i;
+
+    if (region.n_free) {
+        i = region.free[--region.n_free];
+    } else if (region.current < region.n) {
+        i = region.current++;
+    } else {
         return true;
     }
-    tcg_region_assign(s, region.current);
-    region.current++;
+    tcg_region_assign(s, i);
+    region.birth[i] = ++region.generation;
     return false;
 }
 
@@ -594,6 +612,9 @@ void tcg_region_reset_all(void)
     qemu_mutex_lock(&region.lock);
     region.current = 0;
     region.agg_size_full = 0;
+    region.generation = 0;
+    region.n_free = 0;
+    memset(region.birth, 0, region.n * sizeof(*region.birth));
 
     for (i = 0; i < n_ctxs; i++) {
         TCGContext *s = atomic_read(&tcg_ctxs[i]);
@@ -606,6 +627,95 @@ void tcg_region_reset_all(void)
     tcg_region_tree_reset_all();
 }
 
+/* Can tcg_tb_alloc move on to another region without an eviction? */
+bool tcg_region_available(void)
+{
+    bool ret;
+
+    qemu_mutex_lock(&region.lock);
+    ret = region.n_free || region.current < region.n;
+    qemu_mutex_unlock(&region.lock);
+    return ret;
+}
+
+static bool tcg_region_in_use__locked(size_t i)
+{
+    unsigned int n_ctxs = atomic_read(&n_tcg_ctxs);
+    unsigned int j;
+
+    for (j = 0; j < n_ctxs; j++) {
+        const TCGContext *s = atomic_read(&tcg_ctxs[j]);
+
+        if (tc_ptr_to_region_idx(s->code_gen_buffer) == i) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static gboolean tcg_region_collect_tb(gpointer key, gpointer value,
+                                      gpointer data)
+{
+    g_ptr_array_add(data, value);
+    return false;
+}
+
+/*
+ * Evict the oldest region that no context is translating into: pass
+ * each of its TBs to @evict_tb, which must unlink it from everything
+ * that may still point to it, then make the region available again.
+ * Code in the other regions is kept.
+ *
+ * Returns false, evicting nothing, if every region is in use.
+ *
+ * Call from a safe-work context.
+ */
+bool tcg_region_evict(void (*evict_tb)(TranslationBlock *tb))
+{
+    struct tcg_region_tree *rt;
+    size_t i, oldest = region.n;
+    void *start, *end;
+    GPtrArray *tbs;
+
+    qemu_mutex_lock(&region.lock);
+    for (i = 0; i < region.n; i++) {
+        if (region.birth[i] &&
+            (oldest == region.n || region.birth[i] < region.birth[oldest]) &&
+            !tcg_region_in_use__locked(i)) {
+            oldest = i;
+        }
+    }
+    qemu_mutex_unlock(&region.lock);
+    if (oldest == region.n) {
+        return false;
+    }
+
+    rt = region_trees + oldest * tree_size;
+    tbs = g_ptr_array_new();
+    qemu_mutex_lock(&rt->lock);
+    g_tree_foreach(rt->tree, tcg_region_collect_tb, tbs);
+    qemu_mutex_unlock(&rt->lock);
+
+    for (i = 0; i < tbs->len; i++) {
+        evict_tb(g_ptr_array_index(tbs, i));
+    }
+    g_ptr_array_free(tbs, true);
+
+    qemu_mutex_lock(&rt->lock);
+    /* Increment the refcount first so that destroy acts as a reset */
+    g_tree_ref(rt->tree);
+    g_tree_destroy(rt->tree);
+    qemu_mutex_unlock(&rt->lock);
+
+    tcg_region_bounds(oldest, &start, &end);
+    qemu_mutex_lock(&region.lock);
+    region.agg_size_full -= end - start - TCG_HIGHWATER;
+    region.birth[oldest] = 0;
+    region.free[region.n_free++] = oldest;
+    qemu_mutex_unlock(&region.lock);
+    return true;
+}
+
 #ifdef CONFIG_USER_ONLY
 static size_t tcg_n_regions(void)
 {
@@ -621,30 +731,33 @@ static size_t tcg_n_regions(void)
 static size_t tcg_n_regions(void)
 {
     size_t i;
-
-    /* Use a single region if all we have is one vCPU thread */
-#if !defined(CONFIG_USER_ONLY)
     MachineState *ms = MACHINE(qdev_get_machine());
-    unsigned int max_cpus = ms->smp.max_cpus;
-#endif
-    if (max_cpus == 1 || !qemu_tcg_mttcg_enabled()) {
-        return 1;
+    unsigned int n_threads = ms->smp.max_cpus;
+
+    /*
+     * A single vCPU thread gets several regions as well, so that a full
+     * buffer costs an eviction of the oldest region rather than a flush.
+     */
+    if (!qemu_tcg_mttcg_enabled()) {
+        n_threads = 1;
     }
 
-    /* Try to have more regions than max_cpus, with each region being >= 2 MB */
+    /*
+     * Try to have more regions than threads, with each region being >= 2 MB
+     */
     for (i = 8; i > 0; i--) {
         size_t regions_per_thread = i;
         size_t region_size;
 
         region_size = tcg_init_ctx.code_gen_buffer_size;
-        region_size /= max_cpus * regions_per_thread;
+        region_size /= n_threads * regions_per_thread;
 
         if (region_size >= 2 * 1024u * 1024) {
-            return max_cpus * regions_per_thread;
+            return n_threads * regions_per_thread;
         }
     }
     /* If we can't, then just allocate one region per vCPU thread */
-    return max_cpus;
+    return n_threads;
 }
 #endif
 
@@ -659,7 +772,8 @@ static size_t tcg_n_regions(void)
  * code in parallel without synchronization.
  *
  * In softmmu the number of TCG threads is bounded by max_cpus, so we use at
- * least max_cpus regions in MTTCG. In !MTTCG we use a single region.
+ * least max_cpus regions in MTTCG. In !MTTCG we still use several regions,
+ * so that there is old code to evict when the buffer fills up.
  * Note that the TCG options from the command-line (i.e. -accel accel=tcg,[...])
  * must have been parsed before calling this function, since it calls
  * qemu_tcg_mttcg_enabled().
@@ -713,6 +827,8 @@ void tcg_region_init(void)
     region.end = QEMU_ALIGN_PTR_DOWN(buf + size, page_size);
     /* account for that last guard page */
     region.end -= page_size;
+    region.birth = g_new0(uint64_t, region.n);
+    region.free = g_new(size_t, region.n);
 
     /* set guard pages */
     for (i = 0; i < region.n; i++) {
@@ -4134,6 +4250,9 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb)
 #ifdef TCG_TARGET_NEED_POOL_LABELS
     s->pool_labels = NULL;
 #endif
+#ifdef CONFIG_TCG_INTERPRETER
+    s->tci_fuse_ptr = NULL;
+#endif
 
     num_insns = -1;
     QTAILQ_FOREACH(op, &s->ops, link) {
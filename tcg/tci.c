@@ -285,22 +285,12 @@ tci_read_ulong(const tcg_target_ulong *regs, uint8_t **tb_ptr)
     return taddr;
 }
 
-/* Read indexed register or constant (native size) from bytecode. */
-static tcg_target_ulong
-tci_read_ri(const tcg_target_ulong *regs, uint8_t **tb_ptr)
-{
-    tcg_target_ulong value;
-    TCGReg r = **tb_ptr;
-    *tb_ptr += 1;
-    if (r == TCG_CONST) {
-        value = tci_read_i(tb_ptr);
-    } else {
-        value = tci_read_reg(regs, r);
-    }
-    return value;
-}
-
-/* Read indexed register or constant (32 bit) from bytecode. */
+#if TCG_TARGET_REG_BITS == 32
+/*
+ * Read indexed register or constant (32 bit) from bytecode.  Only the
+ * double-word compares of 32 bit hosts still decide this at run time;
+ * elsewhere the opcode says whether an operand is an immediate.
+ */
 static uint32_t tci_read_ri32(const tcg_target_ulong *regs, uint8_t **tb_ptr)
 {
     uint32_t value;
@@ -314,27 +304,12 @@ static uint32_t tci_read_ri32(const tcg_target_ulong *regs, uint8_t **tb_ptr)
     return value;
 }
 
-#if TCG_TARGET_REG_BITS == 32
 /* Read two indexed registers or constants (2 * 32 bit) from bytecode. */
 static uint64_t tci_read_ri64(const tcg_target_ulong *regs, uint8_t **tb_ptr)
 {
     uint32_t low = tci_read_ri32(regs, tb_ptr);
     return tci_uint64(tci_read_ri32(regs, tb_ptr), low);
 }
-#elif TCG_TARGET_REG_BITS == 64
-/* Read indexed register or constant (64 bit) from bytecode. */
-static uint64_t tci_read_ri64(const tcg_target_ulong *regs, uint8_t **tb_ptr)
-{
-    uint64_t value;
-    TCGReg r = **tb_ptr;
-    *tb_ptr += 1;
-    if (r == TCG_CONST) {
-        value = tci_read_i64(tb_ptr);
-    } else {
-        value = tci_read_reg64(regs, r);
-    }
-    return value;
-}
 #endif
 
 static tcg_target_ulong tci_read_label(uint8_t **tb_ptr)
@@ -474,6 +449,54 @@ static bool tci_compare64(uint64_t u0, uint64_t u1, TCGCond condition)
 # define qemu_st_beq(X)  stq_be_p(g2h(taddr), X)
 #endif
 
+/*
+ * Opcode dispatch.  With GCC's labels as values every handler ends by
+ * fetching the next opcode and jumping straight to its handler through
+ * tci_dispatch[], instead of going back to a single shared switch.  The
+ * indirect jump at the end of each handler is then predicted separately,
+ * which matters a lot for a loop that does nothing but dispatch.
+ *
+ * CASE() labels a handler for both variants; handlers end with NEXT(),
+ * or with JUMP() after they have set tb_ptr to a branch target.
+ */
+#if defined(__GNUC__)
+# define TCI_THREADED
+#endif
+
+#if defined(CONFIG_DEBUG_TCG) && !defined(NDEBUG)
+# define TCI_FETCH() \
+    do { \
+        opc = tb_ptr[0]; \
+        op_size = tb_ptr[1]; \
+        old_code_ptr = tb_ptr; \
+        tb_ptr += 2; \
+    } while (0)
+#else
+# define TCI_FETCH() \
+    do { \
+        opc = tb_ptr[0]; \
+        tb_ptr += 2; \
+    } while (0)
+#endif
+
+#ifdef TCI_THREADED
+# define CASE(op)   case INDEX_op_##op: do_##op
+# define JUMP() \
+    do { \
+        TCI_FETCH(); \
+        goto *tci_dispatch[opc]; \
+    } while (0)
+# define NEXT() \
+    do { \
+        tci_assert(tb_ptr == old_code_ptr + op_size); \
+        JUMP(); \
+    } while (0)
+#else
+# define CASE(op)   case INDEX_op_##op
+# define JUMP()     continue
+# define NEXT()     break
+#endif
+
 /* Interpret pseudo code in tb. */
 uintptr_t tcg_qemu_tb_exec(CPUArchState *env, uint8_t *tb_ptr)
 {
@@ -482,16 +505,205 @@ uintptr_t tcg_qemu_tb_exec(CPUArchState *env, uint8_t *tb_ptr)
     uintptr_t sp_value = (uintptr_t)(tcg_temps + CPU_TEMP_BUF_NLONGS);
     uintptr_t ret = 0;
 
+    TCGOpcode opc;
+#if defined(CONFIG_DEBUG_TCG) && !defined(NDEBUG)
+    uint8_t op_size;
+    uint8_t *old_code_ptr;
+#endif
+#ifdef TCI_THREADED
+    static const void * const tci_dispatch[NB_OPS] = {
+        [0 ... NB_OPS - 1] = &&do_default,
+        [INDEX_op_call] = &&do_call,
+        [INDEX_op_br] = &&do_br,
+        [INDEX_op_setcond_i32] = &&do_setcond_i32,
+#if TCG_TARGET_REG_BITS == 32
+        [INDEX_op_setcond2_i32] = &&do_setcond2_i32,
+#elif TCG_TARGET_REG_BITS == 64
+        [INDEX_op_setcond_i64] = &&do_setcond_i64,
+#endif
+        [INDEX_op_mov_i32] = &&do_mov_i32,
+        [INDEX_op_movi_i32] = &&do_movi_i32,
+        [INDEX_op_ld8u_i32] = &&do_ld8u_i32,
+        [INDEX_op_ld8s_i32] = &&do_ld8s_i32,
+        [INDEX_op_ld16u_i32] = &&do_ld16u_i32,
+        [INDEX_op_ld16s_i32] = &&do_ld16s_i32,
+        [INDEX_op_ld_i32] = &&do_ld_i32,
+        [INDEX_op_st8_i32] = &&do_st8_i32,
+        [INDEX_op_st16_i32] = &&do_st16_i32,
+        [INDEX_op_st_i32] = &&do_st_i32,
+        [INDEX_op_add_i32] = &&do_add_i32,
+        [INDEX_op_sub_i32] = &&do_sub_i32,
+        [INDEX_op_mul_i32] = &&do_mul_i32,
+#if TCG_TARGET_HAS_div_i32
+        [INDEX_op_div_i32] = &&do_div_i32,
+        [INDEX_op_divu_i32] = &&do_divu_i32,
+        [INDEX_op_rem_i32] = &&do_rem_i32,
+        [INDEX_op_remu_i32] = &&do_remu_i32,
+#elif TCG_TARGET_HAS_div2_i32
+        [INDEX_op_div2_i32] = &&do_div2_i32,
+        [INDEX_op_divu2_i32] = &&do_divu2_i32,
+#endif
+        [INDEX_op_and_i32] = &&do_and_i32,
+        [INDEX_op_or_i32] = &&do_or_i32,
+        [INDEX_op_xor_i32] = &&do_xor_i32,
+        [INDEX_op_shl_i32] = &&do_shl_i32,
+        [INDEX_op_shr_i32] = &&do_shr_i32,
+        [INDEX_op_sar_i32] = &&do_sar_i32,
+#if TCG_TARGET_HAS_rot_i32
+        [INDEX_op_rotl_i32] = &&do_rotl_i32,
+        [INDEX_op_rotr_i32] = &&do_rotr_i32,
+#endif
+#if TCG_TARGET_HAS_deposit_i32
+        [INDEX_op_deposit_i32] = &&do_deposit_i32,
+#endif
+        [INDEX_op_brcond_i32] = &&do_brcond_i32,
+        [INDEX_op_tci_addi_i32] = &&do_tci_addi_i32,
+        [INDEX_op_tci_subi_i32] = &&do_tci_subi_i32,
+        [INDEX_op_tci_andi_i32] = &&do_tci_andi_i32,
+        [INDEX_op_tci_ori_i32] = &&do_tci_ori_i32,
+        [INDEX_op_tci_xori_i32] = &&do_tci_xori_i32,
+        [INDEX_op_tci_shli_i32] = &&do_tci_shli_i32,
+        [INDEX_op_tci_shri_i32] = &&do_tci_shri_i32,
+        [INDEX_op_tci_sari_i32] = &&do_tci_sari_i32,
+        [INDEX_op_tci_setcondi_i32] = &&do_tci_setcondi_i32,
+        [INDEX_op_tci_brcondi_i32] = &&do_tci_brcondi_i32,
+        [INDEX_op_tci_ld_add_i32] = &&do_tci_ld_add_i32,
+        [INDEX_op_tci_ld_addi_i32] = &&do_tci_ld_addi_i32,
+        [INDEX_op_tci_ld_brcond_i32] = &&do_tci_ld_brcond_i32,
+        [INDEX_op_tci_ld_brcondi_i32] = &&do_tci_ld_brcondi_i32,
+        [INDEX_op_tci_setcond_brcond_i32] = &&do_tci_setcond_brcond_i32,
+        [INDEX_op_tci_setcondi_brcond_i32] = &&do_tci_setcondi_brcond_i32,
+#if TCG_TARGET_REG_BITS == 32
+        [INDEX_op_add2_i32] = &&do_add2_i32,
+        [INDEX_op_sub2_i32] = &&do_sub2_i32,
+        [INDEX_op_brcond2_i32] = &&do_brcond2_i32,
+        [INDEX_op_mulu2_i32] = &&do_mulu2_i32,
+#endif /* TCG_TARGET_REG_BITS == 32 */
+#if TCG_TARGET_HAS_ext8s_i32
+        [INDEX_op_ext8s_i32] = &&do_ext8s_i32,
+#endif
+#if TCG_TARGET_HAS_ext16s_i32
+        [INDEX_op_ext16s_i32] = &&do_ext16s_i32,
+#endif
+#if TCG_TARGET_HAS_ext8u_i32
+        [INDEX_op_ext8u_i32] = &&do_ext8u_i32,
+#endif
+#if TCG_TARGET_HAS_ext16u_i32
+        [INDEX_op_ext16u_i32] = &&do_ext16u_i32,
+#endif
+#if TCG_TARGET_HAS_bswap16_i32
+        [INDEX_op_bswap16_i32] = &&do_bswap16_i32,
+#endif
+#if TCG_TARGET_HAS_bswap32_i32
+        [INDEX_op_bswap32_i32] = &&do_bswap32_i32,
+#endif
+#if TCG_TARGET_HAS_not_i32
+        [INDEX_op_not_i32] = &&do_not_i32,
+#endif
+#if TCG_TARGET_HAS_neg_i32
+        [INDEX_op_neg_i32] = &&do_neg_i32,
+#endif
+#if TCG_TARGET_REG_BITS == 64
+        [INDEX_op_mov_i64] = &&do_mov_i64,
+        [INDEX_op_movi_i64] = &&do_movi_i64,
+        [INDEX_op_ld8u_i64] = &&do_ld8u_i64,
+        [INDEX_op_ld8s_i64] = &&do_ld8s_i64,
+        [INDEX_op_ld16u_i64] = &&do_ld16u_i64,
+        [INDEX_op_ld16s_i64] = &&do_ld16s_i64,
+        [INDEX_op_ld32u_i64] = &&do_ld32u_i64,
+        [INDEX_op_ld32s_i64] = &&do_ld32s_i64,
+        [INDEX_op_ld_i64] = &&do_ld_i64,
+        [INDEX_op_st8_i64] = &&do_st8_i64,
+        [INDEX_op_st16_i64] = &&do_st16_i64,
+        [INDEX_op_st32_i64] = &&do_st32_i64,
+        [INDEX_op_st_i64] = &&do_st_i64,
+        [INDEX_op_add_i64] = &&do_add_i64,
+        [INDEX_op_sub_i64] = &&do_sub_i64,
+        [INDEX_op_mul_i64] = &&do_mul_i64,
+#if TCG_TARGET_HAS_div_i64
+        [INDEX_op_div_i64] = &&do_div_i64,
+        [INDEX_op_divu_i64] = &&do_divu_i64,
+        [INDEX_op_rem_i64] = &&do_rem_i64,
+        [INDEX_op_remu_i64] = &&do_remu_i64,
+#elif TCG_TARGET_HAS_div2_i64
+        [INDEX_op_div2_i64] = &&do_div2_i64,
+        [INDEX_op_divu2_i64] = &&do_divu2_i64,
+#endif
+        [INDEX_op_and_i64] = &&do_and_i64,
+        [INDEX_op_or_i64] = &&do_or_i64,
+        [INDEX_op_xor_i64] = &&do_xor_i64,
+        [INDEX_op_shl_i64] = &&do_shl_i64,
+        [INDEX_op_shr_i64] = &&do_shr_i64,
+        [INDEX_op_sar_i64] = &&do_sar_i64,
+#if TCG_TARGET_HAS_rot_i64
+        [INDEX_op_rotl_i64] = &&do_rotl_i64,
+        [INDEX_op_rotr_i64] = &&do_rotr_i64,
+#endif
+#if TCG_TARGET_HAS_deposit_i64
+        [INDEX_op_deposit_i64] = &&do_deposit_i64,
+#endif
+        [INDEX_op_brcond_i64] = &&do_brcond_i64,
+        [INDEX_op_tci_addi_i64] = &&do_tci_addi_i64,
+        [INDEX_op_tci_subi_i64] = &&do_tci_subi_i64,
+        [INDEX_op_tci_andi_i64] = &&do_tci_andi_i64,
+        [INDEX_op_tci_ori_i64] = &&do_tci_ori_i64,
+        [INDEX_op_tci_xori_i64] = &&do_tci_xori_i64,
+        [INDEX_op_tci_shli_i64] = &&do_tci_shli_i64,
+        [INDEX_op_tci_shri_i64] = &&do_tci_shri_i64,
+        [INDEX_op_tci_sari_i64] = &&do_tci_sari_i64,
+        [INDEX_op_tci_setcondi_i64] = &&do_tci_setcondi_i64,
+        [INDEX_op_tci_brcondi_i64] = &&do_tci_brcondi_i64,
+#if TCG_TARGET_HAS_ext8u_i64
+        [INDEX_op_ext8u_i64] = &&do_ext8u_i64,
+#endif
+#if TCG_TARGET_HAS_ext8s_i64
+        [INDEX_op_ext8s_i64] = &&do_ext8s_i64,
+#endif
+#if TCG_TARGET_HAS_ext16s_i64
+        [INDEX_op_ext16s_i64] = &&do_ext16s_i64,
+#endif
+#if TCG_TARGET_HAS_ext16u_i64
+        [INDEX_op_ext16u_i64] = &&do_ext16u_i64,
+#endif
+#if TCG_TARGET_HAS_ext32s_i64
+        [INDEX_op_ext32s_i64] = &&do_ext32s_i64,
+#endif
+        [INDEX_op_ext_i32_i64] = &&do_ext_i32_i64,
+#if TCG_TARGET_HAS_ext32u_i64
+        [INDEX_op_ext32u_i64] = &&do_ext32u_i64,
+#endif
+        [INDEX_op_extu_i32_i64] = &&do_extu_i32_i64,
+#if TCG_TARGET_HAS_bswap16_i64
+        [INDEX_op_bswap16_i64] = &&do_bswap16_i64,
+#endif
+#if TCG_TARGET_HAS_bswap32_i64
+        [INDEX_op_bswap32_i64] = &&do_bswap32_i64,
+#endif
+#if TCG_TARGET_HAS_bswap64_i64
+        [INDEX_op_bswap64_i64] = &&do_bswap64_i64,
+#endif
+#if TCG_TARGET_HAS_not_i64
+        [INDEX_op_not_i64] = &&do_not_i64,
+#endif
+#if TCG_TARGET_HAS_neg_i64
+        [INDEX_op_neg_i64] = &&do_neg_i64,
+#endif
+#endif /* TCG_TARGET_REG_BITS == 64 */
+        [INDEX_op_exit_tb] = &&do_exit_tb,
+        [INDEX_op_goto_tb] = &&do_goto_tb,
+        [INDEX_op_qemu_ld_i32] = &&do_qemu_ld_i32,
+        [INDEX_op_qemu_ld_i64] = &&do_qemu_ld_i64,
+        [INDEX_op_qemu_st_i32] = &&do_qemu_st_i32,
+        [INDEX_op_qemu_st_i64] = &&do_qemu_st_i64,
+        [INDEX_op_mb] = &&do_mb,
+    };
+#endif
+
     regs[TCG_AREG0] = (tcg_target_ulong)env;
     regs[TCG_REG_CALL_STACK] = sp_value;
     tci_assert(tb_ptr);
 
     for (;;) {
-        TCGOpcode opc = tb_ptr[0];
-#if defined(CONFIG_DEBUG_TCG) && !defined(NDEBUG)
-        uint8_t op_size = tb_ptr[1];
-        uint8_t *old_code_ptr = tb_ptr;
-#endif
         tcg_target_ulong t0;
         tcg_target_ulong t1;
         tcg_target_ulong t2;
@@ -507,16 +719,18 @@ uintptr_t tcg_qemu_tb_exec(CPUArchState *env, uint8_t *tb_ptr)
 #endif
         TCGMemOpIdx oi;
 
-#if defined(GETPC)
-        tci_tb_ptr = (uintptr_t)tb_ptr;
+        TCI_FETCH();
+#ifdef TCI_THREADED
+        goto *tci_dispatch[opc];
 #endif
 
-        /* Skip opcode and size entry. */
-        tb_ptr += 2;
-
         switch (opc) {
-        case INDEX_op_call:
-            t0 = tci_read_ri(regs, &tb_ptr);
+        CASE(call):
+#if defined(GETPC)
+            /* For GETPC() in the helper */
+            tci_tb_ptr = (uintptr_t)(tb_ptr - 2);
+#endif
+            t0 = tci_read_i(&tb_ptr);
 #if TCG_TARGET_REG_BITS == 32
             tmp64 = ((helper_function)t0)(tci_read_reg(regs, TCG_REG_R0),
                                           tci_read_reg(regs, TCG_REG_R1),
@@ -541,196 +755,196 @@ uintptr_t tcg_qemu_tb_exec(CPUArchState *env, uint8_t *tb_ptr)
                                           tci_read_reg(regs, TCG_REG_R6));
             tci_write_reg(regs, TCG_REG_R0, tmp64);
 #endif
-            break;
-        case INDEX_op_br:
+            NEXT();
+        CASE(br):
             label = tci_read_label(&tb_ptr);
             tci_assert(tb_ptr == old_code_ptr + op_size);
             tb_ptr = (uint8_t *)label;
-            continue;
-        case INDEX_op_setcond_i32:
+            JUMP();
+        CASE(setcond_i32):
             t0 = *tb_ptr++;
             t1 = tci_read_r32(regs, &tb_ptr);
-            t2 = tci_read_ri32(regs, &tb_ptr);
+            t2 = tci_read_r32(regs, &tb_ptr);
             condition = *tb_ptr++;
             tci_write_reg32(regs, t0, tci_compare32(t1, t2, condition));
-            break;
+            NEXT();
 #if TCG_TARGET_REG_BITS == 32
-        case INDEX_op_setcond2_i32:
+        CASE(setcond2_i32):
             t0 = *tb_ptr++;
             tmp64 = tci_read_r64(regs, &tb_ptr);
             v64 = tci_read_ri64(regs, &tb_ptr);
             condition = *tb_ptr++;
             tci_write_reg32(regs, t0, tci_compare64(tmp64, v64, condition));
-            break;
+            NEXT();
 #elif TCG_TARGET_REG_BITS == 64
-        case INDEX_op_setcond_i64:
+        CASE(setcond_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_r64(regs, &tb_ptr);
-            t2 = tci_read_ri64(regs, &tb_ptr);
+            t2 = tci_read_r64(regs, &tb_ptr);
             condition = *tb_ptr++;
             tci_write_reg64(regs, t0, tci_compare64(t1, t2, condition));
-            break;
+            NEXT();
 #endif
-        case INDEX_op_mov_i32:
+        CASE(mov_i32):
             t0 = *tb_ptr++;
             t1 = tci_read_r32(regs, &tb_ptr);
             tci_write_reg32(regs, t0, t1);
-            break;
-        case INDEX_op_movi_i32:
+            NEXT();
+        CASE(movi_i32):
             t0 = *tb_ptr++;
             t1 = tci_read_i32(&tb_ptr);
             tci_write_reg32(regs, t0, t1);
-            break;
+            NEXT();
 
             /* Load/store operations (32 bit). */
 
-        case INDEX_op_ld8u_i32:
+        CASE(ld8u_i32):
             t0 = *tb_ptr++;
             t1 = tci_read_r(regs, &tb_ptr);
             t2 = tci_read_s32(&tb_ptr);
             tci_write_reg8(regs, t0, *(uint8_t *)(t1 + t2));
-            break;
-        case INDEX_op_ld8s_i32:
+            NEXT();
+        CASE(ld8s_i32):
             TODO();
-            break;
-        case INDEX_op_ld16u_i32:
+            NEXT();
+        CASE(ld16u_i32):
             TODO();
-            break;
-        case INDEX_op_ld16s_i32:
+            NEXT();
+        CASE(ld16s_i32):
             TODO();
-            break;
-        case INDEX_op_ld_i32:
+            NEXT();
+        CASE(ld_i32):
             t0 = *tb_ptr++;
             t1 = tci_read_r(regs, &tb_ptr);
             t2 = tci_read_s32(&tb_ptr);
             tci_write_reg32(regs, t0, *(uint32_t *)(t1 + t2));
-            break;
-        case INDEX_op_st8_i32:
+            NEXT();
+        CASE(st8_i32):
             t0 = tci_read_r8(regs, &tb_ptr);
             t1 = tci_read_r(regs, &tb_ptr);
             t2 = tci_read_s32(&tb_ptr);
             *(uint8_t *)(t1 + t2) = t0;
-            break;
-        case INDEX_op_st16_i32:
+            NEXT();
+        CASE(st16_i32):
             t0 = tci_read_r16(regs, &tb_ptr);
             t1 = tci_read_r(regs, &tb_ptr);
             t2 = tci_read_s32(&tb_ptr);
             *(uint16_t *)(t1 + t2) = t0;
-            break;
-        case INDEX_op_st_i32:
+            NEXT();
+        CASE(st_i32):
             t0 = tci_read_r32(regs, &tb_ptr);
             t1 = tci_read_r(regs, &tb_ptr);
             t2 = tci_read_s32(&tb_ptr);
             tci_assert(t1 != sp_value || (int32_t)t2 < 0);
             *(uint32_t *)(t1 + t2) = t0;
-            break;
+            NEXT();
 
             /* Arithmetic operations (32 bit). */
 
-        case INDEX_op_add_i32:
+        CASE(add_i32):
             t0 = *tb_ptr++;
-            t1 = tci_read_ri32(regs, &tb_ptr);
-            t2 = tci_read_ri32(regs, &tb_ptr);
+            t1 = tci_read_r32(regs, &tb_ptr);
+            t2 = tci_read_r32(regs, &tb_ptr);
             tci_write_reg32(regs, t0, t1 + t2);
-            break;
-        case INDEX_op_sub_i32:
+            NEXT();
+        CASE(sub_i32):
             t0 = *tb_ptr++;
-            t1 = tci_read_ri32(regs, &tb_ptr);
-            t2 = tci_read_ri32(regs, &tb_ptr);
+            t1 = tci_read_r32(regs, &tb_ptr);
+            t2 = tci_read_r32(regs, &tb_ptr);
             tci_write_reg32(regs, t0, t1 - t2);
-            break;
-        case INDEX_op_mul_i32:
+            NEXT();
+        CASE(mul_i32):
             t0 = *tb_ptr++;
-            t1 = tci_read_ri32(regs, &tb_ptr);
-            t2 = tci_read_ri32(regs, &tb_ptr);
+            t1 = tci_read_r32(regs, &tb_ptr);
+            t2 = tci_read_r32(regs, &tb_ptr);
             tci_write_reg32(regs, t0, t1 * t2);
-            break;
+            NEXT();
 #if TCG_TARGET_HAS_div_i32
-        case INDEX_op_div_i32:
+        CASE(div_i32):
             t0 = *tb_ptr++;
-            t1 = tci_read_ri32(regs, &tb_ptr);
-            t2 = tci_read_ri32(regs, &tb_ptr);
+            t1 = tci_read_r32(regs, &tb_ptr);
+            t2 = tci_read_r32(regs, &tb_ptr);
             tci_write_reg32(regs, t0, (int32_t)t1 / (int32_t)t2);
-            break;
-        case INDEX_op_divu_i32:
+            NEXT();
+        CASE(divu_i32):
             t0 = *tb_ptr++;
-            t1 = tci_read_ri32(regs, &tb_ptr);
-            t2 = tci_read_ri32(regs, &tb_ptr);
+            t1 = tci_read_r32(regs, &tb_ptr);
+            t2 = tci_read_r32(regs, &tb_ptr);
             tci_write_reg32(regs, t0, t1 / t2);
-            break;
-        case INDEX_op_rem_i32:
+            NEXT();
+        CASE(rem_i32):
             t0 = *tb_ptr++;
-            t1 = tci_read_ri32(regs, &tb_ptr);
-            t2 = tci_read_ri32(regs, &tb_ptr);
+            t1 = tci_read_r32(regs, &tb_ptr);
+            t2 = tci_read_r32(regs, &tb_ptr);
             tci_write_reg32(regs, t0, (int32_t)t1 % (int32_t)t2);
-            break;
-        case INDEX_op_remu_i32:
+            NEXT();
+        CASE(remu_i32):
             t0 = *tb_ptr++;
-            t1 = tci_read_ri32(regs, &tb_ptr);
-            t2 = tci_read_ri32(regs, &tb_ptr);
+            t1 = tci_read_r32(regs, &tb_ptr);
+            t2 = tci_read_r32(regs, &tb_ptr);
             tci_write_reg32(regs, t0, t1 % t2);
-            break;
+            NEXT();
 #elif TCG_TARGET_HAS_div2_i32
-        case INDEX_op_div2_i32:
-        case INDEX_op_divu2_i32:
+        CASE(div2_i32):
+        CASE(divu2_i32):
             TODO();
-            break;
+            NEXT();
 #endif
-        case INDEX_op_and_i32:
+        CASE(and_i32):
             t0 = *tb_ptr++;
-            t1 = tci_read_ri32(regs, &tb_ptr);
-            t2 = tci_read_ri32(regs, &tb_ptr);
+            t1 = tci_read_r32(regs, &tb_ptr);
+            t2 = tci_read_r32(regs, &tb_ptr);
             tci_write_reg32(regs, t0, t1 & t2);
-            break;
-        case INDEX_op_or_i32:
+            NEXT();
+        CASE(or_i32):
             t0 = *tb_ptr++;
-            t1 = tci_read_ri32(regs, &tb_ptr);
-            t2 = tci_read_ri32(regs, &tb_ptr);
+            t1 = tci_read_r32(regs, &tb_ptr);
+            t2 = tci_read_r32(regs, &tb_ptr);
             tci_write_reg32(regs, t0, t1 | t2);
-            break;
-        case INDEX_op_xor_i32:
+            NEXT();
+        CASE(xor_i32):
             t0 = *tb_ptr++;
-            t1 = tci_read_ri32(regs, &tb_ptr);
-            t2 = tci_read_ri32(regs, &tb_ptr);
+            t1 = tci_read_r32(regs, &tb_ptr);
+            t2 = tci_read_r32(regs, &tb_ptr);
             tci_write_reg32(regs, t0, t1 ^ t2);
-            break;
+            NEXT();
 
             /* Shift/rotate operations (32 bit). */
 
-        case INDEX_op_shl_i32:
+        CASE(shl_i32):
             t0 = *tb_ptr++;
-            t1 = tci_read_ri32(regs, &tb_ptr);
-            t2 = tci_read_ri32(regs, &tb_ptr);
+            t1 = tci_read_r32(regs, &tb_ptr);
+            t2 = tci_read_r32(regs, &tb_ptr);
             tci_write_reg32(regs, t0, t1 << (t2 & 31));
-            break;
-        case INDEX_op_shr_i32:
+            NEXT();
+        CASE(shr_i32):
             t0 = *tb_ptr++;
-            t1 = tci_read_ri32(regs, &tb_ptr);
-            t2 = tci_read_ri32(regs, &tb_ptr);
+            t1 = tci_read_r32(regs, &tb_ptr);
+            t2 = tci_read_r32(regs, &tb_ptr);
             tci_write_reg32(regs, t0, t1 >> (t2 & 31));
-            break;
-        case INDEX_op_sar_i32:
+            NEXT();
+        CASE(sar_i32):
             t0 = *tb_ptr++;
-            t1 = tci_read_ri32(regs, &tb_ptr);
-            t2 = tci_read_ri32(regs, &tb_ptr);
+            t1 = tci_read_r32(regs, &tb_ptr);
+            t2 = tci_read_r32(regs, &tb_ptr);
             tci_write_reg32(regs, t0, ((int32_t)t1 >> (t2 & 31)));
-            break;
+            NEXT();
 #if TCG_TARGET_HAS_rot_i32
-        case INDEX_op_rotl_i32:
+        CASE(rotl_i32):
             t0 = *tb_ptr++;
-            t1 = tci_read_ri32(regs, &tb_ptr);
-            t2 = tci_read_ri32(regs, &tb_ptr);
+            t1 = tci_read_r32(regs, &tb_ptr);
+            t2 = tci_read_r32(regs, &tb_ptr);
             tci_write_reg32(regs, t0, rol32(t1, t2 & 31));
-            break;
-        case INDEX_op_rotr_i32:
+            NEXT();
+        CASE(rotr_i32):
             t0 = *tb_ptr++;
-            t1 = tci_read_ri32(regs, &tb_ptr);
-            t2 = tci_read_ri32(regs, &tb_ptr);
+            t1 = tci_read_r32(regs, &tb_ptr);
+            t2 = tci_read_r32(regs, &tb_ptr);
             tci_write_reg32(regs, t0, ror32(t1, t2 & 31));
-            break;
+            NEXT();
 #endif
 #if TCG_TARGET_HAS_deposit_i32
-        case INDEX_op_deposit_i32:
+        CASE(deposit_i32):
             t0 = *tb_ptr++;
             t1 = tci_read_r32(regs, &tb_ptr);
             t2 = tci_read_r32(regs, &tb_ptr);
@@ -738,35 +952,193 @@ uintptr_t tcg_qemu_tb_exec(CPUArchState *env, uint8_t *tb_ptr)
             tmp8 = *tb_ptr++;
             tmp32 = (((1 << tmp8) - 1) << tmp16);
             tci_write_reg32(regs, t0, (t1 & ~tmp32) | ((t2 << tmp16) & tmp32));
-            break;
+            NEXT();
 #endif
-        case INDEX_op_brcond_i32:
+        CASE(brcond_i32):
             t0 = tci_read_r32(regs, &tb_ptr);
-            t1 = tci_read_ri32(regs, &tb_ptr);
+            t1 = tci_read_r32(regs, &tb_ptr);
             condition = *tb_ptr++;
             label = tci_read_label(&tb_ptr);
             if (tci_compare32(t0, t1, condition)) {
                 tci_assert(tb_ptr == old_code_ptr + op_size);
                 tb_ptr = (uint8_t *)label;
-                continue;
+                JUMP();
             }
-            break;
+            NEXT();
+
+            /* Immediate forms (32 bit). */
+
+        CASE(tci_addi_i32):
+            t0 = *tb_ptr++;
+            t1 = tci_read_r32(regs, &tb_ptr);
+            t2 = tci_read_i32(&tb_ptr);
+            tci_write_reg32(regs, t0, t1 + t2);
+            NEXT();
+        CASE(tci_subi_i32):
+            t0 = *tb_ptr++;
+            t1 = tci_read_r32(regs, &tb_ptr);
+            t2 = tci_read_i32(&tb_ptr);
+            tci_write_reg32(regs, t0, t1 - t2);
+            NEXT();
+        CASE(tci_andi_i32):
+            t0 = *tb_ptr++;
+            t1 = tci_read_r32(regs, &tb_ptr);
+            t2 = tci_read_i32(&tb_ptr);
+            tci_write_reg32(regs, t0, t1 & t2);
+            NEXT();
+        CASE(tci_ori_i32):
+            t0 = *tb_ptr++;
+            t1 = tci_read_r32(regs, &tb_ptr);
+            t2 = tci_read_i32(&tb_ptr);
+            tci_write_reg32(regs, t0, t1 | t2);
+            NEXT();
+        CASE(tci_xori_i32):
+            t0 = *tb_ptr++;
+            t1 = tci_read_r32(regs, &tb_ptr);
+            t2 = tci_read_i32(&tb_ptr);
+            tci_write_reg32(regs, t0, t1 ^ t2);
+            NEXT();
+        CASE(tci_shli_i32):
+            t0 = *tb_ptr++;
+            t1 = tci_read_r32(regs, &tb_ptr);
+            t2 = tci_read_i32(&tb_ptr);
+            tci_write_reg32(regs, t0, t1 << (t2 & 31));
+            NEXT();
+        CASE(tci_shri_i32):
+            t0 = *tb_ptr++;
+            t1 = tci_read_r32(regs, &tb_ptr);
+            t2 = tci_read_i32(&tb_ptr);
+            tci_write_reg32(regs, t0, t1 >> (t2 & 31));
+            NEXT();
+        CASE(tci_sari_i32):
+            t0 = *tb_ptr++;
+            t1 = tci_read_r32(regs, &tb_ptr);
+            t2 = tci_read_i32(&tb_ptr);
+            tci_write_reg32(regs, t0, ((int32_t)t1 >> (t2 & 31)));
+            NEXT();
+        CASE(tci_setcondi_i32):
+            t0 = *tb_ptr++;
+            t1 = tci_read_r32(regs, &tb_ptr);
+            t2 = tci_read_i32(&tb_ptr);
+            condition = *tb_ptr++;
+            tci_write_reg32(regs, t0, tci_compare32(t1, t2, condition));
+            NEXT();
+        CASE(tci_brcondi_i32):
+            t0 = tci_read_r32(regs, &tb_ptr);
+            t1 = tci_read_i32(&tb_ptr);
+            condition = *tb_ptr++;
+            label = tci_read_label(&tb_ptr);
+            if (tci_compare32(t0, t1, condition)) {
+                tci_assert(tb_ptr == old_code_ptr + op_size);
+                tb_ptr = (uint8_t *)label;
+                JUMP();
+            }
+            NEXT();
+
+            /*
+             * Superinstructions: a load or setcond fused with the op
+             * after it that uses the result, which is still written to
+             * its register.
+             */
+
+        CASE(tci_ld_add_i32):
+            t0 = *tb_ptr++;
+            t1 = tci_read_r(regs, &tb_ptr);
+            t2 = tci_read_s32(&tb_ptr);
+            tci_write_reg32(regs, t0, *(uint32_t *)(t1 + t2));
+            t0 = *tb_ptr++;
+            t1 = tci_read_r32(regs, &tb_ptr);
+            t2 = tci_read_r32(regs, &tb_ptr);
+            tci_write_reg32(regs, t0, t1 + t2);
+            NEXT();
+        CASE(tci_ld_addi_i32):
+            t0 = *tb_ptr++;
+            t1 = tci_read_r(regs, &tb_ptr);
+            t2 = tci_read_s32(&tb_ptr);
+            tmp32 = *(uint32_t *)(t1 + t2);
+            tci_write_reg32(regs, t0, tmp32);
+            t0 = *tb_ptr++;
+            t2 = tci_read_i32(&tb_ptr);
+            tci_write_reg32(regs, t0, tmp32 + t2);
+            NEXT();
+        CASE(tci_ld_brcond_i32):
+            t0 = *tb_ptr++;
+            t1 = tci_read_r(regs, &tb_ptr);
+            t2 = tci_read_s32(&tb_ptr);
+            tmp32 = *(uint32_t *)(t1 + t2);
+            tci_write_reg32(regs, t0, tmp32);
+            t1 = tci_read_r32(regs, &tb_ptr);
+            condition = *tb_ptr++;
+            label = tci_read_label(&tb_ptr);
+            if (tci_compare32(tmp32, t1, condition)) {
+                tci_assert(tb_ptr == old_code_ptr + op_size);
+                tb_ptr = (uint8_t *)label;
+                JUMP();
+            }
+            NEXT();
+        CASE(tci_ld_brcondi_i32):
+            t0 = *tb_ptr++;
+            t1 = tci_read_r(regs, &tb_ptr);
+            t2 = tci_read_s32(&tb_ptr);
+            tmp32 = *(uint32_t *)(t1 + t2);
+            tci_write_reg32(regs, t0, tmp32);
+            t1 = tci_read_i32(&tb_ptr);
+            condition = *tb_ptr++;
+            label = tci_read_label(&tb_ptr);
+            if (tci_compare32(tmp32, t1, condition)) {
+                tci_assert(tb_ptr == old_code_ptr + op_size);
+                tb_ptr = (uint8_t *)label;
+                JUMP();
+            }
+            NEXT();
+        CASE(tci_setcond_brcond_i32):
+            t0 = *tb_ptr++;
+            t1 = tci_read_r32(regs, &tb_ptr);
+            t2 = tci_read_r32(regs, &tb_ptr);
+            condition = *tb_ptr++;
+            tmp32 = tci_compare32(t1, t2, condition);
+            tci_write_reg32(regs, t0, tmp32);
+            t1 = tci_read_i32(&tb_ptr);
+            condition = *tb_ptr++;
+            label = tci_read_label(&tb_ptr);
+            if (tci_compare32(tmp32, t1, condition)) {
+                tci_assert(tb_ptr == old_code_ptr + op_size);
+                tb_ptr = (uint8_t *)label;
+                JUMP();
+            }
+            NEXT();
+        CASE(tci_setcondi_brcond_i32):
+            t0 = *tb_ptr++;
+            t1 = tci_read_r32(regs, &tb_ptr);
+            t2 = tci_read_i32(&tb_ptr);
+            condition = *tb_ptr++;
+            tmp32 = tci_compare32(t1, t2, condition);
+            tci_write_reg32(regs, t0, tmp32);
+            t1 = tci_read_i32(&tb_ptr);
+            condition = *tb_ptr++;
+            label = tci_read_label(&tb_ptr);
+            if (tci_compare32(tmp32, t1, condition)) {
+                tci_assert(tb_ptr == old_code_ptr + op_size);
+                tb_ptr = (uint8_t *)label;
+                JUMP();
+            }
+            NEXT();
 #if TCG_TARGET_REG_BITS == 32
-        case INDEX_op_add2_i32:
+        CASE(add2_i32):
             t0 = *tb_ptr++;
             t1 = *tb_ptr++;
             tmp64 = tci_read_r64(regs, &tb_ptr);
             tmp64 += tci_read_r64(regs, &tb_ptr);
             tci_write_reg64(regs, t1, t0, tmp64);
-            break;
-        case INDEX_op_sub2_i32:
+            NEXT();
+        CASE(sub2_i32):
             t0 = *tb_ptr++;
             t1 = *tb_ptr++;
             tmp64 = tci_read_r64(regs, &tb_ptr);
             tmp64 -= tci_read_r64(regs, &tb_ptr);
             tci_write_reg64(regs, t1, t0, tmp64);
-            break;
-        case INDEX_op_brcond2_i32:
+            NEXT();
+        CASE(brcond2_i32):
             tmp64 = tci_read_r64(regs, &tb_ptr);
             v64 = tci_read_ri64(regs, &tb_ptr);
             condition = *tb_ptr++;
@@ -774,237 +1146,237 @@ uintptr_t tcg_qemu_tb_exec(CPUArchState *env, uint8_t *tb_ptr)
             if (tci_compare64(tmp64, v64, condition)) {
                 tci_assert(tb_ptr == old_code_ptr + op_size);
                 tb_ptr = (uint8_t *)label;
-                continue;
+                JUMP();
             }
-            break;
-        case INDEX_op_mulu2_i32:
+            NEXT();
+        CASE(mulu2_i32):
             t0 = *tb_ptr++;
             t1 = *tb_ptr++;
             t2 = tci_read_r32(regs, &tb_ptr);
             tmp64 = tci_read_r32(regs, &tb_ptr);
             tci_write_reg64(regs, t1, t0, t2 * tmp64);
-            break;
+            NEXT();
 #endif /* TCG_TARGET_REG_BITS == 32 */
 #if TCG_TARGET_HAS_ext8s_i32
-        case INDEX_op_ext8s_i32:
+        CASE(ext8s_i32):
             t0 = *tb_ptr++;
             t1 = tci_read_r8s(regs, &tb_ptr);
             tci_write_reg32(regs, t0, t1);
-            break;
+            NEXT();
 #endif
 #if TCG_TARGET_HAS_ext16s_i32
-        case INDEX_op_ext16s_i32:
+        CASE(ext16s_i32):
             t0 = *tb_ptr++;
             t1 = tci_read_r16s(regs, &tb_ptr);
             tci_write_reg32(regs, t0, t1);
-            break;
+            NEXT();
 #endif
 #if TCG_TARGET_HAS_ext8u_i32
-        case INDEX_op_ext8u_i32:
+        CASE(ext8u_i32):
             t0 = *tb_ptr++;
             t1 = tci_read_r8(regs, &tb_ptr);
             tci_write_reg32(regs, t0, t1);
-            break;
+            NEXT();
 #endif
 #if TCG_TARGET_HAS_ext16u_i32
-        case INDEX_op_ext16u_i32:
+        CASE(ext16u_i32):
             t0 = *tb_ptr++;
             t1 = tci_read_r16(regs, &tb_ptr);
             tci_write_reg32(regs, t0, t1);
-            break;
+            NEXT();
 #endif
 #if TCG_TARGET_HAS_bswap16_i32
-        case INDEX_op_bswap16_i32:
+        CASE(bswap16_i32):
             t0 = *tb_ptr++;
             t1 = tci_read_r16(regs, &tb_ptr);
             tci_write_reg32(regs, t0, bswap16(t1));
-            break;
+            NEXT();
 #endif
 #if TCG_TARGET_HAS_bswap32_i32
-        case INDEX_op_bswap32_i32:
+        CASE(bswap32_i32):
             t0 = *tb_ptr++;
             t1 = tci_read_r32(regs, &tb_ptr);
             tci_write_reg32(regs, t0, bswap32(t1));
-            break;
+            NEXT();
 #endif
 #if TCG_TARGET_HAS_not_i32
-        case INDEX_op_not_i32:
+        CASE(not_i32):
             t0 = *tb_ptr++;
             t1 = tci_read_r32(regs, &tb_ptr);
             tci_write_reg32(regs, t0, ~t1);
-            break;
+            NEXT();
 #endif
 #if TCG_TARGET_HAS_neg_i32
-        case INDEX_op_neg_i32:
+        CASE(neg_i32):
             t0 = *tb_ptr++;
             t1 = tci_read_r32(regs, &tb_ptr);
             tci_write_reg32(regs, t0, -t1);
-            break;
+            NEXT();
 #endif
 #if TCG_TARGET_REG_BITS == 64
-        case INDEX_op_mov_i64:
+        CASE(mov_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_r64(regs, &tb_ptr);
             tci_write_reg64(regs, t0, t1);
-            break;
-        case INDEX_op_movi_i64:
+            NEXT();
+        CASE(movi_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_i64(&tb_ptr);
             tci_write_reg64(regs, t0, t1);
-            break;
+            NEXT();
 
             /* Load/store operations (64 bit). */
 
-        case INDEX_op_ld8u_i64:
+        CASE(ld8u_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_r(regs, &tb_ptr);
             t2 = tci_read_s32(&tb_ptr);
             tci_write_reg8(regs, t0, *(uint8_t *)(t1 + t2));
-            break;
-        case INDEX_op_ld8s_i64:
+            NEXT();
+        CASE(ld8s_i64):
             TODO();
-            break;
-        case INDEX_op_ld16u_i64:
+            NEXT();
+        CASE(ld16u_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_r(regs, &tb_ptr);
             t2 = tci_read_s32(&tb_ptr);
             tci_write_reg16(regs, t0, *(uint16_t *)(t1 + t2));
-            break;
-        case INDEX_op_ld16s_i64:
+            NEXT();
+        CASE(ld16s_i64):
             TODO();
-            break;
-        case INDEX_op_ld32u_i64:
+            NEXT();
+        CASE(ld32u_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_r(regs, &tb_ptr);
             t2 = tci_read_s32(&tb_ptr);
             tci_write_reg32(regs, t0, *(uint32_t *)(t1 + t2));
-            break;
-        case INDEX_op_ld32s_i64:
+            NEXT();
+        CASE(ld32s_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_r(regs, &tb_ptr);
             t2 = tci_read_s32(&tb_ptr);
             tci_write_reg32s(regs, t0, *(int32_t *)(t1 + t2));
-            break;
-        case INDEX_op_ld_i64:
+            NEXT();
+        CASE(ld_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_r(regs, &tb_ptr);
             t2 = tci_read_s32(&tb_ptr);
             tci_write_reg64(regs, t0, *(uint64_t *)(t1 + t2));
-            break;
-        case INDEX_op_st8_i64:
+            NEXT();
+        CASE(st8_i64):
             t0 = tci_read_r8(regs, &tb_ptr);
             t1 = tci_read_r(regs, &tb_ptr);
             t2 = tci_read_s32(&tb_ptr);
             *(uint8_t *)(t1 + t2) = t0;
-            break;
-        case INDEX_op_st16_i64:
+            NEXT();
+        CASE(st16_i64):
             t0 = tci_read_r16(regs, &tb_ptr);
             t1 = tci_read_r(regs, &tb_ptr);
             t2 = tci_read_s32(&tb_ptr);
             *(uint16_t *)(t1 + t2) = t0;
-            break;
-        case INDEX_op_st32_i64:
+            NEXT();
+        CASE(st32_i64):
             t0 = tci_read_r32(regs, &tb_ptr);
             t1 = tci_read_r(regs, &tb_ptr);
             t2 = tci_read_s32(&tb_ptr);
             *(uint32_t *)(t1 + t2) = t0;
-            break;
-        case INDEX_op_st_i64:
+            NEXT();
+        CASE(st_i64):
             t0 = tci_read_r64(regs, &tb_ptr);
             t1 = tci_read_r(regs, &tb_ptr);
             t2 = tci_read_s32(&tb_ptr);
             tci_assert(t1 != sp_value || (int32_t)t2 < 0);
             *(uint64_t *)(t1 + t2) = t0;
-            break;
+            NEXT();
 
             /* Arithmetic operations (64 bit). */
 
-        case INDEX_op_add_i64:
+        CASE(add_i64):
             t0 = *tb_ptr++;
-            t1 = tci_read_ri64(regs, &tb_ptr);
-            t2 = tci_read_ri64(regs, &tb_ptr);
+            t1 = tci_read_r64(regs, &tb_ptr);
+            t2 = tci_read_r64(regs, &tb_ptr);
             tci_write_reg64(regs, t0, t1 + t2);
-            break;
-        case INDEX_op_sub_i64:
+            NEXT();
+        CASE(sub_i64):
             t0 = *tb_ptr++;
-            t1 = tci_read_ri64(regs, &tb_ptr);
-            t2 = tci_read_ri64(regs, &tb_ptr);
+            t1 = tci_read_r64(regs, &tb_ptr);
+            t2 = tci_read_r64(regs, &tb_ptr);
             tci_write_reg64(regs, t0, t1 - t2);
-            break;
-        case INDEX_op_mul_i64:
+            NEXT();
+        CASE(mul_i64):
             t0 = *tb_ptr++;
-            t1 = tci_read_ri64(regs, &tb_ptr);
-            t2 = tci_read_ri64(regs, &tb_ptr);
+            t1 = tci_read_r64(regs, &tb_ptr);
+            t2 = tci_read_r64(regs, &tb_ptr);
             tci_write_reg64(regs, t0, t1 * t2);
-            break;
+            NEXT();
 #if TCG_TARGET_HAS_div_i64
-        case INDEX_op_div_i64:
-        case INDEX_op_divu_i64:
-        case INDEX_op_rem_i64:
-        case INDEX_op_remu_i64:
+        CASE(div_i64):
+        CASE(divu_i64):
+        CASE(rem_i64):
+        CASE(remu_i64):
             TODO();
-            break;
+            NEXT();
 #elif TCG_TARGET_HAS_div2_i64
-        case INDEX_op_div2_i64:
-        case INDEX_op_divu2_i64:
+        CASE(div2_i64):
+        CASE(divu2_i64):
             TODO();
-            break;
+            NEXT();
 #endif
-        case INDEX_op_and_i64:
+        CASE(and_i64):
             t0 = *tb_ptr++;
-            t1 = tci_read_ri64(regs, &tb_ptr);
-            t2 = tci_read_ri64(regs, &tb_ptr);
+            t1 = tci_read_r64(regs, &tb_ptr);
+            t2 = tci_read_r64(regs, &tb_ptr);
             tci_write_reg64(regs, t0, t1 & t2);
-            break;
-        case INDEX_op_or_i64:
+            NEXT();
+        CASE(or_i64):
             t0 = *tb_ptr++;
-            t1 = tci_read_ri64(regs, &tb_ptr);
-            t2 = tci_read_ri64(regs, &tb_ptr);
+            t1 = tci_read_r64(regs, &tb_ptr);
+            t2 = tci_read_r64(regs, &tb_ptr);
             tci_write_reg64(regs, t0, t1 | t2);
-            break;
-        case INDEX_op_xor_i64:
+            NEXT();
+        CASE(xor_i64):
             t0 = *tb_ptr++;
-            t1 = tci_read_ri64(regs, &tb_ptr);
-            t2 = tci_read_ri64(regs, &tb_ptr);
+            t1 = tci_read_r64(regs, &tb_ptr);
+            t2 = tci_read_r64(regs, &tb_ptr);
             tci_write_reg64(regs, t0, t1 ^ t2);
-            break;
+            NEXT();
 
             /* Shift/rotate operations (64 bit). */
 
-        case INDEX_op_shl_i64:
+        CASE(shl_i64):
             t0 = *tb_ptr++;
-            t1 = tci_read_ri64(regs, &tb_ptr);
-            t2 = tci_read_ri64(regs, &tb_ptr);
+            t1 = tci_read_r64(regs, &tb_ptr);
+            t2 = tci_read_r64(regs, &tb_ptr);
             tci_write_reg64(regs, t0, t1 << (t2 & 63));
-            break;
-        case INDEX_op_shr_i64:
+            NEXT();
+        CASE(shr_i64):
             t0 = *tb_ptr++;
-            t1 = tci_read_ri64(regs, &tb_ptr);
-            t2 = tci_read_ri64(regs, &tb_ptr);
+            t1 = tci_read_r64(regs, &tb_ptr);
+            t2 = tci_read_r64(regs, &tb_ptr);
             tci_write_reg64(regs, t0, t1 >> (t2 & 63));
-            break;
-        case INDEX_op_sar_i64:
+            NEXT();
+        CASE(sar_i64):
             t0 = *tb_ptr++;
-            t1 = tci_read_ri64(regs, &tb_ptr);
-            t2 = tci_read_ri64(regs, &tb_ptr);
+            t1 = tci_read_r64(regs, &tb_ptr);
+            t2 = tci_read_r64(regs, &tb_ptr);
             tci_write_reg64(regs, t0, ((int64_t)t1 >> (t2 & 63)));
-            break;
+            NEXT();
 #if TCG_TARGET_HAS_rot_i64
-        case INDEX_op_rotl_i64:
+        CASE(rotl_i64):
             t0 = *tb_ptr++;
-            t1 = tci_read_ri64(regs, &tb_ptr);
-            t2 = tci_read_ri64(regs, &tb_ptr);
+            t1 = tci_read_r64(regs, &tb_ptr);
+            t2 = tci_read_r64(regs, &tb_ptr);
             tci_write_reg64(regs, t0, rol64(t1, t2 & 63));
-            break;
-        case INDEX_op_rotr_i64:
+            NEXT();
+        CASE(rotr_i64):
             t0 = *tb_ptr++;
-            t1 = tci_read_ri64(regs, &tb_ptr);
-            t2 = tci_read_ri64(regs, &tb_ptr);
+            t1 = tci_read_r64(regs, &tb_ptr);
+            t2 = tci_read_r64(regs, &tb_ptr);
             tci_write_reg64(regs, t0, ror64(t1, t2 & 63));
-            break;
+            NEXT();
 #endif
 #if TCG_TARGET_HAS_deposit_i64
-        case INDEX_op_deposit_i64:
+        CASE(deposit_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_r64(regs, &tb_ptr);
             t2 = tci_read_r64(regs, &tb_ptr);
@@ -1012,115 +1384,184 @@ uintptr_t tcg_qemu_tb_exec(CPUArchState *env, uint8_t *tb_ptr)
             tmp8 = *tb_ptr++;
             tmp64 = (((1ULL << tmp8) - 1) << tmp16);
             tci_write_reg64(regs, t0, (t1 & ~tmp64) | ((t2 << tmp16) & tmp64));
-            break;
+            NEXT();
 #endif
-        case INDEX_op_brcond_i64:
+        CASE(brcond_i64):
             t0 = tci_read_r64(regs, &tb_ptr);
-            t1 = tci_read_ri64(regs, &tb_ptr);
+            t1 = tci_read_r64(regs, &tb_ptr);
             condition = *tb_ptr++;
             label = tci_read_label(&tb_ptr);
             if (tci_compare64(t0, t1, condition)) {
                 tci_assert(tb_ptr == old_code_ptr + op_size);
                 tb_ptr = (uint8_t *)label;
-                continue;
+                JUMP();
             }
-            break;
+            NEXT();
+
+            /* Immediate forms (64 bit). */
+
+        CASE(tci_addi_i64):
+            t0 = *tb_ptr++;
+            t1 = tci_read_r64(regs, &tb_ptr);
+            t2 = tci_read_i64(&tb_ptr);
+            tci_write_reg64(regs, t0, t1 + t2);
+            NEXT();
+        CASE(tci_subi_i64):
+            t0 = *tb_ptr++;
+            t1 = tci_read_r64(regs, &tb_ptr);
+            t2 = tci_read_i64(&tb_ptr);
+            tci_write_reg64(regs, t0, t1 - t2);
+            NEXT();
+        CASE(tci_andi_i64):
+            t0 = *tb_ptr++;
+            t1 = tci_read_r64(regs, &tb_ptr);
+            t2 = tci_read_i64(&tb_ptr);
+            tci_write_reg64(regs, t0, t1 & t2);
+            NEXT();
+        CASE(tci_ori_i64):
+            t0 = *tb_ptr++;
+            t1 = tci_read_r64(regs, &tb_ptr);
+            t2 = tci_read_i64(&tb_ptr);
+            tci_write_reg64(regs, t0, t1 | t2);
+            NEXT();
+        CASE(tci_xori_i64):
+            t0 = *tb_ptr++;
+            t1 = tci_read_r64(regs, &tb_ptr);
+            t2 = tci_read_i64(&tb_ptr);
+            tci_write_reg64(regs, t0, t1 ^ t2);
+            NEXT();
+        CASE(tci_shli_i64):
+            t0 = *tb_ptr++;
+            t1 = tci_read_r64(regs, &tb_ptr);
+            t2 = tci_read_i64(&tb_ptr);
+            tci_write_reg64(regs, t0, t1 << (t2 & 63));
+            NEXT();
+        CASE(tci_shri_i64):
+            t0 = *tb_ptr++;
+            t1 = tci_read_r64(regs, &tb_ptr);
+            t2 = tci_read_i64(&tb_ptr);
+            tci_write_reg64(regs, t0, t1 >> (t2 & 63));
+            NEXT();
+        CASE(tci_sari_i64):
+            t0 = *tb_ptr++;
+            t1 = tci_read_r64(regs, &tb_ptr);
+            t2 = tci_read_i64(&tb_ptr);
+            tci_write_reg64(regs, t0, ((int64_t)t1 >> (t2 & 63)));
+            NEXT();
+        CASE(tci_setcondi_i64):
+            t0 = *tb_ptr++;
+            t1 = tci_read_r64(regs, &tb_ptr);
+            t2 = tci_read_i64(&tb_ptr);
+            condition = *tb_ptr++;
+            tci_write_reg64(regs, t0, tci_compare64(t1, t2, condition));
+            NEXT();
+        CASE(tci_brcondi_i64):
+            t0 = tci_read_r64(regs, &tb_ptr);
+            t1 = tci_read_i64(&tb_ptr);
+            condition = *tb_ptr++;
+            label = tci_read_label(&tb_ptr);
+            if (tci_compare64(t0, t1, condition)) {
+                tci_assert(tb_ptr == old_code_ptr + op_size);
+                tb_ptr = (uint8_t *)label;
+                JUMP();
+            }
+            NEXT();
 #if TCG_TARGET_HAS_ext8u_i64
-        case INDEX_op_ext8u_i64:
+        CASE(ext8u_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_r8(regs, &tb_ptr);
             tci_write_reg64(regs, t0, t1);
-            break;
+            NEXT();
 #endif
 #if TCG_TARGET_HAS_ext8s_i64
-        case INDEX_op_ext8s_i64:
+        CASE(ext8s_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_r8s(regs, &tb_ptr);
             tci_write_reg64(regs, t0, t1);
-            break;
+            NEXT();
 #endif
 #if TCG_TARGET_HAS_ext16s_i64
-        case INDEX_op_ext16s_i64:
+        CASE(ext16s_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_r16s(regs, &tb_ptr);
             tci_write_reg64(regs, t0, t1);
-            break;
+            NEXT();
 #endif
 #if TCG_TARGET_HAS_ext16u_i64
-        case INDEX_op_ext16u_i64:
+        CASE(ext16u_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_r16(regs, &tb_ptr);
             tci_write_reg64(regs, t0, t1);
-            break;
+            NEXT();
 #endif
 #if TCG_TARGET_HAS_ext32s_i64
-        case INDEX_op_ext32s_i64:
+        CASE(ext32s_i64):
 #endif
-        case INDEX_op_ext_i32_i64:
+        CASE(ext_i32_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_r32s(regs, &tb_ptr);
             tci_write_reg64(regs, t0, t1);
-            break;
+            NEXT();
 #if TCG_TARGET_HAS_ext32u_i64
-        case INDEX_op_ext32u_i64:
+        CASE(ext32u_i64):
 #endif
-        case INDEX_op_extu_i32_i64:
+        CASE(extu_i32_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_r32(regs, &tb_ptr);
             tci_write_reg64(regs, t0, t1);
-            break;
+            NEXT();
 #if TCG_TARGET_HAS_bswap16_i64
-        case INDEX_op_bswap16_i64:
+        CASE(bswap16_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_r16(regs, &tb_ptr);
             tci_write_reg64(regs, t0, bswap16(t1));
-            break;
+            NEXT();
 #endif
 #if TCG_TARGET_HAS_bswap32_i64
-        case INDEX_op_bswap32_i64:
+        CASE(bswap32_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_r32(regs, &tb_ptr);
             tci_write_reg64(regs, t0, bswap32(t1));
-            break;
+            NEXT();
 #endif
 #if TCG_TARGET_HAS_bswap64_i64
-        case INDEX_op_bswap64_i64:
+        CASE(bswap64_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_r64(regs, &tb_ptr);
             tci_write_reg64(regs, t0, bswap64(t1));
-            break;
+            NEXT();
 #endif
 #if TCG_TARGET_HAS_not_i64
-        case INDEX_op_not_i64:
+        CASE(not_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_r64(regs, &tb_ptr);
             tci_write_reg64(regs, t0, ~t1);
-            break;
+            NEXT();
 #endif
 #if TCG_TARGET_HAS_neg_i64
-        case INDEX_op_neg_i64:
+        CASE(neg_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_r64(regs, &tb_ptr);
             tci_write_reg64(regs, t0, -t1);
-            break;
+            NEXT();
 #endif
 #endif /* TCG_TARGET_REG_BITS == 64 */
 
             /* QEMU specific operations. */
 
-        case INDEX_op_exit_tb:
+        CASE(exit_tb):
             ret = *(uint64_t *)tb_ptr;
             goto exit;
             break;
-        case INDEX_op_goto_tb:
+        CASE(goto_tb):
             /* Jump address is aligned */
             tb_ptr = QEMU_ALIGN_PTR_UP(tb_ptr, 4);
             t0 = atomic_read((int32_t *)tb_ptr);
             tb_ptr += sizeof(int32_t);
             tci_assert(tb_ptr == old_code_ptr + op_size);
             tb_ptr += (int32_t)t0;
-            continue;
-        case INDEX_op_qemu_ld_i32:
+            JUMP();
+        CASE(qemu_ld_i32):
             t0 = *tb_ptr++;
             taddr = tci_read_ulong(regs, &tb_ptr);
             oi = tci_read_i(&tb_ptr);
@@ -1153,8 +1594,8 @@ uintptr_t tcg_qemu_tb_exec(CPUArchState *env, uint8_t *tb_ptr)
                 tcg_abort();
             }
             tci_write_reg(regs, t0, tmp32);
-            break;
-        case INDEX_op_qemu_ld_i64:
+            NEXT();
+        CASE(qemu_ld_i64):
             t0 = *tb_ptr++;
             if (TCG_TARGET_REG_BITS == 32) {
                 t1 = *tb_ptr++;
@@ -1205,8 +1646,8 @@ uintptr_t tcg_qemu_tb_exec(CPUArchState *env, uint8_t *tb_ptr)
             if (TCG_TARGET_REG_BITS == 32) {
                 tci_write_reg(regs, t1, tmp64 >> 32);
             }
-            break;
-        case INDEX_op_qemu_st_i32:
+            NEXT();
+        CASE(qemu_st_i32):
             t0 = tci_read_r(regs, &tb_ptr);
             taddr = tci_read_ulong(regs, &tb_ptr);
             oi = tci_read_i(&tb_ptr);
@@ -1229,8 +1670,8 @@ uintptr_t tcg_qemu_tb_exec(CPUArchState *env, uint8_t *tb_ptr)
             default:
                 tcg_abort();
             }
-            break;
-        case INDEX_op_qemu_st_i64:
+            NEXT();
+        CASE(qemu_st_i64):
             tmp64 = tci_read_r64(regs, &tb_ptr);
             taddr = tci_read_ulong(regs, &tb_ptr);
             oi = tci_read_i(&tb_ptr);
@@ -1259,12 +1700,15 @@ uintptr_t tcg_qemu_tb_exec(CPUArchState *env, uint8_t *tb_ptr)
             default:
                 tcg_abort();
             }
-            break;
-        case INDEX_op_mb:
+            NEXT();
+        CASE(mb):
             /* Ensure ordering for all kinds */
             smp_mb();
-            break;
+            NEXT();
         default:
+#ifdef TCI_THREADED
+        do_default:
+#endif
             TODO();
             break;
         }
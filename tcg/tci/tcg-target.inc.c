@@ -68,9 +68,9 @@ static const TCGTargetOpDef tcg_target_op_defs[] = {
     { INDEX_op_st16_i32, { R, R } },
     { INDEX_op_st_i32, { R, R } },
 
-    { INDEX_op_add_i32, { R, RI, RI } },
-    { INDEX_op_sub_i32, { R, RI, RI } },
-    { INDEX_op_mul_i32, { R, RI, RI } },
+    { INDEX_op_add_i32, { R, R, RI } },
+    { INDEX_op_sub_i32, { R, R, RI } },
+    { INDEX_op_mul_i32, { R, R, R } },
 #if TCG_TARGET_HAS_div_i32
     { INDEX_op_div_i32, { R, R, R } },
     { INDEX_op_divu_i32, { R, R, R } },
@@ -80,32 +80,34 @@ static const TCGTargetOpDef tcg_target_op_defs[] = {
     { INDEX_op_div2_i32, { R, R, "0", "1", R } },
     { INDEX_op_divu2_i32, { R, R, "0", "1", R } },
 #endif
-    /* TODO: Does R, RI, RI result in faster code than R, R, RI?
-       If both operands are constants, we can optimize. */
-    { INDEX_op_and_i32, { R, RI, RI } },
+    /*
+     * Constants are only accepted where the bytecode has an "i" form, and
+     * only as the last input, so the interpreter never tests for them.
+     */
+    { INDEX_op_and_i32, { R, R, RI } },
 #if TCG_TARGET_HAS_andc_i32
-    { INDEX_op_andc_i32, { R, RI, RI } },
+    { INDEX_op_andc_i32, { R, R, R } },
 #endif
 #if TCG_TARGET_HAS_eqv_i32
-    { INDEX_op_eqv_i32, { R, RI, RI } },
+    { INDEX_op_eqv_i32, { R, R, R } },
 #endif
 #if TCG_TARGET_HAS_nand_i32
-    { INDEX_op_nand_i32, { R, RI, RI } },
+    { INDEX_op_nand_i32, { R, R, R } },
 #endif
 #if TCG_TARGET_HAS_nor_i32
-    { INDEX_op_nor_i32, { R, RI, RI } },
+    { INDEX_op_nor_i32, { R, R, R } },
 #endif
-    { INDEX_op_or_i32, { R, RI, RI } },
+    { INDEX_op_or_i32, { R, R, RI } },
 #if TCG_TARGET_HAS_orc_i32
-    { INDEX_op_orc_i32, { R, RI, RI } },
+    { INDEX_op_orc_i32, { R, R, R } },
 #endif
-    { INDEX_op_xor_i32, { R, RI, RI } },
-    { INDEX_op_shl_i32, { R, RI, RI } },
-    { INDEX_op_shr_i32, { R, RI, RI } },
-    { INDEX_op_sar_i32, { R, RI, RI } },
+    { INDEX_op_xor_i32, { R, R, RI } },
+    { INDEX_op_shl_i32, { R, R, RI } },
+    { INDEX_op_shr_i32, { R, R, RI } },
+    { INDEX_op_sar_i32, { R, R, RI } },
 #if TCG_TARGET_HAS_rot_i32
-    { INDEX_op_rotl_i32, { R, RI, RI } },
-    { INDEX_op_rotr_i32, { R, RI, RI } },
+    { INDEX_op_rotl_i32, { R, R, R } },
+    { INDEX_op_rotr_i32, { R, R, R } },
 #endif
 #if TCG_TARGET_HAS_deposit_i32
     { INDEX_op_deposit_i32, { R, "0", R } },
@@ -148,9 +150,9 @@ static const TCGTargetOpDef tcg_target_op_defs[] = {
     { INDEX_op_st32_i64, { R, R } },
     { INDEX_op_st_i64, { R, R } },
 
-    { INDEX_op_add_i64, { R, RI, RI } },
-    { INDEX_op_sub_i64, { R, RI, RI } },
-    { INDEX_op_mul_i64, { R, RI, RI } },
+    { INDEX_op_add_i64, { R, R, RI } },
+    { INDEX_op_sub_i64, { R, R, RI } },
+    { INDEX_op_mul_i64, { R, R, R } },
 #if TCG_TARGET_HAS_div_i64
     { INDEX_op_div_i64, { R, R, R } },
     { INDEX_op_divu_i64, { R, R, R } },
@@ -160,30 +162,30 @@ static const TCGTargetOpDef tcg_target_op_defs[] = {
     { INDEX_op_div2_i64, { R, R, "0", "1", R } },
     { INDEX_op_divu2_i64, { R, R, "0", "1", R } },
 #endif
-    { INDEX_op_and_i64, { R, RI, RI } },
+    { INDEX_op_and_i64, { R, R, RI } },
 #if TCG_TARGET_HAS_andc_i64
-    { INDEX_op_andc_i64, { R, RI, RI } },
+    { INDEX_op_andc_i64, { R, R, R } },
 #endif
 #if TCG_TARGET_HAS_eqv_i64
-    { INDEX_op_eqv_i64, { R, RI, RI } },
+    { INDEX_op_eqv_i64, { R, R, R } },
 #endif
 #if TCG_TARGET_HAS_nand_i64
-    { INDEX_op_nand_i64, { R, RI, RI } },
+    { INDEX_op_nand_i64, { R, R, R } },
 #endif
 #if TCG_TARGET_HAS_nor_i64
-    { INDEX_op_nor_i64, { R, RI, RI } },
+    { INDEX_op_nor_i64, { R, R, R } },
 #endif
-    { INDEX_op_or_i64, { R, RI, RI } },
+    { INDEX_op_or_i64, { R, R, RI } },
 #if TCG_TARGET_HAS_orc_i64
-    { INDEX_op_orc_i64, { R, RI, RI } },
+    { INDEX_op_orc_i64, { R, R, R } },
 #endif
-    { INDEX_op_xor_i64, { R, RI, RI } },
-    { INDEX_op_shl_i64, { R, RI, RI } },
-    { INDEX_op_shr_i64, { R, RI, RI } },
-    { INDEX_op_sar_i64, { R, RI, RI } },
+    { INDEX_op_xor_i64, { R, R, RI } },
+    { INDEX_op_shl_i64, { R, R, RI } },
+    { INDEX_op_shr_i64, { R, R, RI } },
+    { INDEX_op_sar_i64, { R, R, RI } },
 #if TCG_TARGET_HAS_rot_i64
-    { INDEX_op_rotl_i64, { R, RI, RI } },
-    { INDEX_op_rotr_i64, { R, RI, RI } },
+    { INDEX_op_rotl_i64, { R, R, R } },
+    { INDEX_op_rotr_i64, { R, R, R } },
 #endif
 #if TCG_TARGET_HAS_deposit_i64
     { INDEX_op_deposit_i64, { R, "0", R } },
@@ -424,6 +426,8 @@ static void tcg_out_i(TCGContext *s, tcg_target_ulong v)
 /* Write opcode. */
 static void tcg_out_op_t(TCGContext *s, TCGOpcode op)
 {
+    /* Only the ops that start a superinstruction set this again */
+    s->tci_fuse_ptr = NULL;
     tcg_out8(s, op);
     tcg_out8(s, 0);
 }
@@ -435,24 +439,29 @@ static void tcg_out_r(TCGContext *s, TCGArg t0)
     tcg_out8(s, t0);
 }
 
-/* Write register or constant (native size). */
-static void tcg_out_ri(TCGContext *s, int const_arg, TCGArg arg)
+#if TCG_TARGET_REG_BITS == 32
+/* Write register or constant (32 bit). */
+static void tcg_out_ri32(TCGContext *s, int const_arg, TCGArg arg)
 {
     if (const_arg) {
         tcg_debug_assert(const_arg == 1);
         tcg_out8(s, TCG_CONST);
-        tcg_out_i(s, arg);
+        tcg_out32(s, arg);
     } else {
         tcg_out_r(s, arg);
     }
 }
+#endif
 
-/* Write register or constant (32 bit). */
-static void tcg_out_ri32(TCGContext *s, int const_arg, TCGArg arg)
+/*
+ * Write register, or immediate (32 bit) after turning the op at @op_ptr
+ * into its "i" form @iop.
+ */
+static void tcg_out_ri32_op(TCGContext *s, uint8_t *op_ptr, TCGOpcode iop,
+                            int const_arg, TCGArg arg)
 {
     if (const_arg) {
-        tcg_debug_assert(const_arg == 1);
-        tcg_out8(s, TCG_CONST);
+        op_ptr[0] = iop;
         tcg_out32(s, arg);
     } else {
         tcg_out_r(s, arg);
@@ -460,12 +469,15 @@ static void tcg_out_ri32(TCGContext *s, int const_arg, TCGArg arg)
 }
 
 #if TCG_TARGET_REG_BITS == 64
-/* Write register or constant (64 bit). */
-static void tcg_out_ri64(TCGContext *s, int const_arg, TCGArg arg)
+/*
+ * Write register, or immediate (64 bit) after turning the op at @op_ptr
+ * into its "i" form @iop.
+ */
+static void tcg_out_ri64_op(TCGContext *s, uint8_t *op_ptr, TCGOpcode iop,
+                            int const_arg, TCGArg arg)
 {
     if (const_arg) {
-        tcg_debug_assert(const_arg == 1);
-        tcg_out8(s, TCG_CONST);
+        op_ptr[0] = iop;
         tcg_out64(s, arg);
     } else {
         tcg_out_r(s, arg);
@@ -494,6 +506,7 @@ static void tcg_out_ld(TCGContext *s, TCGType type, TCGReg ret, TCGReg arg1,
         tcg_out_r(s, ret);
         tcg_out_r(s, arg1);
         tcg_out32(s, arg2);
+        s->tci_fuse_ptr = old_code_ptr;
     } else {
         tcg_debug_assert(type == TCG_TYPE_I64);
 #if TCG_TARGET_REG_BITS == 64
@@ -550,15 +563,138 @@ static inline void tcg_out_call(TCGContext *s, tcg_insn_unit *arg)
 {
     uint8_t *old_code_ptr = s->code_ptr;
     tcg_out_op_t(s, INDEX_op_call);
-    tcg_out_ri(s, 1, (uintptr_t)arg);
+    tcg_out_i(s, (uintptr_t)arg);
     old_code_ptr[1] = s->code_ptr - old_code_ptr;
 }
 
+/* The "i" form of @opc, taking its last input as an immediate. */
+static TCGOpcode tci_imm_op(TCGOpcode opc)
+{
+    switch (opc) {
+    case INDEX_op_add_i32:
+        return INDEX_op_tci_addi_i32;
+    case INDEX_op_sub_i32:
+        return INDEX_op_tci_subi_i32;
+    case INDEX_op_and_i32:
+        return INDEX_op_tci_andi_i32;
+    case INDEX_op_or_i32:
+        return INDEX_op_tci_ori_i32;
+    case INDEX_op_xor_i32:
+        return INDEX_op_tci_xori_i32;
+    case INDEX_op_shl_i32:
+        return INDEX_op_tci_shli_i32;
+    case INDEX_op_shr_i32:
+        return INDEX_op_tci_shri_i32;
+    case INDEX_op_sar_i32:
+        return INDEX_op_tci_sari_i32;
+#if TCG_TARGET_REG_BITS == 64
+    case INDEX_op_add_i64:
+        return INDEX_op_tci_addi_i64;
+    case INDEX_op_sub_i64:
+        return INDEX_op_tci_subi_i64;
+    case INDEX_op_and_i64:
+        return INDEX_op_tci_andi_i64;
+    case INDEX_op_or_i64:
+        return INDEX_op_tci_ori_i64;
+    case INDEX_op_xor_i64:
+        return INDEX_op_tci_xori_i64;
+    case INDEX_op_shl_i64:
+        return INDEX_op_tci_shli_i64;
+    case INDEX_op_shr_i64:
+        return INDEX_op_tci_shri_i64;
+    case INDEX_op_sar_i64:
+        return INDEX_op_tci_sari_i64;
+#endif
+    default:
+        tcg_abort();
+    }
+}
+
+/*
+ * Superinstructions.  An op that can start one leaves its address in
+ * s->tci_fuse_ptr.  If the next op uses its result and nothing was
+ * written in between, that op is appended to it: the first opcode is
+ * replaced by the fused one and the second op's operands follow.
+ * Setting a label clears s->tci_fuse_ptr, so no branch lands inside a
+ * fused op; and as none of them can fault or call a helper, unwinding
+ * never needs a guest instruction boundary inside one.
+ */
+static bool tcg_out_fused(TCGContext *s, TCGOpcode opc, const TCGArg *args,
+                          const int *const_args)
+{
+    uint8_t *p = s->tci_fuse_ptr;
+    TCGArg other;
+    bool other_const;
+
+    if (!p || p + p[1] != s->code_ptr) {
+        return false;
+    }
+
+    switch (opc) {
+    case INDEX_op_add_i32:
+        /* ld_i32 t, base, ofs; add_i32 ret, t, arg */
+        if (p[0] != INDEX_op_ld_i32) {
+            return false;
+        }
+        if (args[1] == p[2]) {
+            other = args[2];
+            other_const = const_args[2];
+        } else if (!const_args[2] && args[2] == p[2]) {
+            other = args[1];
+            other_const = false;
+        } else {
+            return false;
+        }
+        p[0] = other_const ? INDEX_op_tci_ld_addi_i32 : INDEX_op_tci_ld_add_i32;
+        tcg_out_r(s, args[0]);
+        if (other_const) {
+            tcg_out32(s, other);
+        } else {
+            tcg_out_r(s, other);
+        }
+        break;
+    case INDEX_op_brcond_i32:
+        if (args[0] != p[2]) {
+            return false;
+        }
+        if (p[0] == INDEX_op_ld_i32) {
+            /* ld_i32 t, base, ofs; brcond_i32 t, arg, cond, label */
+            p[0] = const_args[1] ? INDEX_op_tci_ld_brcondi_i32
+                                 : INDEX_op_tci_ld_brcond_i32;
+        } else if (p[0] == INDEX_op_setcond_i32 && const_args[1]) {
+            /* setcond_i32 t, a, b, c1; brcond_i32 t, imm, c2, label */
+            p[0] = INDEX_op_tci_setcond_brcond_i32;
+        } else if (p[0] == INDEX_op_tci_setcondi_i32 && const_args[1]) {
+            p[0] = INDEX_op_tci_setcondi_brcond_i32;
+        } else {
+            return false;
+        }
+        if (const_args[1]) {
+            tcg_out32(s, args[1]);
+        } else {
+            tcg_out_r(s, args[1]);
+        }
+        tcg_out8(s, args[2]);           /* condition */
+        tci_out_label(s, arg_label(args[3]));
+        break;
+    default:
+        return false;
+    }
+
+    p[1] = s->code_ptr - p;
+    s->tci_fuse_ptr = NULL;
+    return true;
+}
+
 static void tcg_out_op(TCGContext *s, TCGOpcode opc, const TCGArg *args,
                        const int *const_args)
 {
     uint8_t *old_code_ptr = s->code_ptr;
 
+    if (tcg_out_fused(s, opc, args, const_args)) {
+        return;
+    }
+
     tcg_out_op_t(s, opc);
 
     switch (opc) {
@@ -584,8 +720,10 @@ static void tcg_out_op(TCGContext *s, TCGOpcode opc, const TCGArg *args,
     case INDEX_op_setcond_i32:
         tcg_out_r(s, args[0]);
         tcg_out_r(s, args[1]);
-        tcg_out_ri32(s, const_args[2], args[2]);
+        tcg_out_ri32_op(s, old_code_ptr, INDEX_op_tci_setcondi_i32,
+                        const_args[2], args[2]);
         tcg_out8(s, args[3]);   /* condition */
+        s->tci_fuse_ptr = old_code_ptr;
         break;
 #if TCG_TARGET_REG_BITS == 32
     case INDEX_op_setcond2_i32:
@@ -601,7 +739,8 @@ static void tcg_out_op(TCGContext *s, TCGOpcode opc, const TCGArg *args,
     case INDEX_op_setcond_i64:
         tcg_out_r(s, args[0]);
         tcg_out_r(s, args[1]);
-        tcg_out_ri64(s, const_args[2], args[2]);
+        tcg_out_ri64_op(s, old_code_ptr, INDEX_op_tci_setcondi_i64,
+                        const_args[2], args[2]);
         tcg_out8(s, args[3]);   /* condition */
         break;
 #endif
@@ -628,26 +767,34 @@ static void tcg_out_op(TCGContext *s, TCGOpcode opc, const TCGArg *args,
         tcg_out_r(s, args[1]);
         tcg_debug_assert(args[2] == (int32_t)args[2]);
         tcg_out32(s, args[2]);
+        if (opc == INDEX_op_ld_i32) {
+            s->tci_fuse_ptr = old_code_ptr;
+        }
         break;
     case INDEX_op_add_i32:
     case INDEX_op_sub_i32:
-    case INDEX_op_mul_i32:
     case INDEX_op_and_i32:
-    case INDEX_op_andc_i32:     /* Optional (TCG_TARGET_HAS_andc_i32). */
-    case INDEX_op_eqv_i32:      /* Optional (TCG_TARGET_HAS_eqv_i32). */
-    case INDEX_op_nand_i32:     /* Optional (TCG_TARGET_HAS_nand_i32). */
-    case INDEX_op_nor_i32:      /* Optional (TCG_TARGET_HAS_nor_i32). */
     case INDEX_op_or_i32:
-    case INDEX_op_orc_i32:      /* Optional (TCG_TARGET_HAS_orc_i32). */
     case INDEX_op_xor_i32:
     case INDEX_op_shl_i32:
     case INDEX_op_shr_i32:
     case INDEX_op_sar_i32:
+        tcg_out_r(s, args[0]);
+        tcg_out_r(s, args[1]);
+        tcg_out_ri32_op(s, old_code_ptr, tci_imm_op(opc),
+                        const_args[2], args[2]);
+        break;
+    case INDEX_op_mul_i32:
+    case INDEX_op_andc_i32:     /* Optional (TCG_TARGET_HAS_andc_i32). */
+    case INDEX_op_eqv_i32:      /* Optional (TCG_TARGET_HAS_eqv_i32). */
+    case INDEX_op_nand_i32:     /* Optional (TCG_TARGET_HAS_nand_i32). */
+    case INDEX_op_nor_i32:      /* Optional (TCG_TARGET_HAS_nor_i32). */
+    case INDEX_op_orc_i32:      /* Optional (TCG_TARGET_HAS_orc_i32). */
     case INDEX_op_rotl_i32:     /* Optional (TCG_TARGET_HAS_rot_i32). */
     case INDEX_op_rotr_i32:     /* Optional (TCG_TARGET_HAS_rot_i32). */
         tcg_out_r(s, args[0]);
-        tcg_out_ri32(s, const_args[1], args[1]);
-        tcg_out_ri32(s, const_args[2], args[2]);
+        tcg_out_r(s, args[1]);
+        tcg_out_r(s, args[2]);
         break;
     case INDEX_op_deposit_i32:  /* Optional (TCG_TARGET_HAS_deposit_i32). */
         tcg_out_r(s, args[0]);
@@ -662,23 +809,28 @@ static void tcg_out_op(TCGContext *s, TCGOpcode opc, const TCGArg *args,
 #if TCG_TARGET_REG_BITS == 64
     case INDEX_op_add_i64:
     case INDEX_op_sub_i64:
-    case INDEX_op_mul_i64:
     case INDEX_op_and_i64:
-    case INDEX_op_andc_i64:     /* Optional (TCG_TARGET_HAS_andc_i64). */
-    case INDEX_op_eqv_i64:      /* Optional (TCG_TARGET_HAS_eqv_i64). */
-    case INDEX_op_nand_i64:     /* Optional (TCG_TARGET_HAS_nand_i64). */
-    case INDEX_op_nor_i64:      /* Optional (TCG_TARGET_HAS_nor_i64). */
     case INDEX_op_or_i64:
-    case INDEX_op_orc_i64:      /* Optional (TCG_TARGET_HAS_orc_i64). */
     case INDEX_op_xor_i64:
     case INDEX_op_shl_i64:
     case INDEX_op_shr_i64:
     case INDEX_op_sar_i64:
+        tcg_out_r(s, args[0]);
+        tcg_out_r(s, args[1]);
+        tcg_out_ri64_op(s, old_code_ptr, tci_imm_op(opc),
+                        const_args[2], args[2]);
+        break;
+    case INDEX_op_mul_i64:
+    case INDEX_op_andc_i64:     /* Optional (TCG_TARGET_HAS_andc_i64). */
+    case INDEX_op_eqv_i64:      /* Optional (TCG_TARGET_HAS_eqv_i64). */
+    case INDEX_op_nand_i64:     /* Optional (TCG_TARGET_HAS_nand_i64). */
+    case INDEX_op_nor_i64:      /* Optional (TCG_TARGET_HAS_nor_i64). */
+    case INDEX_op_orc_i64:      /* Optional (TCG_TARGET_HAS_orc_i64). */
     case INDEX_op_rotl_i64:     /* Optional (TCG_TARGET_HAS_rot_i64). */
     case INDEX_op_rotr_i64:     /* Optional (TCG_TARGET_HAS_rot_i64). */
         tcg_out_r(s, args[0]);
-        tcg_out_ri64(s, const_args[1], args[1]);
-        tcg_out_ri64(s, const_args[2], args[2]);
+        tcg_out_r(s, args[1]);
+        tcg_out_r(s, args[2]);
         break;
     case INDEX_op_deposit_i64:  /* Optional (TCG_TARGET_HAS_deposit_i64). */
         tcg_out_r(s, args[0]);
@@ -701,7 +853,8 @@ static void tcg_out_op(TCGContext *s, TCGOpcode opc, const TCGArg *args,
         break;
     case INDEX_op_brcond_i64:
         tcg_out_r(s, args[0]);
-        tcg_out_ri64(s, const_args[1], args[1]);
+        tcg_out_ri64_op(s, old_code_ptr, INDEX_op_tci_brcondi_i64,
+                        const_args[1], args[1]);
         tcg_out8(s, args[2]);           /* condition */
         tci_out_label(s, arg_label(args[3]));
         break;
@@ -735,8 +888,8 @@ static void tcg_out_op(TCGContext *s, TCGOpcode opc, const TCGArg *args,
     case INDEX_op_rem_i32:      /* Optional (TCG_TARGET_HAS_div_i32). */
     case INDEX_op_remu_i32:     /* Optional (TCG_TARGET_HAS_div_i32). */
         tcg_out_r(s, args[0]);
-        tcg_out_ri32(s, const_args[1], args[1]);
-        tcg_out_ri32(s, const_args[2], args[2]);
+        tcg_out_r(s, args[1]);
+        tcg_out_r(s, args[2]);
         break;
     case INDEX_op_div2_i32:     /* Optional (TCG_TARGET_HAS_div2_i32). */
     case INDEX_op_divu2_i32:    /* Optional (TCG_TARGET_HAS_div2_i32). */
@@ -769,7 +922,8 @@ static void tcg_out_op(TCGContext *s, TCGOpcode opc, const TCGArg *args,
 #endif
     case INDEX_op_brcond_i32:
         tcg_out_r(s, args[0]);
-        tcg_out_ri32(s, const_args[1], args[1]);
+        tcg_out_ri32_op(s, old_code_ptr, INDEX_op_tci_brcondi_i32,
+                        const_args[1], args[1]);
         tcg_out8(s, args[2]);           /* condition */
         tci_out_label(s, arg_label(args[3]));
         break;
@@ -0,0 +1,50 @@
+/*
+ * Tiny Code Interpreter for QEMU - bytecode-only opcodes
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * These are never emitted by the front ends.  The code generator in
+ * tcg-target.inc.c uses them in the bytecode so that the interpreter
+ * does not have to decode at run time what is known at translation time:
+ *
+ *  - "i" forms take their last input as an immediate, where the generic
+ *    opcodes now only take registers;
+ *  - superinstructions fuse a load from memory, or a setcond, with the
+ *    op right after it that consumes its result.
+ */
+
+DEF(tci_addi_i32, 1, 1, 1, TCG_OPF_NOT_PRESENT)
+DEF(tci_subi_i32, 1, 1, 1, TCG_OPF_NOT_PRESENT)
+DEF(tci_andi_i32, 1, 1, 1, TCG_OPF_NOT_PRESENT)
+DEF(tci_ori_i32, 1, 1, 1, TCG_OPF_NOT_PRESENT)
+DEF(tci_xori_i32, 1, 1, 1, TCG_OPF_NOT_PRESENT)
+DEF(tci_shli_i32, 1, 1, 1, TCG_OPF_NOT_PRESENT)
+DEF(tci_shri_i32, 1, 1, 1, TCG_OPF_NOT_PRESENT)
+DEF(tci_sari_i32, 1, 1, 1, TCG_OPF_NOT_PRESENT)
+DEF(tci_setcondi_i32, 1, 1, 2, TCG_OPF_NOT_PRESENT)
+DEF(tci_brcondi_i32, 0, 1, 3, TCG_OPF_BB_END | TCG_OPF_NOT_PRESENT)
+
+DEF(tci_addi_i64, 1, 1, 1, TCG_OPF_64BIT | TCG_OPF_NOT_PRESENT)
+DEF(tci_subi_i64, 1, 1, 1, TCG_OPF_64BIT | TCG_OPF_NOT_PRESENT)
+DEF(tci_andi_i64, 1, 1, 1, TCG_OPF_64BIT | TCG_OPF_NOT_PRESENT)
+DEF(tci_ori_i64, 1, 1, 1, TCG_OPF_64BIT | TCG_OPF_NOT_PRESENT)
+DEF(tci_xori_i64, 1, 1, 1, TCG_OPF_64BIT | TCG_OPF_NOT_PRESENT)
+DEF(tci_shli_i64, 1, 1, 1, TCG_OPF_64BIT | TCG_OPF_NOT_PRESENT)
+DEF(tci_shri_i64, 1, 1, 1, TCG_OPF_64BIT | TCG_OPF_NOT_PRESENT)
+DEF(tci_sari_i64, 1, 1, 1, TCG_OPF_64BIT | TCG_OPF_NOT_PRESENT)
+DEF(tci_setcondi_i64, 1, 1, 2, TCG_OPF_64BIT | TCG_OPF_NOT_PRESENT)
+DEF(tci_brcondi_i64, 0, 1, 3, TCG_OPF_BB_END | TCG_OPF_64BIT |
+    TCG_OPF_NOT_PRESENT)
+
+/* ld_i32 followed by add_i32 of the loaded value */
+DEF(tci_ld_add_i32, 2, 2, 1, TCG_OPF_NOT_PRESENT)
+DEF(tci_ld_addi_i32, 2, 1, 2, TCG_OPF_NOT_PRESENT)
+/* ld_i32 followed by brcond_i32 on the loaded value */
+DEF(tci_ld_brcond_i32, 1, 2, 3, TCG_OPF_BB_END | TCG_OPF_NOT_PRESENT)
+DEF(tci_ld_brcondi_i32, 1, 1, 4, TCG_OPF_BB_END | TCG_OPF_NOT_PRESENT)
+/* setcond_i32 followed by a brcond_i32 testing its result against zero */
+DEF(tci_setcond_brcond_i32, 1, 2, 3, TCG_OPF_BB_END | TCG_OPF_NOT_PRESENT)
+DEF(tci_setcondi_brcond_i32, 1, 1, 4, TCG_OPF_BB_END | TCG_OPF_NOT_PRESENT)
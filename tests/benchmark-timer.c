@@ -0,0 +1,123 @@
+/*
+ * QEMUTimerList speed benchmark
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/timer.h"
+
+#define REARMS (4 * 1000 * 1000)
+
+static QEMUTimerListGroup tlg;
+static unsigned int fired;
+
+static void timer_notify(void *opaque, QEMUClockType type)
+{
+}
+
+static void timer_cb(void *opaque)
+{
+    fired++;
+}
+
+static QEMUTimer *timers_new(size_t n)
+{
+    QEMUTimer *timers = g_new0(QEMUTimer, n);
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        timer_init_full(&timers[i], &tlg, QEMU_CLOCK_REALTIME, SCALE_NS, 0,
+                        timer_cb, NULL);
+    }
+    return timers;
+}
+
+static void timers_free(QEMUTimer *timers, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        timer_del(&timers[i]);
+        timer_deinit(&timers[i]);
+    }
+    g_free(timers);
+}
+
+/*
+ * Re-arm random timers of a list of @n pending ones far in the future,
+ * like devices re-arming their timers from MMIO writes do.
+ */
+static void test_timer_rearm_speed(const void *opaque)
+{
+    size_t n = (size_t)opaque;
+    QEMUTimer *timers = timers_new(n);
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        timer_mod_ns(&timers[i], now + NANOSECONDS_PER_SECOND * 3600 +
+                     g_test_rand_int_range(0, 1000000));
+    }
+
+    g_test_timer_start();
+    for (i = 0; i < REARMS; i++) {
+        timer_mod_ns(&timers[g_test_rand_int_range(0, n)],
+                     now + NANOSECONDS_PER_SECOND * 3600 +
+                     g_test_rand_int_range(0, 1000000));
+    }
+    g_test_timer_elapsed();
+
+    g_print("%zu timers: %.2f M re-arms/sec ",
+            n, REARMS / 1e6 / g_test_timer_last());
+
+    timers_free(timers, n);
+}
+
+/*
+ * Arm @n timers that have all expired already and run them.
+ */
+static void test_timer_run_speed(const void *opaque)
+{
+    size_t n = (size_t)opaque;
+    QEMUTimer *timers = timers_new(n);
+    QEMUTimerList *timer_list = tlg.tl[QEMU_CLOCK_REALTIME];
+    size_t rounds = MAX(REARMS / n, 1);
+    size_t i, j;
+
+    fired = 0;
+    g_test_timer_start();
+    for (j = 0; j < rounds; j++) {
+        for (i = 0; i < n; i++) {
+            timer_mod_ns(&timers[i], g_test_rand_int_range(0, 1000000));
+        }
+        timerlist_run_timers(timer_list);
+    }
+    g_test_timer_elapsed();
+    g_assert_cmpuint(fired, ==, rounds * n);
+
+    g_print("%zu timers: %.2f M expiries/sec ",
+            n, rounds * n / 1e6 / g_test_timer_last());
+
+    timers_free(timers, n);
+}
+
+int main(int argc, char **argv)
+{
+    size_t i;
+    char name[64];
+
+    g_test_init(&argc, &argv, NULL);
+    init_clocks(NULL);
+    timerlistgroup_init(&tlg, timer_notify, NULL);
+
+    for (i = 4; i <= 4096; i *= 8) {
+        snprintf(name, sizeof(name), "/timer/rearm/speed-%zu", i);
+        g_test_add_data_func(name, (void *)i, test_timer_rearm_speed);
+        snprintf(name, sizeof(name), "/timer/run/speed-%zu", i);
+        g_test_add_data_func(name, (void *)i, test_timer_run_speed);
+    }
+
+    return g_test_run();
+}
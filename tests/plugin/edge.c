@@ -0,0 +1,90 @@
+/*
+ * Edge coverage for coverage guided fuzzers
+ *
+ * Maintains an AFL style edge map, updated inline by the translated
+ * code. With arg=shm=<id>, or when __AFL_SHM_ID is set in the
+ * environment, the map is the System V shared memory segment of an
+ * external fuzzer; otherwise the number of edges hit is reported at
+ * exit.
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+#include <inttypes.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <glib.h>
+
+#include <qemu-plugin.h>
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_version = QEMU_PLUGIN_VERSION;
+
+/* AFL's default MAP_SIZE */
+#define EDGE_MAP_SIZE   (1 << 16)
+
+static uint8_t *edge_map;
+static bool edge_map_shared;
+static uint32_t prev_loc;
+
+static void plugin_exit(qemu_plugin_id_t id, void *p)
+{
+    g_autofree gchar *out = NULL;
+    size_t i, edges = 0;
+
+    if (edge_map_shared) {
+        shmdt(edge_map);
+        return;
+    }
+
+    for (i = 0; i < EDGE_MAP_SIZE; i++) {
+        edges += edge_map[i] != 0;
+    }
+    out = g_strdup_printf("edges: %zu\n", edges);
+    qemu_plugin_outs(out);
+    g_free(edge_map);
+}
+
+static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
+{
+    uint64_t pc = qemu_plugin_tb_vaddr(tb);
+
+    /* Same location hash as AFL's QEMU mode */
+    qemu_plugin_register_vcpu_tb_exec_edge_inline(tb, edge_map, EDGE_MAP_SIZE,
+                                                  &prev_loc,
+                                                  (pc >> 4) ^ (pc << 8));
+}
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_install(qemu_plugin_id_t id,
+                                           const qemu_info_t *info,
+                                           int argc, char **argv)
+{
+    const char *shm_id = getenv("__AFL_SHM_ID");
+    int i;
+
+    for (i = 0; i < argc; i++) {
+        if (g_str_has_prefix(argv[i], "shm=")) {
+            shm_id = argv[i] + strlen("shm=");
+        } else {
+            fprintf(stderr, "edge: unknown option %s\n", argv[i]);
+            return -1;
+        }
+    }
+
+    if (shm_id) {
+        edge_map = shmat(atoi(shm_id), NULL, 0);
+        if (edge_map == (void *)-1) {
+            fprintf(stderr, "edge: cannot attach shared memory %s\n", shm_id);
+            return -1;
+        }
+        edge_map_shared = true;
+    } else {
+        edge_map = g_malloc0(EDGE_MAP_SIZE);
+    }
+
+    qemu_plugin_register_vcpu_tb_trans_cb(id, vcpu_tb_trans);
+    qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
+    return 0;
+}
@@ -53,34 +53,17 @@ void timer_init_full(QEMUTimer *ts,
 void timer_mod(QEMUTimer *ts, int64_t expire_time)
 {
     QEMUTimerList *timer_list = ts->timer_list;
-    QEMUTimer *t = &timer_list->active_timers;
-
-    while (t->next != NULL) {
-        if (t->next == ts) {
-            break;
-        }
-
-        t = t->next;
-    }
 
+    timer_list->active_timers = g_list_remove(timer_list->active_timers, ts);
     ts->expire_time = MAX(expire_time * ts->scale, 0);
-    ts->next = NULL;
-    t->next = ts;
+    timer_list->active_timers = g_list_append(timer_list->active_timers, ts);
 }
 
 void timer_del(QEMUTimer *ts)
 {
     QEMUTimerList *timer_list = ts->timer_list;
-    QEMUTimer *t = &timer_list->active_timers;
 
-    while (t->next != NULL) {
-        if (t->next == ts) {
-            t->next = ts->next;
-            return;
-        }
-
-        t = t->next;
-    }
+    timer_list->active_timers = g_list_remove(timer_list->active_timers, ts);
 }
 
 int64_t qemu_clock_get_ns(QEMUClockType type)
@@ -91,17 +74,17 @@ int64_t qemu_clock_get_ns(QEMUClockType type)
 int64_t qemu_clock_deadline_ns_all(QEMUClockType type, int attr_mask)
 {
     QEMUTimerList *timer_list = main_loop_tlg.tl[QEMU_CLOCK_VIRTUAL];
-    QEMUTimer *t = timer_list->active_timers.next;
+    GList *l;
     int64_t deadline = -1;
 
-    while (t != NULL) {
+    for (l = timer_list->active_timers; l != NULL; l = l->next) {
+        QEMUTimer *t = l->data;
+
         if (deadline == -1) {
             deadline = t->expire_time;
         } else {
             deadline = MIN(deadline, t->expire_time);
         }
-
-        t = t->next;
     }
 
     return deadline;
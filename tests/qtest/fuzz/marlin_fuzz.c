@@ -0,0 +1,397 @@
+/*
+ * Marlin firmware G-code fuzzing target
+ *
+ * Boots the Marlin firmware on the marlinboard machine once, keeps a
+ * snapshot of the booted machine in memory and, for every input,
+ * restores it and feeds the input to the firmware's host serial port as
+ * G-code. Faults taken by the firmware, resets and stalls of the serial
+ * receive path are reported as crashes.
+ *
+ * The marlin-gcode-fuzz-reset-check target checks that oracle once: it
+ * makes the booted firmware's NVIC see a SYSRESETREQ and expects the run
+ * to be reported as a reset.
+ *
+ * The firmware image is taken from $MARLIN_FIRMWARE. If
+ * $MARLIN_FUZZ_EDGE_PLUGIN points to tests/plugin/libedge.so, the
+ * firmware's own edge coverage is handed to libFuzzer as well.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include "cpu.h"
+#include "chardev/char.h"
+#include "exec/ram_addr.h"
+#include "exec/ramblock.h"
+#include "io/channel-buffer.h"
+#include "migration/qemu-file-channel.h"
+#include "migration/qemu-file.h"
+#include "migration/savevm.h"
+#include "qemu/main-loop.h"
+#include "qemu/timer.h"
+#include "sysemu/runstate.h"
+#include "sysemu/tcg.h"
+#include "tests/qtest/libqtest.h"
+#include "fuzz.h"
+
+#define MARLIN_FUZZ_CHARDEV     "fuzz-serial"
+
+/* Virtual time budgets */
+#define MARLIN_FUZZ_BOOT_NS     (2 * NANOSECONDS_PER_SECOND)
+#define MARLIN_FUZZ_TICK_NS     (50 * SCALE_US)
+#define MARLIN_FUZZ_STALL_NS    (100 * SCALE_MS)
+#define MARLIN_FUZZ_TAIL_NS     (50 * SCALE_MS)
+
+#define MARLIN_FUZZ_EDGE_MAP_SIZE   (1 << 16)
+
+/* Firmware edge coverage, picked up by libFuzzer */
+static uint8_t marlin_fuzz_counters[MARLIN_FUZZ_EDGE_MAP_SIZE]
+    __attribute__((section("__libfuzzer_extra_counters")));
+
+typedef struct MarlinFuzzRAM {
+    RAMBlock *rb;
+    uint8_t *data;
+} MarlinFuzzRAM;
+
+typedef struct MarlinFuzzRun {
+    QEMUTimer *timer;
+    const uint8_t *data;
+    size_t size;
+    size_t pos;
+    int64_t last_progress_ns;
+    int64_t tail_end_ns;
+    const char *crash;
+    bool done;
+} MarlinFuzzRun;
+
+static struct {
+    Chardev *chr;
+    QIOChannelBuffer *devices;
+    QEMUFile *devices_in;
+    GArray *ram;
+    uint8_t *edge_map;
+    int edge_shm;
+} marlin_fuzz = { .edge_shm = -1 };
+
+static int marlin_fuzz_save_ram(RAMBlock *rb, void *opaque)
+{
+    MarlinFuzzRAM r = { .rb = rb };
+
+    if (memory_region_is_rom(rb->mr) || memory_region_is_romd(rb->mr)) {
+        return 0;
+    }
+    r.data = g_memdup(qemu_ram_get_host_addr(rb),
+                      qemu_ram_get_used_length(rb));
+    g_array_append_val(marlin_fuzz.ram, r);
+    return 0;
+}
+
+static void marlin_fuzz_snapshot(void)
+{
+    QEMUFile *f;
+
+    marlin_fuzz.ram = g_array_new(false, false, sizeof(MarlinFuzzRAM));
+    qemu_ram_foreach_block(marlin_fuzz_save_ram, NULL);
+
+    marlin_fuzz.devices = qio_channel_buffer_new(4096);
+    f = qemu_fopen_channel_output(QIO_CHANNEL(marlin_fuzz.devices));
+    if (qemu_save_device_state(f) < 0) {
+        fprintf(stderr, "marlin-fuzz: cannot save device state\n");
+        abort();
+    }
+    /* Not closed: that would free the buffer, which we keep reading */
+    qemu_fflush(f);
+    marlin_fuzz.devices_in =
+        qemu_fopen_channel_input(QIO_CHANNEL(marlin_fuzz.devices));
+}
+
+static void marlin_fuzz_restore(void)
+{
+    int i;
+
+    for (i = 0; i < marlin_fuzz.ram->len; i++) {
+        MarlinFuzzRAM *r = &g_array_index(marlin_fuzz.ram, MarlinFuzzRAM, i);
+        ram_addr_t offset = qemu_ram_get_offset(r->rb);
+        ram_addr_t len = qemu_ram_get_used_length(r->rb);
+
+        memcpy(qemu_ram_get_host_addr(r->rb), r->data, len);
+        if (tcg_enabled()) {
+            tb_invalidate_phys_range(offset, offset + len);
+        }
+    }
+
+    qio_channel_io_seek(QIO_CHANNEL(marlin_fuzz.devices), 0, SEEK_SET, NULL);
+    if (qemu_load_device_state(marlin_fuzz.devices_in) < 0) {
+        fprintf(stderr, "marlin-fuzz: cannot restore device state\n");
+        abort();
+    }
+}
+
+/* Is the firmware handling a fault? */
+static const char *marlin_fuzz_fault(void)
+{
+    ARMCPU *cpu = ARM_CPU(first_cpu);
+
+    switch (cpu->env.v7m.exception) {
+    case ARMV7M_EXCP_HARD:
+        return "HardFault";
+    case ARMV7M_EXCP_MEM:
+        return "MemManage";
+    case ARMV7M_EXCP_BUS:
+        return "BusFault";
+    case ARMV7M_EXCP_USAGE:
+        return "UsageFault";
+    default:
+        return NULL;
+    }
+}
+
+/*
+ * Has the firmware asked for a reset?  The machine runs with -no-reboot,
+ * so watchdog and SYSRESETREQ resets show up as a shutdown request with
+ * a reset cause.
+ */
+static const char *marlin_fuzz_reset(void)
+{
+    ShutdownCause cause = qemu_shutdown_requested_get();
+
+    if (cause == SHUTDOWN_CAUSE_GUEST_RESET || qemu_reset_requested_get()) {
+        return "reset";
+    }
+    if (cause != SHUTDOWN_CAUSE_NONE) {
+        return "shutdown";
+    }
+    return NULL;
+}
+
+/*
+ * Runs on the vCPU thread every MARLIN_FUZZ_TICK_NS of virtual time:
+ * push more of the input into the USART and check on the firmware.
+ */
+static void marlin_fuzz_tick(void *opaque)
+{
+    MarlinFuzzRun *run = opaque;
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    int n;
+
+    if (run->pos < run->size) {
+        n = MIN(qemu_chr_be_can_write(marlin_fuzz.chr), run->size - run->pos);
+        if (n > 0) {
+            qemu_chr_be_write(marlin_fuzz.chr, (uint8_t *)run->data + run->pos,
+                              n);
+            run->pos += n;
+            run->last_progress_ns = now;
+        } else if (now - run->last_progress_ns > MARLIN_FUZZ_STALL_NS) {
+            run->crash = "serial receive stalled";
+        }
+        if (run->pos == run->size) {
+            run->tail_end_ns = now + MARLIN_FUZZ_TAIL_NS;
+        }
+    }
+
+    if (!run->crash) {
+        run->crash = marlin_fuzz_fault();
+    }
+
+    if (run->crash || (run->pos == run->size && now >= run->tail_end_ns)) {
+        run->done = true;
+        qemu_notify_event();
+    } else {
+        timer_mod(run->timer, now + MARLIN_FUZZ_TICK_NS);
+    }
+}
+
+/* Returns why the run has to be reported as a crash, or NULL */
+static const char *marlin_fuzz_run(const uint8_t *data, size_t size)
+{
+    MarlinFuzzRun run = {
+        .data = data,
+        .size = size,
+        .last_progress_ns = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL),
+        .tail_end_ns = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+                       MARLIN_FUZZ_TAIL_NS,
+    };
+    const char *reset;
+
+    run.timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, marlin_fuzz_tick, &run);
+    timer_mod(run.timer, run.last_progress_ns + MARLIN_FUZZ_TICK_NS);
+    while (!atomic_read(&run.done)) {
+        main_loop_wait(false);
+        /*
+         * A reset request stops the vCPU that made it, so the tick that
+         * would notice it may never come.
+         */
+        reset = marlin_fuzz_reset();
+        if (reset) {
+            vm_stop(RUN_STATE_PAUSED);
+            if (!run.crash) {
+                run.crash = reset;
+            }
+            break;
+        }
+    }
+    timer_del(run.timer);
+    timer_free(run.timer);
+
+    return run.crash;
+}
+
+static void marlin_fuzz_report(const char *crash)
+{
+    if (crash) {
+        fprintf(stderr, "marlin-fuzz: %s\n", crash);
+        abort();
+    }
+}
+
+static void marlin_fuzz_pre_fuzz(QTestState *s)
+{
+    marlin_fuzz.chr = qemu_chr_find(MARLIN_FUZZ_CHARDEV);
+    g_assert(marlin_fuzz.chr);
+
+    /* Let the firmware boot, then keep that state */
+    while (qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) < MARLIN_FUZZ_BOOT_NS) {
+        marlin_fuzz_report(marlin_fuzz_run(NULL, 0));
+    }
+
+    vm_stop(RUN_STATE_PAUSED);
+    marlin_fuzz_snapshot();
+    vm_start();
+
+    if (marlin_fuzz.edge_map) {
+        memset(marlin_fuzz.edge_map, 0, MARLIN_FUZZ_EDGE_MAP_SIZE);
+    }
+}
+
+/*
+ * Does @data hold an M112 anywhere?  Marlin takes the command letter in
+ * either case and ignores leading zeros in the number, and its emergency
+ * parser also skips spaces after the letter.  NUL bytes do not end the
+ * serial input, so all of @data is scanned.
+ */
+static bool marlin_fuzz_has_m112(const unsigned char *data, size_t size)
+{
+    size_t i, j;
+
+    for (i = 0; i < size; i++) {
+        if (g_ascii_toupper(data[i]) != 'M') {
+            continue;
+        }
+        for (j = i + 1; j < size && data[j] == ' '; j++) {
+        }
+        for (; j < size && data[j] == '0'; j++) {
+        }
+        if (size - j >= 3 && !memcmp(data + j, "112", 3) &&
+            (size - j == 3 || !g_ascii_isdigit(data[j + 3]))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void marlin_fuzz(QTestState *s, const unsigned char *data, size_t size)
+{
+    /* Emergency stop halts the firmware on purpose */
+    if (marlin_fuzz_has_m112(data, size)) {
+        return;
+    }
+
+    vm_stop(RUN_STATE_PAUSED);
+    marlin_fuzz_restore();
+    vm_start();
+
+    marlin_fuzz_report(marlin_fuzz_run(data, size));
+
+    if (marlin_fuzz.edge_map) {
+        memcpy(marlin_fuzz_counters, marlin_fuzz.edge_map,
+               MARLIN_FUZZ_EDGE_MAP_SIZE);
+        memset(marlin_fuzz.edge_map, 0, MARLIN_FUZZ_EDGE_MAP_SIZE);
+    }
+}
+
+/* AIRCR with VECTKEY and SYSRESETREQ */
+#define MARLIN_FUZZ_AIRCR           0xe000ed0c
+#define MARLIN_FUZZ_SYSRESETREQ     0x05fa0004
+
+static void marlin_fuzz_reset_check(QTestState *s)
+{
+    const char *crash;
+
+    marlin_fuzz_pre_fuzz(s);
+
+    qtest_writel(s, MARLIN_FUZZ_AIRCR, MARLIN_FUZZ_SYSRESETREQ);
+    crash = marlin_fuzz_run(NULL, 0);
+    g_assert_cmpstr(crash, ==, "reset");
+
+    printf("marlin-fuzz: SYSRESETREQ is reported as a reset\n");
+    exit(0);
+}
+
+static void marlin_fuzz_pre_vm_init(void)
+{
+    if (!getenv("MARLIN_FUZZ_EDGE_PLUGIN")) {
+        return;
+    }
+
+    marlin_fuzz.edge_shm = shmget(IPC_PRIVATE, MARLIN_FUZZ_EDGE_MAP_SIZE,
+                                  IPC_CREAT | 0600);
+    g_assert(marlin_fuzz.edge_shm >= 0);
+    marlin_fuzz.edge_map = shmat(marlin_fuzz.edge_shm, NULL, 0);
+    g_assert(marlin_fuzz.edge_map != (void *)-1);
+    /* Gone once both we and the plugin have detached */
+    shmctl(marlin_fuzz.edge_shm, IPC_RMID, NULL);
+}
+
+static const char *marlin_fuzz_argv(FuzzTarget *t)
+{
+    const char *firmware = getenv("MARLIN_FIRMWARE");
+    const char *plugin = getenv("MARLIN_FUZZ_EDGE_PLUGIN");
+    g_autofree char *plugin_arg = NULL;
+
+    if (!firmware) {
+        fprintf(stderr, "marlin-fuzz: set MARLIN_FIRMWARE to the firmware "
+                "image\n");
+        exit(1);
+    }
+    if (plugin) {
+        plugin_arg = g_strdup_printf("-plugin %s,arg=shm=%d", plugin,
+                                     marlin_fuzz.edge_shm);
+    }
+
+    /* The host serial port of the BTT SKR Mini E3 is USART2 */
+    return g_strdup_printf("%s -machine marlinboard -accel tcg "
+                           "-icount shift=0,sleep=off -display none "
+                           "-no-reboot -kernel %s "
+                           "-chardev null,id=" MARLIN_FUZZ_CHARDEV " "
+                           "-serial null -serial chardev:" MARLIN_FUZZ_CHARDEV
+                           " %s", TARGET_NAME, firmware,
+                           plugin_arg ? plugin_arg : "");
+}
+
+static void register_marlin_fuzz_targets(void)
+{
+    fuzz_add_target(&(FuzzTarget){
+                .name = "marlin-gcode-fuzz",
+                .description = "Fuzz the Marlin firmware's G-code parser "
+                               "through its serial port, restoring a booted "
+                               "snapshot before each run",
+                .get_init_cmdline = marlin_fuzz_argv,
+                .pre_vm_init = marlin_fuzz_pre_vm_init,
+                .pre_fuzz = marlin_fuzz_pre_fuzz,
+                .fuzz = marlin_fuzz});
+    fuzz_add_target(&(FuzzTarget){
+                .name = "marlin-gcode-fuzz-reset-check",
+                .description = "Check that marlin-gcode-fuzz reports a "
+                               "SYSRESETREQ from the firmware as a reset",
+                .get_init_cmdline = marlin_fuzz_argv,
+                .pre_vm_init = marlin_fuzz_pre_vm_init,
+                .pre_fuzz = marlin_fuzz_reset_check,
+                .fuzz = marlin_fuzz});
+}
+
+fuzz_target_init(register_marlin_fuzz_targets);
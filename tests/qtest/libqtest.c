@@ -22,6 +22,7 @@
 
 #include "libqtest.h"
 #include "qemu-common.h"
+#include "qemu/bswap.h"
 #include "qemu/ctype.h"
 #include "qemu/cutils.h"
 #include "qapi/error.h"
@@ -1138,6 +1139,213 @@ void qtest_memset(QTestState *s, uint64_t addr, uint8_t pattern, size_t size)
     qtest_rsp(s, 0);
 }
 
+int qtest_irq_handle(QTestState *s, const char *qom_path, const char *name,
+                     int num)
+{
+    gchar **args;
+    int handle;
+
+    if (!name) {
+        name = "unnamed-gpio-in";
+    }
+    qtest_sendf(s, "irq_handle %s %s %d\n", qom_path, name, num);
+    args = qtest_rsp(s, 2);
+    handle = atoi(args[1]);
+    g_strfreev(args);
+
+    return handle;
+}
+
+/* Batch wire format, see the protocol description in qtest.c */
+#define QTEST_BATCH_VERSION     1
+#define QTEST_BATCH_OP_SIZE     24
+
+enum {
+    QTEST_BATCH_READ = 1,
+    QTEST_BATCH_WRITE,
+    QTEST_BATCH_CLOCK_STEP,
+    QTEST_BATCH_CLOCK_STEP_NEXT,
+    QTEST_BATCH_SET_IRQ_IN,
+};
+
+struct QTestBatch {
+    QTestState *s;
+    uint8_t *ops;
+    uint8_t *shm;
+    uint64_t *results;
+    unsigned max_ops;
+    unsigned nops;
+    bool ran;
+};
+
+QTestBatch *qtest_batch_new(QTestState *s, unsigned max_ops, bool shm)
+{
+    QTestBatch *b = g_new0(QTestBatch, 1);
+    gchar **args;
+    bool stream;
+
+    qtest_sendf(s, "batch_hello %d\n", QTEST_BATCH_VERSION);
+    args = qtest_rsp(s, 2);
+    g_assert_cmpint(atoi(args[1]), ==, QTEST_BATCH_VERSION);
+    stream = strstr(args[2], "stream") != NULL;
+    shm &= strstr(args[2], "shm") != NULL;
+    g_strfreev(args);
+    g_assert(stream || shm);
+
+    b->s = s;
+    b->max_ops = max_ops;
+    b->results = g_new0(uint64_t, max_ops);
+
+    if (shm) {
+        size_t size = (size_t)max_ops * QTEST_BATCH_OP_SIZE;
+        gchar *path;
+        int fd;
+
+        fd = g_file_open_tmp("qtest-batch-XXXXXX", &path, NULL);
+        g_assert(fd >= 0);
+        g_assert(ftruncate(fd, size) == 0);
+        b->shm = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        g_assert(b->shm != MAP_FAILED);
+        close(fd);
+
+        qtest_sendf(s, "batch_shm_open %s %zu\n", path, size);
+        qtest_rsp(s, 0);
+        /* Both sides have it mapped now */
+        unlink(path);
+        g_free(path);
+    } else {
+        b->ops = g_malloc0((size_t)max_ops * QTEST_BATCH_OP_SIZE);
+    }
+
+    return b;
+}
+
+void qtest_batch_free(QTestBatch *b)
+{
+    if (b->shm) {
+        munmap(b->shm, (size_t)b->max_ops * QTEST_BATCH_OP_SIZE);
+    }
+    g_free(b->ops);
+    g_free(b->results);
+    g_free(b);
+}
+
+static unsigned qtest_batch_add(QTestBatch *b, uint8_t op, uint8_t size,
+                                uint32_t handle, uint64_t addr, uint64_t value)
+{
+    uint8_t *rec;
+
+    if (b->ran) {
+        b->nops = 0;
+        b->ran = false;
+    }
+    g_assert_cmpuint(b->nops, <, b->max_ops);
+
+    if (b->shm) {
+        rec = b->shm + b->nops * QTEST_BATCH_OP_SIZE;
+    } else {
+        rec = b->ops + b->nops * QTEST_BATCH_OP_SIZE;
+    }
+    rec[0] = op;
+    rec[1] = size;
+    stw_le_p(rec + 2, 0);
+    stl_le_p(rec + 4, handle);
+    stq_le_p(rec + 8, addr);
+    stq_le_p(rec + 16, value);
+
+    return b->nops++;
+}
+
+unsigned qtest_batch_read(QTestBatch *b, uint64_t addr, unsigned size)
+{
+    return qtest_batch_add(b, QTEST_BATCH_READ, size, 0, addr, 0);
+}
+
+void qtest_batch_write(QTestBatch *b, uint64_t addr, unsigned size,
+                       uint64_t value)
+{
+    qtest_batch_add(b, QTEST_BATCH_WRITE, size, 0, addr, value);
+}
+
+unsigned qtest_batch_clock_step(QTestBatch *b, int64_t step)
+{
+    return qtest_batch_add(b, QTEST_BATCH_CLOCK_STEP, 0, 0, 0, step);
+}
+
+unsigned qtest_batch_clock_step_next(QTestBatch *b)
+{
+    return qtest_batch_add(b, QTEST_BATCH_CLOCK_STEP_NEXT, 0, 0, 0, 0);
+}
+
+void qtest_batch_set_irq_in(QTestBatch *b, int handle, int level)
+{
+    qtest_batch_add(b, QTEST_BATCH_SET_IRQ_IN, 0, handle, 0, (int64_t)level);
+}
+
+static void qtest_batch_recv(QTestState *s, uint64_t *results, size_t size)
+{
+    uint8_t *buf = g_malloc(size);
+    size_t have = MIN(s->rx->len, size);
+    size_t i;
+
+    memcpy(buf, s->rx->str, have);
+    g_string_erase(s->rx, 0, have);
+
+    while (have < size) {
+        ssize_t len = read(s->fd, buf + have, size - have);
+
+        if (len == -1 && errno == EINTR) {
+            continue;
+        }
+        if (len == -1 || len == 0) {
+            fprintf(stderr, "Broken pipe\n");
+            abort();
+        }
+        have += len;
+    }
+
+    for (i = 0; i < size / 8; i++) {
+        results[i] = ldq_le_p(buf + i * 8);
+    }
+    g_free(buf);
+}
+
+void qtest_batch_run(QTestBatch *b)
+{
+    QTestState *s = b->s;
+    g_autofree char *hdr = NULL;
+    gchar **args;
+    unsigned i;
+
+    b->ran = true;
+
+    if (b->shm) {
+        qtest_sendf(s, "batch_shm %u\n", b->nops);
+        qtest_rsp(s, 0);
+        for (i = 0; i < b->nops; i++) {
+            b->results[i] = ldq_le_p(b->shm + i * QTEST_BATCH_OP_SIZE + 16);
+        }
+        return;
+    }
+
+    hdr = g_strdup_printf("batch %u\n", b->nops);
+    socket_send(s->fd, hdr, strlen(hdr));
+    socket_send(s->fd, (char *)b->ops, b->nops * QTEST_BATCH_OP_SIZE);
+
+    args = qtest_rsp(s, 2);
+    g_assert_cmpint(atoi(args[1]), ==, b->nops * 8);
+    g_strfreev(args);
+    qtest_batch_recv(s, b->results, b->nops * 8);
+}
+
+uint64_t qtest_batch_result(QTestBatch *b, unsigned idx)
+{
+    g_assert(b->ran);
+    g_assert_cmpuint(idx, <, b->nops);
+
+    return b->results[idx];
+}
+
 void qtest_qmp_assert_success(QTestState *qts, const char *fmt, ...)
 {
     va_list ap;
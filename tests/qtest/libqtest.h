@@ -516,6 +516,112 @@ void qtest_bufwrite(QTestState *s, uint64_t addr,
  */
 void qtest_memset(QTestState *s, uint64_t addr, uint8_t patt, size_t size);
 
+/**
+ * qtest_irq_handle:
+ * @s: #QTestState instance to operate on.
+ * @qom_path: QOM path of a device.
+ * @name: IRQ name, or %NULL for the unnamed GPIO-in pins.
+ * @num: IRQ number.
+ *
+ * Look up a GPIO-in pin once, for use with qtest_batch_set_irq_in().
+ *
+ * Returns: A handle for the pin.
+ */
+int qtest_irq_handle(QTestState *s, const char *qom_path, const char *name,
+                     int num);
+
+/**
+ * QTestBatch:
+ *
+ * A batch of accesses sent to QEMU in binary form and run with a single
+ * round trip.  Queue operations with the qtest_batch_*() functions, run
+ * them with qtest_batch_run() and then fetch the results of those that
+ * return an index with qtest_batch_result().  Queueing an operation after
+ * qtest_batch_run() starts a new batch.
+ */
+typedef struct QTestBatch QTestBatch;
+
+/**
+ * qtest_batch_new:
+ * @s: #QTestState instance to operate on.
+ * @max_ops: Maximum number of operations in one batch.
+ * @shm: Pass the operations through memory shared with QEMU rather than
+ * through the qtest socket, if QEMU supports it.
+ *
+ * Returns: A new, empty batch.
+ */
+QTestBatch *qtest_batch_new(QTestState *s, unsigned max_ops, bool shm);
+
+/**
+ * qtest_batch_free:
+ * @b: Batch to free.
+ */
+void qtest_batch_free(QTestBatch *b);
+
+/**
+ * qtest_batch_read:
+ * @b: Batch to add to.
+ * @addr: Guest address to read from.
+ * @size: Access size in bytes: 1, 2, 4 or 8.
+ *
+ * Returns: The index of the result.
+ */
+unsigned qtest_batch_read(QTestBatch *b, uint64_t addr, unsigned size);
+
+/**
+ * qtest_batch_write:
+ * @b: Batch to add to.
+ * @addr: Guest address to write to.
+ * @size: Access size in bytes: 1, 2, 4 or 8.
+ * @value: Value to write.
+ */
+void qtest_batch_write(QTestBatch *b, uint64_t addr, unsigned size,
+                       uint64_t value);
+
+/**
+ * qtest_batch_clock_step:
+ * @b: Batch to add to.
+ * @step: Number of nanoseconds to advance the clock by.
+ *
+ * Returns: The index of the result, the current clock in nanoseconds.
+ */
+unsigned qtest_batch_clock_step(QTestBatch *b, int64_t step);
+
+/**
+ * qtest_batch_clock_step_next:
+ * @b: Batch to add to.
+ *
+ * Advance the clock to the next deadline.
+ *
+ * Returns: The index of the result, the current clock in nanoseconds.
+ */
+unsigned qtest_batch_clock_step_next(QTestBatch *b);
+
+/**
+ * qtest_batch_set_irq_in:
+ * @b: Batch to add to.
+ * @handle: Pin from qtest_irq_handle().
+ * @level: IRQ level.
+ */
+void qtest_batch_set_irq_in(QTestBatch *b, int handle, int level);
+
+/**
+ * qtest_batch_run:
+ * @b: Batch to run.
+ *
+ * Run the queued operations in order.
+ */
+void qtest_batch_run(QTestBatch *b);
+
+/**
+ * qtest_batch_result:
+ * @b: Batch that has been run.
+ * @idx: Index returned when the operation was queued.
+ *
+ * Returns: The value read, or the clock after a clock step.
+ */
+uint64_t qtest_batch_result(QTestBatch *b, unsigned idx);
+
 /**
  * qtest_clock_step_next:
  * @s: #QTestState instance to operate on.
@@ -0,0 +1,75 @@
+/*
+ * MMIO dispatch speed test
+ *
+ * Times 32-bit reads that go through address_space_read() and
+ * memory_region_dispatch_read() to a device's MemoryRegionOps callback.
+ * They are sent as qtest batches over shared memory, so the qtest
+ * protocol is paid once per batch rather than once per read.  Reads of
+ * SRAM, which are copied straight from the RAM block, are the baseline.
+ *
+ * Timing only runs with "-m perf"; otherwise each case runs one batch.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest.h"
+
+#define BATCH_OPS   4096
+#define BATCHES     256
+
+typedef struct MMIODispatchCase {
+    const char *name;
+    uint64_t addr;
+} MMIODispatchCase;
+
+static const MMIODispatchCase cases[] = {
+    { "sram", 0x20000000 },
+    /* STM32F1 GPIOA IDR, set up with memory_region_init_io_typed() */
+    { "stm32f1xx-gpio", 0x40010808 },
+    /* STM32F1 USART1 SR */
+    { "stm32f2xx-usart", 0x40013800 },
+};
+
+static void test_read_speed(const void *data)
+{
+    const MMIODispatchCase *c = data;
+    QTestState *qts = qtest_init("-machine marlinboard");
+    QTestBatch *b = qtest_batch_new(qts, BATCH_OPS, true);
+    int batches = g_test_perf() ? BATCHES : 1;
+    double elapsed = 0;
+    int i, j;
+
+    for (i = 0; i < batches; i++) {
+        for (j = 0; j < BATCH_OPS; j++) {
+            qtest_batch_read(b, c->addr, 4);
+        }
+        g_test_timer_start();
+        qtest_batch_run(b);
+        elapsed += g_test_timer_elapsed();
+    }
+
+    if (g_test_perf()) {
+        g_print("%.1f ns/read ", elapsed * 1e9 / (batches * BATCH_OPS));
+    }
+
+    qtest_batch_free(b);
+    qtest_quit(qts);
+}
+
+int main(int argc, char **argv)
+{
+    int i;
+
+    g_test_init(&argc, &argv, NULL);
+
+    for (i = 0; i < ARRAY_SIZE(cases); i++) {
+        g_autofree char *name = g_strdup_printf("/mmio-dispatch/read/%s",
+                                                cases[i].name);
+
+        qtest_add_data_func(name, &cases[i], test_read_speed);
+    }
+
+    return g_test_run();
+}
@@ -0,0 +1,63 @@
+/*
+ * QTest batch tests
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest.h"
+
+/* RAM of the virt machine */
+#define RAM_BASE    0x40000000
+
+static void test_batch(const void *data)
+{
+    bool shm = *(const bool *)data;
+    QTestState *qts = qtest_init("-machine virt");
+    QTestBatch *b = qtest_batch_new(qts, 16, shm);
+    unsigned rb, rw, rl, rq, clk1, clk2;
+    int64_t now;
+
+    qtest_batch_write(b, RAM_BASE, 8, 0x0123456789abcdefULL);
+    qtest_batch_write(b, RAM_BASE + 8, 1, 0x5a);
+    rb = qtest_batch_read(b, RAM_BASE + 8, 1);
+    rw = qtest_batch_read(b, RAM_BASE, 2);
+    rl = qtest_batch_read(b, RAM_BASE, 4);
+    rq = qtest_batch_read(b, RAM_BASE, 8);
+    qtest_batch_run(b);
+
+    g_assert_cmphex(qtest_batch_result(b, rb), ==, 0x5a);
+    g_assert_cmphex(qtest_batch_result(b, rw), ==, 0xcdef);
+    g_assert_cmphex(qtest_batch_result(b, rl), ==, 0x89abcdef);
+    g_assert_cmphex(qtest_batch_result(b, rq), ==, 0x0123456789abcdefULL);
+
+    /* Batches and single commands see the same memory */
+    g_assert_cmphex(qtest_readl(qts, RAM_BASE + 4), ==, 0x01234567);
+    qtest_writel(qts, RAM_BASE + 12, 0xdeadbeef);
+    rl = qtest_batch_read(b, RAM_BASE + 12, 4);
+    qtest_batch_run(b);
+    g_assert_cmphex(qtest_batch_result(b, rl), ==, 0xdeadbeef);
+
+    now = qtest_clock_step(qts, 0);
+    clk1 = qtest_batch_clock_step(b, 1000);
+    clk2 = qtest_batch_clock_step(b, 500);
+    qtest_batch_run(b);
+    g_assert_cmpint(qtest_batch_result(b, clk1), ==, now + 1000);
+    g_assert_cmpint(qtest_batch_result(b, clk2), ==, now + 1500);
+
+    qtest_batch_free(b);
+    qtest_quit(qts);
+}
+
+int main(int argc, char **argv)
+{
+    static const bool stream = false, shm = true;
+
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_data_func("/qtest-batch/stream", &stream, test_batch);
+    qtest_add_data_func("/qtest-batch/shm", &shm, test_batch);
+
+    return g_test_run();
+}
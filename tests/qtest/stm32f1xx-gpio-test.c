@@ -0,0 +1,75 @@
+/*
+ * QTest testcase for the STM32F1 GPIO output pin events
+ *
+ * Every write to ODR, BSRR or BRR that changes an output pin sends a
+ * GPIO_PIN_CHANGE event carrying the level the pin has after the write.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest.h"
+#include "qapi/qmp/qdict.h"
+
+/* GPIOA of the STM32F103 on the marlinboard, port-id 0 */
+#define GPIOA_BASE      0x40010800
+#define GPIO_ODR        0x0C
+#define GPIO_BSRR       0x10
+#define GPIO_BRR        0x14
+
+#define TEST_PIN        5
+
+static void check_pin_event(QTestState *qts, int pin, bool value)
+{
+    QDict *ev = qtest_qmp_eventwait_ref(qts, "GPIO_PIN_CHANGE");
+    QDict *data = qdict_get_qdict(ev, "data");
+
+    g_assert_cmpint(qdict_get_int(data, "port-id"), ==, 0);
+    g_assert_cmpint(qdict_get_int(data, "pin"), ==, pin);
+    g_assert(qdict_get_bool(data, "value") == value);
+    qobject_unref(ev);
+}
+
+static void test_odr_events(void)
+{
+    QTestState *qts = qtest_init("-machine marlinboard");
+
+    qtest_writel(qts, GPIOA_BASE + GPIO_ODR, 1 << TEST_PIN);
+    check_pin_event(qts, TEST_PIN, true);
+    qtest_writel(qts, GPIOA_BASE + GPIO_ODR, 0);
+    check_pin_event(qts, TEST_PIN, false);
+
+    qtest_quit(qts);
+}
+
+static void test_bsrr_events(void)
+{
+    QTestState *qts = qtest_init("-machine marlinboard");
+
+    /* Set half of BSRR */
+    qtest_writel(qts, GPIOA_BASE + GPIO_BSRR, 1 << TEST_PIN);
+    check_pin_event(qts, TEST_PIN, true);
+    /* Reset half of BSRR */
+    qtest_writel(qts, GPIOA_BASE + GPIO_BSRR, 1 << (TEST_PIN + 16));
+    check_pin_event(qts, TEST_PIN, false);
+
+    qtest_writel(qts, GPIOA_BASE + GPIO_BSRR, 1 << TEST_PIN);
+    check_pin_event(qts, TEST_PIN, true);
+    qtest_writel(qts, GPIOA_BASE + GPIO_BRR, 1 << TEST_PIN);
+    check_pin_event(qts, TEST_PIN, false);
+
+    g_assert_cmphex(qtest_readl(qts, GPIOA_BASE + GPIO_ODR), ==, 0);
+
+    qtest_quit(qts);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_func("/stm32f1xx-gpio/odr-events", test_odr_events);
+    qtest_add_func("/stm32f1xx-gpio/bsrr-events", test_bsrr_events);
+
+    return g_test_run();
+}
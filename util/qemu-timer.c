@@ -55,6 +55,12 @@ typedef struct QEMUClock {
 QEMUTimerListGroup main_loop_tlg;
 static QEMUClock qemu_clocks[QEMU_CLOCK_MAX];
 
+/* The pending timers of a list are kept in a TIMER_HEAP_ARITY-ary min-heap
+ * ordered by expire_time, then by seq, so that timers which expire at the
+ * same time still run in the order they were armed.
+ */
+#define TIMER_HEAP_ARITY 4
+
 /* A QEMUTimerList is a list of timers attached to a clock. More
  * than one QEMUTimerList can be attached to each clock, for instance
  * used by different AioContexts / threads. Each clock also has
@@ -65,7 +71,10 @@ static QEMUClock qemu_clocks[QEMU_CLOCK_MAX];
 struct QEMUTimerList {
     QEMUClock *clock;
     QemuMutex active_timers_lock;
-    QEMUTimer *active_timers;
+    QEMUTimer **active_timers;
+    int nr_active_timers;
+    int max_active_timers;
+    uint64_t timer_seq;
     QLIST_ENTRY(QEMUTimerList) list;
     QEMUTimerListNotifyCB *notify_cb;
     void *notify_opaque;
@@ -92,6 +101,130 @@ static bool timer_expired_ns(QEMUTimer *timer_head, int64_t current_time)
     return timer_head && (timer_head->expire_time <= current_time);
 }
 
+static inline QEMUTimer *timerlist_head(QEMUTimerList *timer_list)
+{
+    return timer_list->nr_active_timers ? timer_list->active_timers[0] : NULL;
+}
+
+static inline bool timer_before(QEMUTimer *a, QEMUTimer *b)
+{
+    return a->expire_time < b->expire_time ||
+           (a->expire_time == b->expire_time && a->seq < b->seq);
+}
+
+static inline void timer_heap_set(QEMUTimerList *timer_list, int i,
+                                  QEMUTimer *ts)
+{
+    timer_list->active_timers[i] = ts;
+    ts->heap_index = i;
+}
+
+static void timer_heap_up(QEMUTimerList *timer_list, int i)
+{
+    QEMUTimer *ts = timer_list->active_timers[i];
+
+    while (i > 0) {
+        int parent = (i - 1) / TIMER_HEAP_ARITY;
+        QEMUTimer *t = timer_list->active_timers[parent];
+
+        if (!timer_before(ts, t)) {
+            break;
+        }
+        timer_heap_set(timer_list, i, t);
+        i = parent;
+    }
+    timer_heap_set(timer_list, i, ts);
+}
+
+static void timer_heap_down(QEMUTimerList *timer_list, int i)
+{
+    QEMUTimer **heap = timer_list->active_timers;
+    QEMUTimer *ts = heap[i];
+    int n = timer_list->nr_active_timers;
+
+    for (;;) {
+        int first = i * TIMER_HEAP_ARITY + 1;
+        int last = MIN(first + TIMER_HEAP_ARITY, n);
+        int c, min = first;
+
+        if (first >= n) {
+            break;
+        }
+        for (c = first + 1; c < last; c++) {
+            if (timer_before(heap[c], heap[min])) {
+                min = c;
+            }
+        }
+        if (!timer_before(heap[min], ts)) {
+            break;
+        }
+        timer_heap_set(timer_list, i, heap[min]);
+        i = min;
+    }
+    timer_heap_set(timer_list, i, ts);
+}
+
+static void timer_heap_insert(QEMUTimerList *timer_list, QEMUTimer *ts)
+{
+    int n = timer_list->nr_active_timers;
+
+    if (n == timer_list->max_active_timers) {
+        timer_list->max_active_timers = MAX(n * 2, 16);
+        timer_list->active_timers = g_renew(QEMUTimer *,
+                                            timer_list->active_timers,
+                                            timer_list->max_active_timers);
+    }
+    ts->seq = timer_list->timer_seq++;
+    timer_list->active_timers[n] = ts;
+    atomic_set(&timer_list->nr_active_timers, n + 1);
+    timer_heap_up(timer_list, n);
+}
+
+static void timer_heap_remove(QEMUTimerList *timer_list, int i)
+{
+    int n = timer_list->nr_active_timers - 1;
+    QEMUTimer *last = timer_list->active_timers[n];
+
+    timer_list->active_timers[i]->heap_index = -1;
+    atomic_set(&timer_list->nr_active_timers, n);
+    if (i == n) {
+        return;
+    }
+    timer_heap_set(timer_list, i, last);
+    if (i > 0 && timer_before(last,
+            timer_list->active_timers[(i - 1) / TIMER_HEAP_ARITY])) {
+        timer_heap_up(timer_list, i);
+    } else {
+        timer_heap_down(timer_list, i);
+    }
+}
+
+/* Soonest timer in the subheap at @i whose attributes are all in
+ * @attr_mask, or @best if there is none before @best.
+ */
+static QEMUTimer *timer_heap_find(QEMUTimerList *timer_list, int i,
+                                  int attr_mask, QEMUTimer *best)
+{
+    QEMUTimer *ts;
+    int c;
+
+    if (i >= timer_list->nr_active_timers) {
+        return best;
+    }
+    ts = timer_list->active_timers[i];
+    if (best && !timer_before(ts, best)) {
+        return best;
+    }
+    if (!(ts->attributes & ~attr_mask)) {
+        return ts;
+    }
+    for (c = 1; c <= TIMER_HEAP_ARITY; c++) {
+        best = timer_heap_find(timer_list, i * TIMER_HEAP_ARITY + c,
+                               attr_mask, best);
+    }
+    return best;
+}
+
 QEMUTimerList *timerlist_new(QEMUClockType type,
                              QEMUTimerListNotifyCB *cb,
                              void *opaque)
@@ -116,6 +249,7 @@ void timerlist_free(QEMUTimerList *timer_list)
         QLIST_REMOVE(timer_list, list);
     }
     qemu_mutex_destroy(&timer_list->active_timers_lock);
+    g_free(timer_list->active_timers);
     g_free(timer_list);
 }
 
@@ -170,7 +304,7 @@ void qemu_clock_enable(QEMUClockType type, bool enabled)
 
 bool timerlist_has_timers(QEMUTimerList *timer_list)
 {
-    return !!atomic_read(&timer_list->active_timers);
+    return !!atomic_read(&timer_list->nr_active_timers);
 }
 
 bool qemu_clock_has_timers(QEMUClockType type)
@@ -183,15 +317,15 @@ bool timerlist_expired(QEMUTimerList *timer_list)
 {
     int64_t expire_time;
 
-    if (!atomic_read(&timer_list->active_timers)) {
+    if (!atomic_read(&timer_list->nr_active_timers)) {
         return false;
     }
 
     WITH_QEMU_LOCK_GUARD(&timer_list->active_timers_lock) {
-        if (!timer_list->active_timers) {
+        if (!timer_list->nr_active_timers) {
             return false;
         }
-        expire_time = timer_list->active_timers->expire_time;
+        expire_time = timerlist_head(timer_list)->expire_time;
     }
 
     return expire_time <= qemu_clock_get_ns(timer_list->clock->type);
@@ -213,7 +347,7 @@ int64_t timerlist_deadline_ns(QEMUTimerList *timer_list)
     int64_t delta;
     int64_t expire_time;
 
-    if (!atomic_read(&timer_list->active_timers)) {
+    if (!atomic_read(&timer_list->nr_active_timers)) {
         return -1;
     }
 
@@ -226,10 +360,10 @@ int64_t timerlist_deadline_ns(QEMUTimerList *timer_list)
      * the caller should notice the change and there is no race condition.
      */
     WITH_QEMU_LOCK_GUARD(&timer_list->active_timers_lock) {
-        if (!timer_list->active_timers) {
+        if (!timer_list->nr_active_timers) {
             return -1;
         }
-        expire_time = timer_list->active_timers->expire_time;
+        expire_time = timerlist_head(timer_list)->expire_time;
     }
 
     delta = expire_time - qemu_clock_get_ns(timer_list->clock->type);
@@ -261,11 +395,8 @@ int64_t qemu_clock_deadline_ns_all(QEMUClockType type, int attr_mask)
 
     QLIST_FOREACH(timer_list, &clock->timerlists, list) {
         qemu_mutex_lock(&timer_list->active_timers_lock);
-        ts = timer_list->active_timers;
         /* Skip all external timers */
-        while (ts && (ts->attributes & ~attr_mask)) {
-            ts = ts->next;
-        }
+        ts = timer_heap_find(timer_list, 0, attr_mask, NULL);
         if (!ts) {
             qemu_mutex_unlock(&timer_list->active_timers_lock);
             continue;
@@ -366,6 +497,7 @@ void timer_init_full(QEMUTimer *ts,
     ts->scale = scale;
     ts->attributes = attributes;
     ts->expire_time = -1;
+    ts->heap_index = -1;
 }
 
 void timer_deinit(QEMUTimer *ts)
@@ -376,41 +508,23 @@ void timer_deinit(QEMUTimer *ts)
 
 static void timer_del_locked(QEMUTimerList *timer_list, QEMUTimer *ts)
 {
-    QEMUTimer **pt, *t;
+    int i = ts->heap_index;
 
     ts->expire_time = -1;
-    pt = &timer_list->active_timers;
-    for(;;) {
-        t = *pt;
-        if (!t)
-            break;
-        if (t == ts) {
-            atomic_set(pt, t->next);
-            break;
-        }
-        pt = &t->next;
+    if (i >= 0 && i < timer_list->nr_active_timers &&
+        timer_list->active_timers[i] == ts) {
+        timer_heap_remove(timer_list, i);
     }
 }
 
 static bool timer_mod_ns_locked(QEMUTimerList *timer_list,
                                 QEMUTimer *ts, int64_t expire_time)
 {
-    QEMUTimer **pt, *t;
-
-    /* add the timer in the sorted list */
-    pt = &timer_list->active_timers;
-    for (;;) {
-        t = *pt;
-        if (!timer_expired_ns(t, expire_time)) {
-            break;
-        }
-        pt = &t->next;
-    }
+    /* add the timer after all those that expire no later */
     ts->expire_time = MAX(expire_time, 0);
-    ts->next = *pt;
-    atomic_set(pt, ts);
+    timer_heap_insert(timer_list, ts);
 
-    return pt == &timer_list->active_timers;
+    return timerlist_head(timer_list) == ts;
 }
 
 static void timerlist_rearm(QEMUTimerList *timer_list)
@@ -504,7 +618,7 @@ bool timerlist_run_timers(QEMUTimerList *timer_list)
     void *opaque;
     bool need_replay_checkpoint = false;
 
-    if (!atomic_read(&timer_list->active_timers)) {
+    if (!atomic_read(&timer_list->nr_active_timers)) {
         return false;
     }
 
@@ -553,7 +667,7 @@ bool timerlist_run_timers(QEMUTimerList *timer_list)
      */
     current_time = qemu_clock_get_ns(timer_list->clock->type);
     qemu_mutex_lock(&timer_list->active_timers_lock);
-    while ((ts = timer_list->active_timers)) {
+    while ((ts = timerlist_head(timer_list))) {
         if (!timer_expired_ns(ts, current_time)) {
             /* No expired timers left.  The checkpoint can be skipped
              * if no timers fired or they were all external.
@@ -576,8 +690,7 @@ bool timerlist_run_timers(QEMUTimerList *timer_list)
         }
 
         /* remove timer from the list before calling the callback */
-        timer_list->active_timers = ts->next;
-        ts->next = NULL;
+        timer_heap_remove(timer_list, 0);
         ts->expire_time = -1;
         cb = ts->cb;
         opaque = ts->opaque;